@@ -7,6 +7,9 @@ KERNEL_DEV_PATH="/dev/ddriver"
 USER_DDRIVER="./user_ddriver"
 USER_LOG_PATH="$HOME/ddriver_log"
 USER_DEV_PATH="$HOME/ddriver"
+USER_MAP_PATH="$HOME/ddriver.map"
+USER_ZONE_PATH="$HOME/ddriver.zones"
+USER_CMAP_PATH="$HOME/ddriver.cmap"
 
 
 if [ -L "$0" ]; then
@@ -20,6 +23,11 @@ cd "$WORK_DIR" || exit
 
 CONFIG_BLOCK_SZ=512
 BLOCK_COUNT=8192
+KERNEL_SIZE_PARAM="/sys/module/ddriver/parameters/disk_size"
+
+if [ "$DDRIVER_TYPE" == "k" ] && [ -r "$KERNEL_SIZE_PARAM" ]; then
+    BLOCK_COUNT=$(( $(cat "$KERNEL_SIZE_PARAM") / CONFIG_BLOCK_SZ ))
+fi
 
 
 function usage(){
@@ -37,8 +45,9 @@ function usage(){
     echo "-i [k|u]      安装ddriver: [k] - kernel / [u] - user"
     echo "-t            测试ddriver[请忽略]"
     echo "-d            导出ddriver至当前工作目录[PWD]"
-    echo "-r            擦除ddriver"
+    echo "-r            擦除ddriver（DDRIVER_BACKEND=overlay时丢弃增量，回到DDRIVER_BASE；raid0/raid1时擦除各成员镜像）"
     echo "-l            显示ddriver的Log"
+    echo "-m [hdd|ssd|nvme|none] 设置用户态ddriver镜像的延迟模型（DDRIVER_MODEL环境变量优先）"
     echo "-v            显示ddriver的类型[内核模块 / 用户静态链接库]"
     echo "-h            打印本帮助菜单"
     echo "===================================================================="
@@ -80,7 +89,8 @@ function install() {
         sudo rm $KERNEL_DEV_PATH>/dev/null 2>&1 
         sudo rmmod ddriver>/dev/null 2>&1 
         sudo dmesg -C
-        sudo insmod ./ddriver.ko
+        # DDRIVER_SIZE=<字节数> 可指定内核设备大小，默认4MiB
+        sudo insmod ./ddriver.ko ${DDRIVER_SIZE:+disk_size=$DDRIVER_SIZE}
         in=$(dmesg | tail -n 1)
         tokens=("$in")
         major_number=${tokens[${#tokens[*]}-1]}
@@ -157,12 +167,52 @@ function clean(){
     if [ "$DDRIVER_TYPE" == "k" ]; then  
         echo "目标设备 $KERNEL_DEV_PATH"
         sudo dd if=/dev/zero of=$KERNEL_DEV_PATH bs=$CONFIG_BLOCK_SZ count=$BLOCK_COUNT
+    elif [ "$DDRIVER_BACKEND" == "overlay" ]; then
+        echo "目标设备 $USER_DEV_PATH (overlay, 底层镜像 $DDRIVER_BASE)"
+        # 先删分配位图再截断增量，耗时与设备大小无关
+        rm -f "$USER_MAP_PATH"
+        truncate -s 0 "$USER_DEV_PATH"
+    elif [ "$DDRIVER_BACKEND" == "raid0" ] || [ "$DDRIVER_BACKEND" == "raid1" ]; then
+        members=${DDRIVER_MEMBERS:-2}
+        echo "目标设备 $USER_DEV_PATH.0 ... $USER_DEV_PATH.$((members - 1)) ($DDRIVER_BACKEND)"
+        rm -f "$USER_ZONE_PATH"
+        # 数据在各成员镜像中，$USER_DEV_PATH本身不存数据；成员大小由后端决定，按实际大小擦除
+        for ((i = 0; i < members; i++)); do
+            member="$USER_DEV_PATH.$i"
+            [ -f "$member" ] || continue
+            member_size=$(stat -c %s "$member")
+            fallocate --punch-hole --offset 0 --length "$member_size" "$member" 2>/dev/null \
+                || dd if=/dev/zero of="$member" bs=$CONFIG_BLOCK_SZ count=$((member_size / CONFIG_BLOCK_SZ)) conv=notrunc
+        done
+    elif [ "$DDRIVER_BACKEND" == "compress" ]; then
+        echo "目标设备 $USER_DEV_PATH (compress)"
+        # 块映射丢失后所有块读回零，日志镜像可直接截断
+        rm -f "$USER_CMAP_PATH"
+        truncate -s 0 "$USER_DEV_PATH"
     else
         echo "目标设备 $USER_DEV_PATH"
-        dd if=/dev/zero of="$USER_DEV_PATH" bs=$CONFIG_BLOCK_SZ count=$BLOCK_COUNT
+        rm -f "$USER_ZONE_PATH"
+        # 优先打洞，镜像保持稀疏；宿主文件系统不支持时退化为写零
+        fallocate --punch-hole --offset 0 --length $((CONFIG_BLOCK_SZ * BLOCK_COUNT)) "$USER_DEV_PATH" 2>/dev/null \
+            || dd if=/dev/zero of="$USER_DEV_PATH" bs=$CONFIG_BLOCK_SZ count=$BLOCK_COUNT
     fi 
 }
 
+function model() {
+    if [ "$DDRIVER_TYPE" == "k" ]; then
+        echo "内核设备不模拟延迟"
+        exit 1
+    fi
+    case "$1" in
+        hdd|ssd|nvme|none) ;;
+        *) echo "未知延迟模型: $1"; exit 1 ;;
+    esac
+    touch "$USER_DEV_PATH"
+    # 记录在镜像文件的xattr中，随镜像一起保存
+    setfattr -n user.ddriver.model -v "$1" "$USER_DEV_PATH" || exit 1
+    echo "$USER_DEV_PATH 延迟模型: $1"
+}
+
 function version () {
     if [ "$DDRIVER_TYPE" == "k" ]; then  
         echo "内核设备: $KERNEL_DEV_PATH"
@@ -174,7 +224,7 @@ function version () {
 if [ $# == 0 ]; then
     usage
 else 
-    while getopts 'i:tdhrlv' OPT; do
+    while getopts 'i:tdhrlm:v' OPT; do
         case $OPT in
             i) install "$OPTARG"
             ;;
@@ -186,6 +236,8 @@ else
             ;;
             l) log
             ;;
+            m) model "$OPTARG"
+            ;;
             v) version 
             ;;
             h) usage
@@ -2,6 +2,11 @@
 #include <linux/kernel.h>
 #include <linux/init.h>
 #include <linux/fs.h>
+#include <linux/moduleparam.h>
+#include <linux/vmalloc.h>
+#include <linux/rwsem.h>
+#include <linux/atomic.h>
+#include <linux/mm.h>
 #include <asm/uaccess.h>
 #include <linux/uaccess.h>
 #include "ddriver_ctl.h"
@@ -36,14 +41,9 @@
 #define IS_ADDR_ALIGN(addr)     (addr % CONFIG_BLOCK_SZ == 0)
 #define ADDR_ROUND_UP(addr)     ((addr / CONFIG_BLOCK_SZ) * CONFIG_BLOCK_SZ)
 
-#define GET_HEAD_POS(disk)      (disk.head - disk.layout)
-#define FORWARD_HEAD(disk, dis) (disk.head += dis)
-#define SET_HEAD(disk, ofs)     (disk.head = disk.layout + ofs)
-#define RESET_HEAD(disk)        (SET_HEAD(disk, 0))
-
-#define INC_READCNT(disk)       (disk.read_cnt++)
-#define INC_WRITECNT(disk)      (disk.write_cnt++)
-#define INC_SEEKCNT(disk)       (disk.seek_cnt++)
+#define INC_READCNT(disk)       (atomic_inc(&disk.read_cnt))
+#define INC_WRITECNT(disk)      (atomic_inc(&disk.write_cnt))
+#define INC_SEEKCNT(disk)       (atomic_inc(&disk.seek_cnt))
 /******************************************************************************
 * SECTION: Kernel Module Template
 *******************************************************************************/
@@ -51,44 +51,56 @@ MODULE_LICENSE("GPL");
 MODULE_AUTHOR(DRIVER_AUTHOR);	    
 MODULE_DESCRIPTION(DRIVER_DESC);	
 MODULE_VERSION(DRIVER_VERSION);	
+
+static int disk_size = CONFIG_DISK_SZ;
+module_param(disk_size, int, 0444);
+MODULE_PARM_DESC(disk_size, "Disk size in bytes, multiple of 512 (default 4MiB)");
 /******************************************************************************
 * SECTION: Type definitions
 *******************************************************************************/
+/*
+ * Each open file keeps its own head in file->f_pos, so any number of
+ * processes can use the disk at once. Readers share the layout, writers
+ * and discards take it exclusively.
+ *
+ * The layout can also be mmap'ed. Mapped accesses bypass the lock and the
+ * counters; users report them with IOC_REQ_DEVICE_ACCOUNT instead.
+ */
 struct ddriver
 {
-    char layout[CONFIG_DISK_SZ];                      /* Disk Layout */
-    char *head;                                       /* Disk Head */
-    int  read_cnt;
-    int  write_cnt;
-    int  seek_cnt;
+    char *layout;                                     /* Disk Layout, vmalloc_user'ed */
+    struct rw_semaphore lock;                         /* Protects layout */
+    atomic_t read_cnt;
+    atomic_t write_cnt;
+    atomic_t seek_cnt;
+    atomic_t open_count;
     int  major_num;
-    int  open_count;
     int  layout_size;
     int  iounit_size;
 };
 
 static struct ddriver disk = {
-    .head        = NULL,
-    .read_cnt    = 0,
-    .write_cnt   = 0,
-    .seek_cnt    = 0,
+    .layout      = NULL,
+    .read_cnt    = ATOMIC_INIT(0),
+    .write_cnt   = ATOMIC_INIT(0),
+    .seek_cnt    = ATOMIC_INIT(0),
+    .open_count  = ATOMIC_INIT(0),
     .major_num   = 0,
-    .open_count  = 0,
     .layout_size = CONFIG_DISK_SZ,
     .iounit_size = CONFIG_BLOCK_SZ
 };
 /******************************************************************************
 * SECTION: Helper Functions
 *******************************************************************************/
-int check_valid(size_t size){
-    if (GET_HEAD_POS(disk) >=  CONFIG_DISK_SZ) {
-        kernel_alert("disk head reach the end");
-        return -EINVAL;
-    }
-    if (size != CONFIG_BLOCK_SZ){
-        kernel_alert("io size %ld should align to %d", size, CONFIG_BLOCK_SZ);
+static int check_valid(loff_t pos, size_t size){
+    if (size == 0 || size % CONFIG_BLOCK_SZ != 0){
+        kernel_alert("io size %zu should align to %d", size, CONFIG_BLOCK_SZ);
         return -EIO;
     }
+    if (pos < 0 || pos + size > disk.layout_size) {
+        kernel_alert("io [%lld, +%zu) beyond disk end", pos, size);
+        return -EINVAL;
+    }
     return 0;
 }
 /******************************************************************************
@@ -100,6 +112,7 @@ static ssize_t  device_read(struct file *, char *, size_t, loff_t *);
 static ssize_t  device_write(struct file *, const char *, size_t, loff_t *);
 static loff_t   device_seek(struct file *, loff_t, int);
 static long     device_ioctl(struct file *, unsigned int, unsigned long);
+static int      device_mmap(struct file *, struct vm_area_struct *);
 /******************************************************************************
 * SECTION: Global var or structure definitions
 *******************************************************************************/
@@ -109,6 +122,7 @@ static struct file_operations file_ops = {
     .open = device_open,
     .llseek = device_seek,
     .unlocked_ioctl = device_ioctl,
+    .mmap = device_mmap,
     .release = device_release
 };
 /******************************************************************************
@@ -119,57 +133,66 @@ static struct file_operations file_ops = {
  * 
  * @param file          Ignored
  * @param user_buffer   User space buffer
- * @param size          Must equal to Blocksize @CONFIG_BLOCK_SZ
- * @param offset        Ignored
- * @return ssize_t      Bytes have been read 
+ * @param size          Multiple of Blocksize @CONFIG_BLOCK_SZ
+ * @param offset        Head of this open file, advanced by size
+ * @return ssize_t      Bytes have been read, 0 at disk end
  */
 static ssize_t 
 device_read(struct file *file, char *user_buffer, size_t size, loff_t *offset) {
-    IGNORE_ARG(offset);
+    int res;
     IGNORE_ARG(file);
-    int res = check_valid(size);
+    if (*offset == disk.layout_size)                  /* EOF, lets dd and cat stop */
+        return 0;
+    res = check_valid(*offset, size);
     if(res < 0)
         return res;
-    if (copy_to_user(user_buffer, disk.head, CONFIG_BLOCK_SZ))
+
+    down_read(&disk.lock);
+    res = copy_to_user(user_buffer, disk.layout + *offset, size);
+    up_read(&disk.lock);
+    if (res)
         return -EFAULT;
-    FORWARD_HEAD(disk, CONFIG_BLOCK_SZ);
+    *offset += size;
     INC_READCNT(disk);
-    return CONFIG_BLOCK_SZ;
+    return size;
 }
 /**
  * @brief Disk Write
  * 
  * @param file          Ignored
  * @param user_buffer   User space buffer, copy content from
- * @param size          Must equal to Blocksize @CONFIG_BLOCK_SZ
- * @param offset        Ignored
+ * @param size          Multiple of Blocksize @CONFIG_BLOCK_SZ
+ * @param offset        Head of this open file, advanced by size
  * @return ssize_t      Bytes have been written
  */
 static ssize_t 
 device_write(struct file *file, const char *user_buffer, size_t size, loff_t *offset) {
-    IGNORE_ARG(offset);
+    int res;
     IGNORE_ARG(file);
-    int res = check_valid(size);
+    res = check_valid(*offset, size);
     if(res < 0)
         return res;
 
-    if (copy_from_user(disk.head, user_buffer, CONFIG_BLOCK_SZ))
+    down_write(&disk.lock);
+    res = copy_from_user(disk.layout + *offset, user_buffer, size);
+    up_write(&disk.lock);
+    if (res)
         return -EFAULT;
-    FORWARD_HEAD(disk, CONFIG_BLOCK_SZ);
+    *offset += size;
     INC_WRITECNT(disk);
-    return CONFIG_BLOCK_SZ;
+    return size;
 }
 /**
  * @brief Disk Seek
  * 
- * @param file          Ignored
+ * @param file          Head lives in file->f_pos
  * @param offset        Aligned to @CONFIG_BLOCK_SZ
- * @param whence        SEEK_CUR, SEEK_SET
+ * @param whence        SEEK_SET, SEEK_CUR, SEEK_END
  * @return loff_t       cur pos
  */
 static loff_t 
 device_seek(struct file *file, loff_t offset, int whence) {
-    IGNORE_ARG(file);
+    loff_t pos;
     if (!IS_ADDR_ALIGN(offset)) {
         kernel_alert("offset %lld must be aligned to block size %d", 
                       offset, CONFIG_BLOCK_SZ);
@@ -178,30 +201,39 @@ device_seek(struct file *file, loff_t offset, int whence) {
     switch (whence)
     {
     case SEEK_SET:
-        SET_HEAD(disk, offset);
+        pos = offset;
         break;
     case SEEK_CUR:
-        FORWARD_HEAD(disk, offset);
+        pos = file->f_pos + offset;
         break;
-    default:
+    case SEEK_END:
+        pos = disk.layout_size + offset;
         break;
+    default:
+        return -EINVAL;
+    }
+    if (pos < 0 || pos > disk.layout_size) {
+        kernel_alert("seek to %lld out of disk", pos);
+        return -EINVAL;
     }
+    file->f_pos = pos;
     INC_SEEKCNT(disk);
-    return GET_HEAD_POS(disk);
+    return pos;
 }
 /**
  * @brief Disk ioctl
  * 
- * @param file          Ignored
+ * @param file          RESET rewinds this file's head
  * @param cmd           Command
  * @param arg           Args
  * @return long         State
  */
 static long 
 device_ioctl(struct file *file, unsigned int cmd, unsigned long arg){
-    IGNORE_ARG(file);
     int ret;
     struct ddriver_state state;
+    struct ddriver_discard_range range;
+    struct ddriver_account account;
     switch (cmd)
     {
     case IOC_REQ_DEVICE_SIZE:                         /* Device Size */
@@ -210,46 +242,88 @@ device_ioctl(struct file *file, unsigned int cmd, unsigned long arg){
             return -EFAULT;
         break;
     case IOC_REQ_DEVICE_STATE:                        /* Device State */
-        state.read_cnt = disk.read_cnt;
-        state.write_cnt = disk.write_cnt;
-        state.seek_cnt = disk.seek_cnt;
+        state.read_cnt = atomic_read(&disk.read_cnt);
+        state.write_cnt = atomic_read(&disk.write_cnt);
+        state.seek_cnt = atomic_read(&disk.seek_cnt);
         ret = copy_to_user((int __user *)arg, &state, sizeof(struct ddriver_state));
         if (ret) 
             return -EFAULT;
         break;
     case IOC_REQ_DEVICE_RESET:                        /* Reset Device */
-        disk.head = disk.layout;
-        disk.read_cnt = 0;
-        disk.write_cnt = 0;
-        disk.seek_cnt = 0;
+        file->f_pos = 0;
+        atomic_set(&disk.read_cnt, 0);
+        atomic_set(&disk.write_cnt, 0);
+        atomic_set(&disk.seek_cnt, 0);
         break;
     case IOC_REQ_DEVICE_IO_SZ:
         ret = copy_to_user((int __user *)arg, &disk.iounit_size, sizeof(int));
         if (ret) 
             return -EFAULT;
         break;
+    case IOC_REQ_DEVICE_DISCARD:                      /* Discard range, reads back zero */
+        if (copy_from_user(&range, (void __user *)arg, sizeof(range)))
+            return -EFAULT;
+        if (!IS_ADDR_ALIGN(range.offset) || !IS_ADDR_ALIGN(range.len) || range.offset < 0 
+            || range.len < 0 || range.offset + range.len > disk.layout_size)
+            return -EINVAL;
+        down_write(&disk.lock);
+        memset(disk.layout + range.offset, 0, range.len);
+        up_write(&disk.lock);
+        break;
+    case IOC_REQ_DEVICE_ACCOUNT:                      /* Count an I/O done through mmap */
+        if (copy_from_user(&account, (void __user *)arg, sizeof(account)))
+            return -EFAULT;
+        if (account.op == DDRIVER_ACCOUNT_SEEK) {
+            INC_SEEKCNT(disk);
+            break;
+        }
+        ret = check_valid(account.offset, account.len);
+        if (ret < 0)
+            return ret;
+        if (account.op == DDRIVER_ACCOUNT_READ)
+            INC_READCNT(disk);
+        else if (account.op == DDRIVER_ACCOUNT_WRITE)
+            INC_WRITECNT(disk);
+        else
+            return -EINVAL;
+        break;
     default:
         break;
     }
     return 0;
 }
+/**
+ * @brief Disk mmap, maps the layout itself, no copy
+ * 
+ * @param file          Ignored
+ * @param vma           Offset and length must stay inside the disk
+ * @return int          state
+ */
+static int 
+device_mmap(struct file *file, struct vm_area_struct *vma) {
+    unsigned long len = vma->vm_end - vma->vm_start;
+    unsigned long ofs = vma->vm_pgoff << PAGE_SHIFT;
+    IGNORE_ARG(file);
+
+    if (ofs + len > PAGE_ALIGN(disk.layout_size)) {
+        kernel_alert("mmap [%lu, +%lu) beyond disk end", ofs, len);
+        return -EINVAL;
+    }
+    return remap_vmalloc_range(vma, disk.layout, vma->vm_pgoff);
+}
 /**
  * @brief Disk Open
  * 
  * @param inode         Ignored
- * @param file          Ignored
+ * @param file          Gets its own head at 0
  * @return int          state
  */
 static int 
 device_open(struct inode *inode, struct file *file) {
     IGNORE_ARG(inode);
-    IGNORE_ARG(file);
-    
-    if (disk.open_count) {                            /* If device is open, return busy */
-        return -EBUSY;
-    }
-    RESET_HEAD(disk);                                 /* Everytime close device, reset head */
-    disk.open_count++;
+
+    file->f_pos = 0;                                  /* Every open file has its own head */
+    atomic_inc(&disk.open_count);
     try_module_get(THIS_MODULE);
     return 0;
 }
@@ -266,7 +340,7 @@ device_release(struct inode *inode, struct file *file) {
                                                          Without this, the module would not unload. */
     IGNORE_ARG(inode);
     IGNORE_ARG(file);
-    disk.open_count--;
+    atomic_dec(&disk.open_count);
     module_put(THIS_MODULE);
     return 0;
 }
@@ -276,16 +350,30 @@ device_release(struct inode *inode, struct file *file) {
 static int __init 
 ddriver_init(void)
 {
-    int major_num = register_chrdev(0, DEVICE_NAME, &file_ops);   
+    int major_num;
+
+    if (disk_size <= 0 || !IS_ADDR_ALIGN(disk_size)) {
+        kernel_alert("disk_size %d must be a positive multiple of %d", disk_size, CONFIG_BLOCK_SZ);
+        return -EINVAL;
+    }
+    disk.layout = vmalloc_user(disk_size);            /* Zeroed, can be remapped to user */
+    if (disk.layout == NULL) {
+        kernel_alert("Can't allocate %d bytes for disk", disk_size);
+        return -ENOMEM;
+    }
+    disk.layout_size = disk_size;
+    init_rwsem(&disk.lock);
+
+    major_num = register_chrdev(0, DEVICE_NAME, &file_ops);   
                                                       /* Register an device */
     if (major_num < 0) {                              /* Register fail */
         kernel_alert("Can't register device, ret %d", major_num);
+        vfree(disk.layout);
         return major_num;
     } 
     else {                                            /* Register success */                                                  
         kernel_info("module loaded with device major number %d", major_num);
         disk.major_num = major_num;
-        memset(disk.layout, 0, CONFIG_DISK_SZ);
         return 0;
     }
     return 0;
@@ -299,6 +387,7 @@ ddriver_exit(void)
     if(major_num != 0){
         unregister_chrdev(major_num, DEVICE_NAME);
     }
+    vfree(disk.layout);
 }
 
 module_init(ddriver_init);
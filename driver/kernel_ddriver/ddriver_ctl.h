@@ -14,8 +14,28 @@ struct ddriver_state
     int seek_cnt;
 };
 
+struct ddriver_discard_range
+{
+    long long offset;
+    long long len;
+};
+
+#define DDRIVER_ACCOUNT_READ    0
+#define DDRIVER_ACCOUNT_WRITE   1
+#define DDRIVER_ACCOUNT_SEEK    2
+
+struct ddriver_account                                /* I/O done through mmap, for counters */
+{
+    long long offset;
+    long long len;
+    int       op;                                     /* DDRIVER_ACCOUNT_* */
+    int       pad;
+};
+
 #define IOC_REQ_DEVICE_SIZE     _IOR(IOC_MAGIC, 0, int)
 #define IOC_REQ_DEVICE_STATE    _IOR(IOC_MAGIC, 1, struct ddriver_state)
 #define IOC_REQ_DEVICE_RESET    _IO(IOC_MAGIC, 2)
 #define IOC_REQ_DEVICE_IO_SZ    _IOR(IOC_MAGIC, 3, int)
+#define IOC_REQ_DEVICE_DISCARD  _IOW(IOC_MAGIC, 6, struct ddriver_discard_range)
+#define IOC_REQ_DEVICE_ACCOUNT  _IOW(IOC_MAGIC, 14, struct ddriver_account)
 #endif
\ No newline at end of file
@@ -1,3 +1,4 @@
+#define _GNU_SOURCE
 #include "stdio.h"
 #include "stdlib.h"
 #include <unistd.h>
@@ -6,46 +7,30 @@
 #include "string.h"
 #include <linux/fs.h>
 #include "ddriver_ctl.h"
+#include "ddriver_trace.h"
+#include "ddriver_backend.h"
+#include "ddriver_model.h"
+#include "ddriver_zone.h"
+#include "ddriver_remote.h"
+#include "ddriver_rabuf.h"
 #include "stdio.h"
 #include "errno.h"
 #include <pwd.h>
+#include <sys/xattr.h>
 #include <time.h>
 
 extern int errno;
-
-#define USER_INFO     "INFO: "
-#define USER_ALERT    "WARNING: "
-
-#define USER_PANIC    "PANIC: "
 /******************************************************************************
 * SECTION: Macro definitions
 *******************************************************************************/   
-#define DEVICE_NAME   "ddriver"
-#define DEVICE_LOG    "ddriver_log"
-
-#define user_info(fmt, ...)\
-	do {\
-		printf(USER_INFO DEVICE_NAME " " fmt "\n", ##__VA_ARGS__);\
-        fprintf(debugf, USER_PANIC  " " fmt "\n", ##__VA_ARGS__);\
-	} while(0)\
-
-#define user_alert(fmt, ...)\
-	do {\
-		printf(USER_ALERT DEVICE_NAME " " fmt "\n", ##__VA_ARGS__);\
-        fprintf(debugf, USER_PANIC  " " fmt "\n", ##__VA_ARGS__);\
-	} while(0)\
-
-#define user_panic(fmt, ...)\
-    do {\
-        printf(USER_PANIC  " " fmt "\n", ##__VA_ARGS__);\
-    } while (0)\
+#define ENV_TRACE     "DDRIVER_TRACE"                 /* 设置后将块IO trace写入该路径 */
+#define ENV_WCOMB     "DDRIVER_WCOMB"                 /* 写合并上限（字节），默认64KiB，0关闭 */
+#define WCOMB_SZ      (64 * 1024)
 
 #define DRIVER_AUTHOR   "Deadpool <deadpoolmine@qq.com>"
 #define DRIVER_DESC     "A Fake disk driver in user space"
 #define DRIVER_VERSION  "0.1.0"
 
-#define CONFIG_DISK_SZ  (4 * 1024 * 1024)
-#define CONFIG_BLOCK_SZ (512)
 /******************************************************************************
 * SECTION: Macro Functions 
 *******************************************************************************/
@@ -56,8 +41,7 @@ extern int errno;
 #define INC_READCNT(disk)       (disk.read_cnt++)
 #define INC_WRITECNT(disk)      (disk.write_cnt++)
 #define INC_SEEKCNT(disk)       (disk.seek_cnt++)
-
-#define RW_DELAY(disk, rw_ops)  (usleep(disk.rw_ops##_lat * 1000))
+#define IS_REMOTE(disk)         (disk.backend.ops->flags & BACKEND_F_REMOTE)
 /******************************************************************************
 * SECTION: Type definitions
 *******************************************************************************/
@@ -67,55 +51,322 @@ struct ddriver
     int  read_cnt;
     int  write_cnt;
     int  seek_cnt;
-    int  read_lat;
-    int  write_lat;
-    int  seek_lat;
-    int  track_num;
     int  major_num;
     int  layout_size;
     int  iounit_size;
+    off_t head;                                       /* 当前磁头位置 */
+    off_t arm;                                        /* 读缓冲开启时磁头的机械位置，定位推迟到读写 */
+    struct ddriver_backend backend;                   /* 存储后端 */
+    const struct ddriver_model_ops *model;            /* 延迟模型 */
+};
+
+/*
+ * 写合并：从上一次写的末尾继续的写先攒在buf中，达到cap、seek到别处、
+ * 读到重叠区间、ioctl或close时作为一个请求下发，延迟、计数与trace都按
+ * 合并后的请求计算。文件系统按扇区循环写入时，宿主机写调用因此大幅减少。
+ *
+ * 合并写的trace记录在下发时写出，可能排在之后的SEEK记录后面，记录里的
+ * offset是它真正写入的位置。下发失败时回退分区写指针，错误记在err中，
+ * 由下一次写、IOC_REQ_DEVICE_FLUSH或close返回，与写回缓存的语义一致。
+ */
+struct wcomb
+{
+    char   *buf;
+    off_t   start;
+    size_t  len;
+    size_t  cap;                                      /* 0表示关闭 */
+    int     err;                                      /* 尚未报告的下发失败 */
 };
 /******************************************************************************
 * SECTION: Global Variable
 *******************************************************************************/
-/* reference: https://en.wikipedia.org/wiki/Hard_disk_drive_performance_characteristics */
 struct ddriver disk = {
     .read_cnt    = 0,
     .write_cnt   = 0,
     .seek_cnt    = 0,
-    .read_lat    = 2,       /* 2ms */       
-    .write_lat   = 1,       /* 1ms */
-    .seek_lat    = 4,       /* 4.17ms per 360 degree */
     .major_num   = 0,
-    .track_num   = 100,
     .layout_size = CONFIG_DISK_SZ,
-    .iounit_size = CONFIG_BLOCK_SZ
+    .iounit_size = CONFIG_BLOCK_SZ,
+    .head        = 0,
+    .arm         = 0
 };
 
 FILE *debugf = NULL;
+
+static struct wcomb wcomb;
+
+static const struct ddriver_backend_ops *backends[] = {
+    &ddriver_file_ops,
+    &ddriver_raid0_ops,
+    &ddriver_raid1_ops,
+    &ddriver_overlay_ops,
+    &ddriver_remote_ops,
+    &ddriver_compress_ops,
+};
 /******************************************************************************
 * SECTION: Helper Functions
 *******************************************************************************/
 int check_valid(size_t size) {
-    if (size != CONFIG_BLOCK_SZ){
+    if (size == 0 || size % CONFIG_BLOCK_SZ != 0){
         user_alert("io size %ld should align to %d", size, CONFIG_BLOCK_SZ);
         return -EIO;
     }
+    if (disk.head + (off_t)size > disk.layout_size) {
+        user_alert("io [%ld, +%ld) beyond device end", (long)disk.head, size);
+        return -EINVAL;
+    }
     return 0;
 }
 
-int emulate_rotate(int fd, off_t start, off_t end) {
-    int bytes_per_track = disk.layout_size / disk.track_num;
-    int lat_per_track = disk.seek_lat;
-    int distance = abs(end - start) % bytes_per_track; 
-    
-    if (distance == 0) {
+int ddriver_env_int(const char *name, int dflt) {
+    char *val = getenv(name);
+    if (val == NULL || *val == '\0') {
+        return dflt;
+    }
+    return atoi(val);
+}
+
+/**
+ * @brief 打开（必要时创建）镜像文件，并以稀疏方式扩展到size
+ * 
+ * @return int 文件描述符，失败返回负错误码
+ */
+int ddriver_open_image(const char *path, off_t size) {
+    struct stat st;
+    int fd = open(path, O_CREAT | O_RDWR, 0644);
+
+    if (fd < 0) {
+        user_panic("can't open image %s: %s", path, strerror(errno));
+        return -errno;
+    }
+    if (fstat(fd, &st) == 0 && st.st_size < size && ftruncate(fd, size) < 0) {
+        user_panic("low space");
+        close(fd);
+        return -ENOSPC;
+    }
+    return fd;
+}
+/**
+ * @brief 在镜像文件中打洞，之后该区间读回零且不占用宿主机空间
+ * 
+ * @return int 0成功，文件系统不支持时返回-EOPNOTSUPP
+ */
+int ddriver_punch_hole(int fd, off_t offset, off_t len) {
+    if (fallocate(fd, FALLOC_FL_PUNCH_HOLE | FALLOC_FL_KEEP_SIZE, offset, len) < 0) {
+        return -errno;
+    }
+    return 0;
+}
+
+/**
+ * @brief fsync文件所在的目录，使其中的rename持久
+ */
+static int sync_parent_dir(const char *path) {
+    char  dir[256];
+    char *slash;
+    int   fd, ret = 0;
+
+    snprintf(dir, sizeof(dir), "%s", path);
+    slash = strrchr(dir, '/');
+    if (slash == NULL) {
+        snprintf(dir, sizeof(dir), ".");
+    } else {
+        *(slash == dir ? slash + 1 : slash) = '\0';
+    }
+    fd = open(dir, O_RDONLY | O_DIRECTORY);
+    if (fd < 0) {
+        return -errno;
+    }
+    if (fsync(fd) < 0) {
+        ret = -errno;
+    }
+    close(fd);
+    return ret;
+}
+
+/**
+ * @brief 替换后端的元数据旁路文件（压缩map、overlay分配表、分区写指针等）
+ *
+ * 先写到path.tmp并fsync，再rename到path并fsync目录。崩溃后path要么是
+ * 旧内容，要么是新内容，不会被截断或只写一半。
+ *
+ * @return int 0成功，失败返回负错误码，path保持原样
+ */
+int ddriver_store_meta(const char *path, const void *hdr, size_t hdr_len, const void *body, size_t body_len) {
+    char tmp[256 + 8];
+    int  fd, ret = 0;
+
+    snprintf(tmp, sizeof(tmp), "%s.tmp", path);
+    fd = open(tmp, O_CREAT | O_TRUNC | O_WRONLY, 0644);
+    if (fd < 0) {
+        return -errno;
+    }
+    errno = 0;
+    if (write(fd, hdr, hdr_len) != (ssize_t)hdr_len || write(fd, body, body_len) != (ssize_t)body_len) {
+        ret = errno ? -errno : -EIO;
+    } else if (fsync(fd) < 0) {
+        ret = -errno;
+    }
+    close(fd);
+    if (ret == 0 && rename(tmp, path) < 0) {
+        ret = -errno;
+    }
+    if (ret < 0) {
+        unlink(tmp);
+        return ret;
+    }
+    return sync_parent_dir(path);
+}
+
+static int discard_range(off_t offset, off_t len) {
+    static char zeros[4096];
+    uint64_t start = ddriver_now_ns();
+    off_t cur, chunk;
+    int ret = -EOPNOTSUPP;
+
+    if (!IS_ADDR_ALIGN(offset) || !IS_ADDR_ALIGN(len) || offset < 0 || len < 0
+        || offset + len > disk.layout_size) {
+        user_alert("discard [%ld, +%ld) must be aligned to %d and inside device",
+                   (long)offset, (long)len, CONFIG_BLOCK_SZ);
+        return -EINVAL;
+    }
+    if (len == 0) {
         return 0;
     }
+    if (disk.backend.ops->discard != NULL) {
+        ret = disk.backend.ops->discard(&disk.backend, offset, len);
+    }
+    if (ret == -EOPNOTSUPP) {                         /* 退化为写零 */
+        for (cur = offset, ret = 0; cur < offset + len && ret >= 0; cur += chunk) {
+            chunk = offset + len - cur < (off_t)sizeof(zeros) ? offset + len - cur : (off_t)sizeof(zeros);
+            ret = disk.backend.ops->write(&disk.backend, zeros, chunk, cur);
+        }
+        ret = ret < 0 ? ret : 0;
+    }
+    ddriver_trace_log(DDRIVER_TRACE_DISCARD, offset, len, start);
+    return ret;
+}
+
+static const struct ddriver_backend_ops* find_backend(const char *name) {
+    size_t i;
+    if (name == NULL || *name == '\0') {
+        return &ddriver_file_ops;
+    }
+    for (i = 0; i < sizeof(backends) / sizeof(backends[0]); i++) {
+        if (strcmp(backends[i]->name, name) == 0) {
+            return backends[i];
+        }
+    }
+    return NULL;
+}
 
-    usleep(distance * lat_per_track / bytes_per_track * 1000);
+/**
+ * @brief 选择延迟模型：环境变量优先，其次是镜像文件上的xattr，默认hdd
+ */
+static const struct ddriver_model_ops* select_model(int fd) {
+    char  name[16] = {0};
+    char *env = getenv(ENV_MODEL);
+
+    if (env && *env) {
+        return ddriver_find_model(env);
+    }
+    if (fgetxattr(fd, XATTR_MODEL, name, sizeof(name) - 1) > 0) {
+        return ddriver_find_model(name);
+    }
+    return &ddriver_hdd_model;
+}
+
+/**
+ * @brief 磁头从start移动到end的耗时(us)，由当前延迟模型决定
+ */
+long ddriver_position_us(off_t start, off_t end) {
+    return disk.model->position(start, end);
+}
+
+static void emulate_position(off_t start, off_t end) {
+    ddriver_delay_us(ddriver_position_us(start, end));
+}
+/**
+ * @brief 读写前的定位与访问延迟
+ */
+static void emulate_access(int op, off_t offset, size_t size) {
+    if (disk.backend.ops->position != NULL) {
+        emulate_position(disk.backend.ops->position(&disk.backend, op, offset), offset);
+    } else if (ddriver_rabuf_enabled()) {
+        emulate_position(disk.arm, offset);
+        disk.arm = offset + size;
+    }
+    if (!IS_REMOTE(disk))
+        disk.model->access(op, offset, size, !(disk.backend.ops->flags & BACKEND_F_TRANSFER));
+}
+
+/**
+ * @brief 下发一个写请求：延迟模拟、后端写入、计数与trace
+ */
+static int submit_write(const char *buf, size_t size, off_t offset) {
+    uint64_t start = ddriver_now_ns();
+    ssize_t ret;
+
+    emulate_access(DDRIVER_TRACE_WRITE, offset, size);
+    ret = disk.backend.ops->write(&disk.backend, buf, size, offset);
+    if (ret < 0) {
+        user_alert("write error at %ld: %s", (long)offset, strerror(-ret));
+        return -EIO;
+    }
+    INC_WRITECNT(disk);
+    ddriver_trace_log(DDRIVER_TRACE_WRITE, offset, size, start);
+    return 0;
+}
+
+static int wcomb_open(void) {
+    wcomb.len = 0;
+    wcomb.err = 0;
+    wcomb.cap = ddriver_env_int(ENV_WCOMB, WCOMB_SZ);
+    if ((int)wcomb.cap < 0 || wcomb.cap % CONFIG_BLOCK_SZ != 0) {
+        user_alert("write combining size %d must be a multiple of %d", (int)wcomb.cap, CONFIG_BLOCK_SZ);
+        return -EINVAL;
+    }
+    if (wcomb.cap > 0 && (wcomb.buf = malloc(wcomb.cap)) == NULL) {
+        return -ENOMEM;
+    }
     return 0;
 }
+
+static int wcomb_flush(void) {
+    int ret;
+    if (wcomb.len == 0) {
+        return 0;
+    }
+    ret = submit_write(wcomb.buf, wcomb.len, wcomb.start);
+    if (ret < 0) {                                    /* 这些写已向调用者返回成功 */
+        ddriver_zone_rewind(wcomb.start, wcomb.len);
+        if (wcomb.err == 0)
+            wcomb.err = ret;
+    }
+    wcomb.len = 0;
+    return ret;
+}
+
+/**
+ * @brief 取出并清除尚未报告的合并写失败
+ */
+static int wcomb_take_err(void) {
+    int err = wcomb.err;
+    wcomb.err = 0;
+    return err;
+}
+
+static off_t wcomb_end(void) {
+    return wcomb.start + wcomb.len;
+}
+/**
+ * @brief 多块请求的传输时间，由当前延迟模型决定
+ * 
+ * @param size 请求字节数
+ */
+void ddriver_emulate_transfer(size_t size) {
+    ddriver_delay_us(disk.model->transfer(size));
+}
 /******************************************************************************
 * SECTION: Global Function Implementation
 *******************************************************************************/
@@ -125,9 +376,12 @@ int emulate_rotate(int fd, off_t start, off_t end) {
  * @return int 文件描述符
  */
 int ddriver_open(char *path) {
-    int fd, ret = 0;
+    int ret = 0;
+    const struct ddriver_backend_ops *ops;
+    struct ddriver_geometry geo;
     char device_path[128] = {0};
     char log_path[128] = {0};
+    char *trace_path = getenv(ENV_TRACE);
     
     sprintf(device_path, "%s/" DEVICE_NAME, getpwuid(getuid())->pw_dir);
     sprintf(log_path, "%s/" DEVICE_LOG, getpwuid(getuid())->pw_dir);
@@ -137,29 +391,77 @@ int ddriver_open(char *path) {
         return -1;
     }
 
-    if (access(device_path, F_OK) == 0) {
-        fd = open(device_path, O_RDWR);
+    ops = find_backend(getenv(ENV_BACKEND));
+    if (ops == NULL) {
+        user_panic("unknown backend [%s]", getenv(ENV_BACKEND));
+        return -1;
     }
-    else {
-        fd = open(device_path, O_CREAT | O_TRUNC | O_RDWR, 0644);
+
+    debugf = fopen(log_path, "w+");
+    if (debugf == NULL) {
+        user_panic("can't init log: %s", log_path);
+        return -1;
     }
-    if (fd < 0) {
-        user_panic("can't open device: %d", fd);
-        return fd;
+
+    ret = ddriver_direct_init();
+    if (ret < 0) {
+        fclose(debugf);
+        return ret;
     }
-    ret = posix_fallocate(fd, 0, CONFIG_DISK_SZ);
+
+    disk.backend.ops  = ops;
+    disk.backend.size = disk.layout_size;
+    disk.backend.priv = NULL;
+    ret = ops->open(&disk.backend, device_path, disk.layout_size);
     if (ret < 0) {
-        user_panic("low space");
+        ddriver_direct_release();
+        fclose(debugf);
         return ret;
     }
 
-    debugf = fopen(log_path, "w+");
-    if (debugf == NULL) {
-        user_panic("can't init log: %s", log_path);
+    disk.model = select_model(disk.backend.fd);
+    if (disk.model == NULL || disk.model->init(disk.layout_size, disk.iounit_size) < 0) {
+        user_panic("bad latency model [%s]", getenv(ENV_MODEL) ? getenv(ENV_MODEL) : "xattr " XATTR_MODEL);
+        ops->close(&disk.backend);
+        ddriver_direct_release();
+        fclose(debugf);
         return -1;
     }
+    user_info("backend %s, latency model %s", ops->name, IS_REMOTE(disk) ? "on server" : disk.model->name);
 
-    return fd;
+    memset(&geo, 0, sizeof(geo));                     /* 多磁头与远端后端不模拟读缓冲 */
+    if (ops->position == NULL && !IS_REMOTE(disk))
+        disk.model->geometry(&geo);
+    ret = ddriver_rabuf_open(&geo);
+    if (ret < 0) {
+        ops->close(&disk.backend);
+        ddriver_direct_release();
+        fclose(debugf);
+        return ret;
+    }
+
+    if (!IS_REMOTE(disk))                             /* 远端设备由服务端按它的环境分区 */
+        ret = ddriver_zone_open(device_path, disk.layout_size, disk.iounit_size);
+    if (ret == 0)
+        ret = wcomb_open();
+    if (ret < 0) {
+        ddriver_zone_close();
+        ops->close(&disk.backend);
+        ddriver_direct_release();
+        fclose(debugf);
+        return ret;
+    }
+
+    disk.head = 0;
+    disk.arm  = 0;
+    if (trace_path && *trace_path) {
+        ret = ddriver_trace_open(trace_path, disk.iounit_size, disk.layout_size);
+        if (ret < 0) {
+            user_alert("can't open trace %s: %s", trace_path, strerror(-ret));
+        }
+    }
+
+    return disk.backend.fd;
 }
 /**
  * @brief 关闭驱动
@@ -168,7 +470,32 @@ int ddriver_open(char *path) {
  * @return int 
  */
 int ddriver_close(int fd) {
-    return close(fd) && fclose(debugf);
+    struct ddriver_rabuf_state rabuf;
+    int ret;
+    int stalls;
+
+    wcomb_flush();
+    ret = wcomb_take_err();
+    if (ret < 0) {
+        user_alert("combined write lost: %s", strerror(-ret));
+    }
+    free(wcomb.buf);
+    wcomb.buf = NULL;
+    stalls = ddriver_trace_close();
+    if (stalls < 0) {
+        user_alert("trace write failed, trace file is incomplete: %s", strerror(-stalls));
+    } else if (stalls > 0) {
+        user_alert("trace ring overflowed %d times", stalls);
+    }
+    if (ddriver_rabuf_enabled()) {
+        ddriver_rabuf_state(&rabuf);
+        user_info("read buffer: %lld hits, %lld misses", rabuf.hits, rabuf.misses);
+    }
+    IGNORE_ARG(fd);
+    ddriver_zone_close();
+    ret = disk.backend.ops->close(&disk.backend);
+    ddriver_direct_release();
+    return ret && fclose(debugf);
 }
 /**
  * @brief 磁盘头SEEK
@@ -179,27 +506,50 @@ int ddriver_close(int fd) {
  * @return int 
  */
 int ddriver_seek(int fd, off_t offset, int whence){
-    int ret = 0;
-    int cur = 0;
+    off_t ret = 0;
+    off_t cur = disk.head;
+    uint64_t start = ddriver_now_ns();
 
+    IGNORE_ARG(fd);
     if (!IS_ADDR_ALIGN(offset)) {
         user_alert("offset %ld must be aligned to block size %d", 
                       offset, CONFIG_BLOCK_SZ);
         return -EINVAL;
     }
 
+    switch (whence)
+    {
+    case SEEK_SET:
+        ret = offset;
+        break;
+    case SEEK_CUR:
+        ret = cur + offset;
+        break;
+    case SEEK_END:
+        ret = disk.layout_size + offset;
+        break;
+    default:
+        return -EINVAL;
+    }
+    if (ret < 0 || ret > disk.layout_size) {
+        user_panic("seek error: offset %ld out of device", (long)ret);
+        return -EINVAL;
+    }
+    if (ret != wcomb_end()) {                         /* 不连续，下发攒下的写，失败留给下一次写报告 */
+        wcomb_flush();
+    }
+
     INC_SEEKCNT(disk);
-    cur = lseek(fd, 0, SEEK_CUR);
-    ret = lseek(fd, offset, whence);
-    if (ret < 0) {
-        user_panic("seek error: %s", strerror(errno));
-        return ret;
+    if (disk.backend.ops->position == NULL && !IS_REMOTE(disk) /* 否则推迟到读写时计算 */
+        && !ddriver_rabuf_enabled()) {
+        emulate_position(cur, ret);
     }
-    emulate_rotate(fd, cur, ret);
+    disk.head = ret;
+    ddriver_trace_log(DDRIVER_TRACE_SEEK, ret, 0, start);
     return ret;
 }
 /**
- * @brief 磁盘写入，写入大小可通过IOCTL查询
+ * @brief 磁盘写入，写入大小为IO单位（可通过IOCTL查询）的整数倍
  * 
  * @param fd 
  * @param buf 
@@ -210,15 +560,70 @@ int ddriver_write(int fd, char *buf, size_t size){
     int res = check_valid(size);
     if(res < 0)
         return res;
+    res = wcomb_take_err();                           /* 之前合并的写下发失败 */
+    if (res < 0)
+        return res;
+    res = ddriver_zone_check_write(disk.head, size);  /* 分区模式拒绝非顺序写 */
+    if (res < 0)
+        return res;
         
-    RW_DELAY(disk, write);
-    write(fd, buf, size);
+    IGNORE_ARG(fd);
+    if (wcomb.len > 0 && (disk.head != wcomb_end() || wcomb.len + size > wcomb.cap)) {
+        res = wcomb_flush();
+        if (res < 0)
+            return wcomb_take_err();                  /* 报告之前合并的写 */
+    }
+    if (size < wcomb.cap) {                           /* 攒到合并缓冲区，满了立即下发 */
+        if (wcomb.len == 0)
+            wcomb.start = disk.head;
+        memcpy(wcomb.buf + wcomb.len, buf, size);
+        wcomb.len += size;
+        if (wcomb.len == wcomb.cap && wcomb_flush() < 0)
+            return wcomb_take_err();                  /* 本次写也在失败的区间里 */
+    } else {
+        res = submit_write(buf, size, disk.head);
+    }
+    if (res < 0)
+        return res;
 
-    INC_WRITECNT(disk);
-    return CONFIG_BLOCK_SZ;
+    ddriver_zone_advance(disk.head, size);
+    disk.head += size;
+    return size;
 }
 /**
- * @brief 
+ * @brief 区域追加写：数据写到zone当前写指针处，由设备决定写入位置
+ * 
+ * @param fd 
+ * @param buf 
+ * @param size 写入大小，IO单位的整数倍且不能超出区域剩余空间
+ * @param zone 区域起始偏移
+ * @param written 返回实际写入的偏移
+ * @return int 写入大小，失败返回负错误码
+ */
+int ddriver_zone_append(int fd, char *buf, size_t size, off_t zone, off_t *written){
+    off_t wp;
+    int ret;
+
+    IGNORE_ARG(fd);
+    if (IS_REMOTE(disk))                              /* 写指针在服务端 */
+        return ddriver_remote_append(buf, size, zone, written);
+    wp = ddriver_zone_wp(zone);
+    if (wp < 0) {
+        user_alert("zone append to %ld: not a sequential zone", (long)zone);
+        return wp;
+    }
+    ret = ddriver_seek(fd, wp, SEEK_SET);
+    if (ret < 0)
+        return ret;
+    ret = ddriver_write(fd, buf, size);
+    if (ret < 0)
+        return ret;
+    if (written)
+        *written = wp;
+    return ret;
+}
+/**
+ * @brief 磁盘读取，读取大小为IO单位的整数倍
  * 
  * @param fd 
  * @param buf 
@@ -226,15 +631,36 @@ int ddriver_write(int fd, char *buf, size_t size){
  * @return int 
  */
 int ddriver_read(int fd, char *buf, size_t size){
+    uint64_t start = ddriver_now_ns();
+    ssize_t ret;
+    int hit;
     int res = check_valid(size);
     if(res < 0)
         return res;
 
-    RW_DELAY(disk, read);
-    read(fd, buf, size);
+    IGNORE_ARG(fd);
+    if (wcomb.len > 0 && disk.head < wcomb_end() && disk.head + (off_t)size > wcomb.start) {
+        res = wcomb_flush();                          /* 读到尚未下发的数据 */
+        if (res < 0)
+            return res;
+    }
+    hit = ddriver_rabuf_lookup(disk.head, size);
+    if (hit)
+        ddriver_delay_us(ddriver_rabuf_hit_us(size)); /* 缓冲命中，磁头不动 */
+    else
+        emulate_access(DDRIVER_TRACE_READ, disk.head, size);
+    ret = disk.backend.ops->read(&disk.backend, buf, size, disk.head);
+    if (ret < 0) {
+        user_alert("read error at %ld: %s", (long)disk.head, strerror(-ret));
+        return -EIO;
+    }
 
+    if (!hit)
+        ddriver_rabuf_fill(disk.head, size);
     INC_READCNT(disk);
-    return CONFIG_BLOCK_SZ;
+    ddriver_trace_log(DDRIVER_TRACE_READ, disk.head, size, start);
+    disk.head += size;
+    return size;
 }
 /**
  * @brief 
@@ -246,6 +672,26 @@ int ddriver_read(int fd, char *buf, size_t size){
  */
 int ddriver_ioctl(int fd, unsigned long cmd, void *arg){
     struct ddriver_state state;
+    struct ddriver_member_state *member;
+    struct ddriver_discard_range *range;
+    struct ddriver_geometry *geo;
+    struct ddriver_account *account;
+    off_t zone_len;
+    int ret;
+
+    IGNORE_ARG(fd);
+    wcomb_flush();                                    /* ioctl看到的设备状态包含所有已完成的写 */
+    if (cmd == IOC_REQ_DEVICE_FLUSH) {                /* 合并写的下发失败在刷盘时报告 */
+        ret = wcomb_take_err();
+        if (ret < 0)
+            return ret;
+    }
+    ret = disk.backend.ops->ioctl(&disk.backend, cmd, arg);
+    if (ret != -ENOTTY) {                             /* Handled by backend */
+        if (cmd == IOC_REQ_DEVICE_RESET && ret == 0)  /* Remote backend forwards everything */
+            disk.head = 0;
+        return ret;
+    }
     switch (cmd)
     {
     case IOC_REQ_DEVICE_SIZE:                         /* Device Size */
@@ -257,14 +703,14 @@ int ddriver_ioctl(int fd, unsigned long cmd, void *arg){
         state.seek_cnt = disk.seek_cnt;
         memcpy(arg, &state, sizeof(struct ddriver_state));
         break;
-    case IOC_REQ_DEVICE_RESET:                        /* Reset Device */
-        lseek(fd, 0, SEEK_SET);
-        char buf[4096] = {'\0'};
-        for (size_t i = 0; i < CONFIG_DISK_SZ; i += 4096)
-        {
-            write(fd, buf, 4096);
-        }
-        lseek(fd, 0, SEEK_SET);
+    case IOC_REQ_DEVICE_RESET:                        /* Reset Device, one discard */
+        ret = discard_range(0, disk.layout_size);
+        if (ret < 0)
+            return ret;
+        ddriver_zone_reset_all();
+        ddriver_rabuf_reset();
+        disk.head = 0;
+        disk.arm = 0;
         disk.read_cnt = 0;
         disk.write_cnt = 0;
         disk.seek_cnt = 0;
@@ -272,6 +718,56 @@ int ddriver_ioctl(int fd, unsigned long cmd, void *arg){
     case IOC_REQ_DEVICE_IO_SZ:
         memcpy(arg, &disk.iounit_size, sizeof(int));
         break;
+    case IOC_REQ_DEVICE_DISCARD:                      /* Discard (TRIM) a range */
+        range = (struct ddriver_discard_range *)arg;
+        return discard_range(range->offset, range->len);
+    case IOC_REQ_DEVICE_MEMBERS:                      /* Single image backends */
+        ret = 1;
+        memcpy(arg, &ret, sizeof(int));
+        break;
+    case IOC_REQ_DEVICE_MEMBER_STATE:
+        member = (struct ddriver_member_state *)arg;
+        if (member->member != 0)
+            return -EINVAL;
+        member->read_cnt = disk.read_cnt;
+        member->write_cnt = disk.write_cnt;
+        member->read_bytes = 0;
+        member->write_bytes = 0;
+        member->busy_us = 0;
+        break;
+    case IOC_REQ_DEVICE_GEOMETRY:                     /* Geometry of the latency model */
+        geo = (struct ddriver_geometry *)arg;
+        disk.model->geometry(geo);
+        break;
+    case IOC_REQ_DEVICE_ACCOUNT:                      /* Count an I/O done outside read/write */
+        account = (struct ddriver_account *)arg;
+        if (account->op == DDRIVER_ACCOUNT_READ)
+            INC_READCNT(disk);
+        else if (account->op == DDRIVER_ACCOUNT_WRITE)
+            INC_WRITECNT(disk);
+        else if (account->op == DDRIVER_ACCOUNT_SEEK)
+            INC_SEEKCNT(disk);
+        else
+            return -EINVAL;
+        break;
+    case IOC_REQ_DEVICE_FLUSH:                        /* Flush images, fdatasync if enabled */
+        if (disk.backend.ops->flush != NULL)
+            return disk.backend.ops->flush(&disk.backend);
+        break;
+    case IOC_REQ_RABUF_STATE:                         /* Track read buffer hits */
+        ddriver_rabuf_state((struct ddriver_rabuf_state *)arg);
+        break;
+    case IOC_REQ_ZONE_REPORT:                         /* Zoned mode: report zones */
+        return ddriver_zone_report((struct ddriver_zone_report *)arg);
+    case IOC_REQ_ZONE_RESET:                          /* Zoned mode: rewind write pointer */
+        ret = ddriver_zone_range(*(long long *)arg, &zone_len);
+        if (ret < 0)
+            return ret;
+        ret = discard_range(*(long long *)arg, zone_len);
+        if (ret < 0)
+            return ret;
+        ddriver_zone_reset(*(long long *)arg);
+        break;
     default:
         break;
     }
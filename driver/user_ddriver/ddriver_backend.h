@@ -0,0 +1,117 @@
+#ifndef _DDRIVER_BACKEND_H_
+#define _DDRIVER_BACKEND_H_
+
+#include "stdio.h"
+#include <sys/types.h>
+/******************************************************************************
+* SECTION: Macro definitions
+*******************************************************************************/
+#define USER_INFO     "INFO: "
+#define USER_ALERT    "WARNING: "
+
+#define USER_PANIC    "PANIC: "
+
+#define DEVICE_NAME   "ddriver"
+#define DEVICE_LOG    "ddriver_log"
+#define ENV_BACKEND   "DDRIVER_BACKEND"               /* 选择存储后端，默认file */
+#define ENV_DIRECT    "DDRIVER_DIRECT"                /* 1: 镜像以O_DIRECT打开，绕过宿主机页缓存 */
+#define ENV_DIRECT_ALIGN "DDRIVER_DIRECT_ALIGN"       /* 直接I/O对齐要求，默认4096 */
+#define ENV_FDATASYNC "DDRIVER_FDATASYNC"             /* 1: IOC_REQ_DEVICE_FLUSH执行fdatasync */
+
+#define CONFIG_DISK_SZ  (4 * 1024 * 1024)
+#define CONFIG_BLOCK_SZ (512)
+
+#define user_info(fmt, ...)\
+	do {\
+		printf(USER_INFO DEVICE_NAME " " fmt "\n", ##__VA_ARGS__);\
+        fprintf(debugf, USER_PANIC  " " fmt "\n", ##__VA_ARGS__);\
+	} while(0)\
+
+#define user_alert(fmt, ...)\
+	do {\
+		printf(USER_ALERT DEVICE_NAME " " fmt "\n", ##__VA_ARGS__);\
+        fprintf(debugf, USER_PANIC  " " fmt "\n", ##__VA_ARGS__);\
+	} while(0)\
+
+#define user_panic(fmt, ...)\
+    do {\
+        printf(USER_PANIC  " " fmt "\n", ##__VA_ARGS__);\
+    } while (0)\
+
+extern FILE *debugf;
+/******************************************************************************
+* SECTION: Backend interface
+*******************************************************************************/
+/*
+ * 后端只负责按逻辑偏移存取数据，磁头位置、计数器、延迟模拟与trace
+ * 都在ddriver.c中统一处理。
+ *
+ * BACKEND_F_TRANSFER: 后端自行调用ddriver_emulate_transfer模拟传输时间
+ *                     （例如RAID-0各成员并行传输）
+ *
+ * BACKEND_F_REMOTE:   设备在另一个进程（ddriver_server）中，延迟模拟、分区检查
+ *                     与计数都由服务端完成，ioctl全部转发
+ *
+ * discard:  可选。释放区间对应的存储（打洞），之后读回零；
+ *           不提供或返回-EOPNOTSUPP时由ddriver.c写零代替。
+ *
+ * flush:    可选。IOC_REQ_DEVICE_FLUSH时把各镜像文件落盘（ddriver_image_flush）。
+ *
+ * position: 可选。多磁头后端（例如RAID-1）在每次读写前被调用，选择服务
+ *           该请求的成员，并返回用于计算定位延迟的起始磁头位置；
+ *           提供该回调时seek不再立即计算定位延迟。
+ */
+#define BACKEND_F_TRANSFER      0x1
+#define BACKEND_F_REMOTE        0x2
+
+struct ddriver_backend;
+
+struct ddriver_backend_ops
+{
+    const char *name;
+    int         flags;
+    int     (*open)(struct ddriver_backend *be, const char *path, int size);
+    ssize_t (*read)(struct ddriver_backend *be, char *buf, size_t size, off_t offset);
+    ssize_t (*write)(struct ddriver_backend *be, const char *buf, size_t size, off_t offset);
+    int     (*ioctl)(struct ddriver_backend *be, unsigned long cmd, void *arg); /* 不支持返回-ENOTTY */
+    int     (*discard)(struct ddriver_backend *be, off_t offset, off_t len);
+    off_t   (*position)(struct ddriver_backend *be, int op, off_t offset);
+    int     (*flush)(struct ddriver_backend *be);
+    int     (*close)(struct ddriver_backend *be);
+};
+
+struct ddriver_backend
+{
+    const struct ddriver_backend_ops *ops;
+    int                               fd;             /* 返回给调用者的设备描述符 */
+    int                               size;           /* 逻辑设备大小 */
+    void                             *priv;
+};
+
+extern const struct ddriver_backend_ops ddriver_file_ops;
+extern const struct ddriver_backend_ops ddriver_raid0_ops;
+extern const struct ddriver_backend_ops ddriver_raid1_ops;
+extern const struct ddriver_backend_ops ddriver_overlay_ops;
+extern const struct ddriver_backend_ops ddriver_remote_ops;
+extern const struct ddriver_backend_ops ddriver_compress_ops;
+/******************************************************************************
+* SECTION: ddriver.c helpers for backends
+*******************************************************************************/
+int  ddriver_env_int(const char *name, int dflt);
+int  ddriver_open_image(const char *path, off_t size);
+int  ddriver_punch_hole(int fd, off_t offset, off_t len);
+int  ddriver_store_meta(const char *path, const void *hdr, size_t hdr_len, const void *body, size_t body_len);
+void ddriver_emulate_transfer(size_t size);
+long ddriver_position_us(off_t start, off_t end);
+/******************************************************************************
+* SECTION: ddriver_direct.c - 镜像直接I/O，file、raid0与raid1后端使用
+*******************************************************************************/
+int     ddriver_direct_init(void);
+void    ddriver_direct_release(void);
+int     ddriver_direct_enabled(void);
+int     ddriver_open_direct(const char *path, off_t size);
+ssize_t ddriver_image_pread(int fd, char *buf, size_t size, off_t offset);
+ssize_t ddriver_image_pwrite(int fd, const char *buf, size_t size, off_t offset);
+int     ddriver_image_flush(int fd);
+
+#endif /* _DDRIVER_BACKEND_H_ */
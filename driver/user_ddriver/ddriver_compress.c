@@ -0,0 +1,680 @@
+#include "stdio.h"
+#include "stdlib.h"
+#include <unistd.h>
+#include <fcntl.h>
+#include "string.h"
+#include "errno.h"
+#include <stdint.h>
+#include <pthread.h>
+#include "ddriver_ctl.h"
+#include "ddriver_trace.h"
+#include "ddriver_backend.h"
+/******************************************************************************
+* SECTION: Macro definitions
+*******************************************************************************/
+#define CMP_BLK_SZ              4096                  /* 压缩单位，小于它的写入先读出整块再合并 */
+#define CMP_SEG_SZ              (64 * 1024)           /* 日志段，空间按段回收 */
+#define CMP_SPARE_SEGS          8                     /* 逻辑容量之外预留的段，保证整理总能进行 */
+#define CMP_LOW_SEGS            4                     /* 空闲段少于该值时唤醒后台整理 */
+#define CMP_RESERVE_SEGS        1                     /* 前台写入不能占用的段，留给整理搬迁活跃数据 */
+#define CMP_MAP_SUFFIX          ".cmap"
+#define CMP_MAP_MAGIC           0x5a434444            /* "DDCZ" */
+
+#define LZ_MIN_MATCH            4
+#define LZ_HASH_BITS            12
+#define LZ_MAX_OFFSET           65535
+#define LZ_HASH(v)              (((v) * 2654435761U) >> (32 - LZ_HASH_BITS))
+/******************************************************************************
+* SECTION: Type definitions
+*******************************************************************************/
+/*
+ * 镜像文件是按段组织的追加日志，每个逻辑块压缩后写到当前段的末尾：
+ *
+ * | seg 0: blk a | blk b | blk a' | ... | seg 1: ... | ... |
+ *
+ * 块的最新位置记在内存中的map里（close / flush时写入 path.cmap）。覆盖写
+ * 使旧版本成为垃圾；段内活跃数据降为0时退役，空闲段不足时后台线程把活跃
+ * 数据最少的段中的块搬到日志末尾，再让该段退役。
+ *
+ * 上一次落盘的map可能仍指向退役段中的旧版本，所以退役段要等下一次map提交
+ * （镜像fdatasync -> map经临时文件fsync后rename）之后才打洞、重新使用。
+ * 崩溃后总能回到最后一次flush时的设备内容。
+ */
+struct cmp_slot
+{
+    uint32_t off;                                     /* 镜像内字节偏移 */
+    uint32_t len;                                     /* 0: 全零块，未存储；CMP_BLK_SZ: 未压缩 */
+};
+
+struct cmp_seg
+{
+    int used;                                         /* 已追加的字节数，0表示空闲 */
+    int live;                                         /* 其中仍被map引用的字节数 */
+    int retired;                                      /* 已无活跃数据，等map提交后回收 */
+};
+
+struct ddriver_compress_map_hdr
+{
+    uint32_t magic;
+    uint32_t blk_size;
+    uint32_t nr_blks;
+    uint32_t seg_size;
+};
+
+struct compress
+{
+    int              fd;
+    int              nr_blks;
+    int              nr_segs;
+    int              head;                            /* 当前追加的段，-1表示尚未分配 */
+    int              free_segs;
+    int              retired_segs;
+    int              dirty;
+    int              stop;
+    int              cache_blk;                       /* 最近访问的块的明文，-1表示无效 */
+    struct cmp_slot *map;
+    struct cmp_seg  *segs;
+    uint8_t          cache[CMP_BLK_SZ];
+    uint8_t          tmp[CMP_BLK_SZ];
+    struct ddriver_compress_state stat;
+    char             map_path[256];
+    pthread_t        compactor;
+    pthread_mutex_t  lock;
+    pthread_cond_t   kick;
+};
+/******************************************************************************
+* SECTION: Global Variable
+*******************************************************************************/
+static struct compress cmp = {
+    .fd   = -1,
+    .lock = PTHREAD_MUTEX_INITIALIZER,
+    .kick = PTHREAD_COND_INITIALIZER,
+};
+
+static const uint8_t zero_blk[CMP_BLK_SZ];
+/******************************************************************************
+* SECTION: LZ codec
+*******************************************************************************/
+/*
+ * 类LZ4的字节流格式，由若干序列组成：
+ *
+ * | token | [字面量长度扩展] | 字面量 | offset (2B, LE) | [匹配长度扩展] |
+ *
+ * token高4位为字面量长度，低4位为匹配长度 - LZ_MIN_MATCH，取15时后跟扩展
+ * 字节（每个255累加，直到小于255）。最后一个序列只有字面量，输入在此结束。
+ */
+static uint32_t read32(const uint8_t *p) {
+    uint32_t v;
+    memcpy(&v, p, sizeof(v));
+    return v;
+}
+
+static int lz_put_len(uint8_t *dst, int op, int cap, int len) {
+    for (; len >= 255; len -= 255) {
+        if (op >= cap)
+            return -1;
+        dst[op++] = 255;
+    }
+    if (op >= cap)
+        return -1;
+    dst[op++] = len;
+    return op;
+}
+
+static int lz_put_seq(uint8_t *dst, int op, int cap, const uint8_t *lit, int nr_lit, int offset, int mlen) {
+    int ml = mlen - LZ_MIN_MATCH;
+
+    if (op >= cap)
+        return -1;
+    dst[op++] = ((nr_lit < 15 ? nr_lit : 15) << 4) | (mlen == 0 ? 0 : (ml < 15 ? ml : 15));
+    if (nr_lit >= 15 && (op = lz_put_len(dst, op, cap, nr_lit - 15)) < 0)
+        return -1;
+    if (op + nr_lit > cap)
+        return -1;
+    memcpy(dst + op, lit, nr_lit);
+    op += nr_lit;
+    if (mlen == 0)                                    /* 结尾序列 */
+        return op;
+    if (op + 2 > cap)
+        return -1;
+    dst[op++] = offset & 0xff;
+    dst[op++] = offset >> 8;
+    if (ml >= 15 && (op = lz_put_len(dst, op, cap, ml - 15)) < 0)
+        return -1;
+    return op;
+}
+
+/**
+ * @brief 压缩n字节到dst
+ *
+ * @return int 压缩后长度，超过cap返回-1（调用者改为存明文）
+ */
+static int lz_compress(const uint8_t *src, int n, uint8_t *dst, int cap) {
+    int      table[1 << LZ_HASH_BITS];
+    int      ip = 0, anchor = 0, op = 0, ref, len;
+    uint32_t seq;
+
+    memset(table, -1, sizeof(table));
+    while (ip + LZ_MIN_MATCH <= n) {
+        seq = read32(src + ip);
+        ref = table[LZ_HASH(seq)];
+        table[LZ_HASH(seq)] = ip;
+        if (ref < 0 || ip - ref > LZ_MAX_OFFSET || read32(src + ref) != seq) {
+            ip++;
+            continue;
+        }
+        for (len = LZ_MIN_MATCH; ip + len < n && src[ref + len] == src[ip + len]; len++)
+            ;
+        op = lz_put_seq(dst, op, cap, src + anchor, ip - anchor, ip - ref, len);
+        if (op < 0)
+            return -1;
+        ip    += len;
+        anchor = ip;
+    }
+    return lz_put_seq(dst, op, cap, src + anchor, n - anchor, 0, 0);
+}
+
+static int lz_get_len(const uint8_t *src, int *ip, int n, int len) {
+    uint8_t b;
+    do {
+        if (*ip >= n)
+            return -1;
+        b    = src[(*ip)++];
+        len += b;
+    } while (b == 255);
+    return len;
+}
+
+/**
+ * @brief 解压到dst，结果必须恰好为out字节
+ *
+ * @return int 0成功，数据损坏返回-EIO
+ */
+static int lz_decompress(const uint8_t *src, int n, uint8_t *dst, int out) {
+    int ip = 0, op = 0, nr_lit, mlen, offset;
+
+    while (ip < n) {
+        nr_lit = src[ip] >> 4;
+        mlen   = (src[ip] & 0xf) + LZ_MIN_MATCH;
+        ip++;
+        if (nr_lit == 15 && (nr_lit = lz_get_len(src, &ip, n, nr_lit)) < 0)
+            return -EIO;
+        if (ip + nr_lit > n || op + nr_lit > out)
+            return -EIO;
+        memcpy(dst + op, src + ip, nr_lit);
+        ip += nr_lit;
+        op += nr_lit;
+        if (ip == n)
+            break;
+        if (ip + 2 > n)
+            return -EIO;
+        offset = src[ip] | (src[ip + 1] << 8);
+        ip    += 2;
+        if (mlen == 15 + LZ_MIN_MATCH && (mlen = lz_get_len(src, &ip, n, mlen)) < 0)
+            return -EIO;
+        if (offset == 0 || offset > op || op + mlen > out)
+            return -EIO;
+        for (; mlen > 0; mlen--, op++) {              /* 逐字节复制，允许与输出重叠 */
+            dst[op] = dst[op - offset];
+        }
+    }
+    return op == out ? 0 : -EIO;
+}
+/******************************************************************************
+* SECTION: Helper Functions
+*******************************************************************************/
+static int seg_of(uint32_t off) {
+    return off / CMP_SEG_SZ;
+}
+
+/**
+ * @brief 段中已无活跃数据；落盘的map可能仍引用它，提交map前不能重新使用
+ */
+static void seg_retire(int seg) {
+    cmp.segs[seg].retired = 1;
+    cmp.retired_segs++;
+}
+
+static void seg_free(int seg) {
+    cmp.segs[seg].used    = 0;
+    cmp.segs[seg].live    = 0;
+    cmp.segs[seg].retired = 0;
+    cmp.free_segs++;
+    ddriver_punch_hole(cmp.fd, (off_t)seg * CMP_SEG_SZ, CMP_SEG_SZ);
+}
+
+static void slot_release(int blk) {
+    struct cmp_slot *slot = &cmp.map[blk];
+    int seg;
+
+    if (slot->len == 0) {
+        return;
+    }
+    seg = seg_of(slot->off);
+    cmp.segs[seg].live -= slot->len;
+    cmp.stat.stored_blks--;
+    cmp.stat.stored_bytes -= slot->len;
+    slot->len = 0;
+    cmp.dirty = 1;
+    if (cmp.segs[seg].live == 0 && seg != cmp.head) { /* 只剩旧版本 */
+        seg_retire(seg);
+    }
+}
+
+static int seg_alloc(void) {
+    int seg;
+    for (seg = 0; seg < cmp.nr_segs; seg++) {
+        if (cmp.segs[seg].used == 0 && seg != cmp.head) {
+            cmp.free_segs--;
+            return seg;
+        }
+    }
+    return -1;
+}
+
+/**
+ * @brief 把len字节追加到日志末尾
+ *
+ * @param reserve 至少保留的空闲段数
+ * @return int 0成功，没有可用的空闲段返回-ENOSPC
+ */
+static int log_append(const uint8_t *data, int len, uint32_t *off, int reserve) {
+    struct cmp_seg *seg;
+    int next;
+
+    if (cmp.head < 0 || cmp.segs[cmp.head].used + len > CMP_SEG_SZ) {
+        next = cmp.free_segs > reserve ? seg_alloc() : -1;
+        if (next < 0) {
+            return -ENOSPC;
+        }
+        if (cmp.head >= 0 && cmp.segs[cmp.head].live == 0) {
+            seg_retire(cmp.head);                     /* 旧的追加段已全是垃圾 */
+        }
+        cmp.head = next;
+    }
+    seg  = &cmp.segs[cmp.head];
+    *off = (uint32_t)cmp.head * CMP_SEG_SZ + seg->used;
+    if (pwrite(cmp.fd, data, len, *off) != len) {
+        return errno ? -errno : -EIO;
+    }
+    seg->used += len;
+    seg->live += len;
+    cmp.stat.media_bytes += len;
+    if (cmp.free_segs < CMP_LOW_SEGS) {
+        pthread_cond_signal(&cmp.kick);
+    }
+    return 0;
+}
+
+/**
+ * @brief 整理一个段：活跃块搬到日志末尾后回收该段
+ *
+ * @return int 1回收了一个段，0没有可整理的段
+ */
+static int compact_one(void) {
+    uint8_t buf[CMP_BLK_SZ];
+    int     seg, victim = -1, blk, room;
+    uint32_t off;
+
+    room = cmp.free_segs * CMP_SEG_SZ + (cmp.head >= 0 ? CMP_SEG_SZ - cmp.segs[cmp.head].used : 0);
+    for (seg = 0; seg < cmp.nr_segs; seg++) {         /* 选活跃数据最少、且有垃圾可回收的段 */
+        if (seg == cmp.head || cmp.segs[seg].used == 0 || cmp.segs[seg].retired
+            || cmp.segs[seg].live >= cmp.segs[seg].used)
+            continue;
+        if (victim < 0 || cmp.segs[seg].live < cmp.segs[victim].live)
+            victim = seg;
+    }
+    if (victim < 0 || cmp.segs[victim].live > room - CMP_BLK_SZ) {
+        return 0;
+    }
+    for (blk = 0; blk < cmp.nr_blks && cmp.segs[victim].live > 0; blk++) {
+        struct cmp_slot *slot = &cmp.map[blk];
+        if (slot->len == 0 || seg_of(slot->off) != victim)
+            continue;
+        if (pread(cmp.fd, buf, slot->len, slot->off) != (ssize_t)slot->len
+            || log_append(buf, slot->len, &off, 0) < 0) {
+            return 0;
+        }
+        cmp.segs[victim].live -= slot->len;
+        cmp.stat.media_bytes  += slot->len;           /* 读出的字节，写入已由log_append计入 */
+        cmp.stat.compact_moves++;
+        slot->off = off;
+        cmp.dirty = 1;
+    }
+    seg_retire(victim);
+    return 1;
+}
+
+static int map_commit(void);
+
+/**
+ * @brief 腾出空闲段：先整理，攒够退役段或整理不动时提交一次map回收它们
+ *
+ * @return int 1有进展，0没有可做的
+ */
+static int compact_step(void) {
+    if (cmp.retired_segs < CMP_LOW_SEGS && compact_one() > 0) {
+        return 1;
+    }
+    return cmp.retired_segs > 0 && map_commit() == 0;
+}
+
+static void* compactor(void *arg) {
+    (void)arg;
+    pthread_mutex_lock(&cmp.lock);
+    while (!cmp.stop) {
+        if (cmp.free_segs < CMP_LOW_SEGS && compact_step() > 0) {
+            pthread_mutex_unlock(&cmp.lock);          /* 每整理一段让出一次锁 */
+            pthread_mutex_lock(&cmp.lock);
+            continue;
+        }
+        pthread_cond_wait(&cmp.kick, &cmp.lock);
+    }
+    pthread_mutex_unlock(&cmp.lock);
+    return NULL;
+}
+
+static int blk_load(int blk, uint8_t *buf) {
+    struct cmp_slot *slot = &cmp.map[blk];
+    int ret;
+
+    if (blk == cmp.cache_blk) {
+        memcpy(buf, cmp.cache, CMP_BLK_SZ);
+        return 0;
+    }
+    if (slot->len == 0) {
+        memset(buf, 0, CMP_BLK_SZ);
+        return 0;
+    }
+    if (pread(cmp.fd, cmp.tmp, slot->len, slot->off) != (ssize_t)slot->len) {
+        return -EIO;
+    }
+    cmp.stat.media_bytes += slot->len;
+    ddriver_emulate_transfer(slot->len);
+    if (slot->len == CMP_BLK_SZ) {
+        memcpy(buf, cmp.tmp, CMP_BLK_SZ);
+    } else if ((ret = lz_decompress(cmp.tmp, slot->len, buf, CMP_BLK_SZ)) < 0) {
+        user_alert("compressed block %d corrupted", blk);
+        return ret;
+    }
+    memcpy(cmp.cache, buf, CMP_BLK_SZ);
+    cmp.cache_blk = blk;
+    return 0;
+}
+
+static int blk_store(int blk, const uint8_t *buf) {
+    const uint8_t *data = cmp.tmp;
+    uint32_t off;
+    int len, ret;
+
+    cmp.cache_blk = -1;
+    if (memcmp(buf, zero_blk, CMP_BLK_SZ) == 0) {     /* 全零块不占空间 */
+        slot_release(blk);
+        return 0;
+    }
+    len = lz_compress(buf, CMP_BLK_SZ, cmp.tmp, CMP_BLK_SZ - 1);
+    if (len < 0) {
+        data = buf;
+        len  = CMP_BLK_SZ;
+    }
+    ret = log_append(data, len, &off, CMP_RESERVE_SEGS);
+    while (ret == -ENOSPC && compact_step() > 0) {    /* 后台整理没跟上，同步整理 */
+        ret = log_append(data, len, &off, CMP_RESERVE_SEGS);
+    }
+    if (ret < 0) {
+        return ret;
+    }
+    ddriver_emulate_transfer(len);
+    slot_release(blk);
+    cmp.map[blk].off = off;
+    cmp.map[blk].len = len;
+    cmp.stat.stored_blks++;
+    cmp.stat.stored_bytes += len;
+    cmp.dirty = 1;
+    memcpy(cmp.cache, buf, CMP_BLK_SZ);
+    cmp.cache_blk = blk;
+    return 0;
+}
+
+static void map_load(void) {
+    struct ddriver_compress_map_hdr hdr;
+    size_t len = sizeof(struct cmp_slot) * cmp.nr_blks;
+    int fd = open(cmp.map_path, O_RDONLY), blk, seg, ok = 0;
+
+    memset(cmp.map, 0, len);
+    if (fd >= 0) {
+        ok = read(fd, &hdr, sizeof(hdr)) == sizeof(hdr) && hdr.magic == CMP_MAP_MAGIC
+             && hdr.blk_size == CMP_BLK_SZ && hdr.nr_blks == (uint32_t)cmp.nr_blks
+             && hdr.seg_size == CMP_SEG_SZ && read(fd, cmp.map, len) == (ssize_t)len;
+        close(fd);
+    }
+    for (blk = 0; ok && blk < cmp.nr_blks; blk++) {
+        struct cmp_slot *slot = &cmp.map[blk];
+        if (slot->len > CMP_BLK_SZ || (slot->len && (seg_of(slot->off) >= cmp.nr_segs
+            || slot->off % CMP_SEG_SZ + slot->len > CMP_SEG_SZ))) {
+            ok = 0;
+        }
+    }
+    if (!ok) {
+        if (fd >= 0)
+            user_alert("compress map %s mismatched, device starts empty", cmp.map_path);
+        memset(cmp.map, 0, len);
+    }
+    for (blk = 0; blk < cmp.nr_blks; blk++) {         /* 段的使用情况由map重建 */
+        struct cmp_slot *slot = &cmp.map[blk];
+        if (slot->len == 0)
+            continue;
+        seg = seg_of(slot->off);
+        cmp.segs[seg].live += slot->len;
+        if (cmp.segs[seg].used < (int)(slot->off % CMP_SEG_SZ + slot->len))
+            cmp.segs[seg].used = slot->off % CMP_SEG_SZ + slot->len;
+        cmp.stat.stored_blks++;
+        cmp.stat.stored_bytes += slot->len;
+    }
+    for (seg = 0; seg < cmp.nr_segs; seg++) {
+        cmp.free_segs += cmp.segs[seg].used == 0;
+    }
+}
+
+/**
+ * @brief 提交map：镜像先落盘，map再原子替换，之后退役段才可以回收
+ *
+ * map是否有效取决于它引用的数据是否已在镜像中，这里的fdatasync不受
+ * DDRIVER_FDATASYNC控制。调用者持有lock。
+ */
+static int map_commit(void) {
+    struct ddriver_compress_map_hdr hdr = {
+        .magic    = CMP_MAP_MAGIC,
+        .blk_size = CMP_BLK_SZ,
+        .nr_blks  = cmp.nr_blks,
+        .seg_size = CMP_SEG_SZ,
+    };
+    int seg, ret;
+
+    if (cmp.dirty) {                                  /* map未变时落盘的map也不引用退役段 */
+        if (fdatasync(cmp.fd) < 0) {
+            return -errno;
+        }
+        ret = ddriver_store_meta(cmp.map_path, &hdr, sizeof(hdr), cmp.map, sizeof(struct cmp_slot) * cmp.nr_blks);
+        if (ret < 0) {
+            user_alert("can't save compress map %s: %s", cmp.map_path, strerror(-ret));
+            return ret;
+        }
+        cmp.dirty = 0;
+    }
+    for (seg = 0; seg < cmp.nr_segs && cmp.retired_segs > 0; seg++) {
+        if (cmp.segs[seg].retired) {
+            seg_free(seg);
+            cmp.retired_segs--;
+        }
+    }
+    return 0;
+}
+
+static void fill_state(struct ddriver_compress_state *state) {
+    int seg;
+
+    cmp.stat.blk_size    = CMP_BLK_SZ;
+    cmp.stat.nr_blks     = cmp.nr_blks;
+    cmp.stat.free_segs   = cmp.free_segs;
+    cmp.stat.image_bytes = 0;
+    for (seg = 0; seg < cmp.nr_segs; seg++) {
+        cmp.stat.image_bytes += cmp.segs[seg].used ? CMP_SEG_SZ : 0;
+    }
+    *state = cmp.stat;
+}
+/******************************************************************************
+* SECTION: Compress backend - 按块压缩的日志结构镜像
+*******************************************************************************/
+static int compress_open(struct ddriver_backend *be, const char *path, int size) {
+    if (size % CMP_BLK_SZ != 0) {
+        user_panic("device size %d must be a multiple of %d", size, CMP_BLK_SZ);
+        return -EINVAL;
+    }
+    cmp.fd = open(path, O_CREAT | O_RDWR, 0644);
+    if (cmp.fd < 0) {
+        user_panic("can't open image %s: %s", path, strerror(errno));
+        return -errno;
+    }
+    snprintf(cmp.map_path, sizeof(cmp.map_path), "%s" CMP_MAP_SUFFIX, path);
+    cmp.nr_blks   = size / CMP_BLK_SZ;
+    cmp.nr_segs   = size / CMP_SEG_SZ + CMP_SPARE_SEGS;
+    cmp.head      = -1;
+    cmp.free_segs = 0;
+    cmp.retired_segs = 0;
+    cmp.dirty     = 0;
+    cmp.stop      = 0;
+    cmp.cache_blk = -1;
+    memset(&cmp.stat, 0, sizeof(cmp.stat));
+    cmp.map  = malloc(sizeof(struct cmp_slot) * cmp.nr_blks);
+    cmp.segs = calloc(cmp.nr_segs, sizeof(struct cmp_seg));
+    if (cmp.map == NULL || cmp.segs == NULL) {
+        free(cmp.map);
+        free(cmp.segs);
+        close(cmp.fd);
+        return -ENOMEM;
+    }
+    map_load();
+
+    if (pthread_create(&cmp.compactor, NULL, compactor, NULL) != 0) {
+        free(cmp.map);
+        free(cmp.segs);
+        close(cmp.fd);
+        return -EAGAIN;
+    }
+    be->fd   = cmp.fd;
+    be->priv = &cmp;
+    user_info("compress: %d/%d blocks stored in %lld bytes",
+              cmp.stat.stored_blks, cmp.nr_blks, cmp.stat.stored_bytes);
+    return 0;
+}
+
+static ssize_t compress_rw(int op, char *buf, size_t size, off_t offset) {
+    uint8_t  blkbuf[CMP_BLK_SZ];
+    uint64_t start = ddriver_now_ns();
+    off_t    pos, blk_ofs;
+    size_t   len;
+    int      blk, ret = 0;
+
+    pthread_mutex_lock(&cmp.lock);
+    for (pos = offset; pos < offset + (off_t)size && ret == 0; pos += len) {
+        blk     = pos / CMP_BLK_SZ;
+        blk_ofs = pos % CMP_BLK_SZ;
+        len     = CMP_BLK_SZ - blk_ofs < offset + (off_t)size - pos ? (size_t)(CMP_BLK_SZ - blk_ofs)
+                                                                   : (size_t)(offset + (off_t)size - pos);
+        if (op == DDRIVER_TRACE_READ) {
+            ret = blk_load(blk, blkbuf);
+            memcpy(buf + (pos - offset), blkbuf + blk_ofs, len);
+        } else if (len == CMP_BLK_SZ && op == DDRIVER_TRACE_WRITE) {
+            ret = blk_store(blk, (const uint8_t *)buf + (pos - offset));
+        } else {                                      /* 部分写或discard：读出整块合并后重新压缩 */
+            ret = blk_load(blk, blkbuf);
+            if (op == DDRIVER_TRACE_WRITE)
+                memcpy(blkbuf + blk_ofs, buf + (pos - offset), len);
+            else
+                memset(blkbuf + blk_ofs, 0, len);
+            if (ret == 0)
+                ret = blk_store(blk, blkbuf);
+        }
+    }
+    cmp.stat.user_bytes += size;
+    cmp.stat.io_us      += (ddriver_now_ns() - start) / 1000;
+    pthread_mutex_unlock(&cmp.lock);
+    return ret < 0 ? ret : (ssize_t)size;
+}
+
+static ssize_t compress_read(struct ddriver_backend *be, char *buf, size_t size, off_t offset) {
+    (void)be;
+    return compress_rw(DDRIVER_TRACE_READ, buf, size, offset);
+}
+
+static ssize_t compress_write(struct ddriver_backend *be, const char *buf, size_t size, off_t offset) {
+    (void)be;
+    return compress_rw(DDRIVER_TRACE_WRITE, (char *)buf, size, offset);
+}
+
+static int compress_discard(struct ddriver_backend *be, off_t offset, off_t len) {
+    (void)be;
+    return compress_rw(DDRIVER_TRACE_DISCARD, NULL, len, offset) < 0 ? -EIO : 0;
+}
+
+static int compress_ioctl(struct ddriver_backend *be, unsigned long cmd, void *arg) {
+    (void)be;
+    if (cmd != IOC_REQ_COMPRESS_STATE) {
+        return -ENOTTY;
+    }
+    pthread_mutex_lock(&cmp.lock);
+    fill_state((struct ddriver_compress_state *)arg);
+    pthread_mutex_unlock(&cmp.lock);
+    return 0;
+}
+
+static int compress_flush(struct ddriver_backend *be) {
+    int ret;
+    (void)be;
+
+    pthread_mutex_lock(&cmp.lock);
+    ret = cmp.dirty ? map_commit() : ddriver_image_flush(cmp.fd);   /* map_commit已同步镜像 */
+    pthread_mutex_unlock(&cmp.lock);
+    return ret;
+}
+
+static int compress_close(struct ddriver_backend *be) {
+    struct ddriver_compress_state state;
+    int ret;
+    (void)be;
+
+    pthread_mutex_lock(&cmp.lock);
+    cmp.stop = 1;
+    pthread_cond_signal(&cmp.kick);
+    pthread_mutex_unlock(&cmp.lock);
+    pthread_join(cmp.compactor, NULL);
+
+    fill_state(&state);
+    if (state.stored_bytes > 0 && state.io_us > 0) {
+        user_info("compress: ratio %.2f, %lld user / %lld media bytes, %.1f MB/s effective",
+                  (double)state.stored_blks * CMP_BLK_SZ / state.stored_bytes,
+                  state.user_bytes, state.media_bytes, (double)state.user_bytes / state.io_us);
+    }
+    ret = map_commit();
+    free(cmp.map);
+    free(cmp.segs);
+    cmp.map  = NULL;
+    cmp.segs = NULL;
+    if (close(cmp.fd) < 0 && ret == 0) {
+        ret = -errno;
+    }
+    return ret;
+}
+
+const struct ddriver_backend_ops ddriver_compress_ops = {
+    .name    = "compress",
+    .flags   = BACKEND_F_TRANSFER,
+    .open    = compress_open,
+    .read    = compress_read,
+    .write   = compress_write,
+    .ioctl   = compress_ioctl,
+    .discard = compress_discard,
+    .flush   = compress_flush,
+    .close   = compress_close,
+};
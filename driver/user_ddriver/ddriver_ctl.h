@@ -14,8 +14,131 @@ struct ddriver_state
     int seek_cnt;
 };
 
+struct ddriver_member_state                           /* 多成员后端（RAID）中单个成员的统计 */
+{
+    int       member;                                 /* 输入：成员编号 */
+    int       read_cnt;
+    int       write_cnt;
+    long long read_bytes;
+    long long write_bytes;
+    long long busy_us;
+};
+
+struct ddriver_discard_range                          /* 丢弃区间，需与IO单位对齐 */
+{
+    long long offset;
+    long long len;
+};
+
+#define DDRIVER_CLASS_HDD       0
+#define DDRIVER_CLASS_SSD       1
+#define DDRIVER_CLASS_NVME      2
+
+struct ddriver_geometry                               /* 磁道几何与延迟模型参数 */
+{
+    int track_size;                                   /* 每条磁道字节数 */
+    int track_num;
+    int iounit_size;
+    int read_lat_us;                                  /* 每次读固定延迟 */
+    int write_lat_us;                                 /* 每次写固定延迟 */
+    int rotate_us;                                    /* 磁头移动d字节耗时 (d % track_size) * rotate_us / track_size */
+    int dev_class;                                    /* DDRIVER_CLASS_* */
+    int channels;                                     /* 可并行服务的通道数 */
+    int queue_depth;                                  /* 最多同时在途请求数 */
+};
+
+struct ddriver_overlay_state                          /* overlay后端：增量中的块数 */
+{
+    int blk_size;
+    int nr_blks;
+    int allocated;
+};
+
+struct ddriver_overlay_snapshot                       /* overlay后端：导出合并后镜像的路径 */
+{
+    char path[256];
+};
+
+#define DDRIVER_ZONE_COND_NOT_WP    0               /* 常规区域，可随机写 */
+#define DDRIVER_ZONE_COND_EMPTY     1
+#define DDRIVER_ZONE_COND_OPEN      2
+#define DDRIVER_ZONE_COND_FULL      3
+#define DDRIVER_ZONE_REPORT_MAX     32
+
+struct ddriver_zone                                   /* 分区模式：单个区域 */
+{
+    long long start;
+    long long len;
+    long long wp;                                     /* 写指针，下一次写入必须从这里开始 */
+    int       cond;                                   /* DDRIVER_ZONE_COND_* */
+    int       pad;
+};
+
+struct ddriver_zone_report                            /* 分区模式：区域报告 */
+{
+    int                 start;                        /* 输入：起始区域编号 */
+    int                 nr_zones;                     /* 输出：本次返回的区域数 */
+    int                 total;                        /* 输出：设备区域总数 */
+    int                 pad;
+    struct ddriver_zone zones[DDRIVER_ZONE_REPORT_MAX];
+};
+
+#define DDRIVER_ACCOUNT_READ    0
+#define DDRIVER_ACCOUNT_WRITE   1
+#define DDRIVER_ACCOUNT_SEEK    2
+
+struct ddriver_account                                /* 绕过读写接口（内核设备mmap）完成的IO，用于计数 */
+{
+    long long offset;
+    long long len;
+    int       op;                                     /* DDRIVER_ACCOUNT_* */
+    int       pad;
+};
+
+#define DDRIVER_RABUF_OFF       0
+#define DDRIVER_RABUF_TRACK     1                     /* 未命中时缓存整条磁道 */
+#define DDRIVER_RABUF_AHEAD     2                     /* 未命中时缓存请求位置到磁道末尾 */
+
+struct ddriver_rabuf_state                            /* 磁道读缓冲（预读）统计 */
+{
+    int       policy;                                 /* DDRIVER_RABUF_* */
+    int       segments;                               /* 缓冲段数，每段一条磁道 */
+    int       track_size;
+    int       pad;
+    long long hits;                                   /* 完全由缓冲服务的读 */
+    long long misses;
+};
+
+struct ddriver_compress_state                         /* compress后端：压缩率与有效吞吐 */
+{
+    int       blk_size;                               /* 压缩单位（逻辑块）大小 */
+    int       nr_blks;
+    int       stored_blks;                            /* 非零逻辑块数，全零块不占空间 */
+    int       free_segs;                              /* 空闲日志段数 */
+    long long stored_bytes;                           /* 非零块压缩后的总字节数 */
+    long long image_bytes;                            /* 已占用日志段的总字节数（含待回收的旧版本） */
+    long long user_bytes;                             /* 读写的逻辑字节数 */
+    long long media_bytes;                            /* 实际读写镜像的字节数 */
+    long long io_us;                                  /* 后端读写耗时，有效吞吐 = user_bytes / io_us */
+    long long compact_moves;                          /* 后台整理搬移的块数 */
+};
+
 #define IOC_REQ_DEVICE_SIZE     _IOR(IOC_MAGIC, 0, int)
 #define IOC_REQ_DEVICE_STATE    _IOR(IOC_MAGIC, 1, struct ddriver_state)
 #define IOC_REQ_DEVICE_RESET    _IO(IOC_MAGIC, 2)
 #define IOC_REQ_DEVICE_IO_SZ    _IOR(IOC_MAGIC, 3, int)
+#define IOC_REQ_DEVICE_MEMBERS  _IOR(IOC_MAGIC, 4, int)
+#define IOC_REQ_DEVICE_MEMBER_STATE _IOWR(IOC_MAGIC, 5, struct ddriver_member_state)
+#define IOC_REQ_DEVICE_DISCARD  _IOW(IOC_MAGIC, 6, struct ddriver_discard_range)
+#define IOC_REQ_OVERLAY_STATE   _IOR(IOC_MAGIC, 7, struct ddriver_overlay_state)
+#define IOC_REQ_OVERLAY_SNAPSHOT _IOW(IOC_MAGIC, 8, struct ddriver_overlay_snapshot)
+#define IOC_REQ_OVERLAY_DISCARD _IO(IOC_MAGIC, 9)
+#define IOC_REQ_OVERLAY_COMMIT  _IO(IOC_MAGIC, 10)
+#define IOC_REQ_DEVICE_GEOMETRY _IOR(IOC_MAGIC, 11, struct ddriver_geometry)
+#define IOC_REQ_ZONE_REPORT     _IOWR(IOC_MAGIC, 12, struct ddriver_zone_report)
+#define IOC_REQ_ZONE_RESET      _IOW(IOC_MAGIC, 13, long long)
+#define IOC_REQ_DEVICE_ACCOUNT  _IOW(IOC_MAGIC, 14, struct ddriver_account)
+#define IOC_REQ_RABUF_STATE     _IOR(IOC_MAGIC, 15, struct ddriver_rabuf_state)
+#define IOC_REQ_DEVICE_FLUSH    _IO(IOC_MAGIC, 16)
+#define IOC_REQ_COMPRESS_STATE  _IOR(IOC_MAGIC, 17, struct ddriver_compress_state)
 #endif
\ No newline at end of file
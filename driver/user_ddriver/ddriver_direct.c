@@ -0,0 +1,219 @@
+#define _GNU_SOURCE
+#include "stdio.h"
+#include "stdlib.h"
+#include <unistd.h>
+#include <fcntl.h>
+#include "string.h"
+#include "errno.h"
+#include <stdint.h>
+#include <pthread.h>
+#include "ddriver_backend.h"
+/******************************************************************************
+* SECTION: Macro definitions
+*******************************************************************************/
+#define DIRECT_ALIGN            4096                  /* 宿主设备逻辑块大小未知时取4K，512B设备同样满足 */
+#define DIRECT_BUF_SZ           (128 * 1024)
+#define DIRECT_NR_BUFS          4
+
+#define ALIGN_DOWN(x, a)        ((x) / (a) * (a))
+#define ALIGN_UP(x, a)          (((x) + (a) - 1) / (a) * (a))
+#define IS_ALIGNED(x, a)        ((x) % (a) == 0)
+/******************************************************************************
+* SECTION: Type definitions
+*******************************************************************************/
+/*
+ * O_DIRECT要求缓冲区地址、长度、文件偏移都按宿主设备的块对齐。调用者的
+ * 缓冲区满足时直接读写；否则借用池中对齐的中转缓冲区，窗口两端不完整的
+ * 边界块先读出再合并写回（read-modify-write），大请求按缓冲区大小分片。
+ */
+struct direct
+{
+    int             enabled;
+    int             fdatasync;
+    int             align;
+    int             nr_free;
+    char           *bufs[DIRECT_NR_BUFS];
+    char           *free[DIRECT_NR_BUFS];
+    pthread_mutex_t lock;
+    pthread_cond_t  avail;
+};
+/******************************************************************************
+* SECTION: Global Variable
+*******************************************************************************/
+static struct direct direct = {
+    .lock  = PTHREAD_MUTEX_INITIALIZER,
+    .avail = PTHREAD_COND_INITIALIZER,
+};
+/******************************************************************************
+* SECTION: Helper Functions
+*******************************************************************************/
+static char* get_buf(void) {
+    char *buf;
+    pthread_mutex_lock(&direct.lock);
+    while (direct.nr_free == 0)
+        pthread_cond_wait(&direct.avail, &direct.lock);
+    buf = direct.free[--direct.nr_free];
+    pthread_mutex_unlock(&direct.lock);
+    return buf;
+}
+
+static void put_buf(char *buf) {
+    pthread_mutex_lock(&direct.lock);
+    direct.free[direct.nr_free++] = buf;
+    pthread_cond_signal(&direct.avail);
+    pthread_mutex_unlock(&direct.lock);
+}
+
+static int is_direct_ok(const void *buf, size_t size, off_t offset) {
+    return IS_ALIGNED((uintptr_t)buf, direct.align) && IS_ALIGNED(size, direct.align)
+        && IS_ALIGNED(offset, direct.align);
+}
+
+static ssize_t pread_full(int fd, char *buf, size_t size, off_t offset) {
+    ssize_t ret = pread(fd, buf, size, offset);
+    if (ret < 0)
+        return -errno;
+    if ((size_t)ret < size)                           /* 镜像末尾之外读回零 */
+        memset(buf + ret, 0, size - ret);
+    return size;
+}
+/******************************************************************************
+* SECTION: Direct I/O
+*******************************************************************************/
+/**
+ * @brief 读取直接I/O相关环境变量，开启时分配对齐的中转缓冲池（所有成员共享）
+ */
+int ddriver_direct_init(void) {
+    int i;
+
+    direct.enabled   = ddriver_env_int(ENV_DIRECT, 0);
+    direct.fdatasync = ddriver_env_int(ENV_FDATASYNC, 0);
+    direct.align     = ddriver_env_int(ENV_DIRECT_ALIGN, DIRECT_ALIGN);
+    if (!direct.enabled) {
+        return 0;
+    }
+    if (direct.align < 512 || (direct.align & (direct.align - 1)) || direct.align > DIRECT_BUF_SZ) {
+        user_alert("direct I/O alignment %d must be a power of 2 in [512, %d]", direct.align, DIRECT_BUF_SZ);
+        direct.enabled = 0;
+        return -EINVAL;
+    }
+    for (i = 0; i < DIRECT_NR_BUFS; i++) {
+        if (posix_memalign((void **)&direct.bufs[i], direct.align, DIRECT_BUF_SZ) != 0) {
+            ddriver_direct_release();
+            return -ENOMEM;
+        }
+        direct.free[i] = direct.bufs[i];
+    }
+    direct.nr_free = DIRECT_NR_BUFS;
+    user_info("direct I/O: %d byte alignment, %d x %d byte bounce buffers",
+              direct.align, DIRECT_NR_BUFS, DIRECT_BUF_SZ);
+    return 0;
+}
+
+void ddriver_direct_release(void) {
+    int i;
+    for (i = 0; i < DIRECT_NR_BUFS; i++) {
+        free(direct.bufs[i]);
+        direct.bufs[i] = NULL;
+    }
+    direct.nr_free = 0;
+    direct.enabled = 0;
+}
+
+int ddriver_direct_enabled(void) {
+    return direct.enabled;
+}
+
+/**
+ * @brief 打开镜像，直接I/O模式下设置O_DIRECT绕过宿主机页缓存
+ *
+ * @return int 文件描述符，失败返回负错误码
+ */
+int ddriver_open_direct(const char *path, off_t size) {
+    int fd = ddriver_open_image(path, size);
+
+    if (fd < 0 || !direct.enabled) {
+        return fd;
+    }
+    if (fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_DIRECT) < 0) {
+        user_alert("%s doesn't support O_DIRECT (%s), using page cache", path, strerror(errno));
+    }
+    return fd;
+}
+
+ssize_t ddriver_image_pread(int fd, char *buf, size_t size, off_t offset) {
+    off_t   lo, hi, start;
+    size_t  done = 0, len;
+    ssize_t ret = 0;
+    char   *bounce;
+
+    if (!direct.enabled || is_direct_ok(buf, size, offset)) {
+        ret = pread(fd, buf, size, offset);
+        return ret < 0 ? -errno : ret;
+    }
+    bounce = get_buf();
+    while (done < size) {
+        start = offset + done;
+        lo    = ALIGN_DOWN(start, direct.align);
+        len   = size - done;
+        if ((start - lo) + len > DIRECT_BUF_SZ)
+            len = DIRECT_BUF_SZ - (start - lo);
+        hi    = ALIGN_UP(start + (off_t)len, direct.align);
+        ret   = pread_full(fd, bounce, hi - lo, lo);
+        if (ret < 0)
+            break;
+        memcpy(buf + done, bounce + (start - lo), len);
+        done += len;
+    }
+    put_buf(bounce);
+    return ret < 0 ? ret : (ssize_t)size;
+}
+
+ssize_t ddriver_image_pwrite(int fd, const char *buf, size_t size, off_t offset) {
+    off_t   lo, hi, start, end;
+    size_t  done = 0, len;
+    ssize_t ret = 0;
+    int     head, tail;
+    char   *bounce;
+
+    if (!direct.enabled || is_direct_ok(buf, size, offset)) {
+        ret = pwrite(fd, buf, size, offset);
+        return ret < 0 ? -errno : ret;
+    }
+    bounce = get_buf();
+    while (done < size) {
+        start = offset + done;
+        lo    = ALIGN_DOWN(start, direct.align);
+        len   = size - done;
+        if ((start - lo) + len > DIRECT_BUF_SZ)
+            len = DIRECT_BUF_SZ - (start - lo);
+        end   = start + len;
+        hi    = ALIGN_UP(end, direct.align);
+        head  = lo < start;                           /* 边界块中不属于本次写入的部分要先读出 */
+        tail  = hi > end && !(head && hi - lo == direct.align);
+        if (head)
+            ret = pread_full(fd, bounce, direct.align, lo);
+        if (ret >= 0 && tail)
+            ret = pread_full(fd, bounce + (hi - direct.align - lo), direct.align, hi - direct.align);
+        if (ret < 0)
+            break;
+        memcpy(bounce + (start - lo), buf + done, len);
+        if (pwrite(fd, bounce, hi - lo, lo) < 0) {
+            ret = -errno;
+            break;
+        }
+        done += len;
+    }
+    put_buf(bounce);
+    return ret < 0 ? ret : (ssize_t)size;
+}
+
+/**
+ * @brief IOC_REQ_DEVICE_FLUSH：DDRIVER_FDATASYNC=1时把镜像数据落盘，否则立即返回
+ */
+int ddriver_image_flush(int fd) {
+    if (!direct.fdatasync) {
+        return 0;
+    }
+    return fdatasync(fd) < 0 ? -errno : 0;
+}
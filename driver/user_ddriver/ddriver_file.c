@@ -0,0 +1,58 @@
+#include "stdio.h"
+#include "stdlib.h"
+#include <unistd.h>
+#include <fcntl.h>
+#include "string.h"
+#include "errno.h"
+#include "ddriver_backend.h"
+/******************************************************************************
+* SECTION: File backend - 单个镜像文件（默认后端）
+*******************************************************************************/
+static int file_open(struct ddriver_backend *be, const char *path, int size) {
+    int fd = ddriver_open_direct(path, size);
+
+    if (fd < 0) {
+        return fd;
+    }
+    be->fd = fd;
+    return 0;
+}
+
+static ssize_t file_read(struct ddriver_backend *be, char *buf, size_t size, off_t offset) {
+    return ddriver_image_pread(be->fd, buf, size, offset);
+}
+
+static ssize_t file_write(struct ddriver_backend *be, const char *buf, size_t size, off_t offset) {
+    return ddriver_image_pwrite(be->fd, buf, size, offset);
+}
+
+static int file_discard(struct ddriver_backend *be, off_t offset, off_t len) {
+    return ddriver_punch_hole(be->fd, offset, len);
+}
+
+static int file_flush(struct ddriver_backend *be) {
+    return ddriver_image_flush(be->fd);
+}
+
+static int file_ioctl(struct ddriver_backend *be, unsigned long cmd, void *arg) {
+    (void)be;
+    (void)cmd;
+    (void)arg;
+    return -ENOTTY;
+}
+
+static int file_close(struct ddriver_backend *be) {
+    return close(be->fd);
+}
+
+const struct ddriver_backend_ops ddriver_file_ops = {
+    .name    = "file",
+    .flags   = 0,
+    .open    = file_open,
+    .read    = file_read,
+    .write   = file_write,
+    .ioctl   = file_ioctl,
+    .discard = file_discard,
+    .flush   = file_flush,
+    .close   = file_close,
+};
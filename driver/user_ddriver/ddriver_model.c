@@ -0,0 +1,301 @@
+#include "stdio.h"
+#include "stdlib.h"
+#include <unistd.h>
+#include "string.h"
+#include "errno.h"
+#include <time.h>
+#include <pthread.h>
+#include "ddriver_ctl.h"
+#include "ddriver_trace.h"
+#include "ddriver_backend.h"
+#include "ddriver_model.h"
+/******************************************************************************
+* SECTION: Macro definitions
+*******************************************************************************/
+#define MODEL_SPIN_US           200                   /* 短于该值的延迟忙等，usleep精度不够 */
+#define FLASH_MAX_CHANNELS      64
+/******************************************************************************
+* SECTION: Type definitions
+*******************************************************************************/
+struct hdd
+{
+    int read_lat;                                     /* ms */
+    int write_lat;                                    /* ms */
+    int seek_lat;                                     /* ms，转过一整条磁道 */
+    int track_num;
+    int bytes_per_track;
+    int iounit_size;
+};
+
+/*
+ * 闪存设备：请求按页分布到各通道 ((offset / page_size + i) % channels)，
+ * 每个通道维护忙碌截止时间，请求在所有涉及通道都完成时完成。
+ * 并发调用者之间同样按通道排队，超过队列深度的请求等待空位。
+ */
+struct flash
+{
+    int             read_us;
+    int             write_us;
+    int             page_size;
+    int             page_us;                          /* 单通道传输一页的时间 */
+    int             channels;
+    int             queue_depth;
+    int             iounit_size;
+    int             inflight;
+    uint64_t        busy_until[FLASH_MAX_CHANNELS];   /* ns */
+    pthread_mutex_t lock;
+    pthread_cond_t  slot;
+};
+/******************************************************************************
+* SECTION: Global Variable
+*******************************************************************************/
+/* reference: https://en.wikipedia.org/wiki/Hard_disk_drive_performance_characteristics */
+static struct hdd hdd = {
+    .read_lat  = 2,         /* 2ms */
+    .write_lat = 1,         /* 1ms */
+    .seek_lat  = 4,         /* 4.17ms per 360 degree */
+    .track_num = 100,
+};
+
+/* SATA SSD: 约550MB/s，8通道，NCQ深度32 */
+static struct flash ssd = {
+    .read_us     = 90,
+    .write_us    = 40,
+    .page_size   = 4096,
+    .page_us     = 60,
+    .channels    = 8,
+    .queue_depth = 32,
+    .lock        = PTHREAD_MUTEX_INITIALIZER,
+    .slot        = PTHREAD_COND_INITIALIZER,
+};
+
+/* NVMe: 微秒级延迟，16通道，深队列 */
+static struct flash nvme = {
+    .read_us     = 20,
+    .write_us    = 10,
+    .page_size   = 4096,
+    .page_us     = 4,
+    .channels    = 16,
+    .queue_depth = 1024,
+    .lock        = PTHREAD_MUTEX_INITIALIZER,
+    .slot        = PTHREAD_COND_INITIALIZER,
+};
+
+static int none_iounit;
+
+static const struct ddriver_model_ops *models[] = {
+    &ddriver_hdd_model,
+    &ddriver_ssd_model,
+    &ddriver_nvme_model,
+    &ddriver_none_model,
+};
+/******************************************************************************
+* SECTION: Helper Functions
+*******************************************************************************/
+void ddriver_delay_us(long us) {
+    struct timespec ts;
+    uint64_t deadline;
+
+    if (us <= 0) {
+        return;
+    }
+    if (us < MODEL_SPIN_US) {
+        deadline = ddriver_now_ns() + us * 1000ULL;
+        while (ddriver_now_ns() < deadline)
+            ;
+        return;
+    }
+    ts.tv_sec  = us / 1000000;
+    ts.tv_nsec = (us % 1000000) * 1000;
+    while (nanosleep(&ts, &ts) < 0 && errno == EINTR)
+        ;
+}
+
+const struct ddriver_model_ops* ddriver_find_model(const char *name) {
+    size_t i;
+    if (name == NULL || *name == '\0') {
+        return &ddriver_hdd_model;
+    }
+    for (i = 0; i < sizeof(models) / sizeof(models[0]); i++) {
+        if (strcmp(models[i]->name, name) == 0) {
+            return models[i];
+        }
+    }
+    return NULL;
+}
+/******************************************************************************
+* SECTION: HDD model - 单磁头旋转模型
+*******************************************************************************/
+static int hdd_init(int layout_size, int iounit_size) {
+    hdd.bytes_per_track = layout_size / hdd.track_num;
+    hdd.iounit_size     = iounit_size;
+    return 0;
+}
+
+static long hdd_position(off_t from, off_t to) {
+    long distance = labs(to - from) % hdd.bytes_per_track;
+    return distance * hdd.seek_lat * 1000 / hdd.bytes_per_track;
+}
+
+static long hdd_transfer(size_t size) {                /* 首个IO单位包含在读写延迟中 */
+    if (size <= (size_t)hdd.iounit_size) {
+        return 0;
+    }
+    return (size - hdd.iounit_size) * hdd.seek_lat * 1000LL / hdd.bytes_per_track;
+}
+
+static void hdd_access(int op, off_t offset, size_t size, int transfer) {
+    (void)offset;
+    ddriver_delay_us((op == DDRIVER_TRACE_READ ? hdd.read_lat : hdd.write_lat) * 1000L
+                     + (transfer ? hdd_transfer(size) : 0));
+}
+
+static void hdd_geometry(struct ddriver_geometry *geo) {
+    geo->track_size   = hdd.bytes_per_track;
+    geo->track_num    = hdd.track_num;
+    geo->iounit_size  = hdd.iounit_size;
+    geo->read_lat_us  = hdd.read_lat * 1000;
+    geo->write_lat_us = hdd.write_lat * 1000;
+    geo->rotate_us    = hdd.seek_lat * 1000;
+    geo->dev_class    = DDRIVER_CLASS_HDD;
+    geo->channels     = 1;
+    geo->queue_depth  = 1;
+}
+
+const struct ddriver_model_ops ddriver_hdd_model = {
+    .name      = "hdd",
+    .dev_class = DDRIVER_CLASS_HDD,
+    .init      = hdd_init,
+    .position  = hdd_position,
+    .access    = hdd_access,
+    .transfer  = hdd_transfer,
+    .geometry  = hdd_geometry,
+};
+/******************************************************************************
+* SECTION: Flash models - SATA SSD / NVMe，无定位开销，多通道并行
+*******************************************************************************/
+static int flash_init(struct flash *f, int iounit_size) {
+    f->channels    = ddriver_env_int(ENV_MODEL_CHANNELS, f->channels);
+    f->queue_depth = ddriver_env_int(ENV_MODEL_QDEPTH, f->queue_depth);
+    if (f->channels < 1 || f->channels > FLASH_MAX_CHANNELS || f->queue_depth < 1) {
+        user_alert("channels %d must be in [1, %d], queue depth %d must be positive",
+                   f->channels, FLASH_MAX_CHANNELS, f->queue_depth);
+        return -EINVAL;
+    }
+    f->iounit_size = iounit_size;
+    f->inflight    = 0;
+    memset(f->busy_until, 0, sizeof(f->busy_until));
+    return 0;
+}
+
+static long flash_position(off_t from, off_t to) {
+    (void)from;
+    (void)to;
+    return 0;
+}
+
+static long flash_transfer(struct flash *f, size_t size) {
+    long pages = (size + f->page_size - 1) / f->page_size;
+    return (pages + f->channels - 1) / f->channels * f->page_us;
+}
+
+static void flash_access(struct flash *f, int op, off_t offset, size_t size, int transfer) {
+    int      cnt[FLASH_MAX_CHANNELS] = {0};
+    long     pages = (size + f->page_size - 1) / f->page_size, i;
+    long     lat = op == DDRIVER_TRACE_READ ? f->read_us : f->write_us;
+    uint64_t now, start, end, done;
+    int      ch;
+
+    pthread_mutex_lock(&f->lock);
+    while (f->inflight >= f->queue_depth)
+        pthread_cond_wait(&f->slot, &f->lock);
+    f->inflight++;
+
+    for (i = 0; i < pages; i++) {
+        cnt[(offset / f->page_size + i) % f->channels]++;
+    }
+    now = done = ddriver_now_ns();
+    for (ch = 0; ch < f->channels; ch++) {
+        if (cnt[ch] == 0)
+            continue;
+        start = f->busy_until[ch] > now ? f->busy_until[ch] : now;
+        end   = start + (lat + (transfer ? cnt[ch] * f->page_us : 0)) * 1000ULL;
+        f->busy_until[ch] = end;
+        done  = end > done ? end : done;
+    }
+    pthread_mutex_unlock(&f->lock);
+
+    ddriver_delay_us((long)((done - now) / 1000));
+
+    pthread_mutex_lock(&f->lock);
+    f->inflight--;
+    pthread_cond_signal(&f->slot);
+    pthread_mutex_unlock(&f->lock);
+}
+
+static void flash_geometry(struct flash *f, int dev_class, struct ddriver_geometry *geo) {
+    geo->track_size   = 0;                            /* 无磁道，文件系统不必按磁道布局 */
+    geo->track_num    = 0;
+    geo->iounit_size  = f->iounit_size;
+    geo->read_lat_us  = f->read_us;
+    geo->write_lat_us = f->write_us;
+    geo->rotate_us    = 0;
+    geo->dev_class    = dev_class;
+    geo->channels     = f->channels;
+    geo->queue_depth  = f->queue_depth;
+}
+
+static int  ssd_init(int layout_size, int iounit_size) { (void)layout_size; return flash_init(&ssd, iounit_size); }
+static long ssd_transfer(size_t size) { return flash_transfer(&ssd, size); }
+static void ssd_access(int op, off_t offset, size_t size, int transfer) { flash_access(&ssd, op, offset, size, transfer); }
+static void ssd_geometry(struct ddriver_geometry *geo) { flash_geometry(&ssd, DDRIVER_CLASS_SSD, geo); }
+
+static int  nvme_init(int layout_size, int iounit_size) { (void)layout_size; return flash_init(&nvme, iounit_size); }
+static long nvme_transfer(size_t size) { return flash_transfer(&nvme, size); }
+static void nvme_access(int op, off_t offset, size_t size, int transfer) { flash_access(&nvme, op, offset, size, transfer); }
+static void nvme_geometry(struct ddriver_geometry *geo) { flash_geometry(&nvme, DDRIVER_CLASS_NVME, geo); }
+
+const struct ddriver_model_ops ddriver_ssd_model = {
+    .name      = "ssd",
+    .dev_class = DDRIVER_CLASS_SSD,
+    .init      = ssd_init,
+    .position  = flash_position,
+    .access    = ssd_access,
+    .transfer  = ssd_transfer,
+    .geometry  = ssd_geometry,
+};
+
+const struct ddriver_model_ops ddriver_nvme_model = {
+    .name      = "nvme",
+    .dev_class = DDRIVER_CLASS_NVME,
+    .init      = nvme_init,
+    .position  = flash_position,
+    .access    = nvme_access,
+    .transfer  = nvme_transfer,
+    .geometry  = nvme_geometry,
+};
+/******************************************************************************
+* SECTION: None model - 不模拟延迟，配合DDRIVER_DIRECT测量宿主设备本身
+*******************************************************************************/
+static int  none_init(int layout_size, int iounit_size) { (void)layout_size; none_iounit = iounit_size; return 0; }
+static long none_position(off_t from, off_t to) { (void)from; (void)to; return 0; }
+static void none_access(int op, off_t offset, size_t size, int transfer) { (void)op; (void)offset; (void)size; (void)transfer; }
+static long none_transfer(size_t size) { (void)size; return 0; }
+
+static void none_geometry(struct ddriver_geometry *geo) {
+    memset(geo, 0, sizeof(*geo));                     /* 无磁道，延迟未知 */
+    geo->iounit_size = none_iounit;
+    geo->dev_class   = DDRIVER_CLASS_SSD;
+    geo->channels    = 1;
+    geo->queue_depth = 1;
+}
+
+const struct ddriver_model_ops ddriver_none_model = {
+    .name      = "none",
+    .dev_class = DDRIVER_CLASS_SSD,
+    .init      = none_init,
+    .position  = none_position,
+    .access    = none_access,
+    .transfer  = none_transfer,
+    .geometry  = none_geometry,
+};
@@ -0,0 +1,47 @@
+#ifndef _DDRIVER_MODEL_H_
+#define _DDRIVER_MODEL_H_
+
+#include <sys/types.h>
+#include "ddriver_ctl.h"
+/******************************************************************************
+* SECTION: Macro definitions
+*******************************************************************************/
+#define ENV_MODEL               "DDRIVER_MODEL"       /* 延迟模型：hdd | ssd | nvme | none，默认hdd */
+#define ENV_MODEL_CHANNELS      "DDRIVER_CHANNELS"    /* 覆盖ssd / nvme的并行通道数 */
+#define ENV_MODEL_QDEPTH        "DDRIVER_QDEPTH"      /* 覆盖ssd / nvme的队列深度 */
+#define XATTR_MODEL             "user.ddriver.model"  /* 镜像文件上记录的延迟模型 */
+/******************************************************************************
+* SECTION: Latency model interface
+*******************************************************************************/
+/*
+ * 延迟模型只负责"花多少时间"，数据存取由后端完成：
+ *
+ * position: 磁头从from移动到to的耗时(us)，由调用者睡眠；无定位开销的设备返回0。
+ *           多磁头后端（RAID-1）也用它挑选成员。
+ * access:   模拟一次读写：排队、固定延迟与传输，返回时请求已"完成"。
+ *           transfer为0时不计传输时间（后端自行调用ddriver_emulate_transfer）。
+ * transfer: size字节的纯传输时间(us)。
+ * geometry: 填写IOC_REQ_DEVICE_GEOMETRY的返回值。
+ */
+struct ddriver_model_ops
+{
+    const char *name;
+    int         dev_class;                            /* DDRIVER_CLASS_* */
+    int   (*init)(int layout_size, int iounit_size);
+    long  (*position)(off_t from, off_t to);
+    void  (*access)(int op, off_t offset, size_t size, int transfer);
+    long  (*transfer)(size_t size);
+    void  (*geometry)(struct ddriver_geometry *geo);
+};
+
+extern const struct ddriver_model_ops ddriver_hdd_model;
+extern const struct ddriver_model_ops ddriver_ssd_model;
+extern const struct ddriver_model_ops ddriver_nvme_model;
+extern const struct ddriver_model_ops ddriver_none_model;
+/******************************************************************************
+* SECTION: ddriver_model.c
+*******************************************************************************/
+const struct ddriver_model_ops* ddriver_find_model(const char *name);
+void ddriver_delay_us(long us);
+
+#endif /* _DDRIVER_MODEL_H_ */
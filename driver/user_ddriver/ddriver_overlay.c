@@ -0,0 +1,363 @@
+#include "stdio.h"
+#include "stdlib.h"
+#include <unistd.h>
+#include <fcntl.h>
+#include "string.h"
+#include "errno.h"
+#include <stdint.h>
+#include <pthread.h>
+#include "ddriver_ctl.h"
+#include "ddriver_backend.h"
+/******************************************************************************
+* SECTION: Macro definitions
+*******************************************************************************/
+#define ENV_OVERLAY_BASE        "DDRIVER_BASE"        /* 只读底层镜像路径 */
+
+#define OVERLAY_MAP_SUFFIX      ".map"
+#define OVERLAY_MAP_MAGIC       0x564f4444            /* "DDOV" */
+#define OVERLAY_BLK_SZ          CONFIG_BLOCK_SZ       /* 分配粒度 = IO单位，写入无需copy-up */
+#define OVERLAY_COPY_SZ         (64 * 1024)
+
+#define BIT_TEST(map, i)        ((map)[(i) / 8] &  (1 << ((i) % 8)))
+#define BIT_SET(map, i)         ((map)[(i) / 8] |= (1 << ((i) % 8)))
+/******************************************************************************
+* SECTION: Type definitions
+*******************************************************************************/
+/*
+ * | base (只读) |  <- 未分配块从这里读
+ * | delta       |  <- 设备路径本身，稀疏文件，写入总是落在这里
+ * | delta.map   |  <- ddriver_overlay_map_hdr + 每块1 bit 的分配位图
+ *
+ * 丢弃增量只需截断delta并清空位图，与设备大小无关。
+ *
+ * 位图引用的块必须已在delta中：map_store先fdatasync增量，再经临时文件
+ * 原子替换位图；丢弃增量时先持久化清空的位图，再截断delta。
+ */
+struct ddriver_overlay_map_hdr
+{
+    uint32_t magic;
+    uint32_t blk_size;
+    uint32_t nr_blks;
+    uint32_t allocated;
+};
+
+struct overlay
+{
+    int             base_fd;
+    int             delta_fd;
+    int             size;
+    int             nr_blks;
+    int             allocated;
+    int             dirty;
+    uint8_t        *map;
+    char            base_path[256];
+    char            map_path[256];
+    pthread_mutex_t lock;
+};
+/******************************************************************************
+* SECTION: Global Variable
+*******************************************************************************/
+static struct overlay ovl = {
+    .base_fd  = -1,
+    .delta_fd = -1,
+    .lock     = PTHREAD_MUTEX_INITIALIZER,
+};
+/******************************************************************************
+* SECTION: Helper Functions
+*******************************************************************************/
+static int map_bytes(void) {
+    return (ovl.nr_blks + 7) / 8;
+}
+
+static void map_load(void) {
+    struct ddriver_overlay_map_hdr hdr;
+    int fd = open(ovl.map_path, O_RDONLY);
+
+    memset(ovl.map, 0, map_bytes());
+    ovl.allocated = 0;
+    if (fd < 0) {
+        return;
+    }
+    if (read(fd, &hdr, sizeof(hdr)) == sizeof(hdr) && hdr.magic == OVERLAY_MAP_MAGIC
+        && hdr.blk_size == OVERLAY_BLK_SZ && hdr.nr_blks == (uint32_t)ovl.nr_blks
+        && read(fd, ovl.map, map_bytes()) == map_bytes()) {
+        ovl.allocated = hdr.allocated;
+    }
+    else {
+        user_alert("overlay map %s mismatched, delta ignored", ovl.map_path);
+        memset(ovl.map, 0, map_bytes());
+    }
+    close(fd);
+}
+
+/**
+ * @brief 持久化分配位图；位图是否有效取决于增量，这里的fdatasync不受DDRIVER_FDATASYNC控制
+ */
+static int map_store(void) {
+    struct ddriver_overlay_map_hdr hdr;
+    int ret;
+
+    if (!ovl.dirty) {
+        return 0;
+    }
+    if (fdatasync(ovl.delta_fd) < 0) {
+        return -errno;
+    }
+    hdr.magic     = OVERLAY_MAP_MAGIC;
+    hdr.blk_size  = OVERLAY_BLK_SZ;
+    hdr.nr_blks   = ovl.nr_blks;
+    hdr.allocated = ovl.allocated;
+    ret = ddriver_store_meta(ovl.map_path, &hdr, sizeof(hdr), ovl.map, map_bytes());
+    if (ret < 0) {
+        user_alert("can't save overlay map %s: %s", ovl.map_path, strerror(-ret));
+        return ret;
+    }
+    ovl.dirty = 0;
+    return 0;
+}
+
+static ssize_t pread_zero(int fd, char *buf, size_t size, off_t offset) {
+    ssize_t ret = fd < 0 ? 0 : pread(fd, buf, size, offset);
+    if (ret < 0) {
+        return -errno;
+    }
+    if ((size_t)ret < size) {                         /* 超出底层镜像末尾的部分读为零 */
+        memset(buf + ret, 0, size - ret);
+    }
+    return size;
+}
+
+static int drop_delta(void) {
+    int ret;
+
+    memset(ovl.map, 0, map_bytes());
+    ovl.allocated = 0;
+    ovl.dirty     = 1;
+    ret = map_store();                                /* 空位图落盘后delta中的内容不再被引用 */
+    if (ret < 0) {
+        return ret;
+    }
+    if (ftruncate(ovl.delta_fd, 0) < 0 || ftruncate(ovl.delta_fd, ovl.size) < 0) {
+        return -errno;
+    }
+    return 0;
+}
+
+static int copy_merged(int dst_fd, int only_allocated) {
+    char   *buf = malloc(OVERLAY_COPY_SZ);
+    char   *zero = calloc(1, OVERLAY_COPY_SZ);
+    off_t   offset;
+    ssize_t ret = 0;
+    int     blk, nr, i, any;
+
+    for (offset = 0; offset < ovl.size && ret >= 0; offset += OVERLAY_COPY_SZ) {
+        blk = offset / OVERLAY_BLK_SZ;
+        nr  = OVERLAY_COPY_SZ / OVERLAY_BLK_SZ;
+        for (i = 0, any = 0; i < nr && blk + i < ovl.nr_blks; i++) {
+            any |= BIT_TEST(ovl.map, blk + i) ? 1 : 0;
+        }
+        if (only_allocated && !any) {
+            continue;
+        }
+        ret = pread_zero(ovl.base_fd, buf, OVERLAY_COPY_SZ, offset);
+        for (i = 0; i < nr && ret >= 0 && blk + i < ovl.nr_blks; i++) {
+            if (BIT_TEST(ovl.map, blk + i)) {
+                ret = pread_zero(ovl.delta_fd, buf + i * OVERLAY_BLK_SZ, OVERLAY_BLK_SZ,
+                                 offset + (off_t)i * OVERLAY_BLK_SZ);
+            }
+        }
+        if (ret >= 0 && (only_allocated || memcmp(buf, zero, OVERLAY_COPY_SZ) != 0)) {
+            ret = pwrite(dst_fd, buf, OVERLAY_COPY_SZ, offset);   /* 全零块跳过，保持稀疏 */
+            ret = ret < 0 ? -errno : ret;
+        }
+    }
+    free(buf);
+    free(zero);
+    return ret < 0 ? ret : 0;
+}
+/******************************************************************************
+* SECTION: Overlay backend - 只读底层镜像 + 稀疏写时复制增量
+*******************************************************************************/
+static int overlay_open(struct ddriver_backend *be, const char *path, int size) {
+    char *base = getenv(ENV_OVERLAY_BASE);
+
+    if (base == NULL || *base == '\0') {
+        user_panic("overlay backend needs " ENV_OVERLAY_BASE);
+        return -EINVAL;
+    }
+    snprintf(ovl.base_path, sizeof(ovl.base_path), "%s", base);
+    snprintf(ovl.map_path, sizeof(ovl.map_path), "%s" OVERLAY_MAP_SUFFIX, path);
+
+    ovl.base_fd = open(ovl.base_path, O_RDONLY);
+    if (ovl.base_fd < 0) {
+        user_panic("can't open overlay base %s: %s", ovl.base_path, strerror(errno));
+        return -errno;
+    }
+    ovl.delta_fd = ddriver_open_image(path, size);
+    if (ovl.delta_fd < 0) {
+        close(ovl.base_fd);
+        return ovl.delta_fd;
+    }
+    ovl.size    = size;
+    ovl.nr_blks = size / OVERLAY_BLK_SZ;
+    ovl.dirty   = 0;
+    ovl.map     = malloc(map_bytes());
+    if (ovl.map == NULL) {
+        close(ovl.delta_fd);
+        close(ovl.base_fd);
+        return -ENOMEM;
+    }
+    map_load();
+
+    be->fd   = ovl.delta_fd;
+    be->priv = &ovl;
+    user_info("overlay: base %s, %d/%d blocks in delta", ovl.base_path, ovl.allocated, ovl.nr_blks);
+    return 0;
+}
+
+static ssize_t overlay_read(struct ddriver_backend *be, char *buf, size_t size, off_t offset) {
+    int     blk = offset / OVERLAY_BLK_SZ, end = (offset + size) / OVERLAY_BLK_SZ, run;
+    int     in_delta;
+    ssize_t ret = 0;
+    (void)be;
+
+    pthread_mutex_lock(&ovl.lock);
+    while (blk < end && ret >= 0) {                   /* 按分配状态相同的连续块分段读取 */
+        in_delta = BIT_TEST(ovl.map, blk) ? 1 : 0;
+        for (run = 1; blk + run < end && (BIT_TEST(ovl.map, blk + run) ? 1 : 0) == in_delta; run++)
+            ;
+        ret = pread_zero(in_delta ? ovl.delta_fd : ovl.base_fd, buf, (size_t)run * OVERLAY_BLK_SZ,
+                         (off_t)blk * OVERLAY_BLK_SZ);
+        buf += (size_t)run * OVERLAY_BLK_SZ;
+        blk += run;
+    }
+    pthread_mutex_unlock(&ovl.lock);
+    return ret < 0 ? ret : (ssize_t)size;
+}
+
+static ssize_t overlay_write(struct ddriver_backend *be, const char *buf, size_t size, off_t offset) {
+    int     blk;
+    ssize_t ret;
+    (void)be;
+
+    pthread_mutex_lock(&ovl.lock);
+    ret = pwrite(ovl.delta_fd, buf, size, offset);
+    if (ret < 0) {
+        pthread_mutex_unlock(&ovl.lock);
+        return -errno;
+    }
+    for (blk = offset / OVERLAY_BLK_SZ; blk < (offset + (off_t)size) / OVERLAY_BLK_SZ; blk++) {
+        if (!BIT_TEST(ovl.map, blk)) {
+            BIT_SET(ovl.map, blk);
+            ovl.allocated++;
+            ovl.dirty = 1;
+        }
+    }
+    pthread_mutex_unlock(&ovl.lock);
+    return ret;
+}
+
+static int overlay_discard(struct ddriver_backend *be, off_t offset, off_t len) {
+    int blk, ret;
+    (void)be;
+
+    pthread_mutex_lock(&ovl.lock);                    /* 块仍标记在增量中，打洞后读回零而不是底层数据 */
+    ret = ddriver_punch_hole(ovl.delta_fd, offset, len);
+    for (blk = offset / OVERLAY_BLK_SZ; ret == 0 && blk < (offset + len) / OVERLAY_BLK_SZ; blk++) {
+        if (!BIT_TEST(ovl.map, blk)) {
+            BIT_SET(ovl.map, blk);
+            ovl.allocated++;
+            ovl.dirty = 1;
+        }
+    }
+    pthread_mutex_unlock(&ovl.lock);
+    return ret;
+}
+
+static int overlay_ioctl(struct ddriver_backend *be, unsigned long cmd, void *arg) {
+    struct ddriver_overlay_snapshot *snap;
+    struct ddriver_overlay_state    *state;
+    int fd, ret;
+    (void)be;
+
+    pthread_mutex_lock(&ovl.lock);
+    switch (cmd)
+    {
+    case IOC_REQ_OVERLAY_STATE:
+        state = (struct ddriver_overlay_state *)arg;
+        state->blk_size  = OVERLAY_BLK_SZ;
+        state->nr_blks   = ovl.nr_blks;
+        state->allocated = ovl.allocated;
+        ret = 0;
+        break;
+    case IOC_REQ_OVERLAY_DISCARD:                     /* 丢弃增量，设备回到底层镜像 */
+        ret = drop_delta();
+        break;
+    case IOC_REQ_OVERLAY_COMMIT:                      /* 增量写回底层镜像后丢弃 */
+        fd = open(ovl.base_path, O_RDWR);
+        if (fd < 0) {
+            ret = -errno;
+            break;
+        }
+        ret = copy_merged(fd, 1);
+        if (ret == 0 && fsync(fd) < 0)
+            ret = -errno;
+        close(fd);
+        if (ret == 0)
+            ret = drop_delta();
+        break;
+    case IOC_REQ_OVERLAY_SNAPSHOT:                    /* 导出当前设备内容为新的（稀疏）底层镜像 */
+        snap = (struct ddriver_overlay_snapshot *)arg;
+        fd = open(snap->path, O_CREAT | O_TRUNC | O_WRONLY, 0644);
+        if (fd < 0) {
+            ret = -errno;
+            break;
+        }
+        ret = ftruncate(fd, ovl.size) < 0 ? -errno : copy_merged(fd, 0);
+        if (ret == 0 && fsync(fd) < 0)
+            ret = -errno;
+        close(fd);
+        break;
+    default:
+        ret = -ENOTTY;
+        break;
+    }
+    pthread_mutex_unlock(&ovl.lock);
+    return ret;
+}
+
+static int overlay_flush(struct ddriver_backend *be) {
+    int ret;
+    (void)be;
+
+    pthread_mutex_lock(&ovl.lock);
+    ret = ovl.dirty ? map_store() : ddriver_image_flush(ovl.delta_fd);   /* map_store已同步增量 */
+    pthread_mutex_unlock(&ovl.lock);
+    return ret;
+}
+
+static int overlay_close(struct ddriver_backend *be) {
+    int ret;
+    (void)be;
+
+    ret = map_store();
+    free(ovl.map);
+    ovl.map = NULL;
+    close(ovl.base_fd);
+    if (close(ovl.delta_fd) < 0 && ret == 0) {
+        ret = -errno;
+    }
+    return ret;
+}
+
+const struct ddriver_backend_ops ddriver_overlay_ops = {
+    .name    = "overlay",
+    .flags   = 0,
+    .open    = overlay_open,
+    .read    = overlay_read,
+    .write   = overlay_write,
+    .ioctl   = overlay_ioctl,
+    .discard = overlay_discard,
+    .flush   = overlay_flush,
+    .close   = overlay_close,
+};
@@ -0,0 +1,174 @@
+#include "stdio.h"
+#include "stdlib.h"
+#include "string.h"
+#include "errno.h"
+#include <stdint.h>
+#include "ddriver_ctl.h"
+#include "ddriver_backend.h"
+#include "ddriver_rabuf.h"
+/******************************************************************************
+* SECTION: Type definitions
+*******************************************************************************/
+struct rabuf_seg
+{
+    long     track;                                   /* -1表示空闲 */
+    off_t    start;                                   /* 段内有效数据起点（AHEAD策略） */
+    uint64_t stamp;                                   /* LRU时间戳 */
+};
+
+struct rabuf
+{
+    int              policy;
+    int              nr_segs;
+    int              track_size;
+    uint64_t         clock;
+    long long        hits;
+    long long        misses;
+    struct rabuf_seg segs[RABUF_MAX_SEGS];
+};
+/******************************************************************************
+* SECTION: Global Variable
+*******************************************************************************/
+static struct rabuf rabuf;
+
+static const char *policy_names[] = { "off", "track", "ahead" };
+/******************************************************************************
+* SECTION: Helper Functions
+*******************************************************************************/
+static int parse_policy(const char *name) {
+    int i;
+    if (name == NULL || *name == '\0') {
+        return DDRIVER_RABUF_TRACK;
+    }
+    for (i = 0; i < (int)(sizeof(policy_names) / sizeof(policy_names[0])); i++) {
+        if (strcmp(policy_names[i], name) == 0) {
+            return i;
+        }
+    }
+    return -EINVAL;
+}
+
+static struct rabuf_seg* find_seg(long track) {
+    int i;
+    for (i = 0; i < rabuf.nr_segs; i++) {
+        if (rabuf.segs[i].track == track) {
+            return &rabuf.segs[i];
+        }
+    }
+    return NULL;
+}
+
+static struct rabuf_seg* victim_seg(void) {
+    struct rabuf_seg *victim = &rabuf.segs[0];
+    int i;
+    for (i = 1; i < rabuf.nr_segs; i++) {
+        if (rabuf.segs[i].stamp < victim->stamp) {
+            victim = &rabuf.segs[i];
+        }
+    }
+    return victim;
+}
+/******************************************************************************
+* SECTION: Track read buffer
+*******************************************************************************/
+int ddriver_rabuf_open(const struct ddriver_geometry *geo) {
+    memset(&rabuf, 0, sizeof(rabuf));
+    rabuf.policy  = parse_policy(getenv(ENV_RABUF));
+    rabuf.nr_segs = ddriver_env_int(ENV_RABUF_SEGS, RABUF_SEGS);
+    if (rabuf.policy < 0 || rabuf.nr_segs < 0 || rabuf.nr_segs > RABUF_MAX_SEGS) {
+        user_alert("read buffer policy must be track | ahead | off, segments in [0, %d]", RABUF_MAX_SEGS);
+        return -EINVAL;
+    }
+    if (geo->track_size <= 0 || rabuf.nr_segs == 0) {   /* 无磁道的设备不模拟 */
+        rabuf.policy = DDRIVER_RABUF_OFF;
+    }
+    if (rabuf.policy == DDRIVER_RABUF_OFF) {
+        rabuf.nr_segs = 0;
+        return 0;
+    }
+    rabuf.track_size = geo->track_size;
+    ddriver_rabuf_reset();
+    user_info("read buffer: %s, %d segment(s) of %d bytes",
+              policy_names[rabuf.policy], rabuf.nr_segs, rabuf.track_size);
+    return 0;
+}
+
+int ddriver_rabuf_enabled(void) {
+    return rabuf.policy != DDRIVER_RABUF_OFF;
+}
+
+/**
+ * @brief 查询[offset, offset + size)是否全部在缓冲中，并更新命中统计
+ *
+ * @return int 1命中，0未命中
+ */
+int ddriver_rabuf_lookup(off_t offset, size_t size) {
+    struct rabuf_seg *seg;
+    long track, last;
+
+    if (!ddriver_rabuf_enabled()) {
+        return 0;
+    }
+    last = (offset + size - 1) / rabuf.track_size;
+    for (track = offset / rabuf.track_size; track <= last; track++) {
+        seg = find_seg(track);
+        if (seg == NULL || (track == offset / rabuf.track_size && offset < seg->start)) {
+            rabuf.misses++;
+            return 0;
+        }
+    }
+    for (track = offset / rabuf.track_size; track <= last; track++) {
+        find_seg(track)->stamp = ++rabuf.clock;
+    }
+    rabuf.hits++;
+    return 1;
+}
+
+/**
+ * @brief 读未命中后，把请求经过的磁道读入缓冲
+ */
+void ddriver_rabuf_fill(off_t offset, size_t size) {
+    struct rabuf_seg *seg;
+    long track, first = offset / rabuf.track_size, last;
+
+    if (!ddriver_rabuf_enabled()) {
+        return;
+    }
+    last = (offset + size - 1) / rabuf.track_size;
+    for (track = first; track <= last; track++) {
+        seg = find_seg(track);
+        if (seg == NULL) {                            /* AHEAD只缓存请求位置之后的部分 */
+            seg = victim_seg();
+            seg->track = track;
+            seg->start = rabuf.policy == DDRIVER_RABUF_AHEAD && track == first
+                         ? offset : (off_t)track * rabuf.track_size;
+        } else if (track == first && offset < seg->start) {
+            seg->start = offset;
+        }
+        seg->stamp = ++rabuf.clock;
+    }
+}
+
+long ddriver_rabuf_hit_us(size_t size) {
+    return (size + RABUF_BYTES_PER_US - 1) / RABUF_BYTES_PER_US;
+}
+
+void ddriver_rabuf_reset(void) {
+    int i;
+    for (i = 0; i < rabuf.nr_segs; i++) {
+        rabuf.segs[i].track = -1;
+        rabuf.segs[i].start = 0;
+        rabuf.segs[i].stamp = 0;
+    }
+    rabuf.hits   = 0;
+    rabuf.misses = 0;
+}
+
+void ddriver_rabuf_state(struct ddriver_rabuf_state *state) {
+    state->policy     = rabuf.policy;
+    state->segments   = rabuf.nr_segs;
+    state->track_size = rabuf.track_size;
+    state->pad        = 0;
+    state->hits       = rabuf.hits;
+    state->misses     = rabuf.misses;
+}
@@ -0,0 +1,31 @@
+#ifndef _DDRIVER_RABUF_H_
+#define _DDRIVER_RABUF_H_
+
+#include <sys/types.h>
+#include "ddriver_ctl.h"
+/******************************************************************************
+* SECTION: Macro definitions
+*******************************************************************************/
+#define ENV_RABUF               "DDRIVER_RABUF"       /* 读缓冲策略：track | ahead | off，默认track */
+#define ENV_RABUF_SEGS          "DDRIVER_RABUF_SEGS"  /* 缓冲段数（每段一条磁道），默认4，0关闭 */
+#define RABUF_SEGS              4
+#define RABUF_MAX_SEGS          64
+#define RABUF_BYTES_PER_US      150                   /* 命中时按接口速率（约150MB/s）传输 */
+/******************************************************************************
+* SECTION: ddriver_rabuf.c
+*******************************************************************************/
+/*
+ * 模拟磁盘板载的磁道读缓冲：读未命中时照常定位、读取，同时把所在磁道
+ * 读入一个缓冲段（LRU替换）；之后落在已缓冲区间内的读不再移动磁头，
+ * 只付出接口传输时间。缓冲只影响计时，数据始终由后端提供；写为直写，
+ * 不使缓冲失效。只对有磁道的延迟模型（hdd）生效。
+ */
+int   ddriver_rabuf_open(const struct ddriver_geometry *geo);
+int   ddriver_rabuf_enabled(void);
+int   ddriver_rabuf_lookup(off_t offset, size_t size);
+void  ddriver_rabuf_fill(off_t offset, size_t size);
+long  ddriver_rabuf_hit_us(size_t size);
+void  ddriver_rabuf_reset(void);
+void  ddriver_rabuf_state(struct ddriver_rabuf_state *state);
+
+#endif /* _DDRIVER_RABUF_H_ */
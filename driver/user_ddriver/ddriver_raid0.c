@@ -0,0 +1,375 @@
+#include "stdio.h"
+#include "stdlib.h"
+#include <unistd.h>
+#include <fcntl.h>
+#include "string.h"
+#include "errno.h"
+#include <pthread.h>
+#include <sys/uio.h>
+#include "ddriver_ctl.h"
+#include "ddriver_trace.h"
+#include "ddriver_backend.h"
+/******************************************************************************
+* SECTION: Macro definitions
+*******************************************************************************/
+#define ENV_RAID_MEMBERS        "DDRIVER_MEMBERS"     /* 成员数，默认2 */
+#define ENV_RAID_STRIPE         "DDRIVER_STRIPE"      /* 条带单元字节数，默认4096 */
+
+#define RAID0_MAX_MEMBERS       16
+#define RAID0_DEFAULT_MEMBERS   2
+#define RAID0_DEFAULT_STRIPE    4096
+#define RAID0_MAX_IOV           64                    /* 单轮中每个成员最多处理的条带数 */
+
+#define RAID0_OP_READ           0
+#define RAID0_OP_WRITE          1
+/******************************************************************************
+* SECTION: Type definitions
+*******************************************************************************/
+/*
+ * 逻辑偏移L所在条带 s = L / stripe，落在成员 s % N 上，
+ * 成员内偏移为 (s / N) * stripe + L % stripe。
+ * 同一请求中落在同一成员的各个条带在成员内是连续的，
+ * 因此每个成员只需一次 preadv / pwritev。
+ */
+struct raid0_job
+{
+    int          op;
+    int          pending;
+    off_t        offset;                              /* 成员内起始偏移 */
+    size_t       bytes;
+    ssize_t      ret;
+    int          iovcnt;
+    struct iovec iov[RAID0_MAX_IOV];
+};
+
+struct raid0_member
+{
+    int                         fd;
+    pthread_t                   worker;
+    struct raid0_job            job;
+    struct ddriver_member_state stat;
+};
+
+struct raid0
+{
+    int                 nr_members;
+    int                 stripe;
+    off_t               member_size;
+    int                 outstanding;
+    int                 stop;
+    pthread_mutex_t     submit;                       /* 串行化逻辑请求 */
+    pthread_mutex_t     lock;
+    pthread_cond_t      kick;
+    pthread_cond_t      done;
+    struct raid0_member members[RAID0_MAX_MEMBERS];
+};
+/******************************************************************************
+* SECTION: Global Variable
+*******************************************************************************/
+static struct raid0 raid = {
+    .submit = PTHREAD_MUTEX_INITIALIZER,
+    .lock   = PTHREAD_MUTEX_INITIALIZER,
+    .kick   = PTHREAD_COND_INITIALIZER,
+    .done   = PTHREAD_COND_INITIALIZER,
+};
+/******************************************************************************
+* SECTION: Helper Functions
+*******************************************************************************/
+/*
+ * 直接I/O时各条带的缓冲区未必对齐，不能整体preadv/pwritev，
+ * 逐个条带交给ddriver_image_pread/pwrite，必要时借用对齐的中转缓冲区。
+ */
+static ssize_t raid0_direct_job(struct raid0_member *m) {
+    struct raid0_job *job = &m->job;
+    off_t   offset = job->offset;
+    ssize_t ret;
+    int     i;
+
+    for (i = 0; i < job->iovcnt; i++) {
+        if (job->op == RAID0_OP_READ)
+            ret = ddriver_image_pread(m->fd, job->iov[i].iov_base, job->iov[i].iov_len, offset);
+        else
+            ret = ddriver_image_pwrite(m->fd, job->iov[i].iov_base, job->iov[i].iov_len, offset);
+        if (ret < 0)
+            return ret;
+        if ((size_t)ret != job->iov[i].iov_len)
+            return -EIO;
+        offset += ret;
+    }
+    return job->bytes;
+}
+
+static void raid0_do_job(struct raid0_member *m) {
+    struct raid0_job *job = &m->job;
+    uint64_t start = ddriver_now_ns();
+
+    if (ddriver_direct_enabled()) {
+        job->ret = raid0_direct_job(m);
+    }
+    else {
+        if (job->op == RAID0_OP_READ) {
+            job->ret = preadv(m->fd, job->iov, job->iovcnt, job->offset);
+        }
+        else {
+            job->ret = pwritev(m->fd, job->iov, job->iovcnt, job->offset);
+        }
+        if (job->ret >= 0 && (size_t)job->ret != job->bytes) {
+            job->ret = -EIO;
+        }
+        else if (job->ret < 0) {
+            job->ret = -errno;
+        }
+    }
+    ddriver_emulate_transfer(job->bytes);
+
+    if (job->op == RAID0_OP_READ) {
+        m->stat.read_cnt++;
+        m->stat.read_bytes += job->bytes;
+    }
+    else {
+        m->stat.write_cnt++;
+        m->stat.write_bytes += job->bytes;
+    }
+    m->stat.busy_us += (ddriver_now_ns() - start) / 1000;
+}
+
+static void* raid0_worker(void *arg) {
+    struct raid0_member *m = arg;
+
+    pthread_mutex_lock(&raid.lock);
+    for (;;) {
+        while (!m->job.pending && !raid.stop)
+            pthread_cond_wait(&raid.kick, &raid.lock);
+        if (!m->job.pending)
+            break;
+        pthread_mutex_unlock(&raid.lock);
+
+        raid0_do_job(m);
+
+        pthread_mutex_lock(&raid.lock);
+        m->job.pending = 0;
+        if (--raid.outstanding == 0)
+            pthread_cond_signal(&raid.done);
+    }
+    pthread_mutex_unlock(&raid.lock);
+    return NULL;
+}
+
+static ssize_t raid0_rw(int op, char *buf, size_t size, off_t offset) {
+    struct raid0_member *m;
+    struct raid0_job    *job;
+    size_t  total = 0, chunk;
+    off_t   stripe_no, in_stripe;
+    int     i, touched, last = 0;
+    ssize_t ret = 0;
+
+    pthread_mutex_lock(&raid.submit);
+    while (size > 0 && ret >= 0) {
+        for (i = 0; i < raid.nr_members; i++) {
+            raid.members[i].job.iovcnt = 0;
+            raid.members[i].job.bytes  = 0;
+        }
+        touched = 0;
+
+        while (size > 0) {                            /* 组装一轮成员请求 */
+            stripe_no = offset / raid.stripe;
+            in_stripe = offset % raid.stripe;
+            i         = stripe_no % raid.nr_members;
+            job       = &raid.members[i].job;
+            if (job->iovcnt == RAID0_MAX_IOV)
+                break;
+            if (job->iovcnt == 0) {
+                job->op     = op;
+                job->offset = (stripe_no / raid.nr_members) * raid.stripe + in_stripe;
+                touched++;
+                last = i;
+            }
+            chunk = raid.stripe - in_stripe;
+            if (chunk > size)
+                chunk = size;
+            job->iov[job->iovcnt].iov_base = buf;
+            job->iov[job->iovcnt].iov_len  = chunk;
+            job->iovcnt++;
+            job->bytes += chunk;
+            buf    += chunk;
+            offset += chunk;
+            size   -= chunk;
+        }
+
+        if (touched == 1) {                           /* 单成员请求直接在调用线程完成 */
+            m = &raid.members[last];
+            raid0_do_job(m);
+            ret = m->job.ret;
+        }
+        else {
+            pthread_mutex_lock(&raid.lock);
+            for (i = 0; i < raid.nr_members; i++) {
+                if (raid.members[i].job.iovcnt > 0) {
+                    raid.members[i].job.pending = 1;
+                    raid.outstanding++;
+                }
+            }
+            pthread_cond_broadcast(&raid.kick);
+            while (raid.outstanding > 0)
+                pthread_cond_wait(&raid.done, &raid.lock);
+            pthread_mutex_unlock(&raid.lock);
+            for (i = 0; i < raid.nr_members; i++) {
+                if (raid.members[i].job.iovcnt > 0 && raid.members[i].job.ret < 0)
+                    ret = raid.members[i].job.ret;
+            }
+        }
+        for (i = 0; i < raid.nr_members && ret >= 0; i++) {
+            total += raid.members[i].job.bytes;
+        }
+    }
+    pthread_mutex_unlock(&raid.submit);
+    return ret < 0 ? ret : (ssize_t)total;
+}
+/******************************************************************************
+* SECTION: RAID-0 backend - 多个镜像文件 path.0 ... path.N-1 条带化为一个设备
+*******************************************************************************/
+static int raid0_open(struct ddriver_backend *be, const char *path, int size) {
+    char member_path[256];
+    int  i, fd, ret;
+
+    raid.nr_members = ddriver_env_int(ENV_RAID_MEMBERS, RAID0_DEFAULT_MEMBERS);
+    raid.stripe     = ddriver_env_int(ENV_RAID_STRIPE, RAID0_DEFAULT_STRIPE);
+    if (raid.nr_members < 1 || raid.nr_members > RAID0_MAX_MEMBERS) {
+        user_alert("raid0 members %d out of range [1, %d]", raid.nr_members, RAID0_MAX_MEMBERS);
+        return -EINVAL;
+    }
+    if (raid.stripe <= 0 || raid.stripe % CONFIG_BLOCK_SZ != 0) {
+        user_alert("raid0 stripe %d must be a multiple of %d", raid.stripe, CONFIG_BLOCK_SZ);
+        return -EINVAL;
+    }
+    raid.member_size = ((off_t)size + (off_t)raid.stripe * raid.nr_members - 1)
+                       / ((off_t)raid.stripe * raid.nr_members) * raid.stripe;
+    raid.stop        = 0;
+    raid.outstanding = 0;
+
+    for (i = 0; i < raid.nr_members; i++) {
+        snprintf(member_path, sizeof(member_path), "%s.%d", path, i);
+        fd = ddriver_open_direct(member_path, raid.member_size);
+        if (fd < 0) {
+            ret = fd;
+            goto err;
+        }
+        memset(&raid.members[i], 0, sizeof(struct raid0_member));
+        raid.members[i].fd          = fd;
+        raid.members[i].stat.member = i;
+        ret = pthread_create(&raid.members[i].worker, NULL, raid0_worker, &raid.members[i]);
+        if (ret != 0) {                               /* 已启动的成员由close回收 */
+            user_alert("raid0 member %d worker: %s", i, strerror(ret));
+            close(fd);
+            ret = -ret;
+            goto err;
+        }
+    }
+
+    be->fd   = raid.members[0].fd;
+    be->priv = &raid;
+    user_info("raid0: %d members, stripe %d, %ld bytes per member",
+              raid.nr_members, raid.stripe, (long)raid.member_size);
+    return 0;
+err:
+    raid.nr_members = i;
+    be->ops->close(be);
+    return ret;
+}
+
+static ssize_t raid0_read(struct ddriver_backend *be, char *buf, size_t size, off_t offset) {
+    (void)be;
+    return raid0_rw(RAID0_OP_READ, buf, size, offset);
+}
+
+static ssize_t raid0_write(struct ddriver_backend *be, const char *buf, size_t size, off_t offset) {
+    (void)be;
+    return raid0_rw(RAID0_OP_WRITE, (char *)buf, size, offset);
+}
+
+static int raid0_discard(struct ddriver_backend *be, off_t offset, off_t len) {
+    off_t start[RAID0_MAX_MEMBERS], end[RAID0_MAX_MEMBERS];
+    off_t stripe_no, in_stripe, moff, chunk;
+    int   i, ret = 0;
+    (void)be;
+
+    for (i = 0; i < raid.nr_members; i++) {
+        start[i] = end[i] = -1;
+    }
+    while (len > 0) {                                 /* 每个成员上对应的区间是连续的 */
+        stripe_no = offset / raid.stripe;
+        in_stripe = offset % raid.stripe;
+        i         = stripe_no % raid.nr_members;
+        moff      = (stripe_no / raid.nr_members) * raid.stripe + in_stripe;
+        chunk     = raid.stripe - in_stripe < len ? raid.stripe - in_stripe : len;
+        if (start[i] < 0)
+            start[i] = moff;
+        end[i]  = moff + chunk;
+        offset += chunk;
+        len    -= chunk;
+    }
+    pthread_mutex_lock(&raid.submit);
+    for (i = 0; i < raid.nr_members && ret == 0; i++) {
+        if (start[i] >= 0)
+            ret = ddriver_punch_hole(raid.members[i].fd, start[i], end[i] - start[i]);
+    }
+    pthread_mutex_unlock(&raid.submit);
+    return ret;
+}
+
+static int raid0_ioctl(struct ddriver_backend *be, unsigned long cmd, void *arg) {
+    struct ddriver_member_state *state;
+    (void)be;
+
+    switch (cmd)
+    {
+    case IOC_REQ_DEVICE_MEMBERS:
+        memcpy(arg, &raid.nr_members, sizeof(int));
+        return 0;
+    case IOC_REQ_DEVICE_MEMBER_STATE:
+        state = (struct ddriver_member_state *)arg;
+        if (state->member < 0 || state->member >= raid.nr_members)
+            return -EINVAL;
+        memcpy(state, &raid.members[state->member].stat, sizeof(struct ddriver_member_state));
+        return 0;
+    default:
+        return -ENOTTY;
+    }
+}
+
+static int raid0_flush(struct ddriver_backend *be) {
+    int i, ret = 0;
+    (void)be;
+
+    for (i = 0; i < raid.nr_members && ret == 0; i++) {
+        ret = ddriver_image_flush(raid.members[i].fd);
+    }
+    return ret;
+}
+
+static int raid0_close(struct ddriver_backend *be) {
+    int i;
+    (void)be;
+
+    pthread_mutex_lock(&raid.lock);
+    raid.stop = 1;
+    pthread_cond_broadcast(&raid.kick);
+    pthread_mutex_unlock(&raid.lock);
+    for (i = 0; i < raid.nr_members; i++) {
+        pthread_join(raid.members[i].worker, NULL);
+        close(raid.members[i].fd);
+    }
+    return 0;
+}
+
+const struct ddriver_backend_ops ddriver_raid0_ops = {
+    .name    = "raid0",
+    .flags   = BACKEND_F_TRANSFER,
+    .open    = raid0_open,
+    .read    = raid0_read,
+    .write   = raid0_write,
+    .ioctl   = raid0_ioctl,
+    .discard = raid0_discard,
+    .flush   = raid0_flush,
+    .close   = raid0_close,
+};
@@ -0,0 +1,221 @@
+#include "stdio.h"
+#include "stdlib.h"
+#include <unistd.h>
+#include <fcntl.h>
+#include "string.h"
+#include "errno.h"
+#include <pthread.h>
+#include "ddriver_ctl.h"
+#include "ddriver_trace.h"
+#include "ddriver_backend.h"
+/******************************************************************************
+* SECTION: Macro definitions
+*******************************************************************************/
+#define ENV_RAID_MEMBERS        "DDRIVER_MEMBERS"     /* 镜像成员数，默认2 */
+
+#define RAID1_MAX_MEMBERS       8
+#define RAID1_DEFAULT_MEMBERS   2
+/******************************************************************************
+* SECTION: Type definitions
+*******************************************************************************/
+/*
+ * 每个成员维护自己的模拟磁头位置：
+ *   读 - 选择定位耗时最短的成员（相同时选读次数少的），只移动该成员的磁头
+ *   写 - 写入所有成员，各成员并行定位，延迟取最远的那个，所有磁头随之移动
+ */
+struct raid1_member
+{
+    int                         fd;
+    off_t                       head;
+    struct ddriver_member_state stat;
+};
+
+struct raid1
+{
+    int                 nr_members;
+    int                 chosen;                       /* position()为下一次读选中的成员 */
+    pthread_mutex_t     lock;
+    struct raid1_member members[RAID1_MAX_MEMBERS];
+};
+/******************************************************************************
+* SECTION: Global Variable
+*******************************************************************************/
+static struct raid1 mirror = {
+    .lock = PTHREAD_MUTEX_INITIALIZER,
+};
+/******************************************************************************
+* SECTION: RAID-1 backend - 多个镜像文件 path.0 ... path.N-1 互为镜像
+*******************************************************************************/
+static int raid1_open(struct ddriver_backend *be, const char *path, int size) {
+    char member_path[256];
+    int  i, fd, ret;
+
+    mirror.nr_members = ddriver_env_int(ENV_RAID_MEMBERS, RAID1_DEFAULT_MEMBERS);
+    if (mirror.nr_members < 1 || mirror.nr_members > RAID1_MAX_MEMBERS) {
+        user_alert("raid1 members %d out of range [1, %d]", mirror.nr_members, RAID1_MAX_MEMBERS);
+        return -EINVAL;
+    }
+
+    for (i = 0; i < mirror.nr_members; i++) {
+        snprintf(member_path, sizeof(member_path), "%s.%d", path, i);
+        fd = ddriver_open_direct(member_path, size);
+        if (fd < 0) {
+            ret = fd;
+            goto err;
+        }
+        memset(&mirror.members[i], 0, sizeof(struct raid1_member));
+        mirror.members[i].fd          = fd;
+        mirror.members[i].stat.member = i;
+    }
+    mirror.chosen = 0;
+
+    be->fd   = mirror.members[0].fd;
+    be->priv = &mirror;
+    user_info("raid1: %d mirrors", mirror.nr_members);
+    return 0;
+err:
+    while (--i >= 0) {
+        close(mirror.members[i].fd);
+    }
+    return ret;
+}
+
+static off_t raid1_position(struct ddriver_backend *be, int op, off_t offset) {
+    struct raid1_member *m;
+    long  dist, best = -1;
+    off_t from = offset;
+    int   i;
+    (void)be;
+
+    pthread_mutex_lock(&mirror.lock);
+    for (i = 0; i < mirror.nr_members; i++) {
+        m    = &mirror.members[i];
+        dist = ddriver_position_us(m->head, offset);
+        if (op == DDRIVER_TRACE_READ) {
+            if (best < 0 || dist < best
+                || (dist == best && m->stat.read_cnt < mirror.members[mirror.chosen].stat.read_cnt)) {
+                best          = dist;
+                mirror.chosen = i;
+                from          = m->head;
+            }
+        }
+        else if (dist > best) {                       /* 写：所有成员并行定位，取最慢者 */
+            best = dist;
+            from = m->head;
+        }
+    }
+    pthread_mutex_unlock(&mirror.lock);
+    return from;
+}
+
+static ssize_t raid1_read(struct ddriver_backend *be, char *buf, size_t size, off_t offset) {
+    struct raid1_member *m;
+    uint64_t start = ddriver_now_ns();
+    ssize_t  ret;
+    (void)be;
+
+    pthread_mutex_lock(&mirror.lock);
+    m = &mirror.members[mirror.chosen];
+    pthread_mutex_unlock(&mirror.lock);
+
+    ret = ddriver_image_pread(m->fd, buf, size, offset);
+    if (ret < 0)
+        return ret;
+
+    pthread_mutex_lock(&mirror.lock);
+    m->head = offset + size;
+    m->stat.read_cnt++;
+    m->stat.read_bytes += size;
+    m->stat.busy_us    += (ddriver_now_ns() - start) / 1000;
+    pthread_mutex_unlock(&mirror.lock);
+    return ret;
+}
+
+static ssize_t raid1_write(struct ddriver_backend *be, const char *buf, size_t size, off_t offset) {
+    struct raid1_member *m;
+    uint64_t start;
+    ssize_t  ret;
+    int      i;
+    (void)be;
+
+    for (i = 0; i < mirror.nr_members; i++) {
+        m     = &mirror.members[i];
+        start = ddriver_now_ns();
+        ret   = ddriver_image_pwrite(m->fd, buf, size, offset);
+        if (ret < 0)
+            return ret;
+
+        pthread_mutex_lock(&mirror.lock);
+        m->head = offset + size;
+        m->stat.write_cnt++;
+        m->stat.write_bytes += size;
+        m->stat.busy_us     += (ddriver_now_ns() - start) / 1000;
+        pthread_mutex_unlock(&mirror.lock);
+    }
+    return size;
+}
+
+static int raid1_discard(struct ddriver_backend *be, off_t offset, off_t len) {
+    int i, ret = 0;
+    (void)be;
+
+    for (i = 0; i < mirror.nr_members && ret == 0; i++) {
+        ret = ddriver_punch_hole(mirror.members[i].fd, offset, len);
+    }
+    return ret;
+}
+
+static int raid1_ioctl(struct ddriver_backend *be, unsigned long cmd, void *arg) {
+    struct ddriver_member_state *state;
+    (void)be;
+
+    switch (cmd)
+    {
+    case IOC_REQ_DEVICE_MEMBERS:
+        memcpy(arg, &mirror.nr_members, sizeof(int));
+        return 0;
+    case IOC_REQ_DEVICE_MEMBER_STATE:
+        state = (struct ddriver_member_state *)arg;
+        if (state->member < 0 || state->member >= mirror.nr_members)
+            return -EINVAL;
+        pthread_mutex_lock(&mirror.lock);
+        memcpy(state, &mirror.members[state->member].stat, sizeof(struct ddriver_member_state));
+        pthread_mutex_unlock(&mirror.lock);
+        return 0;
+    default:
+        return -ENOTTY;
+    }
+}
+
+static int raid1_flush(struct ddriver_backend *be) {
+    int i, ret = 0;
+    (void)be;
+
+    for (i = 0; i < mirror.nr_members && ret == 0; i++) {
+        ret = ddriver_image_flush(mirror.members[i].fd);
+    }
+    return ret;
+}
+
+static int raid1_close(struct ddriver_backend *be) {
+    int i;
+    (void)be;
+
+    for (i = 0; i < mirror.nr_members; i++) {
+        close(mirror.members[i].fd);
+    }
+    return 0;
+}
+
+const struct ddriver_backend_ops ddriver_raid1_ops = {
+    .name     = "raid1",
+    .flags    = 0,
+    .open     = raid1_open,
+    .read     = raid1_read,
+    .write    = raid1_write,
+    .ioctl    = raid1_ioctl,
+    .discard  = raid1_discard,
+    .position = raid1_position,
+    .flush    = raid1_flush,
+    .close    = raid1_close,
+};
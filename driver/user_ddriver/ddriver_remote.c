@@ -0,0 +1,308 @@
+#include "stdio.h"
+#include "stdlib.h"
+#include <unistd.h>
+#include "string.h"
+#include "errno.h"
+#include <pthread.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include "ddriver_ctl.h"
+#include "ddriver_backend.h"
+#include "ddriver_remote.h"
+/******************************************************************************
+* SECTION: Type definitions
+*******************************************************************************/
+/*
+ * 写请求发出后立即返回，最多depth个写在途；读与ioctl发出后等待自己的响应，
+ * 途中收到的写确认顺带回收。在途写的首个错误记在deferred中，由下一次
+ * 读写或ioctl返回给调用者（与异步写回的块设备语义一致）。
+ */
+struct remote
+{
+    int             sock;
+    uint32_t        next_tag;
+    int             inflight;                         /* 已发送、未确认的写 */
+    int             depth;
+    int             deferred;
+    pthread_mutex_t lock;
+};
+/******************************************************************************
+* SECTION: Global Variable
+*******************************************************************************/
+static struct remote rmt = {
+    .sock = -1,
+    .lock = PTHREAD_MUTEX_INITIALIZER,
+};
+/******************************************************************************
+* SECTION: Protocol helpers（客户端与ddriver_server共用）
+*******************************************************************************/
+int ddriver_remote_send(int sock, const void *buf, size_t len) {
+    const char *p = buf;
+    ssize_t n;
+
+    while (len > 0) {
+        n = send(sock, p, len, MSG_NOSIGNAL);         /* 对端关闭时返回EPIPE而不是收到SIGPIPE */
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n <= 0)
+            return n < 0 ? -errno : -EPIPE;
+        p   += n;
+        len -= n;
+    }
+    return 0;
+}
+
+int ddriver_remote_recv(int sock, void *buf, size_t len) {
+    char *p = buf;
+    ssize_t n;
+
+    while (len > 0) {
+        n = recv(sock, p, len, 0);
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n <= 0)
+            return n < 0 ? -errno : -ECONNRESET;
+        p   += n;
+        len -= n;
+    }
+    return 0;
+}
+
+/**
+ * @brief 服务器socket路径：环境变量DDRIVER_SOCKET，否则为设备路径加.sock
+ */
+int ddriver_remote_path(char *path, size_t size, const char *device_path) {
+    char *env = getenv(ENV_REMOTE_SOCKET);
+    int   len;
+
+    if (env && *env)
+        len = snprintf(path, size, "%s", env);
+    else
+        len = snprintf(path, size, "%s" REMOTE_SOCK_SUFFIX, device_path);
+    if (len < 0 || (size_t)len >= size || (size_t)len >= sizeof(((struct sockaddr_un *)0)->sun_path)) {
+        return -ENAMETOOLONG;
+    }
+    return 0;
+}
+/******************************************************************************
+* SECTION: Helper Functions
+*******************************************************************************/
+static int remote_submit(uint32_t op, off_t offset, unsigned long cmd, const void *payload, uint32_t len,
+                         uint32_t *tag) {
+    struct ddriver_remote_req req = {
+        .magic  = REMOTE_MAGIC,
+        .tag    = rmt.next_tag++,
+        .op     = op,
+        .len    = len,
+        .offset = offset,
+        .cmd    = cmd,
+    };
+    int ret = ddriver_remote_send(rmt.sock, &req, sizeof(req));
+
+    if (ret == 0 && payload != NULL && len > 0)
+        ret = ddriver_remote_send(rmt.sock, payload, len);
+    *tag = req.tag;
+    return ret;
+}
+
+/**
+ * @brief 接收一个响应头。不是want的响应只可能是先前流水线写的确认，
+ *        计入inflight与deferred并丢弃其payload
+ *
+ * @param want 等待的tag，NULL表示只回收一个写确认
+ * @return int 1收到want，0回收了一个确认，连接出错返回负错误码
+ */
+static int remote_next(struct ddriver_remote_rsp *rsp, const uint32_t *want) {
+    char   drain[512];
+    size_t chunk;
+    int    ret = ddriver_remote_recv(rmt.sock, rsp, sizeof(*rsp));
+
+    if (ret < 0)
+        return ret;
+    if (rsp->magic != REMOTE_MAGIC)
+        return -EPROTO;
+    if (want != NULL && rsp->tag == *want)
+        return 1;
+    rmt.inflight--;
+    if (rsp->ret < 0 && rmt.deferred == 0)
+        rmt.deferred = rsp->ret;
+    for (; rsp->len > 0; rsp->len -= chunk) {
+        chunk = rsp->len < sizeof(drain) ? rsp->len : sizeof(drain);
+        if ((ret = ddriver_remote_recv(rmt.sock, drain, chunk)) < 0)
+            return ret;
+    }
+    return 0;
+}
+
+/**
+ * @brief 等待tag对应的响应，payload最多cap字节写入buf
+ *
+ * @return int 服务器返回值，连接出错返回负错误码
+ */
+static int remote_wait(uint32_t tag, void *buf, size_t cap) {
+    struct ddriver_remote_rsp rsp;
+    int ret;
+
+    while ((ret = remote_next(&rsp, &tag)) == 0)
+        ;
+    if (ret < 0)
+        return ret;
+    if (rsp.len > cap)
+        return -EPROTO;
+    if (rsp.len > 0 && (ret = ddriver_remote_recv(rmt.sock, buf, rsp.len)) < 0)
+        return ret;
+    return rsp.ret;
+}
+
+static int remote_reap(int limit) {                  /* 把在途写收敛到limit个以内 */
+    struct ddriver_remote_rsp rsp;
+    int ret;
+
+    while (rmt.inflight > limit) {
+        if ((ret = remote_next(&rsp, NULL)) < 0)
+            return ret;
+    }
+    return 0;
+}
+
+static int remote_take_deferred(void) {
+    int ret = rmt.deferred;
+    rmt.deferred = 0;
+    return ret;
+}
+
+static int remote_call(uint32_t op, off_t offset, unsigned long cmd, void *buf, uint32_t len,
+                       int send_payload) {
+    uint32_t tag;
+    int ret;
+
+    pthread_mutex_lock(&rmt.lock);
+    ret = remote_take_deferred();
+    if (ret == 0)
+        ret = remote_submit(op, offset, cmd, send_payload ? buf : NULL, len, &tag);
+    if (ret == 0)
+        ret = remote_wait(tag, buf, len);
+    pthread_mutex_unlock(&rmt.lock);
+    return ret;
+}
+/**
+ * @brief 区域追加写由服务器决定写入位置，ddriver_zone_append在远端后端时调用
+ *
+ * @return int 写入大小，失败返回负错误码
+ */
+int ddriver_remote_append(const char *buf, size_t size, off_t zone, off_t *written) {
+    int64_t  wp = 0;
+    uint32_t tag;
+    int      ret;
+
+    if (size > REMOTE_MAX_IO)
+        return -EINVAL;
+    pthread_mutex_lock(&rmt.lock);
+    ret = remote_take_deferred();
+    if (ret == 0)
+        ret = remote_submit(REMOTE_OP_APPEND, zone, 0, buf, size, &tag);
+    if (ret == 0)
+        ret = remote_wait(tag, &wp, sizeof(wp));
+    pthread_mutex_unlock(&rmt.lock);
+    if (ret >= 0 && written)
+        *written = wp;
+    return ret;
+}
+/******************************************************************************
+* SECTION: Remote backend - 设备在ddriver_server进程中
+*******************************************************************************/
+static int remote_open(struct ddriver_backend *be, const char *path, int size) {
+    struct sockaddr_un addr;
+    int dev_size = 0, ret;
+
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    ret = ddriver_remote_path(addr.sun_path, sizeof(addr.sun_path), path);
+    if (ret < 0) {
+        user_panic("socket path for %s too long", path);
+        return ret;
+    }
+    rmt.sock = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (rmt.sock < 0 || connect(rmt.sock, (struct sockaddr *)&addr, sizeof(addr)) < 0) {
+        ret = -errno;
+        user_panic("can't connect to ddriver_server at %s: %s", addr.sun_path, strerror(errno));
+        if (rmt.sock >= 0)
+            close(rmt.sock);
+        rmt.sock = -1;
+        return ret;
+    }
+    rmt.next_tag = 0;
+    rmt.inflight = 0;
+    rmt.deferred = 0;
+    rmt.depth    = ddriver_env_int(ENV_REMOTE_DEPTH, REMOTE_DEPTH);
+    if (rmt.depth < 0)
+        rmt.depth = 0;
+
+    be->fd = rmt.sock;
+    ret = remote_call(REMOTE_OP_IOCTL, 0, IOC_REQ_DEVICE_SIZE, &dev_size, sizeof(int), 1);
+    if (ret < 0 || dev_size != size) {
+        user_panic("server device size %d differs from %d", dev_size, size);
+        close(rmt.sock);
+        rmt.sock = -1;
+        return ret < 0 ? ret : -EINVAL;
+    }
+    user_info("remote: %s, pipeline depth %d", addr.sun_path, rmt.depth);
+    return 0;
+}
+
+static ssize_t remote_read(struct ddriver_backend *be, char *buf, size_t size, off_t offset) {
+    (void)be;
+    if (size > REMOTE_MAX_IO)
+        return -EINVAL;
+    return remote_call(REMOTE_OP_READ, offset, 0, buf, size, 0);
+}
+
+static ssize_t remote_write(struct ddriver_backend *be, const char *buf, size_t size, off_t offset) {
+    uint32_t tag;
+    int ret;
+
+    (void)be;
+    if (size > REMOTE_MAX_IO)
+        return -EINVAL;
+    pthread_mutex_lock(&rmt.lock);
+    ret = remote_take_deferred();
+    if (ret == 0)
+        ret = remote_submit(REMOTE_OP_WRITE, offset, 0, buf, size, &tag);
+    if (ret == 0) {
+        rmt.inflight++;
+        ret = remote_reap(rmt.depth);
+    }
+    pthread_mutex_unlock(&rmt.lock);
+    return ret < 0 ? ret : (ssize_t)size;
+}
+
+static int remote_ioctl(struct ddriver_backend *be, unsigned long cmd, void *arg) {
+    (void)be;
+    return remote_call(REMOTE_OP_IOCTL, 0, cmd, arg, _IOC_SIZE(cmd), 1); /* 全部命令由服务器处理 */
+}
+
+static int remote_close(struct ddriver_backend *be) {
+    int ret;
+
+    (void)be;
+    pthread_mutex_lock(&rmt.lock);
+    ret = remote_reap(0);
+    if (ret == 0)
+        ret = remote_take_deferred();
+    if (ret < 0)
+        user_alert("pipelined write failed: %s", strerror(-ret));
+    close(rmt.sock);
+    rmt.sock = -1;
+    pthread_mutex_unlock(&rmt.lock);
+    return ret;
+}
+
+const struct ddriver_backend_ops ddriver_remote_ops = {
+    .name    = "remote",
+    .flags   = BACKEND_F_REMOTE,
+    .open    = remote_open,
+    .read    = remote_read,
+    .write   = remote_write,
+    .ioctl   = remote_ioctl,
+    .close   = remote_close,
+};
@@ -0,0 +1,62 @@
+#ifndef _DDRIVER_REMOTE_H_
+#define _DDRIVER_REMOTE_H_
+
+#include <stdint.h>
+#include <sys/types.h>
+/******************************************************************************
+* SECTION: Macro definitions
+*******************************************************************************/
+#define ENV_REMOTE_SOCKET       "DDRIVER_SOCKET"      /* 块服务器socket路径，默认 ~/ddriver.sock */
+#define ENV_REMOTE_DEPTH        "DDRIVER_REMOTE_DEPTH" /* 客户端最多未确认的写请求数，默认32 */
+#define REMOTE_SOCK_SUFFIX      ".sock"
+#define REMOTE_DEPTH            32
+
+#define REMOTE_MAGIC            0x52444444            /* "DDDR" */
+#define REMOTE_MAX_IO           (4 * 1024 * 1024)     /* 单个请求的最大数据量 */
+
+#define REMOTE_OP_READ          0
+#define REMOTE_OP_WRITE         1
+#define REMOTE_OP_IOCTL         2
+#define REMOTE_OP_APPEND        3
+/******************************************************************************
+* SECTION: Wire protocol
+*******************************************************************************/
+/*
+ * 客户端 -> 服务器: | ddriver_remote_req | payload (len字节) |
+ * 服务器 -> 客户端: | ddriver_remote_rsp | payload (len字节) |
+ *
+ * READ:   请求无payload，len为读取字节数；响应payload为读出的数据
+ * WRITE:  请求payload为写入的数据；响应无payload
+ * IOCTL:  请求与响应的payload都是_IOC_SIZE(cmd)字节的参数
+ * APPEND: offset为区域起始，请求payload为数据；响应payload为int64写入偏移
+ *
+ * 每个请求都带绝对偏移，服务器对每个请求执行"seek + 读写"，多个客户端
+ * 交错访问时各自的磁头位置互不影响。客户端可以连续发送多个请求而不等待
+ * 响应（流水线），响应通过tag与请求对应；同一连接上的请求按发送顺序执行。
+ */
+struct ddriver_remote_req
+{
+    uint32_t magic;
+    uint32_t tag;
+    uint32_t op;                                      /* REMOTE_OP_* */
+    uint32_t len;                                     /* payload或读取的字节数 */
+    int64_t  offset;
+    uint64_t cmd;                                     /* IOCTL命令 */
+};
+
+struct ddriver_remote_rsp
+{
+    uint32_t magic;
+    uint32_t tag;
+    int32_t  ret;                                     /* 读写字节数或负错误码 */
+    uint32_t len;                                     /* payload字节数 */
+};
+/******************************************************************************
+* SECTION: ddriver_remote.c
+*******************************************************************************/
+int ddriver_remote_send(int sock, const void *buf, size_t len);
+int ddriver_remote_recv(int sock, void *buf, size_t len);
+int ddriver_remote_path(char *path, size_t size, const char *device_path);
+int ddriver_remote_append(const char *buf, size_t size, off_t zone, off_t *written);
+
+#endif /* _DDRIVER_REMOTE_H_ */
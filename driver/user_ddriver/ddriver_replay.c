@@ -0,0 +1,197 @@
+#include "stdio.h"
+#include "stdlib.h"
+#include "string.h"
+#include <unistd.h>
+#include <fcntl.h>
+#include <pwd.h>
+#include "errno.h"
+#include "include/ddriver.h"
+#include "ddriver_trace.h"
+/******************************************************************************
+* SECTION: Macro definitions
+*******************************************************************************/
+#define DEVICE_NAME   "ddriver"
+#define REPLAY_BATCH  256
+
+#define replay_panic(fmt, ...)\
+    do {\
+        fprintf(stderr, "PANIC: " fmt "\n", ##__VA_ARGS__);\
+    } while (0)\
+
+/******************************************************************************
+* SECTION: Type definitions
+*******************************************************************************/
+struct replay_stat
+{
+    uint64_t cnt;
+    uint64_t bytes;
+    uint64_t orig_us;                                 /* trace中记录的耗时 */
+    uint64_t replay_us;                               /* 本次重放的耗时 */
+};
+
+static const char *op_names[] = { "read", "write", "seek", "discard" };
+/******************************************************************************
+* SECTION: Helper Functions
+*******************************************************************************/
+static void usage(const char *prog) {
+    printf("用法: %s [-t] [-r] trace_file\n", prog);
+    printf("-t            按trace中的时间戳节奏重放（默认尽快重放）\n");
+    printf("-r            只重放读与seek，跳过写与discard（不破坏设备内容）\n");
+    printf("目标设备固定为 ~/" DEVICE_NAME "，后端与延迟模型由 libddriver 的环境变量决定，\n");
+    printf("trace不包含数据，写入内容为填充字节\n");
+}
+
+/**
+ * @brief 重放一条记录，读写按记录自身的offset定位
+ *
+ * 合并写在下发时才记录，可能排在之后的SEEK后面；-r跳过的写也不会移动磁头。
+ * head跟踪设备磁头，只有位置不一致时才补一次seek。
+ */
+static int replay_one(int fd, struct ddriver_trace_rec *rec, char *buf, off_t *head) {
+    struct ddriver_discard_range range;
+    int ret;
+
+    if ((rec->op == DDRIVER_TRACE_READ || rec->op == DDRIVER_TRACE_WRITE) && (off_t)rec->offset != *head) {
+        ret = ddriver_seek(fd, rec->offset, SEEK_SET);
+        if (ret < 0)
+            return ret;
+        *head = rec->offset;
+    }
+    switch (rec->op)
+    {
+    case DDRIVER_TRACE_SEEK:
+        ret = ddriver_seek(fd, rec->offset, SEEK_SET);
+        *head = rec->offset;
+        return ret < 0 ? ret : 0;
+    case DDRIVER_TRACE_READ:
+        ret = ddriver_read(fd, buf, rec->len);
+        *head += rec->len;
+        return ret < 0 ? ret : 0;
+    case DDRIVER_TRACE_WRITE:
+        ret = ddriver_write(fd, buf, rec->len);
+        *head += rec->len;
+        return ret < 0 ? ret : 0;
+    case DDRIVER_TRACE_DISCARD:
+        range.offset = rec->offset;
+        range.len    = rec->len;
+        return ddriver_ioctl(fd, IOC_REQ_DEVICE_DISCARD, &range);
+    default:
+        return -EINVAL;
+    }
+}
+/******************************************************************************
+* SECTION: Entry
+*******************************************************************************/
+int main(int argc, char **argv) {
+    struct ddriver_trace_hdr hdr;
+    struct ddriver_trace_rec recs[REPLAY_BATCH];
+    struct replay_stat       stats[4];
+    struct ddriver_state     state;
+    char   device_path[128]  = {0};
+    char  *buf;
+    int    paced = 0, readonly = 0, opt, tfd, fd, iounit, err = 0;
+    ssize_t n;
+    size_t have = 0;                                  /* recs中已读入的字节数 */
+    off_t  head = 0;                                  /* 打开后磁头在0 */
+    uint64_t base, start, now, i, total = 0, skipped = 0;
+
+    sprintf(device_path, "%s/" DEVICE_NAME, getpwuid(getuid())->pw_dir);
+    while ((opt = getopt(argc, argv, "trh")) != -1) {
+        switch (opt)
+        {
+        case 't': paced = 1; break;
+        case 'r': readonly = 1; break;
+        default:  usage(argv[0]); return opt == 'h' ? 0 : 1;
+        }
+    }
+    if (optind >= argc) {
+        usage(argv[0]);
+        return 1;
+    }
+
+    tfd = open(argv[optind], O_RDONLY);
+    if (tfd < 0) {
+        replay_panic("can't open trace %s: %s", argv[optind], strerror(errno));
+        return 1;
+    }
+    if (read(tfd, &hdr, sizeof(hdr)) != sizeof(hdr)
+        || memcmp(hdr.magic, DDRIVER_TRACE_MAGIC, sizeof(hdr.magic)) != 0
+        || hdr.rec_size != sizeof(struct ddriver_trace_rec)) {
+        replay_panic("%s is not a ddriver trace (version %d)", argv[optind], DDRIVER_TRACE_VERSION);
+        return 1;
+    }
+
+    fd = ddriver_open(device_path);
+    if (fd < 0) {
+        return 1;
+    }
+    ddriver_ioctl(fd, IOC_REQ_DEVICE_IO_SZ, &iounit);
+    if ((uint32_t)iounit != hdr.iounit_size) {
+        replay_panic("trace io unit %u differs from device %d", hdr.iounit_size, iounit);
+    }
+    buf = malloc(hdr.layout_size);                    /* 单个请求最多覆盖整个设备 */
+    if (buf == NULL) {
+        replay_panic("can't allocate %lu bytes", (unsigned long)hdr.layout_size);
+        ddriver_close(fd);
+        return 1;
+    }
+    memset(buf, 0xA5, hdr.layout_size);
+    memset(stats, 0, sizeof(stats));
+
+    base = ddriver_now_ns();
+    while ((n = read(tfd, (char *)recs + have, sizeof(recs) - have)) > 0) {
+        have += n;
+        for (i = 0; i < have / sizeof(struct ddriver_trace_rec); i++) {
+            struct ddriver_trace_rec *rec = &recs[i];
+            if (rec->op > DDRIVER_TRACE_DISCARD
+                || (readonly && (rec->op == DDRIVER_TRACE_WRITE || rec->op == DDRIVER_TRACE_DISCARD))) {
+                skipped++;
+                continue;
+            }
+            if (paced) {
+                now = ddriver_now_ns() - base;
+                if (rec->ts_ns > now)
+                    usleep((rec->ts_ns - now) / 1000);
+            }
+            start = ddriver_now_ns();
+            if (replay_one(fd, rec, buf, &head) < 0) {
+                replay_panic("replay failed at record %lu", (unsigned long)total);
+                ddriver_close(fd);
+                return 1;
+            }
+            stats[rec->op].cnt++;
+            stats[rec->op].bytes     += rec->len;
+            stats[rec->op].orig_us   += rec->lat_us;
+            stats[rec->op].replay_us += (ddriver_now_ns() - start) / 1000;
+            total++;
+        }
+        have %= sizeof(struct ddriver_trace_rec);     /* 不完整的记录留到下一次read补齐 */
+        memmove(recs, (char *)&recs[i], have);
+    }
+    now = ddriver_now_ns() - base;
+    if (n < 0) {
+        replay_panic("can't read trace: %s", strerror(errno));
+        err = 1;
+    } else if (have > 0) {
+        replay_panic("trace truncated: %lu trailing bytes after record %lu",
+                     (unsigned long)have, (unsigned long)(total + skipped));
+        err = 1;
+    }
+
+    printf("replayed %lu records (%lu skipped) in %.3f s\n",
+           (unsigned long)total, (unsigned long)skipped, now / 1e9);
+    printf("%-6s %10s %12s %14s %14s\n", "op", "count", "bytes", "orig_lat(us)", "replay_lat(us)");
+    for (i = 0; i < 4; i++) {
+        printf("%-6s %10lu %12lu %14lu %14lu\n", op_names[i],
+               (unsigned long)stats[i].cnt, (unsigned long)stats[i].bytes,
+               (unsigned long)stats[i].orig_us, (unsigned long)stats[i].replay_us);
+    }
+    ddriver_ioctl(fd, IOC_REQ_DEVICE_STATE, &state);
+    printf("device: read_cnt %d write_cnt %d seek_cnt %d\n",
+           state.read_cnt, state.write_cnt, state.seek_cnt);
+
+    free(buf);
+    close(tfd);
+    ddriver_close(fd);
+    return err;
+}
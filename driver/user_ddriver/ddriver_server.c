@@ -0,0 +1,270 @@
+#include "stdio.h"
+#include "stdlib.h"
+#include "string.h"
+#include <unistd.h>
+#include <pwd.h>
+#include <signal.h>
+#include <stdint.h>
+#include <pthread.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include "errno.h"
+#include "include/ddriver.h"
+#include "ddriver_remote.h"
+/******************************************************************************
+* SECTION: Macro definitions
+*******************************************************************************/
+#define DEVICE_NAME   "ddriver"
+#define SERVER_BACKLOG 16
+
+#define server_panic(fmt, ...)\
+    do {\
+        fprintf(stderr, "PANIC: " fmt "\n", ##__VA_ARGS__);\
+    } while (0)\
+
+/******************************************************************************
+* SECTION: Type definitions
+*******************************************************************************/
+/*
+ * 每个连接一个线程，按到达顺序执行该连接上的请求；设备只有一个磁头，
+ * 所有连接的请求在dev_lock下串行执行，磁头不在请求偏移处时先seek，
+ * 因此多个客户端交错访问时seek计数与延迟都如实反映。
+ */
+struct server
+{
+    int             dev_fd;
+    int             listen_fd;
+    off_t           head;                             /* 设备磁头位置，-1表示未知 */
+    int             clients;
+    uint64_t        ops[4];                           /* 按REMOTE_OP_*统计请求数 */
+    pthread_mutex_t dev_lock;
+};
+/******************************************************************************
+* SECTION: Global Variable
+*******************************************************************************/
+static struct server srv = {
+    .dev_fd    = -1,
+    .listen_fd = -1,
+    .head      = -1,
+    .dev_lock  = PTHREAD_MUTEX_INITIALIZER,
+};
+
+static volatile sig_atomic_t stopping = 0;
+
+static const char *op_names[] = { "read", "write", "ioctl", "append" };
+/******************************************************************************
+* SECTION: Helper Functions
+*******************************************************************************/
+static void usage(const char *prog) {
+    printf("用法: %s [-s socket] [-d device]\n", prog);
+    printf("-s socket     监听的Unix socket，默认 $" ENV_REMOTE_SOCKET " 或 设备路径" REMOTE_SOCK_SUFFIX "\n");
+    printf("-d device     服务的设备路径，默认 ~/" DEVICE_NAME "\n");
+    printf("后端、延迟模型与分区模式由服务器进程的 libddriver 环境变量决定，\n");
+    printf("客户端设置 DDRIVER_BACKEND=remote 即可通过本服务器访问设备\n");
+}
+
+static void on_signal(int sig) {
+    (void)sig;
+    stopping = 1;
+}
+
+static int seek_to(off_t offset) {
+    int ret;
+    if (srv.head == offset)
+        return 0;
+    ret = ddriver_seek(srv.dev_fd, offset, SEEK_SET);
+    srv.head = ret < 0 ? -1 : offset;
+    return ret < 0 ? ret : 0;
+}
+
+/**
+ * @brief 在设备上执行一个请求
+ *
+ * @param buf 请求payload，也用来存放响应payload
+ * @param rsp 填写ret与len
+ */
+static void execute(struct ddriver_remote_req *req, char *buf, struct ddriver_remote_rsp *rsp) {
+    off_t written = 0;
+    int64_t wp;
+    int ret;
+
+    rsp->len = 0;
+    pthread_mutex_lock(&srv.dev_lock);
+    srv.ops[req->op]++;
+    switch (req->op)
+    {
+    case REMOTE_OP_READ:
+        ret = seek_to(req->offset);
+        if (ret == 0)
+            ret = ddriver_read(srv.dev_fd, buf, req->len);
+        if (ret > 0) {
+            srv.head += ret;
+            rsp->len  = ret;
+        }
+        break;
+    case REMOTE_OP_WRITE:
+        ret = seek_to(req->offset);
+        if (ret == 0)
+            ret = ddriver_write(srv.dev_fd, buf, req->len);
+        if (ret > 0)
+            srv.head += ret;
+        break;
+    case REMOTE_OP_IOCTL:
+        ret = ddriver_ioctl(srv.dev_fd, req->cmd, buf);
+        rsp->len = req->len;
+        srv.head = -1;                                /* RESET等命令会移动磁头 */
+        break;
+    case REMOTE_OP_APPEND:
+        ret = ddriver_zone_append(srv.dev_fd, buf, req->len, req->offset, &written);
+        wp  = written;
+        memcpy(buf, &wp, sizeof(wp));
+        rsp->len = sizeof(wp);
+        srv.head = ret > 0 ? written + ret : -1;
+        break;
+    default:
+        ret = -EINVAL;
+        break;
+    }
+    pthread_mutex_unlock(&srv.dev_lock);
+    rsp->ret = ret;
+}
+
+static int check_request(struct ddriver_remote_req *req) {
+    if (req->magic != REMOTE_MAGIC || req->op > REMOTE_OP_APPEND || req->len > REMOTE_MAX_IO)
+        return -EPROTO;
+    if (req->op == REMOTE_OP_IOCTL && req->len != _IOC_SIZE(req->cmd))
+        return -EPROTO;
+    return 0;
+}
+
+static void* serve_client(void *arg) {
+    struct ddriver_remote_req req;
+    struct ddriver_remote_rsp rsp;
+    int   sock = (int)(intptr_t)arg;
+    char *buf  = malloc(REMOTE_MAX_IO);
+
+    while (buf && ddriver_remote_recv(sock, &req, sizeof(req)) == 0) {
+        if (check_request(&req) < 0) {
+            server_panic("bad request from client %d, closing", sock);
+            break;
+        }
+        if (req.op != REMOTE_OP_READ && req.len > 0 && ddriver_remote_recv(sock, buf, req.len) < 0)
+            break;
+        execute(&req, buf, &rsp);
+        rsp.magic = REMOTE_MAGIC;
+        rsp.tag   = req.tag;
+        if (ddriver_remote_send(sock, &rsp, sizeof(rsp)) < 0
+            || (rsp.len > 0 && ddriver_remote_send(sock, buf, rsp.len) < 0))
+            break;
+    }
+    pthread_mutex_lock(&srv.dev_lock);
+    srv.clients--;
+    pthread_mutex_unlock(&srv.dev_lock);
+    printf("client %d disconnected\n", sock);
+    free(buf);
+    close(sock);
+    return NULL;
+}
+
+static int listen_on(const char *path) {
+    struct sockaddr_un addr;
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+
+    if (fd < 0)
+        return -errno;
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    snprintf(addr.sun_path, sizeof(addr.sun_path), "%s", path);
+    unlink(path);                                     /* 上次异常退出留下的socket文件 */
+    if (bind(fd, (struct sockaddr *)&addr, sizeof(addr)) < 0 || listen(fd, SERVER_BACKLOG) < 0) {
+        close(fd);
+        return -errno;
+    }
+    return fd;
+}
+/******************************************************************************
+* SECTION: Entry
+*******************************************************************************/
+int main(int argc, char **argv) {
+    struct sigaction    sa;
+    struct ddriver_state state;
+    sigset_t  block, old;
+    pthread_t tid;
+    char  device_path[128] = {0};
+    char  sock_path[108]   = {0};
+    char *backend = getenv("DDRIVER_BACKEND");
+    int   opt, sock, i;
+
+    sprintf(device_path, "%s/" DEVICE_NAME, getpwuid(getuid())->pw_dir);
+    while ((opt = getopt(argc, argv, "s:d:h")) != -1) {
+        switch (opt)
+        {
+        case 's': snprintf(sock_path, sizeof(sock_path), "%s", optarg); break;
+        case 'd': snprintf(device_path, sizeof(device_path), "%s", optarg); break;
+        default:  usage(argv[0]); return opt == 'h' ? 0 : 1;
+        }
+    }
+    if (sock_path[0] == '\0' && ddriver_remote_path(sock_path, sizeof(sock_path), device_path) < 0) {
+        server_panic("socket path too long");
+        return 1;
+    }
+    if (backend && strcmp(backend, "remote") == 0) {
+        server_panic("server can't use the remote backend itself");
+        return 1;
+    }
+
+    srv.dev_fd = ddriver_open(device_path);
+    if (srv.dev_fd < 0) {
+        return 1;
+    }
+    srv.listen_fd = listen_on(sock_path);
+    if (srv.listen_fd < 0) {
+        server_panic("can't listen on %s: %s", sock_path, strerror(-srv.listen_fd));
+        ddriver_close(srv.dev_fd);
+        return 1;
+    }
+
+    memset(&sa, 0, sizeof(sa));
+    sa.sa_handler = on_signal;                        /* 不设SA_RESTART，accept被打断后退出 */
+    sigaction(SIGINT, &sa, NULL);
+    sigaction(SIGTERM, &sa, NULL);
+    sigemptyset(&block);
+    sigaddset(&block, SIGINT);
+    sigaddset(&block, SIGTERM);
+    printf("serving %s on %s\n", device_path, sock_path);
+
+    while (!stopping) {
+        sock = accept(srv.listen_fd, NULL, NULL);
+        if (sock < 0) {
+            if (errno != EINTR)
+                server_panic("accept: %s", strerror(errno));
+            continue;
+        }
+        pthread_mutex_lock(&srv.dev_lock);
+        srv.clients++;
+        pthread_mutex_unlock(&srv.dev_lock);
+        printf("client %d connected\n", sock);
+
+        pthread_sigmask(SIG_BLOCK, &block, &old);     /* 信号只由主线程处理 */
+        if (pthread_create(&tid, NULL, serve_client, (void *)(intptr_t)sock) != 0) {
+            server_panic("can't start client thread");
+            close(sock);
+        } else {
+            pthread_detach(tid);
+        }
+        pthread_sigmask(SIG_SETMASK, &old, NULL);
+    }
+
+    close(srv.listen_fd);
+    unlink(sock_path);
+    pthread_mutex_lock(&srv.dev_lock);               /* 等待执行中的请求结束，之后不再释放 */
+    printf("shutting down, %d client(s) still connected\n", srv.clients);
+    for (i = 0; i < 4; i++) {
+        printf("%-6s %10lu\n", op_names[i], (unsigned long)srv.ops[i]);
+    }
+    ddriver_ioctl(srv.dev_fd, IOC_REQ_DEVICE_STATE, &state);
+    printf("device: read_cnt %d write_cnt %d seek_cnt %d\n",
+           state.read_cnt, state.write_cnt, state.seek_cnt);
+    ddriver_close(srv.dev_fd);
+    return 0;
+}
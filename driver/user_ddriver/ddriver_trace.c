@@ -0,0 +1,207 @@
+#include "stdio.h"
+#include "stdlib.h"
+#include "string.h"
+#include <unistd.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <time.h>
+#include "errno.h"
+#include "ddriver_trace.h"
+/******************************************************************************
+* SECTION: Type definitions
+*******************************************************************************/
+/*
+ * 单生产者多线程安全的环形缓冲区:
+ *   head - 下一条记录写入位置 (生产者推进)
+ *   tail - 尚未落盘的第一条记录 (flusher推进)
+ * flusher只在[tail, head)上工作，生产者只写[head, tail + RING)，
+ * 因此写文件时无需持锁。
+ */
+struct ddriver_tracer
+{
+    int                      fd;
+    int                      enabled;
+    int                      stop;
+    uint64_t                 base_ns;
+    uint64_t                 head;
+    uint64_t                 tail;
+    uint64_t                 stalls;                  /* 环满导致的生产者等待次数 */
+    int                      err;                     /* 第一次落盘失败的-errno，之后的记录丢弃 */
+    pthread_t                flusher;
+    pthread_mutex_t          lock;
+    pthread_cond_t           not_empty;
+    pthread_cond_t           not_full;
+    struct ddriver_trace_rec ring[DDRIVER_TRACE_RING];
+};
+/******************************************************************************
+* SECTION: Global Variable
+*******************************************************************************/
+static struct ddriver_tracer tracer = {
+    .fd        = -1,
+    .enabled   = 0,
+    .lock      = PTHREAD_MUTEX_INITIALIZER,
+    .not_empty = PTHREAD_COND_INITIALIZER,
+    .not_full  = PTHREAD_COND_INITIALIZER,
+};
+/******************************************************************************
+* SECTION: Helper Functions
+*******************************************************************************/
+uint64_t ddriver_now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+static int write_full(int fd, const void *buf, size_t size) {
+    const char *cur = buf;
+    while (size > 0) {
+        ssize_t n = write(fd, cur, size);
+        if (n < 0) {
+            if (errno == EINTR)
+                continue;
+            return -errno;
+        }
+        cur  += n;
+        size -= n;
+    }
+    return 0;
+}
+
+static void* trace_flusher(void *arg) {
+    uint64_t head, tail, idx, n;
+    (void)arg;
+
+    pthread_mutex_lock(&tracer.lock);
+    for (;;) {
+        while (!tracer.stop && tracer.head - tracer.tail < DDRIVER_TRACE_RING / 2)
+            pthread_cond_wait(&tracer.not_empty, &tracer.lock);
+        head = tracer.head;
+        tail = tracer.tail;
+        if (head == tail && tracer.stop)
+            break;
+        pthread_mutex_unlock(&tracer.lock);
+
+        while (tail != head) {                        /* 环可能回绕，最多分两段写 */
+            idx = tail % DDRIVER_TRACE_RING;
+            n   = head - tail;
+            if (idx + n > DDRIVER_TRACE_RING)
+                n = DDRIVER_TRACE_RING - idx;
+            if (tracer.err == 0)                      /* 只由flusher写，出错后仍推进tail，生产者不会卡住 */
+                tracer.err = write_full(tracer.fd, &tracer.ring[idx], n * sizeof(struct ddriver_trace_rec));
+            tail += n;
+        }
+
+        pthread_mutex_lock(&tracer.lock);
+        tracer.tail = tail;
+        pthread_cond_broadcast(&tracer.not_full);
+    }
+    pthread_mutex_unlock(&tracer.lock);
+    return NULL;
+}
+/******************************************************************************
+* SECTION: Global Function Implementation
+*******************************************************************************/
+/**
+ * @brief 开启二进制trace，记录写入环形缓冲区，由后台线程批量落盘
+ *
+ * @param path trace文件路径
+ * @param iounit_size 设备IO单位
+ * @param layout_size 设备大小
+ * @return int 0成功，否则失败
+ */
+int ddriver_trace_open(const char *path, int iounit_size, int layout_size) {
+    struct ddriver_trace_hdr hdr;
+
+    if (tracer.enabled)
+        return 0;
+
+    tracer.fd = open(path, O_CREAT | O_TRUNC | O_WRONLY, 0644);
+    if (tracer.fd < 0)
+        return -errno;
+
+    memset(&hdr, 0, sizeof(hdr));
+    memcpy(hdr.magic, DDRIVER_TRACE_MAGIC, sizeof(hdr.magic));
+    hdr.version     = DDRIVER_TRACE_VERSION;
+    hdr.rec_size    = sizeof(struct ddriver_trace_rec);
+    hdr.iounit_size = iounit_size;
+    hdr.layout_size = layout_size;
+    if (write_full(tracer.fd, &hdr, sizeof(hdr)) < 0) {
+        close(tracer.fd);
+        tracer.fd = -1;
+        return -EIO;
+    }
+
+    tracer.head    = 0;
+    tracer.tail    = 0;
+    tracer.stalls  = 0;
+    tracer.err     = 0;
+    tracer.stop    = 0;
+    tracer.base_ns = ddriver_now_ns();
+    if (pthread_create(&tracer.flusher, NULL, trace_flusher, NULL) != 0) {
+        close(tracer.fd);
+        tracer.fd = -1;
+        return -EAGAIN;
+    }
+    tracer.enabled = 1;
+    return 0;
+}
+/**
+ * @brief 追加一条trace记录
+ *
+ * @param op enum ddriver_trace_op
+ * @param offset 操作开始时的磁头位置
+ * @param len 字节数
+ * @param start_ns 操作开始时刻 (ddriver_now_ns)
+ */
+void ddriver_trace_log(int op, off_t offset, size_t len, uint64_t start_ns) {
+    struct ddriver_trace_rec *rec;
+    uint64_t now;
+
+    if (!tracer.enabled)
+        return;
+
+    now = ddriver_now_ns();
+    pthread_mutex_lock(&tracer.lock);
+    if (tracer.head - tracer.tail == DDRIVER_TRACE_RING) {
+        tracer.stalls++;
+        pthread_cond_signal(&tracer.not_empty);
+        while (tracer.head - tracer.tail == DDRIVER_TRACE_RING)
+            pthread_cond_wait(&tracer.not_full, &tracer.lock);
+    }
+    rec = &tracer.ring[tracer.head % DDRIVER_TRACE_RING];
+    rec->ts_ns  = start_ns - tracer.base_ns;
+    rec->offset = offset;
+    rec->len    = len;
+    rec->lat_us = (now - start_ns) / 1000;
+    rec->op     = op;
+    memset(rec->pad, 0, sizeof(rec->pad));
+    tracer.head++;
+    if (tracer.head - tracer.tail >= DDRIVER_TRACE_RING / 2)
+        pthread_cond_signal(&tracer.not_empty);
+    pthread_mutex_unlock(&tracer.lock);
+}
+/**
+ * @brief 落盘剩余记录并关闭trace
+ *
+ * @return int 因环满而等待的次数；记录落盘或关闭文件失败时返回-errno
+ */
+int ddriver_trace_close(void) {
+    if (!tracer.enabled)
+        return 0;
+
+    pthread_mutex_lock(&tracer.lock);
+    tracer.stop = 1;
+    pthread_cond_signal(&tracer.not_empty);
+    pthread_mutex_unlock(&tracer.lock);
+    pthread_join(tracer.flusher, NULL);
+
+    tracer.enabled = 0;
+    if (close(tracer.fd) < 0 && tracer.err == 0)
+        tracer.err = -errno;
+    tracer.fd = -1;
+    return tracer.err < 0 ? tracer.err : (int)tracer.stalls;
+}
+
+int ddriver_trace_enabled(void) {
+    return tracer.enabled;
+}
@@ -0,0 +1,53 @@
+#ifndef _DDRIVER_TRACE_H_
+#define _DDRIVER_TRACE_H_
+
+#include <stdint.h>
+#include <sys/types.h>
+/******************************************************************************
+* SECTION: Trace file format
+*******************************************************************************/
+/*
+ * | ddriver_trace_hdr | ddriver_trace_rec | ddriver_trace_rec | ... |
+ *
+ * 所有字段均为小端，记录定长，便于mmap或直接按数组读取。
+ * 合并写在下发时才记录，可能排在之后的SEEK后面，读写都以记录自身的offset为准。
+ */
+#define DDRIVER_TRACE_MAGIC     "DDTR"
+#define DDRIVER_TRACE_VERSION   1
+#define DDRIVER_TRACE_RING      4096                  /* 环形缓冲区记录数 */
+
+enum ddriver_trace_op {
+    DDRIVER_TRACE_READ    = 0,
+    DDRIVER_TRACE_WRITE   = 1,
+    DDRIVER_TRACE_SEEK    = 2,
+    DDRIVER_TRACE_DISCARD = 3,
+};
+
+struct ddriver_trace_hdr
+{
+    char     magic[4];
+    uint32_t version;
+    uint32_t rec_size;                                /* sizeof(struct ddriver_trace_rec) */
+    uint32_t iounit_size;
+    uint64_t layout_size;
+};
+
+struct ddriver_trace_rec
+{
+    uint64_t ts_ns;                                   /* 相对于trace开始的时间戳 */
+    uint64_t offset;                                  /* 操作的设备偏移，重放按它定位而不是按前面的SEEK */
+    uint32_t len;                                     /* 字节数，SEEK为0 */
+    uint32_t lat_us;                                  /* 操作耗时（含模拟延迟） */
+    uint8_t  op;                                      /* enum ddriver_trace_op */
+    uint8_t  pad[7];
+};
+/******************************************************************************
+* SECTION: ddriver_trace.c
+*******************************************************************************/
+int      ddriver_trace_open(const char *path, int iounit_size, int layout_size);
+void     ddriver_trace_log(int op, off_t offset, size_t len, uint64_t start_ns);
+int      ddriver_trace_close(void);
+int      ddriver_trace_enabled(void);
+uint64_t ddriver_now_ns(void);
+
+#endif /* _DDRIVER_TRACE_H_ */
@@ -0,0 +1,249 @@
+#include "stdio.h"
+#include "stdlib.h"
+#include <unistd.h>
+#include <fcntl.h>
+#include "string.h"
+#include "errno.h"
+#include <stdint.h>
+#include "ddriver_ctl.h"
+#include "ddriver_backend.h"
+#include "ddriver_zone.h"
+/******************************************************************************
+* SECTION: Macro definitions
+*******************************************************************************/
+#define ZONE_MAGIC              0x4e5a4444            /* "DDZN" */
+/******************************************************************************
+* SECTION: Type definitions
+*******************************************************************************/
+/*
+ * | ddriver_zone_hdr | wp[0] | wp[1] | ... | wp[nr_zones - 1] |
+ */
+struct ddriver_zone_hdr
+{
+    uint32_t magic;
+    uint32_t zone_size;
+    uint32_t nr_zones;
+    uint32_t nr_conv;
+};
+
+struct zoned
+{
+    int        enabled;
+    int        zone_size;
+    int        nr_zones;
+    int        nr_conv;                               /* 前nr_conv个区域为常规区域 */
+    long long *wp;                                    /* 各区域写指针（绝对偏移） */
+    char       path[256];
+};
+/******************************************************************************
+* SECTION: Global Variable
+*******************************************************************************/
+static struct zoned zoned;
+/******************************************************************************
+* SECTION: Helper Functions
+*******************************************************************************/
+static off_t zone_start(int zno) {
+    return (off_t)zno * zoned.zone_size;
+}
+
+static int zone_cond(int zno) {
+    if (zno < zoned.nr_conv)
+        return DDRIVER_ZONE_COND_NOT_WP;
+    if (zoned.wp[zno] == zone_start(zno))
+        return DDRIVER_ZONE_COND_EMPTY;
+    if (zoned.wp[zno] == zone_start(zno) + zoned.zone_size)
+        return DDRIVER_ZONE_COND_FULL;
+    return DDRIVER_ZONE_COND_OPEN;
+}
+
+static int zone_of_start(off_t start) {               /* start必须是顺序写区域的起始偏移 */
+    int zno;
+    if (!zoned.enabled || start < 0 || start % zoned.zone_size != 0)
+        return -EINVAL;
+    zno = start / zoned.zone_size;
+    if (zno >= zoned.nr_zones || zno < zoned.nr_conv)
+        return -EINVAL;
+    return zno;
+}
+
+static void zone_load(void) {
+    struct ddriver_zone_hdr hdr;
+    int fd = open(zoned.path, O_RDONLY), zno;
+    size_t len = sizeof(long long) * zoned.nr_zones;
+
+    for (zno = 0; zno < zoned.nr_zones; zno++) {
+        zoned.wp[zno] = zone_start(zno);
+    }
+    if (fd < 0) {
+        return;
+    }
+    if (read(fd, &hdr, sizeof(hdr)) != sizeof(hdr) || hdr.magic != ZONE_MAGIC
+        || hdr.zone_size != (uint32_t)zoned.zone_size || hdr.nr_zones != (uint32_t)zoned.nr_zones
+        || hdr.nr_conv != (uint32_t)zoned.nr_conv || read(fd, zoned.wp, len) != (ssize_t)len) {
+        user_alert("zone state %s mismatched, all zones reset to empty", zoned.path);
+        for (zno = 0; zno < zoned.nr_zones; zno++) {
+            zoned.wp[zno] = zone_start(zno);
+        }
+    }
+    close(fd);
+}
+
+static void zone_store(void) {
+    struct ddriver_zone_hdr hdr = {
+        .magic     = ZONE_MAGIC,
+        .zone_size = zoned.zone_size,
+        .nr_zones  = zoned.nr_zones,
+        .nr_conv   = zoned.nr_conv,
+    };
+    int ret = ddriver_store_meta(zoned.path, &hdr, sizeof(hdr), zoned.wp, sizeof(long long) * zoned.nr_zones);
+
+    if (ret < 0) {                                    /* 原状态文件保持不变 */
+        user_alert("can't save zone state %s: %s", zoned.path, strerror(-ret));
+    }
+}
+/******************************************************************************
+* SECTION: Zoned device emulation
+*******************************************************************************/
+int ddriver_zone_open(const char *path, int layout_size, int iounit_size) {
+    zoned.enabled   = 0;
+    zoned.zone_size = ddriver_env_int(ENV_ZONE_SZ, 0);
+    zoned.nr_conv   = ddriver_env_int(ENV_ZONE_CONV, 0);
+    if (zoned.zone_size == 0) {
+        return 0;
+    }
+    if (zoned.zone_size < 0 || zoned.zone_size % iounit_size != 0 || layout_size % zoned.zone_size != 0) {
+        user_alert("zone size %d must be a multiple of %d and divide %d", zoned.zone_size, iounit_size, layout_size);
+        return -EINVAL;
+    }
+    zoned.nr_zones = layout_size / zoned.zone_size;
+    if (zoned.nr_conv < 0 || zoned.nr_conv > zoned.nr_zones) {
+        user_alert("conventional zones %d out of range [0, %d]", zoned.nr_conv, zoned.nr_zones);
+        return -EINVAL;
+    }
+    snprintf(zoned.path, sizeof(zoned.path), "%s" ZONE_SUFFIX, path);
+    zoned.wp      = malloc(sizeof(long long) * zoned.nr_zones);
+    if (zoned.wp == NULL) {
+        return -ENOMEM;
+    }
+    zoned.enabled = 1;
+    zone_load();
+    user_info("zoned: %d zones of %d bytes, %d conventional", zoned.nr_zones, zoned.zone_size, zoned.nr_conv);
+    return 0;
+}
+
+void ddriver_zone_close(void) {
+    if (!zoned.enabled) {
+        return;
+    }
+    zone_store();
+    free(zoned.wp);
+    zoned.wp      = NULL;
+    zoned.enabled = 0;
+}
+
+int ddriver_zone_enabled(void) {
+    return zoned.enabled;
+}
+
+int ddriver_zone_check_write(off_t offset, size_t size) {
+    int zno;
+
+    if (!zoned.enabled) {
+        return 0;
+    }
+    zno = offset / zoned.zone_size;
+    if (zno < zoned.nr_conv) {                        /* 常规区域，写入不能跨入顺序写区域 */
+        if (offset + (off_t)size > zone_start(zoned.nr_conv)) {
+            user_alert("write [%ld, +%ld) crosses into sequential zones", (long)offset, (long)size);
+            return -EIO;
+        }
+        return 0;
+    }
+    if (offset != zoned.wp[zno]) {
+        user_alert("unaligned write at %ld, zone %d write pointer %lld", (long)offset, zno, zoned.wp[zno]);
+        return -EIO;
+    }
+    if (offset + (off_t)size > zone_start(zno) + zoned.zone_size) {
+        user_alert("write [%ld, +%ld) crosses end of zone %d", (long)offset, (long)size, zno);
+        return -EIO;
+    }
+    return 0;
+}
+
+void ddriver_zone_advance(off_t offset, size_t size) {
+    int zno;
+
+    if (!zoned.enabled) {
+        return;
+    }
+    zno = offset / zoned.zone_size;
+    if (zno >= zoned.nr_conv) {
+        zoned.wp[zno] = offset + size;
+    }
+}
+
+/**
+ * @brief 已前移写指针的写入最终失败，把[offset, offset + size)涉及的写指针退回
+ */
+void ddriver_zone_rewind(off_t offset, size_t size) {
+    int zno;
+
+    if (!zoned.enabled) {
+        return;
+    }
+    for (zno = offset / zoned.zone_size; zno < zoned.nr_zones && zone_start(zno) < offset + (off_t)size; zno++) {
+        if (zno >= zoned.nr_conv && zoned.wp[zno] > offset) {
+            zoned.wp[zno] = offset > zone_start(zno) ? offset : zone_start(zno);
+        }
+    }
+}
+
+off_t ddriver_zone_wp(off_t start) {
+    int zno = zone_of_start(start);
+    return zno < 0 ? zno : zoned.wp[zno];
+}
+
+int ddriver_zone_range(off_t start, off_t *len) {
+    int zno = zone_of_start(start);
+    if (zno < 0) {
+        return zno;
+    }
+    *len = zoned.zone_size;
+    return 0;
+}
+
+void ddriver_zone_reset(off_t start) {
+    int zno = zone_of_start(start);
+    if (zno >= 0) {
+        zoned.wp[zno] = start;
+    }
+}
+
+void ddriver_zone_reset_all(void) {
+    int zno;
+    for (zno = zoned.nr_conv; zoned.enabled && zno < zoned.nr_zones; zno++) {
+        zoned.wp[zno] = zone_start(zno);
+    }
+}
+
+int ddriver_zone_report(struct ddriver_zone_report *rep) {
+    struct ddriver_zone *z;
+    int zno;
+
+    if (!zoned.enabled) {
+        return -EOPNOTSUPP;
+    }
+    if (rep->start < 0 || rep->start > zoned.nr_zones) {
+        return -EINVAL;
+    }
+    rep->total    = zoned.nr_zones;
+    rep->nr_zones = 0;
+    for (zno = rep->start; zno < zoned.nr_zones && rep->nr_zones < DDRIVER_ZONE_REPORT_MAX; zno++) {
+        z        = &rep->zones[rep->nr_zones++];
+        z->start = zone_start(zno);
+        z->len   = zoned.zone_size;
+        z->wp    = zno < zoned.nr_conv ? zone_start(zno) + zoned.zone_size : zoned.wp[zno];
+        z->cond  = zone_cond(zno);
+    }
+    return 0;
+}
@@ -0,0 +1,32 @@
+#ifndef _DDRIVER_ZONE_H_
+#define _DDRIVER_ZONE_H_
+
+#include <sys/types.h>
+#include "ddriver_ctl.h"
+/******************************************************************************
+* SECTION: Macro definitions
+*******************************************************************************/
+#define ENV_ZONE_SZ             "DDRIVER_ZONE_SZ"     /* 区域大小（字节），设置后进入分区模式 */
+#define ENV_ZONE_CONV           "DDRIVER_ZONE_CONV"   /* 开头的常规（可随机写）区域数，默认0 */
+#define ZONE_SUFFIX             ".zones"              /* 写指针持久化文件后缀 */
+/******************************************************************************
+* SECTION: ddriver_zone.c
+*******************************************************************************/
+/*
+ * 分区模式在ddriver.c中对所有后端生效：
+ *   顺序写区域只接受从写指针开始、不跨越区域末尾的写入，其余写入返回-EIO；
+ *   写指针随写入前移，写满后区域变为FULL，只能通过reset回到EMPTY。
+ */
+int   ddriver_zone_open(const char *path, int layout_size, int iounit_size);
+void  ddriver_zone_close(void);
+int   ddriver_zone_enabled(void);
+int   ddriver_zone_check_write(off_t offset, size_t size);
+void  ddriver_zone_advance(off_t offset, size_t size);
+void  ddriver_zone_rewind(off_t offset, size_t size);
+off_t ddriver_zone_wp(off_t zone_start);
+int   ddriver_zone_range(off_t zone_start, off_t *len);
+void  ddriver_zone_reset(off_t zone_start);
+void  ddriver_zone_reset_all(void);
+int   ddriver_zone_report(struct ddriver_zone_report *rep);
+
+#endif /* _DDRIVER_ZONE_H_ */
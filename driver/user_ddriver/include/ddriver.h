@@ -10,5 +10,6 @@ int ddriver_write(int fd, char *buf, size_t size);
 int ddriver_read(int fd, char *buf, size_t size);
 int ddriver_ioctl(int fd, unsigned long cmd, void *ret);
 int ddriver_close(int fd);
+int ddriver_zone_append(int fd, char *buf, size_t size, off_t zone, off_t *written);
 
 #endif /* _DDRIVER_H_ */
\ No newline at end of file
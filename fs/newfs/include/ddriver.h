@@ -27,7 +27,7 @@ int ddriver_seek(int fd, off_t offset, int whence);
  * 
  * @param fd ddriver设备handler
  * @param buf 要写入的数据Buf
- * @param size 要写入的数据大小，注意一定要等于单次设备IO单位
+ * @param size 要写入的数据大小，注意一定要为设备IO单位的整数倍
  * @return int 0成功，否则失败
  */
 int ddriver_write(int fd, char *buf, size_t size);
@@ -37,7 +37,7 @@ int ddriver_write(int fd, char *buf, size_t size);
  * 
  * @param fd ddriver设备handler
  * @param buf 要读出的数据Buf
- * @param size 要读出的数据大小，注意一定要等于单次设备IO单位
+ * @param size 要读出的数据大小，注意一定要为设备IO单位的整数倍
  * @return int 
  */
 int ddriver_read(int fd, char *buf, size_t size);
@@ -60,4 +60,16 @@ int ddriver_ioctl(int fd, unsigned long cmd, void *ret);
  */
 int ddriver_close(int fd);
 
+/**
+ * @brief 区域追加写（仅分区模式，DDRIVER_ZONE_SZ），写入位置由设备决定
+ * 
+ * @param fd ddriver设备handler
+ * @param buf 要写入的数据Buf
+ * @param size 要写入的数据大小，注意一定要为设备IO单位的整数倍，且不超出区域剩余空间
+ * @param zone 区域起始偏移，见IOC_REQ_ZONE_REPORT
+ * @param written 返回数据实际写入的偏移
+ * @return int 写入大小，否则失败
+ */
+int ddriver_zone_append(int fd, char *buf, size_t size, off_t zone, off_t *written);
+
 #endif /* _DDRIVER_H_ */
\ No newline at end of file
@@ -11,6 +11,7 @@
 #include <stddef.h>
 #include "ddriver.h"
 #include "errno.h"
+#include <pthread.h>
 #include "types.h"
 
 #define NEWFS_MAGIC           0x12345678        /* TODO: Define by yourself */
@@ -28,15 +29,91 @@ char* 			   nfs_get_fname(const char* path);
 int 			   nfs_calc_lvl(const char * path);
 int 			   nfs_driver_read(int offset, uint8_t *out_content, int size);
 int 			   nfs_driver_write(int offset, uint8_t *in_content, int size);
+int 			   nfs_driver_flush();
+int 			   nfs_driver_write_blks(struct nfs_jblk * blks, int cnt);
+int 			   nfs_driver_discard_blks(int * blks, int cnt);
 int 			   nfs_mount(struct custom_options options);
 int 			   nfs_umount();
+int 			   nfs_sync_super();
+int 			   nfs_sync_groups();
+int 			   nfs_alloc_data_blk(struct nfs_inode * inode, int idx);
+int 			   nfs_alloc_data_near(struct nfs_inode * inode, int dno);
+void 			   nfs_free_data_blk(int dno);
 int 			   nfs_alloc_dentry(struct nfs_inode * inode, struct nfs_dentry * dentry, int judge);
+int 			   nfs_drop_dentry(struct nfs_inode * inode, struct nfs_dentry * dentry);
 struct nfs_inode*  nfs_alloc_inode(struct nfs_dentry * dentry);
+void 			   nfs_drop_inode(struct nfs_inode * inode);
+int 			   nfs_write_inode(struct nfs_inode * inode);
 int 			   nfs_sync_inode(struct nfs_inode * inode);
+int 			   nfs_fsync_inode(struct nfs_inode * inode, boolean wait);
 struct nfs_inode*  nfs_read_inode(struct nfs_dentry * dentry, int ino);
 struct nfs_dentry* nfs_get_dentry(struct nfs_inode * inode, int dir);
 struct nfs_dentry* nfs_lookup(const char * path, boolean * is_find, boolean* is_root);
 
+/******************************************************************************
+* SECTION: newfs_dx.c
+*******************************************************************************/
+int 			   nfs_dx_add(struct nfs_inode * inode, struct nfs_dentry * dentry);
+int 			   nfs_dx_convert(struct nfs_inode * inode, struct nfs_dentry * dentry);
+int 			   nfs_dx_del(struct nfs_inode * inode, const char * fname);
+struct nfs_dentry* nfs_dx_lookup(struct nfs_inode * inode, const char * fname);
+int 			   nfs_dx_readdir(struct nfs_inode * inode, void * buf, fuse_fill_dir_t filler, off_t offset);
+
+/******************************************************************************
+* SECTION: newfs_dirent.c
+*******************************************************************************/
+void 			   nfs_dirblk_init(uint8_t * blk);
+int 			   nfs_dirblk_check(uint8_t * blk);
+int 			   nfs_dirblk_add(uint8_t * blk, struct nfs_dentry * dentry);
+int 			   nfs_dirblk_max_free(uint8_t * blk);
+int 			   nfs_dirblk_find(uint8_t * blk, const char * fname);
+void 			   nfs_dirblk_del(uint8_t * blk, int ofs);
+struct nfs_dentry* nfs_dirblk_load(struct nfs_dentry_d * rec);
+
+/******************************************************************************
+* SECTION: newfs_dtable.c
+*******************************************************************************/
+int 			   nfs_dtable_insert(struct nfs_inode * inode, struct nfs_dentry * dentry);
+struct nfs_dentry* nfs_dtable_find(struct nfs_inode * inode, const char * fname);
+void 			   nfs_dtable_remove(struct nfs_inode * inode, struct nfs_dentry * dentry);
+void 			   nfs_dtable_free(struct nfs_inode * inode);
+
+/******************************************************************************
+* SECTION: newfs_cache.c
+*******************************************************************************/
+void 			   nfs_cache_add(struct nfs_inode * inode);
+void 			   nfs_cache_touch(struct nfs_inode * inode);
+void 			   nfs_cache_shrink();
+void 			   nfs_free_inode(struct nfs_inode * inode);
+
+/******************************************************************************
+* SECTION: newfs_journal.c
+*******************************************************************************/
+int 			   nfs_journal_load(int offset, int blks, boolean is_init, int commit_ms);
+int 			   nfs_journal_shutdown();
+void 			   nfs_journal_start();
+void 			   nfs_journal_stop();
+int 			   nfs_journal_sync();
+int 			   nfs_journal_write(int offset, uint8_t * content, int size);
+int 			   nfs_journal_read(int offset, uint8_t * out_content, int size);
+int 			   nfs_journal_revoke(int offset);
+void 			   nfs_journal_discard(int dno);
+
+/******************************************************************************
+* SECTION: newfs_slab.c
+*******************************************************************************/
+void 			   nfs_slab_init(struct nfs_slab * slab, int obj_sz);
+void* 			   nfs_slab_alloc(struct nfs_slab * slab);
+void 			   nfs_slab_free(struct nfs_slab * slab, void * obj);
+void 			   nfs_slab_destroy(struct nfs_slab * slab);
+struct nfs_dentry* new_dentry(char * fname, NFS_FILE_TYPE ftype);
+void 			   nfs_free_dentry(struct nfs_dentry * dentry);
+struct nfs_scratch_mark nfs_scratch_mark();
+void* 			   nfs_scratch_alloc(int size);
+void 			   nfs_scratch_release(struct nfs_scratch_mark mark);
+void 			   nfs_scratch_free();
+void 			   nfs_alloc_stats();
+
 /******************************************************************************
 * SECTION: newfs.c
 *******************************************************************************/
@@ -56,5 +133,9 @@ int   			   newfs_utimens(const char *, const struct timespec tv[2]);
 int   			   newfs_truncate(const char *, off_t);			
 int   			   newfs_open(const char *, struct fuse_file_info *);
 int   			   newfs_opendir(const char *, struct fuse_file_info *);
+int   			   newfs_fsync(const char *, int, struct fuse_file_info *);
+int   			   newfs_fsyncdir(const char *, int, struct fuse_file_info *);
+int   			   newfs_flush(const char *, struct fuse_file_info *);
+int   			   newfs_release(const char *, struct fuse_file_info *);
 
 #endif  /* _newfs_H_ */
\ No newline at end of file
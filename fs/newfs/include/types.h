@@ -20,7 +20,7 @@ typedef enum nfs_file_type {
 #define UINT32_BITS             32
 #define UINT8_BITS              8
 
-#define NFS_MAGIC_NUM           0x52415453  
+#define NFS_MAGIC_NUM           0x52415456      // 块组布局 + 变长目录项 + 元数据日志，与旧布局不兼容
 #define NFS_SUPER_OFS           0
 #define NFS_ROOT_INO            0
 
@@ -36,6 +36,8 @@ typedef enum nfs_file_type {
 #define NFS_ERROR_UNSUPPORTED   ENXIO
 #define NFS_ERROR_IO            EIO     /* Error Input/Output */
 #define NFS_ERROR_INVAL         EINVAL  /* Invalid Args */
+#define NFS_ERROR_NAMETOOLONG   ENAMETOOLONG
+#define NFS_ERROR_NOMEM         ENOMEM
 
 #define NFS_MAX_FILE_NAME       128
 #define NFS_INODE_PER_FILE      16
@@ -45,15 +47,37 @@ typedef enum nfs_file_type {
 #define NFS_IOC_MAGIC           'S'
 #define NFS_IOC_SEEK            _IO(NFS_IOC_MAGIC, 0)
 
+#define NFS_INODE_F_INDEX       0x1     // 目录使用哈希索引（htree），block_pointer[0]为索引根块
+#define NFS_DX_MAX_LEVELS       2       // 索引根块 + 至多一层中间索引块
+
+#define NFS_DTABLE_GROUP        16      // 子项表每次比较16个标签（一条SSE2指令）
+#define NFS_DTABLE_EMPTY        0x80    // 空槽位，最高位为1
+#define NFS_DTABLE_DELETED      0xFE    // 墓碑，最高位为1；有效标签为哈希高7位（最高位为0）
+
+#define NFS_SLAB_ALIGN          16      // slab对象按16字节对齐
+#define NFS_SLAB_PAGE_SZ        65536   // slab每次向堆申请的页大小
+#define NFS_SCRATCH_ALIGN       64      // 临时缓冲区按缓存行对齐
+#define NFS_SCRATCH_CHUNK       65536   // 每个线程的临时缓冲区按64KiB一段增长
+#define NFS_WB_RUN_MAX          32      // 写回时相邻块合并为一次请求的最大块数
+
 #define NFS_FLAG_BUF_DIRTY      0x1
 #define NFS_FLAG_BUF_OCCUPY     0x2
 
-/* 磁盘布局设计 */
+/* 磁盘布局设计：| Super | 块组描述符表 | 日志 | 块组0 | 块组1 | ... | */
 #define NFS_SUPER_BLKS          1       // 超级块占1个逻辑块
-#define NFS_MAP_INODE_BLKS      1       // 索引节点位图占1个逻辑块
-#define NFS_MAP_DATA_BLKS       1       // 数据块位图占1个逻辑块
-#define NFS_INODE_BLKS          585     
-#define NFS_DATA_BLKS           3508  
+#define NFS_GROUP_BLKS          1024    // 每个块组的逻辑块数，块组数随设备大小增长
+#define NFS_GROUP_MAP_BLKS      2       // 块组内inode位图、数据块位图各占1个逻辑块
+#define NFS_GROUP_INODE_BLKS    144     // 每个块组的inode表，每个inode占1个逻辑块
+#define NFS_DNO_BASE            500     // 数据逻辑块号起点，对应物理数据块0
+#define NFS_JOURNAL_BLKS        256     // 元数据日志区：1块日志超级块 + 255块循环日志
+
+#define NFS_JNL_MAGIC           0x4A4E4C31      // 日志超级块
+#define NFS_JNL_DESC_MAGIC      0x4A4E4C44      // 描述块：事务中各块的块号
+#define NFS_JNL_COMMIT_MAGIC    0x4A4E4C43      // 提交块：事务写完的标记与校验和
+#define NFS_JNL_TXN_MAX         64      // 一个事务至多记录的元数据块数
+#define NFS_JNL_TXN_SOFT        32      // 事务超过该块数时，新操作开始前先提交
+#define NFS_JNL_FREED_MAX       256     // 两次丢弃之间至多记录的释放数据块，超出的不再丢弃
+#define NFS_JNL_COMMIT_MS       5000    // 默认的成组提交间隔
 
 /******************************************************************************
 * SECTION: Macro Function
@@ -64,7 +88,8 @@ typedef enum nfs_file_type {
 #define NFS_BLK_SZ()                    (nfs_super.sz_blks)
 #define NFS_DRIVER()                    (nfs_super.driver_fd)
 #define NFS_BLKS_SZ(blks)               ((blks) * NFS_BLK_SZ())
-#define NFS_DENTRY_PER_DATABLK()        (NFS_BLK_SZ() / sizeof(struct nfs_dentry_d))  //计算一个磁盘块可以储存多少dentry_d
+#define NFS_DENTRY_D_LEN(name_len)      (NFS_ROUND_UP((int)sizeof(struct nfs_dentry_d) + (name_len), 4))  // 变长目录项占用的字节数
+#define NFS_DENTRY_D_AT(blk, ofs)       ((struct nfs_dentry_d *)((uint8_t *)(blk) + (ofs)))
 
 // 向上取整及向下取整
 #define NFS_ROUND_DOWN(value, round)    ((value) % (round) == 0 ? (value) : ((value) / (round)) * (round))
@@ -74,8 +99,20 @@ typedef enum nfs_file_type {
 #define NFS_ASSIGN_FNAME(pnfs_dentry, _fname)  memcpy(pnfs_dentry->fname, _fname, strlen(_fname))
 
 // 计算偏移
-#define NFS_INO_OFS(ino)                (nfs_super.inode_offset + NFS_BLKS_SZ(ino))
-#define NFS_DATA_OFS(dno)               (nfs_super.data_offset + NFS_BLKS_SZ(dno))
+// 块组：ino与物理数据块号都按块组连续编号，第g组为[g * 每组数目, (g + 1) * 每组数目)
+#define NFS_INO_GROUP(ino)              ((ino) / nfs_super.inodes_per_group)
+#define NFS_DATA_GROUP(dno)             ((dno) / nfs_super.data_per_group)
+#define NFS_GROUP_OFS(g)                (nfs_super.group_offset + NFS_BLKS_SZ((g) * NFS_GROUP_BLKS))
+#define NFS_GROUP_MAP_INODE_OFS(g)      (NFS_GROUP_OFS(g))
+#define NFS_GROUP_MAP_DATA_OFS(g)       (NFS_GROUP_OFS(g) + NFS_BLKS_SZ(1))
+
+// 计算偏移
+#define NFS_INO_OFS(ino)                (NFS_GROUP_OFS(NFS_INO_GROUP(ino)) \
+                                         + NFS_BLKS_SZ(NFS_GROUP_MAP_BLKS + (ino) % nfs_super.inodes_per_group))
+#define NFS_DATA_OFS(dno)               (NFS_GROUP_OFS(NFS_DATA_GROUP(dno)) \
+                                         + NFS_BLKS_SZ(NFS_GROUP_MAP_BLKS + nfs_super.inodes_per_group \
+                                                       + (dno) % nfs_super.data_per_group))
+#define NFS_DATA_TRACK(dno)             (NFS_DATA_OFS(dno) / nfs_super.sz_track)   // 数据块所在磁道，需sz_track > 0
 
 // 判断inode类型
 #define NFS_IS_DIR(pinode)              (pinode->dentry->ftype == NFS_DIR)
@@ -87,19 +124,101 @@ typedef enum nfs_file_type {
 struct custom_options {
 	const char*        device;
 	boolean            show_help;
+	boolean            no_dir_index;    // 不再把目录转换为哈希索引（已有索引照常使用）
+	int                mem_cap;         // 内存中inode/dentry缓存的上限（KiB），0表示不限
+	int                commit_ms;       // 元数据日志的成组提交间隔（毫秒），0取NFS_JNL_COMMIT_MS
+	boolean            stats;           // 卸载时打印slab、临时缓冲区与日志的统计
+};
+
+struct nfs_slab         // 定长对象的slab缓存：按页向堆申请，释放的对象挂回空闲链表
+{
+    int                 obj_sz;                          // 对象大小，按NFS_SLAB_ALIGN对齐
+    int                 per_page;                        // 每页的对象数
+    void*               free_list;                       // 空闲对象链表，链接指针放在对象开头
+    void*               pages;                           // 已申请的页链表，卸载时整体释放
+    long                allocs;                          // 累计分配次数
+    long                frees;                           // 累计释放次数
+    long                pages_cnt;                       // 向堆申请的页数
+};
+
+struct nfs_jblk         // 一个整块及其内容：日志中的元数据块，或待写回的数据块
+{
+    int                 blk;                             // 逻辑块号（磁盘偏移 / 块大小）
+    uint8_t*            data;                            // 块内容，取自journal.slab
+};
+
+struct nfs_journal      // 元数据日志（WAL）
+{
+    int                 offset;                          // 日志区起始地址，第0块为日志超级块
+    int                 blks;                            // 循环日志的块数（不含日志超级块）
+    int                 start;                           // 最早未写回原位置的事务的描述块
+    int                 head;                            // 下一个事务的描述块
+    uint32_t            start_seq;                       // start处事务的序号
+    uint32_t            seq;                             // 运行中事务的序号
+    uint32_t            commit_seq;                      // 最后提交的事务序号
+
+    struct nfs_jblk     running[NFS_JNL_TXN_MAX];        // 运行中事务：操作写入的元数据块
+    int                 nr_running;
+    int                 revoke[NFS_JNL_TXN_MAX];         // 运行中事务释放的块，重放时不覆盖其旧内容
+    int                 nr_revoke;
+    int                 freed[NFS_JNL_FREED_MAX];        // 释放的数据块，释放它们的操作提交后通知设备丢弃
+    int                 nr_freed;
+    struct nfs_jblk*    committed;                       // 已提交、尚未写回原位置的块（每块最新的一份）
+    int                 nr_committed;
+
+    boolean             active;                          // 挂载期间为TRUE，此前此后元数据直接读写磁盘
+    int                 handles;                         // 进行中的操作数，提交前等其结束
+    boolean             committing;
+    boolean             stop;
+    int                 commit_ms;
+    int                 err;                             // 后台提交或写回的失败，由下一次nfs_journal_sync返回
+    struct nfs_slab     slab;                            // 块内容，只在lock内分配与释放
+    pthread_t           thread;                          // 后台提交与写回线程
+    pthread_mutex_t     lock;
+    pthread_cond_t      wake;                            // 唤醒后台线程
+    pthread_cond_t      done;                            // 一次提交完成或操作结束
+
+    long                commits;                         // 累计提交的事务数
+    long                logged;                          // 累计写入日志的块数
+    long                checkpoints;                     // 累计写回原位置的次数
+};
+
+struct nfs_scratch_mark // 临时缓冲区栈的位置，nfs_scratch_release回到该位置
+{
+    void*               chunk;
+    int                 used;
+};
+
+struct nfs_dtable       // 目录的子项哈希表，开放寻址，按16个槽位一组探测
+{
+    uint8_t*            ctrl;                            // 每个槽位的控制字节：EMPTY / DELETED / 7位哈希标签
+    struct nfs_dentry** slots;                           // 与ctrl一一对应的目录项指针
+    int                 cap;                             // 槽位数，NFS_DTABLE_GROUP的2的幂倍
+    int                 size;                            // 有效目录项数
+    int                 used;                            // 有效目录项 + 墓碑，超过7/8时扩容重建
 };
 
 struct nfs_inode        // 2-索引节点
 { 
     u_int32_t           ino;                             // 索引编号
-    int                 size;                            // 文件已占用空间
+    int                 size;                            // 文件已占用空间；目录为目录块总字节数
     int                 link;                            // 链接数，默认为1
     NFS_FILE_TYPE       ftype;                           // 文件类型（目录类型、普通文件类型）
     int                 block_pointer[NFS_DATA_PER_FILE];// 数据块块号（可固定分配）
+    int                 flags;                           // NFS_INODE_F_*
     struct nfs_dentry*  dentry;                          // 指向该inode的dentry
-    struct nfs_dentry*  dentrys;                         // 所有目录项
-    uint8_t*            data[NFS_DATA_PER_FILE];         // 指向数据块的指针
+    struct nfs_dentry*  dentrys;                         // 所有目录项；索引目录只缓存访问过的目录项
+    struct nfs_dtable*  dtable;                          // 按名字查找dentrys，链表只用于保持遍历顺序
+    uint8_t*            data[NFS_DATA_PER_FILE];         // 指向数据块的指针；线性目录缓存其目录块
     int                 dir_cnt;                         // 如果是目录类型，记录下面有几个目录项           
+    int                 dir_free[NFS_DATA_PER_FILE];     // 线性目录每块最大的连续空闲空间（字节）
+    int                 blk_dirty;                       // data[]中已修改未写回的块，第i位对应第i块
+
+    boolean             dirty;                           // inode或其目录项有未写回的修改
+    int                 ref;                             // 引用数：内存中的子inode数（根inode常驻+1）
+    int                 mem;                             // 上次计入缓存的内存占用（字节）
+    struct nfs_inode*   lru_prev;                        // LRU链表中较新的一个
+    struct nfs_inode*   lru_next;                        // LRU链表中较旧的一个
 };   
 
 struct nfs_dentry       // 3-目录项
@@ -112,6 +231,17 @@ struct nfs_dentry       // 3-目录项
     NFS_FILE_TYPE       ftype;                          // 文件类型
 }; 
 
+struct nfs_group        // 块组描述符
+{
+    int                 free_inodes;                    // 空闲inode数
+    int                 free_data;                      // 空闲数据块数
+    int                 used_dirs;                      // 已分配的目录数，供Orlov分散顶层目录
+    int                 nr_data;                        // 数据块数，最后一个块组可能不完整
+    boolean             dirty;                          // 位图或计数已修改，尚未写入日志
+    uint8_t*            map_inode;                      // inode位图
+    uint8_t*            map_data;                       // data位图
+};
+
 struct nfs_super        // 1-超级块
 {
     uint32_t            magic_num;          // 幻数
@@ -121,36 +251,38 @@ struct nfs_super        // 1-超级块
     int                 sz_blks;            // EXT2的磁盘块大小：1024B
     int                 sz_disk;            // 虚拟磁盘容量：4MB
     int                 sz_usage;
+    int                 sz_track;           // 设备磁道大小，0表示设备不提供几何信息
 
     int                max_ino;             // 索引节点最大数目
-    uint8_t*           map_inode;           // inode位图
-    int                map_inode_blks;      // inode位图所占的数据块
-    int                map_inode_offset;    // inode位图的起始地址
-    int                inode_offset; 
-    
-    int                max_data;            // 数据块最大数目
-    uint8_t*           map_data;            // data位图
-    int                map_data_offset;     // data位图的起始地址
-    int                map_data_blks;       // data位图所占的块数
-    int                data_offset;         // 数据块的起始地址
+    int                max_data;            // 数据块最大数目（含最后一个块组不存在的部分）
+
+    int                group_cnt;           // 块组数
+    int                inodes_per_group;    // 每个块组的inode数
+    int                data_per_group;      // 每个完整块组的数据块数
+    int                gdt_offset;          // 块组描述符表的起始地址
+    int                gdt_blks;            // 块组描述符表所占的块数
+    int                group_offset;        // 块组0的起始地址
+    struct nfs_group*  groups;              // 块组描述符
+    struct nfs_journal journal;             // 元数据日志
 
     boolean            is_mounted;          // 是否挂载
 
     struct nfs_dentry* root_dentry;         // 根目录
+
+    struct nfs_inode*  lru_head;            // 内存inode的LRU链表，表头最近使用
+    struct nfs_inode*  lru_tail;
+    long               cache_bytes;         // 内存inode及其目录项、数据块缓存的总占用
+    long               cache_cap;           // 缓存上限（字节），0表示不限
+
+    struct nfs_slab    dentry_slab;         // struct nfs_dentry
+    struct nfs_slab    inode_slab;          // struct nfs_inode
+    struct nfs_slab    blk_slab;            // inode->data[]中的逻辑块缓存
+    struct nfs_slab    dtable_slab;         // struct nfs_dtable
+    struct nfs_slab    dtable_arr_slab;     // 一组槽位的子项表数组（slots[]与ctrl[]）
+    long               scratch_chunks;      // 各线程临时缓冲区向堆申请的次数
+    long               scratch_bytes;       // 以及申请的总字节数
 };
 
-/* 用于创建新的目录项 */
-static inline struct nfs_dentry* new_dentry(char * fname, NFS_FILE_TYPE ftype) {
-    struct nfs_dentry * dentry = (struct nfs_dentry *)malloc(sizeof(struct nfs_dentry));
-    memset(dentry, 0, sizeof(struct nfs_dentry));
-    NFS_ASSIGN_FNAME(dentry, fname);
-    dentry->ftype   = ftype;
-    dentry->ino     = -1;
-    dentry->inode   = NULL;
-    dentry->parent  = NULL;
-    dentry->brother = NULL;  
-    return dentry;                                          
-}
 /******************************************************************************
 * SECTION: FS Specific Structure - Disk structure
 *******************************************************************************/
@@ -159,32 +291,98 @@ struct nfs_super_d
     uint32_t            magic_num;                      // 幻数
     int                 sz_usage;   
     
-    int                 map_inode_blks;                 // inode位图所占的块数
-    int                 map_inode_offset;               // inode位图的起始地址
-        
-    int                 map_data_blks;                  // data位图所占的块数
-    int                 map_data_offset;                // data位图的起始地址
-    
-    int                 data_offset;                    // 数据块的起始地址                    
-    int                 inode_offset;                   // 索引节点的起始地址
+    int                 group_cnt;                      // 块组数
+    int                 inodes_per_group;               // 每个块组的inode数
+    int                 data_per_group;                 // 每个完整块组的数据块数
+    int                 last_group_data;                // 最后一个块组的数据块数
+
+    int                 gdt_offset;                     // 块组描述符表的起始地址
+    int                 gdt_blks;                       // 块组描述符表所占的块数
+    int                 group_offset;                   // 块组0的起始地址
+    int                 journal_offset;                 // 日志区的起始地址
+    int                 journal_blks;                   // 日志区的块数
+};
+
+struct nfs_group_d
+{
+    int                 free_inodes;                    // 空闲inode数
+    int                 free_data;                      // 空闲数据块数
+    int                 used_dirs;                      // 已分配的目录数
 };
 
 struct nfs_inode_d
 {
     u_int32_t           ino;                             // 索引编号
-    int                 size;                            // 文件已占用空间
+    int                 size;                            // 文件已占用空间；目录为目录块总字节数
     int                 link;                            // 链接数，默认为1
     NFS_FILE_TYPE       ftype;                           // 文件类型（目录类型、普通文件类型）
     int                 block_pointer[NFS_DATA_PER_FILE];// 数据块块号（可固定分配）
     int                 dir_cnt;                         // 如果是目录类型，记录下面有几个目录项 
+    int                 flags;                           // NFS_INODE_F_*
 };  
 
+/*
+ * 元数据日志：日志区第0块是日志超级块，其后是循环使用的日志块。每个事务
+ * 依次写入 描述块 | 元数据块 ... | 提交块，描述块记录各元数据块的块号，
+ * 负数-(blk+1)表示该事务中释放的块（不带内容）。
+ */
+struct nfs_jnl_super_d
+{
+    uint32_t            magic;                           // NFS_JNL_MAGIC
+    uint32_t            seq;                             // 第一个待重放事务的序号
+    int                 start;                           // 它的描述块在循环日志中的位置
+};
+
+struct nfs_jnl_desc_d
+{
+    uint32_t            magic;                           // NFS_JNL_DESC_MAGIC
+    uint32_t            seq;                             // 事务序号
+    int                 nr;                              // entries个数
+    int                 entries[];                       // 块号，释放的块为-(blk+1)
+};
+
+struct nfs_jnl_commit_d
+{
+    uint32_t            magic;                           // NFS_JNL_COMMIT_MAGIC
+    uint32_t            seq;
+    uint32_t            csum;                            // 描述块与各元数据块的校验和
+};
+
+/*
+ * 变长目录项（与ext2相同）：块内的目录项首尾相接铺满整块，rec_len是到下一条
+ * 目录项的距离，多出的部分是空闲空间，插入时从中切分；name_len为0的目录项是空闲的。
+ *
+ * | ino | rec_len | name_len | ftype | name ... pad | ino | rec_len | ... |
+ */
 struct nfs_dentry_d
 {
-    char                fname[NFS_MAX_FILE_NAME];        // 文件名          
-    NFS_FILE_TYPE       ftype;                           // 文件类型
-    int                 ino;                             // 指向的ino号
+    uint32_t            ino;                             // 指向的ino号
+    uint16_t            rec_len;                         // 本目录项（含尾部空闲）的长度，4字节对齐
+    uint8_t             name_len;                        // 文件名长度，不含'\0'
+    uint8_t             ftype;                           // 文件类型
+    char                fname[];                         // 文件名，不以'\0'结尾
 };  
 
+/*
+ * 目录哈希索引（htree）：根块与中间块由索引项组成，按哈希下界升序排列，
+ * 第一项下界为0；叶子块就是普通的变长目录项块。
+ *
+ * | root: hdr | {0, blk} | {h1, blk} | ... |  ->  | leaf: dentry_d ... |
+ */
+struct nfs_dx_entry
+{
+    uint32_t            hash;                            // 子块中最小的哈希值
+    int                 dno;                             // 子块数据块号（含NFS_DNO_BASE偏移）
+};
+
+struct nfs_dx_node
+{
+    int                 levels;                          // 仅根块有效：根之下的中间索引层数
+    int                 count;                           // 有效索引项数
+    int                 limit;                           // 块内最多索引项数
+    int                 reserved;
+    struct nfs_dx_entry entries[];
+};
+
 
 #endif /* _TYPES_H_ */
\ No newline at end of file
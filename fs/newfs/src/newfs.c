@@ -13,6 +13,10 @@
 *******************************************************************************/
 static const struct fuse_opt option_spec[] = {		/* 用于FUSE文件系统解析参数 */
 	OPTION("--device=%s", device),
+	OPTION("--no_dir_index", no_dir_index),
+	OPTION("--mem_cap=%d", mem_cap),
+	OPTION("--commit_ms=%d", commit_ms),
+	OPTION("--stats", stats),
 	FUSE_OPT_END
 };
 
@@ -38,7 +42,12 @@ static struct fuse_operations operations = {
     
     .open      = NULL, 
     .opendir   = NULL,
-    .access    = NULL
+    .access    = NULL,
+
+    .fsync     = newfs_fsync,     /* 写回单个文件并等待落盘 */
+    .fsyncdir  = newfs_fsyncdir,  /* 写回单个目录并等待落盘 */
+    .flush     = newfs_flush,     /* close时写回，不等待日志提交 */
+    .release   = newfs_release    /* 最后一次close */
 };
 
 /******************************************************************************
@@ -93,7 +102,11 @@ int newfs_mkdir(const char* path, mode_t mode) {
     struct nfs_dentry* last_dentry = nfs_lookup(path, &is_find, &is_root);
     struct nfs_dentry* dentry;
     struct nfs_inode*  inode;
+    int ret;
 
+    if (last_dentry == NULL) {	// 读取路径上的inode失败
+        return -NFS_ERROR_IO;
+    }
     if (is_find) {	    // 如果目录已存在，返回错误
         return -NFS_ERROR_EXISTS;
     }
@@ -101,10 +114,32 @@ int newfs_mkdir(const char* path, mode_t mode) {
         return -NFS_ERROR_UNSUPPORTED;
     }
     fname  = nfs_get_fname(path);			// 获取路径中的目录名
+    if (strlen(fname) >= NFS_MAX_FILE_NAME) {	// dentry的fname放不下
+        return -NFS_ERROR_NAMETOOLONG;
+    }
     dentry = new_dentry(fname, NFS_DIR); 	// 创建新的目录项
+    if (dentry == NULL) {
+        return -NFS_ERROR_NOMEM;
+    }
     dentry->parent = last_dentry; 			// 设置父目录
+    nfs_journal_start();					// 本次修改记入同一个日志事务
     inode  = nfs_alloc_inode(dentry);		// 为新目录项分配inode
-    nfs_alloc_dentry(last_dentry->inode, dentry, 1);	// 将新目录项添加到父目录的inode中
+    if (inode == NULL) {					// inode用完，不留下半个事务
+        nfs_journal_stop();
+        nfs_free_dentry(dentry);
+        return -NFS_ERROR_NOSPACE;
+    }
+    ret = nfs_alloc_dentry(last_dentry->inode, dentry, 1);	// 将新目录项添加到父目录的inode中
+    if (ret < 0) {							// 父目录写不下新目录项，撤销新inode
+        nfs_drop_inode(inode);
+        nfs_journal_stop();
+        nfs_free_dentry(dentry);
+        return ret;
+    }
+    nfs_write_inode(inode);					// 新inode、父目录与位图写入日志，由日志线程成组提交
+    nfs_write_inode(last_dentry->inode);
+    nfs_sync_groups();
+    nfs_journal_stop();
     // 创建成功，返回成功标志
     return NFS_ERROR_NONE;
 }
@@ -124,6 +159,10 @@ int newfs_getattr(const char* path, struct stat * nfs_stat) {
     // 查找路径对应的目录项，返回是否找到以及是否为根目录
     struct nfs_dentry* dentry = nfs_lookup(path, &is_find, &is_root);
     
+    // 读取路径上的inode失败
+    if (dentry == NULL) {
+        return -NFS_ERROR_IO;
+    }
     // 如果没有找到路径，返回找不到错误
     if (is_find == FALSE) {
         return -NFS_ERROR_NOTFOUND;
@@ -132,7 +171,7 @@ int newfs_getattr(const char* path, struct stat * nfs_stat) {
     // 如果是目录，设置目录相关的属性
     if (NFS_IS_DIR(dentry->inode)) {
         nfs_stat->st_mode  = S_IFDIR | NFS_DEFAULT_PERM;   // 设置文件类型为目录
-        nfs_stat->st_size  = dentry->inode->dir_cnt * sizeof(struct nfs_dentry_d);  // 设置目录大小
+        nfs_stat->st_size  = dentry->inode->size;           // 目录大小为已分配的目录块（含索引块）
     }
     // 如果是常规文件，设置文件相关的属性
     else if (NFS_IS_REG(dentry->inode)) {
@@ -187,8 +226,14 @@ int newfs_readdir(const char * path, void * buf, fuse_fill_dir_t filler, off_t o
 	struct nfs_dentry* dentry = nfs_lookup(path, &is_find, &is_root);
     struct nfs_dentry* sub_dentry;    // 子目录项
     struct nfs_inode* inode;          // 目录的 inode
+	if (dentry == NULL) {	// 读取路径上的inode失败
+		return -NFS_ERROR_IO;
+	}
 	if (is_find) {		// 如果找到了目录项
 		inode = dentry->inode;		// 获取该目录的 inode
+		if (inode->flags & NFS_INODE_F_INDEX) {	// 索引目录按叶子块顺序批量填充
+			return nfs_dx_readdir(inode, buf, filler, offset);
+		}
 		sub_dentry = nfs_get_dentry(inode, cur_dir);	// 获取目录下的子目录项
 		// 如果找到了子目录项，使用filler填充到buf中
 		if (sub_dentry) {
@@ -216,12 +261,19 @@ int newfs_mknod(const char* path, mode_t mode, dev_t dev) {
 	struct nfs_dentry* dentry;
 	struct nfs_inode* inode;
 	char* fname;
+	int ret;
 	
+	if (last_dentry == NULL) {
+		return -NFS_ERROR_IO;
+	}
 	if (is_find == TRUE) {
 		return -NFS_ERROR_EXISTS;
 	}
 
 	fname = nfs_get_fname(path);
+	if (strlen(fname) >= NFS_MAX_FILE_NAME) {
+		return -NFS_ERROR_NAMETOOLONG;
+	}
 	
 	if (S_ISREG(mode)) {
 		dentry = new_dentry(fname, NFS_REG_FILE);
@@ -232,9 +284,28 @@ int newfs_mknod(const char* path, mode_t mode, dev_t dev) {
 	else {
 		dentry = new_dentry(fname, NFS_REG_FILE);
 	}
+	if (dentry == NULL) {
+		return -NFS_ERROR_NOMEM;
+	}
 	dentry->parent = last_dentry;
+	nfs_journal_start();
 	inode = nfs_alloc_inode(dentry);
-	nfs_alloc_dentry(last_dentry->inode, dentry, 1);
+	if (inode == NULL) {					// inode或数据块用完，nfs_alloc_inode已回滚
+		nfs_journal_stop();
+		nfs_free_dentry(dentry);
+		return -NFS_ERROR_NOSPACE;
+	}
+	ret = nfs_alloc_dentry(last_dentry->inode, dentry, 1);
+	if (ret < 0) {
+		nfs_drop_inode(inode);
+		nfs_journal_stop();
+		nfs_free_dentry(dentry);
+		return ret;
+	}
+	nfs_write_inode(inode);
+	nfs_write_inode(last_dentry->inode);
+	nfs_sync_groups();
+	nfs_journal_stop();
 
 	return NFS_ERROR_NONE;
 }
@@ -350,6 +421,71 @@ int newfs_opendir(const char* path, struct fuse_file_info* fi) {
 	return 0;
 }
 
+/**
+ * @brief 同步文件：只写回该文件的脏块、inode与通往它的各级目录，提交日志后返回
+ * 
+ * @param path 相对于挂载点的路径
+ * @param datasync 非0时为fdatasync；文件的数据块在创建时已固定，与fsync相同
+ * @param fi 可忽略
+ * @return int 0成功，否则返回对应错误号
+ */
+int newfs_fsync(const char* path, int datasync, struct fuse_file_info* fi) {
+	boolean	is_find, is_root;
+	struct nfs_dentry* dentry = nfs_lookup(path, &is_find, &is_root);
+
+	(void)datasync;
+	if (dentry == NULL) {
+		return -NFS_ERROR_IO;
+	}
+	if (is_find == FALSE) {
+		return -NFS_ERROR_NOTFOUND;
+	}
+	return nfs_fsync_inode(dentry->inode, TRUE);
+}
+
+/**
+ * @brief 同步目录：只写回该目录自身的目录块与inode，不递归子目录
+ * 
+ * @param path 相对于挂载点的路径
+ * @param datasync 可忽略
+ * @param fi 可忽略
+ * @return int 0成功，否则返回对应错误号
+ */
+int newfs_fsyncdir(const char* path, int datasync, struct fuse_file_info* fi) {
+	return newfs_fsync(path, datasync, fi);
+}
+
+/**
+ * @brief close时调用：写回文件的脏块，元数据写入运行中事务，由日志线程提交
+ * 
+ * @param path 相对于挂载点的路径
+ * @param fi 可忽略
+ * @return int 0成功，否则返回对应错误号
+ */
+int newfs_flush(const char* path, struct fuse_file_info* fi) {
+	boolean	is_find, is_root;
+	struct nfs_dentry* dentry = nfs_lookup(path, &is_find, &is_root);
+
+	if (dentry == NULL) {
+		return -NFS_ERROR_IO;
+	}
+	if (is_find == FALSE) {
+		return -NFS_ERROR_NOTFOUND;
+	}
+	return nfs_fsync_inode(dentry->inode, FALSE);
+}
+
+/**
+ * @brief 文件的最后一次close：flush之后仍有修改（如dup出的描述符）时再写回一次
+ * 
+ * @param path 相对于挂载点的路径
+ * @param fi 可忽略
+ * @return int 0成功，否则返回对应错误号
+ */
+int newfs_release(const char* path, struct fuse_file_info* fi) {
+	return newfs_flush(path, fi);
+}
+
 /**
  * @brief 改变文件大小
  * 
@@ -391,6 +527,9 @@ int main(int argc, char **argv)
 
 	if (fuse_opt_parse(&args, &nfs_options, option_spec, NULL) == -1)
 		return -1;
+	/* 内存inode由LRU回收，且各操作不对inode加锁，因此固定单线程处理FUSE请求 */
+	if (fuse_opt_add_arg(&args, "-s") == -1)
+		return -1;
 	
 	ret = fuse_main(args.argc, args.argv, &operations, NULL);
 	fuse_opt_free_args(&args);
@@ -0,0 +1,146 @@
+#include "../include/newfs.h"
+
+extern struct nfs_super      nfs_super;
+
+/******************************************************************************
+* SECTION: inode/dentry缓存
+*******************************************************************************/
+/*
+ * 所有内存inode按最近使用顺序挂在LRU链表上，nfs_lookup经过的inode移到表头。
+ * inode的ref记录内存中有几个子inode，ref为0的inode是内存目录树的叶子，可以
+ * 回收：有未写回的修改时先nfs_sync_inode，再释放其子dentry、子项表与数据块
+ * 缓存，父目录的ref随之减1，于是父目录也可能成为可回收的叶子。根inode常驻。
+ *
+ * 回收只在nfs_lookup开始时进行：每个文件系统操作都从一次nfs_lookup开始，
+ * 而main以-s让FUSE单线程处理请求，此时没有其他操作持有inode或dentry指针。
+ * 日志提交线程只接触日志缓冲区，不访问内存inode。
+ */
+
+/**
+ * @brief inode当前的内存占用：inode本身、数据块缓存、子dentry与子项表
+ */
+static int nfs_inode_mem(struct nfs_inode* inode) {
+    int mem = sizeof(struct nfs_inode);
+    int i;
+
+    for (i = 0; i < NFS_DATA_PER_FILE; i++) {
+        if (inode->data[i] != NULL) {
+            mem += NFS_BLK_SZ();
+        }
+    }
+    if (inode->dtable != NULL) {                        // 子项表登记了所有内存中的子dentry
+        mem += sizeof(struct nfs_dtable) + inode->dtable->cap * (1 + sizeof(struct nfs_dentry *))
+             + inode->dtable->size * sizeof(struct nfs_dentry);
+    }
+    return mem;
+}
+
+static void nfs_lru_unlink(struct nfs_inode* inode) {
+    if (inode->lru_prev != NULL) {
+        inode->lru_prev->lru_next = inode->lru_next;
+    } else {
+        nfs_super.lru_head = inode->lru_next;
+    }
+    if (inode->lru_next != NULL) {
+        inode->lru_next->lru_prev = inode->lru_prev;
+    } else {
+        nfs_super.lru_tail = inode->lru_prev;
+    }
+    inode->lru_prev = inode->lru_next = NULL;
+}
+
+static void nfs_lru_push(struct nfs_inode* inode) {
+    inode->lru_prev = NULL;
+    inode->lru_next = nfs_super.lru_head;
+    if (nfs_super.lru_head != NULL) {
+        nfs_super.lru_head->lru_prev = inode;
+    } else {
+        nfs_super.lru_tail = inode;
+    }
+    nfs_super.lru_head = inode;
+}
+
+/**
+ * @brief 新读入或新分配的inode加入缓存，并增加父目录inode的引用
+ */
+void nfs_cache_add(struct nfs_inode* inode) {
+    struct nfs_dentry* parent = inode->dentry->parent;
+
+    inode->ref = 0;
+    inode->mem = nfs_inode_mem(inode);
+    nfs_super.cache_bytes += inode->mem;
+    nfs_lru_push(inode);
+    if (parent != NULL && parent->inode != NULL) {
+        parent->inode->ref++;
+    }
+}
+
+/**
+ * @brief 标记inode最近被使用，并更新其内存占用
+ */
+void nfs_cache_touch(struct nfs_inode* inode) {
+    nfs_super.cache_bytes -= inode->mem;
+    inode->mem = nfs_inode_mem(inode);
+    nfs_super.cache_bytes += inode->mem;
+    if (nfs_super.lru_head != inode) {
+        nfs_lru_unlink(inode);
+        nfs_lru_push(inode);
+    }
+}
+
+/**
+ * @brief 释放内存inode：子dentry、子项表、数据块缓存，并解除与dentry、父目录的关联
+ *
+ * 调用者保证inode没有内存中的子inode（ref为0）且修改已写回。
+ */
+void nfs_free_inode(struct nfs_inode* inode) {
+    struct nfs_dentry* parent = inode->dentry->parent;
+    struct nfs_dentry* cursor;
+    struct nfs_dentry* next;
+    int i;
+
+    nfs_lru_unlink(inode);
+    nfs_super.cache_bytes -= inode->mem;
+    for (cursor = inode->dentrys; cursor != NULL; cursor = next) {
+        next = cursor->brother;
+        nfs_free_dentry(cursor);
+    }
+    nfs_dtable_free(inode);
+    for (i = 0; i < NFS_DATA_PER_FILE; i++) {
+        nfs_slab_free(&nfs_super.blk_slab, inode->data[i]);
+    }
+    if (parent != NULL && parent->inode != NULL) {
+        parent->inode->ref--;
+    }
+    inode->dentry->inode = NULL;
+    nfs_slab_free(&nfs_super.inode_slab, inode);
+}
+
+/**
+ * @brief 缓存超过mem_cap时从LRU表尾回收未被引用的inode
+ */
+void nfs_cache_shrink() {
+    struct nfs_inode* inode = nfs_super.lru_tail;
+    struct nfs_inode* next;
+    struct nfs_inode* parent;
+
+    if (nfs_super.cache_cap <= 0) {
+        return;
+    }
+    while (inode != NULL && nfs_super.cache_bytes > nfs_super.cache_cap) {
+        next = inode->lru_prev;
+        if (inode->ref == 0) {
+            parent = inode->dentry->parent != NULL ? inode->dentry->parent->inode : NULL;
+            if ((inode->dirty || inode->blk_dirty) && nfs_sync_inode(inode) != NFS_ERROR_NONE) {
+                inode = next;                           // 写回失败的inode留在内存中
+                continue;
+            }
+            nfs_free_inode(inode);
+            // 父目录比子inode更早被访问，位于表尾一侧，已经跳过；它刚成为叶子时接着回收
+            if (parent != NULL && parent->ref == 0) {
+                next = parent;
+            }
+        }
+        inode = next;
+    }
+}
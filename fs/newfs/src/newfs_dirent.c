@@ -0,0 +1,156 @@
+#include "../include/newfs.h"
+
+extern struct nfs_super      nfs_super;
+
+/******************************************************************************
+* SECTION: 变长目录项块
+*******************************************************************************/
+/*
+ * 线性目录的数据块与索引目录的叶子块都由变长目录项铺满。每条目录项只占
+ * NFS_DENTRY_D_LEN(name_len)字节，短文件名的目录一块可放几十项。
+ *
+ * 插入：找到第一条尾部空闲不小于新目录项长度的记录，把空闲部分切出来；
+ * 删除：把记录并入前一条的rec_len，块首的记录则置为空闲，空闲空间总是
+ * 与相邻记录合并，不会产生碎片。
+ */
+
+/**
+ * @brief 把块初始化为一条覆盖整块的空闲目录项
+ */
+void nfs_dirblk_init(uint8_t* blk) {
+    struct nfs_dentry_d* rec = NFS_DENTRY_D_AT(blk, 0);
+    memset(blk, 0, NFS_BLK_SZ());
+    rec->rec_len = NFS_BLK_SZ();
+}
+
+/**
+ * @brief 校验块内目录项链，读出目录块后、遍历之前调用
+ *
+ * 名字长度不小于NFS_MAX_FILE_NAME的目录项放不进内存dentry，同样视为损坏。
+ *
+ * @return int 0合法，否则返回-NFS_ERROR_IO
+ */
+int nfs_dirblk_check(uint8_t* blk) {
+    struct nfs_dentry_d* rec;
+    int ofs;
+    for (ofs = 0; ofs < NFS_BLK_SZ(); ofs += rec->rec_len) {
+        rec = NFS_DENTRY_D_AT(blk, ofs);
+        if (rec->rec_len < NFS_DENTRY_D_LEN(0) || rec->rec_len % 4 != 0
+            || ofs + rec->rec_len > NFS_BLK_SZ() || NFS_DENTRY_D_LEN(rec->name_len) > rec->rec_len
+            || rec->name_len >= NFS_MAX_FILE_NAME) {
+            NFS_DBG("[%s] corrupted dentry at %d\n", __func__, ofs);
+            return -NFS_ERROR_IO;
+        }
+    }
+    return NFS_ERROR_NONE;
+}
+
+/**
+ * @brief 在块中放入dentry，占用第一段足够大的空闲空间
+ *
+ * @return int 新目录项在块内的偏移，空间不足返回-NFS_ERROR_NOSPACE，
+ *             名字过长返回-NFS_ERROR_NAMETOOLONG
+ */
+int nfs_dirblk_add(uint8_t* blk, struct nfs_dentry* dentry) {
+    struct nfs_dentry_d* rec;
+    struct nfs_dentry_d* tail;
+    int name_len = strlen(dentry->fname);
+    int need     = NFS_DENTRY_D_LEN(name_len);
+    int ofs, used;
+
+    if (name_len >= NFS_MAX_FILE_NAME) {                // 读回时放不进dentry的fname
+        return -NFS_ERROR_NAMETOOLONG;
+    }
+    for (ofs = 0; ofs < NFS_BLK_SZ(); ofs += rec->rec_len) {
+        rec  = NFS_DENTRY_D_AT(blk, ofs);
+        used = rec->name_len ? NFS_DENTRY_D_LEN(rec->name_len) : 0;
+        if (rec->rec_len - used < need) {
+            continue;
+        }
+        if (used) {                                     // 从记录尾部的空闲空间中切出新记录
+            tail = NFS_DENTRY_D_AT(blk, ofs + used);
+            tail->rec_len = rec->rec_len - used;
+            rec->rec_len  = used;
+            rec = tail;
+            ofs += used;
+        }
+        rec->ino      = dentry->ino;
+        rec->name_len = name_len;
+        rec->ftype    = dentry->ftype;
+        memcpy(rec->fname, dentry->fname, name_len);
+        return ofs;
+    }
+    return -NFS_ERROR_NOSPACE;
+}
+
+/**
+ * @brief 块内最大的一段空闲空间（字节），不小于NFS_DENTRY_D_LEN(name_len)时可放入新目录项
+ */
+int nfs_dirblk_max_free(uint8_t* blk) {
+    struct nfs_dentry_d* rec;
+    int ofs, slack, max_free = 0;
+
+    for (ofs = 0; ofs < NFS_BLK_SZ(); ofs += rec->rec_len) {
+        rec   = NFS_DENTRY_D_AT(blk, ofs);
+        slack = rec->rec_len - (rec->name_len ? NFS_DENTRY_D_LEN(rec->name_len) : 0);
+        if (slack > max_free) {
+            max_free = slack;
+        }
+    }
+    return max_free;
+}
+
+/**
+ * @brief 在块中按名字查找目录项
+ *
+ * @return int 目录项在块内的偏移，未找到返回-1
+ */
+int nfs_dirblk_find(uint8_t* blk, const char* fname) {
+    struct nfs_dentry_d* rec;
+    int name_len = strlen(fname);
+    int ofs;
+
+    for (ofs = 0; ofs < NFS_BLK_SZ(); ofs += rec->rec_len) {
+        rec = NFS_DENTRY_D_AT(blk, ofs);
+        if (rec->name_len == name_len && memcmp(rec->fname, fname, name_len) == 0) {
+            return ofs;
+        }
+    }
+    return -1;
+}
+
+/**
+ * @brief 删除块内偏移ofs处的目录项，空间并入前一条记录
+ */
+void nfs_dirblk_del(uint8_t* blk, int ofs) {
+    struct nfs_dentry_d* rec  = NFS_DENTRY_D_AT(blk, ofs);
+    struct nfs_dentry_d* prev = NULL;
+    int cur;
+
+    for (cur = 0; cur < ofs; cur += NFS_DENTRY_D_AT(blk, cur)->rec_len) {
+        prev = NFS_DENTRY_D_AT(blk, cur);
+    }
+    if (prev != NULL) {
+        prev->rec_len += rec->rec_len;
+    } else {
+        rec->ino      = 0;
+        rec->name_len = 0;
+    }
+}
+
+/**
+ * @brief 由磁盘目录项创建内存dentry（parent由调用者设置）
+ */
+struct nfs_dentry* nfs_dirblk_load(struct nfs_dentry_d* rec) {
+    char fname[NFS_MAX_FILE_NAME];
+    struct nfs_dentry* dentry;
+
+    memcpy(fname, rec->fname, rec->name_len);
+    fname[rec->name_len] = '\0';
+    dentry = new_dentry(fname, (NFS_FILE_TYPE)rec->ftype);
+    if (dentry == NULL) {
+        return NULL;
+    }
+    dentry->ino = rec->ino;
+    return dentry;
+}
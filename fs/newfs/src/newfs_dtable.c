@@ -0,0 +1,265 @@
+#include "../include/newfs.h"
+
+extern struct nfs_super      nfs_super;
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+/******************************************************************************
+* SECTION: 目录子项表
+*******************************************************************************/
+/*
+ * 每个内存目录维护一张开放寻址表：ctrl[]是一字节的控制数组，有效槽位存
+ * 名字哈希的高7位，EMPTY/DELETED最高位为1；slots[]存对应的目录项指针。
+ * 查找时用哈希低位选中一组16个槽位，一条SSE2比较同时筛出标签相同的槽位，
+ * 只有标签命中的槽位才去比较dentry中的名字。热目录的一次查找通常只读
+ * 一组ctrl（16字节）和一个slots缓存行，不再沿brother链表逐个比较。
+ *
+ * dentrys链表保持不变，readdir、刷盘等仍按链表顺序遍历。
+ *
+ * slots[]与ctrl[]放在同一次分配中。大多数目录不超过14项，只用一组槽位，
+ * 表头与这种最小的槽位数组都从slab分配，目录被逐出缓存后再读入时不再
+ * 调用malloc；更大的表仍向堆申请。
+ */
+#define NFS_DTABLE_TAG(hash)        ((uint8_t)((hash) >> 25))
+#define NFS_DTABLE_GROUPS(t)        ((t)->cap / NFS_DTABLE_GROUP)
+
+/**
+ * @brief 文件名哈希（FNV-1a）
+ */
+static uint32_t nfs_dtable_hash(const char* name) {
+    uint32_t hash = 2166136261u;
+    while (*name) {
+        hash ^= (uint8_t)*name++;
+        hash *= 16777619u;
+    }
+    return hash;
+}
+
+/**
+ * @brief 一组16个控制字节中等于tag的槽位掩码
+ */
+static inline uint32_t nfs_dtable_match(const uint8_t* ctrl, uint8_t tag) {
+#ifdef __SSE2__
+    __m128i group = _mm_loadu_si128((const __m128i *)ctrl);
+    return (uint32_t)_mm_movemask_epi8(_mm_cmpeq_epi8(group, _mm_set1_epi8((char)tag)));
+#else
+    uint32_t mask = 0;
+    int i;
+    for (i = 0; i < NFS_DTABLE_GROUP; i++) {
+        if (ctrl[i] == tag) {
+            mask |= 1u << i;
+        }
+    }
+    return mask;
+#endif
+}
+
+/**
+ * @brief 一组中可插入（EMPTY或DELETED，即最高位为1）的槽位掩码
+ */
+static inline uint32_t nfs_dtable_match_free(const uint8_t* ctrl) {
+#ifdef __SSE2__
+    return (uint32_t)_mm_movemask_epi8(_mm_loadu_si128((const __m128i *)ctrl));
+#else
+    uint32_t mask = 0;
+    int i;
+    for (i = 0; i < NFS_DTABLE_GROUP; i++) {
+        if (ctrl[i] & 0x80) {
+            mask |= 1u << i;
+        }
+    }
+    return mask;
+#endif
+}
+
+/**
+ * @brief 把dentry放进第一个可插入的槽位，调用者保证表未满
+ */
+static void nfs_dtable_place(struct nfs_dtable* table, struct nfs_dentry* dentry, uint32_t hash) {
+    int      mask = NFS_DTABLE_GROUPS(table) - 1;
+    int      group = hash & mask;
+    int      step, pos;
+    uint32_t free_mask;
+
+    for (step = 1; ; step++) {
+        free_mask = nfs_dtable_match_free(table->ctrl + group * NFS_DTABLE_GROUP);
+        if (free_mask) {
+            pos = group * NFS_DTABLE_GROUP + __builtin_ctz(free_mask);
+            if (table->ctrl[pos] == NFS_DTABLE_EMPTY) {
+                table->used++;
+            }
+            table->ctrl[pos]  = NFS_DTABLE_TAG(hash);
+            table->slots[pos] = dentry;
+            table->size++;
+            return;
+        }
+        group = (group + step) & mask;                  // 三角数步长，组数为2的幂时可遍历所有组
+    }
+}
+
+/**
+ * @brief 分配cap个槽位的slots[]与紧随其后的ctrl[]
+ */
+static struct nfs_dentry** nfs_dtable_arrays_alloc(int cap) {
+    if (cap == NFS_DTABLE_GROUP) {
+        return (struct nfs_dentry **)nfs_slab_alloc(&nfs_super.dtable_arr_slab);
+    }
+    return (struct nfs_dentry **)malloc(cap * (sizeof(struct nfs_dentry *) + 1));
+}
+
+static void nfs_dtable_arrays_free(struct nfs_dentry** slots, int cap) {
+    if (cap == NFS_DTABLE_GROUP) {
+        nfs_slab_free(&nfs_super.dtable_arr_slab, slots);
+    } else {
+        free(slots);
+    }
+}
+
+/**
+ * @brief 以cap个槽位重建表，同时清除墓碑
+ */
+static int nfs_dtable_rehash(struct nfs_dtable* table, int cap) {
+    uint8_t*            old_ctrl  = table->ctrl;
+    struct nfs_dentry** old_slots = table->slots;
+    int                 old_cap   = table->cap;
+    int                 i;
+
+    table->slots = nfs_dtable_arrays_alloc(cap);
+    if (table->slots == NULL) {
+        table->slots = old_slots;
+        return -NFS_ERROR_NOSPACE;
+    }
+    table->ctrl = (uint8_t *)(table->slots + cap);
+    memset(table->ctrl, NFS_DTABLE_EMPTY, cap);
+    table->cap  = cap;
+    table->size = 0;
+    table->used = 0;
+    for (i = 0; i < old_cap; i++) {
+        if (!(old_ctrl[i] & 0x80)) {
+            nfs_dtable_place(table, old_slots[i], nfs_dtable_hash(old_slots[i]->fname));
+        }
+    }
+    if (old_slots != NULL) {
+        nfs_dtable_arrays_free(old_slots, old_cap);
+    }
+    return NFS_ERROR_NONE;
+}
+
+/**
+ * @brief 把目录项加入目录inode的子项表，首次插入时建表
+ *
+ * @param inode 目录inode
+ * @param dentry 待挂到inode->dentrys上的目录项，调用者保证同名项不存在
+ * @return int 0成功，内存不足时返回错误码
+ */
+int nfs_dtable_insert(struct nfs_inode* inode, struct nfs_dentry* dentry) {
+    struct nfs_dtable* table = inode->dtable;
+    int ret, cap;
+
+    if (table == NULL) {
+        table = (struct nfs_dtable *)nfs_slab_alloc(&nfs_super.dtable_slab);
+        if (table == NULL) {
+            return -NFS_ERROR_NOSPACE;
+        }
+        memset(table, 0, sizeof(struct nfs_dtable));
+        if ((ret = nfs_dtable_rehash(table, NFS_DTABLE_GROUP)) != NFS_ERROR_NONE) {
+            nfs_slab_free(&nfs_super.dtable_slab, table);
+            return ret;
+        }
+        inode->dtable = table;
+    }
+    // 有效项与墓碑合计不超过7/8，保证每条探测序列上总有EMPTY槽位结束查找
+    if (table->used + 1 > table->cap / 8 * 7) {
+        cap = table->size + 1 > table->cap / 2 ? table->cap * 2 : table->cap;
+        ret = nfs_dtable_rehash(table, cap);
+        if (ret != NFS_ERROR_NONE) {
+            return ret;
+        }
+    }
+    nfs_dtable_place(table, dentry, nfs_dtable_hash(dentry->fname));
+    return NFS_ERROR_NONE;
+}
+
+/**
+ * @brief 在目录inode的子项表中按名字精确查找
+ *
+ * @return struct nfs_dentry* 找到的目录项，否则返回NULL
+ */
+struct nfs_dentry* nfs_dtable_find(struct nfs_inode* inode, const char* fname) {
+    struct nfs_dtable* table = inode->dtable;
+    struct nfs_dentry* dentry;
+    const uint8_t*     ctrl;
+    uint32_t hash, match;
+    uint8_t  tag;
+    int      mask, group, step;
+
+    if (table == NULL) {
+        return NULL;
+    }
+    hash  = nfs_dtable_hash(fname);
+    tag   = NFS_DTABLE_TAG(hash);
+    mask  = NFS_DTABLE_GROUPS(table) - 1;
+    group = hash & mask;
+    for (step = 1; step <= NFS_DTABLE_GROUPS(table); step++) {
+        ctrl  = table->ctrl + group * NFS_DTABLE_GROUP;
+        match = nfs_dtable_match(ctrl, tag);
+        while (match) {
+            dentry = table->slots[group * NFS_DTABLE_GROUP + __builtin_ctz(match)];
+            if (strncmp(dentry->fname, fname, NFS_MAX_FILE_NAME) == 0) {
+                return dentry;
+            }
+            match &= match - 1;
+        }
+        if (nfs_dtable_match(ctrl, NFS_DTABLE_EMPTY)) {
+            return NULL;                                // 探测序列遇到EMPTY即可断定不存在
+        }
+        group = (group + step) & mask;
+    }
+    return NULL;
+}
+
+/**
+ * @brief 从目录inode的子项表中移除dentry（留下墓碑），不改动dentrys链表
+ */
+void nfs_dtable_remove(struct nfs_inode* inode, struct nfs_dentry* dentry) {
+    struct nfs_dtable* table = inode->dtable;
+    const uint8_t*     ctrl;
+    uint32_t hash, match;
+    int      mask, group, step, pos;
+
+    if (table == NULL) {
+        return;
+    }
+    hash  = nfs_dtable_hash(dentry->fname);
+    mask  = NFS_DTABLE_GROUPS(table) - 1;
+    group = hash & mask;
+    for (step = 1; step <= NFS_DTABLE_GROUPS(table); step++) {
+        ctrl  = table->ctrl + group * NFS_DTABLE_GROUP;
+        match = nfs_dtable_match(ctrl, NFS_DTABLE_TAG(hash));
+        while (match) {
+            pos = group * NFS_DTABLE_GROUP + __builtin_ctz(match);
+            if (table->slots[pos] == dentry) {
+                table->ctrl[pos] = NFS_DTABLE_DELETED;
+                table->size--;
+                return;
+            }
+            match &= match - 1;
+        }
+        if (nfs_dtable_match(ctrl, NFS_DTABLE_EMPTY)) {
+            return;
+        }
+        group = (group + step) & mask;
+    }
+}
+
+/**
+ * @brief 释放目录inode的子项表
+ */
+void nfs_dtable_free(struct nfs_inode* inode) {
+    if (inode->dtable != NULL) {
+        nfs_dtable_arrays_free(inode->dtable->slots, inode->dtable->cap);
+        nfs_slab_free(&nfs_super.dtable_slab, inode->dtable);
+        inode->dtable = NULL;
+    }
+}
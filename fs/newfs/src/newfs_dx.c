@@ -0,0 +1,499 @@
+#include "../include/newfs.h"
+
+extern struct nfs_super      nfs_super;
+
+/******************************************************************************
+* SECTION: 目录哈希索引（htree）
+*******************************************************************************/
+/*
+ * 索引目录的block_pointer[0]是索引根块，根块之下至多一层中间索引块，
+ * 每个索引项指向一个子块并记录子块中最小的哈希值。查找时在每层索引块内
+ * 二分，只读取根块、（中间块）和哈希对应的叶子块。叶子块写满时按哈希
+ * 对半分裂，哈希相同的目录项总在同一个叶子块中。
+ *
+ * 叶子块是变长目录项块，按字节而不是按项数分裂。1KB块：每个索引块126项，
+ * 10字节左右的文件名每个叶子块约50项，两层索引可容纳数十万个目录项。
+ */
+#define NFS_DX_LIMIT()      ((int)((NFS_BLK_SZ() - sizeof(struct nfs_dx_node)) / sizeof(struct nfs_dx_entry)))
+
+struct nfs_dx_frame                                     // 查找路径上的一层索引块
+{
+    int                 dno;                            // 索引块号（含NFS_DNO_BASE偏移）
+    int                 at;                             // 下降时经过的索引项下标
+    struct nfs_dx_node* node;
+};
+
+/**
+ * @brief 文件名哈希（FNV-1a）
+ */
+static uint32_t nfs_dx_hash(const char* name) {
+    uint32_t hash = 2166136261u;
+    while (*name) {
+        hash ^= (uint8_t)*name++;
+        hash *= 16777619u;
+    }
+    return hash;
+}
+
+static int nfs_dx_read_blk(int dno, void* buf) {
+    return nfs_journal_read(NFS_DATA_OFS(dno - NFS_DNO_BASE), (uint8_t *)buf, NFS_BLK_SZ());
+}
+
+static int nfs_dx_write_blk(int dno, void* buf) {
+    return nfs_journal_write(NFS_DATA_OFS(dno - NFS_DNO_BASE), (uint8_t *)buf, NFS_BLK_SZ());
+}
+
+/**
+ * @brief 在索引块内二分查找，返回最后一个下界不大于hash的索引项
+ */
+static int nfs_dx_search(struct nfs_dx_node* node, uint32_t hash) {
+    int lo = 1, hi = node->count - 1, mid, at = 0;
+    while (lo <= hi) {
+        mid = (lo + hi) / 2;
+        if (node->entries[mid].hash <= hash) {
+            at = mid;
+            lo = mid + 1;
+        } else {
+            hi = mid - 1;
+        }
+    }
+    return at;
+}
+
+static void nfs_dx_insert_entry(struct nfs_dx_node* node, int at, uint32_t hash, int dno) {
+    memmove(&node->entries[at + 2], &node->entries[at + 1],
+            (node->count - at - 1) * sizeof(struct nfs_dx_entry));
+    node->entries[at + 1].hash = hash;
+    node->entries[at + 1].dno  = dno;
+    node->count++;
+}
+
+/**
+ * @brief 从根块下降到hash对应的叶子块，frames记录经过的索引块
+ *
+ * 索引块从临时缓冲区分配，由调用者的nfs_scratch_release统一释放。
+ *
+ * @return int 叶子块号，失败返回错误码
+ */
+static int nfs_dx_probe(struct nfs_inode* inode, uint32_t hash, struct nfs_dx_frame* frames, int* depth) {
+    struct nfs_dx_frame* frame;
+    int levels = 0;
+
+    for (*depth = 0; *depth <= levels; (*depth)++) {
+        frame       = &frames[*depth];
+        frame->dno  = *depth == 0 ? inode->block_pointer[0] : frames[*depth - 1].node->entries[frames[*depth - 1].at].dno;
+        frame->node = (struct nfs_dx_node *)nfs_scratch_alloc(NFS_BLK_SZ());
+        if (nfs_dx_read_blk(frame->dno, frame->node) != NFS_ERROR_NONE) {
+            return -NFS_ERROR_IO;
+        }
+        if (*depth == 0) {
+            levels = frame->node->levels;
+        }
+        if (levels >= NFS_DX_MAX_LEVELS || frame->node->count <= 0 || frame->node->count > NFS_DX_LIMIT()) {
+            NFS_DBG("[%s] corrupted index block %d\n", __func__, frame->dno);
+            return -NFS_ERROR_IO;
+        }
+        frame->at = nfs_dx_search(frame->node, hash);
+    }
+    return frames[*depth - 1].node->entries[frames[*depth - 1].at].dno;
+}
+
+/**
+ * @brief 叶子块中的目录项转为内存dentry，用于排序与分裂
+ */
+static void nfs_dx_fill(struct nfs_dentry* ent, struct nfs_dentry_d* rec) {
+    memset(ent, 0, sizeof(struct nfs_dentry));
+    memcpy(ent->fname, rec->fname, rec->name_len);
+    ent->ftype = (NFS_FILE_TYPE)rec->ftype;
+    ent->ino   = rec->ino;
+}
+
+/**
+ * @brief 按哈希升序排列目录项（插入排序，数量不超过一个目录的线性上限）
+ */
+static void nfs_dx_sort(struct nfs_dentry* ents, int cnt) {
+    struct nfs_dentry tmp;
+    int i, j;
+    for (i = 1; i < cnt; i++) {
+        tmp = ents[i];
+        for (j = i; j > 0 && nfs_dx_hash(ents[j - 1].fname) > nfs_dx_hash(tmp.fname); j--) {
+            ents[j] = ents[j - 1];
+        }
+        ents[j] = tmp;
+    }
+}
+
+/**
+ * @brief 从start开始取至多limit字节的目录项，且不把相同哈希拆到两个叶子块
+ *
+ * @return int 本叶子块的结束下标，无法在哈希边界处切分时返回-1
+ */
+static int nfs_dx_chunk_end(struct nfs_dentry* ents, int start, int cnt, int limit) {
+    int end = start, bytes = 0;
+    while (end < cnt && bytes + NFS_DENTRY_D_LEN(strlen(ents[end].fname)) <= limit) {
+        bytes += NFS_DENTRY_D_LEN(strlen(ents[end].fname));
+        end++;
+    }
+    while (end < cnt && end > start && nfs_dx_hash(ents[end - 1].fname) == nfs_dx_hash(ents[end].fname)) {
+        end--;
+    }
+    return end > start ? end : -1;
+}
+
+static int nfs_dx_write_leaf(int dno, struct nfs_dentry* ents, int cnt) {
+    struct nfs_scratch_mark mark = nfs_scratch_mark();
+    uint8_t* buf = (uint8_t *)nfs_scratch_alloc(NFS_BLK_SZ());
+    int i, ret;
+    nfs_dirblk_init(buf);
+    for (i = 0; i < cnt; i++) {
+        nfs_dirblk_add(buf, &ents[i]);
+    }
+    ret = nfs_dx_write_blk(dno, buf);
+    nfs_scratch_release(mark);
+    return ret;
+}
+
+/**
+ * @brief 在frames的最底层索引块中、经过的索引项之后插入{hash, dno}
+ *
+ * 索引块已满时对半分裂，新索引块登记到上一层；根块满时先把全部索引项
+ * 下移到新的中间块，根块只指向它，再按中间块满处理。根块与中间块都满时
+ * 目录达到容量上限。新索引块从临时缓冲区分配，随调用者的mark释放。
+ */
+static int nfs_dx_insert(struct nfs_inode* inode, struct nfs_dx_frame* frames, int depth,
+                         uint32_t hash, int dno) {
+    struct nfs_dx_frame* frame = &frames[depth - 1];
+    struct nfs_dx_frame* root  = &frames[0];
+    struct nfs_dx_frame  grown = { -1, 0, NULL };
+    struct nfs_dx_node*  sib;
+    int sib_dno, mid, ret;
+
+    if (frame->node->count < NFS_DX_LIMIT()) {
+        nfs_dx_insert_entry(frame->node, frame->at, hash, dno);
+        return nfs_dx_write_blk(frame->dno, frame->node);
+    }
+    if (depth == NFS_DX_MAX_LEVELS && root->node->count == NFS_DX_LIMIT()) {
+        return -NFS_ERROR_NOSPACE;
+    }
+
+    if (depth == 1) {                                   // 根块增加一层
+        grown.dno = nfs_alloc_data_near(inode, root->dno);
+        if (grown.dno < 0) {
+            return grown.dno;
+        }
+        inode->size += NFS_BLK_SZ();                    // 目录大小按占用的块计
+        grown.node = (struct nfs_dx_node *)nfs_scratch_alloc(NFS_BLK_SZ());
+        memcpy(grown.node, root->node, NFS_BLK_SZ());
+        grown.at = root->at;
+        root->node->levels = 1;
+        root->node->count  = 1;
+        root->node->entries[0].hash = 0;
+        root->node->entries[0].dno  = grown.dno;
+        root->at = 0;
+        frame    = &grown;
+    }
+
+    sib_dno = nfs_alloc_data_near(inode, frame->dno);
+    if (sib_dno < 0) {
+        if (grown.node != NULL) {                       // 撤销根块的改动
+            memcpy(root->node, grown.node, NFS_BLK_SZ());
+            root->at = grown.at;
+            nfs_free_data_blk(grown.dno);
+            inode->size -= NFS_BLK_SZ();
+        }
+        return sib_dno;
+    }
+    inode->size += NFS_BLK_SZ();
+    sib = (struct nfs_dx_node *)nfs_scratch_alloc(NFS_BLK_SZ());
+    memset(sib, 0, NFS_BLK_SZ());
+    sib->limit = NFS_DX_LIMIT();
+
+    // 后一半索引项移到新索引块，新项按位置落入其中一块
+    mid        = frame->node->count / 2;
+    sib->count = frame->node->count - mid;
+    memcpy(sib->entries, &frame->node->entries[mid], sib->count * sizeof(struct nfs_dx_entry));
+    frame->node->count  = mid;
+    if (frame->at >= mid) {
+        nfs_dx_insert_entry(sib, frame->at - mid, hash, dno);
+    } else {
+        nfs_dx_insert_entry(frame->node, frame->at, hash, dno);
+    }
+    nfs_dx_insert_entry(root->node, root->at, sib->entries[0].hash, sib_dno);
+
+    ret = nfs_dx_write_blk(frame->dno, frame->node);
+    if (ret == NFS_ERROR_NONE) {
+        ret = nfs_dx_write_blk(sib_dno, sib);
+    }
+    if (ret == NFS_ERROR_NONE) {
+        ret = nfs_dx_write_blk(root->dno, root->node);
+    }
+    return ret;
+}
+
+/**
+ * @brief 在索引目录中插入目录项：放入哈希对应叶子块的空闲空间，放不下时分裂
+ *
+ * @param inode  索引目录的inode
+ * @param dentry 待插入的目录项（ino已分配）
+ * @return int 0成功，否则返回错误码
+ */
+int nfs_dx_add(struct nfs_inode* inode, struct nfs_dentry* dentry) {
+    struct nfs_dx_frame  frames[NFS_DX_MAX_LEVELS];
+    struct nfs_dentry_d* rec;
+    struct nfs_dentry*   ents;
+    struct nfs_scratch_mark mark = nfs_scratch_mark();
+    uint8_t* leaf;
+    int depth, leaf_dno, new_dno, ofs, split, ret;
+    int cnt = 0;
+
+    leaf_dno = nfs_dx_probe(inode, nfs_dx_hash(dentry->fname), frames, &depth);
+    if (leaf_dno < 0) {
+        ret = leaf_dno;
+        goto out;
+    }
+    leaf = (uint8_t *)nfs_scratch_alloc(NFS_BLK_SZ());
+    ret  = nfs_dx_read_blk(leaf_dno, leaf);
+    if (ret == NFS_ERROR_NONE) {
+        ret = nfs_dirblk_check(leaf);
+    }
+    if (ret != NFS_ERROR_NONE) {
+        goto out;
+    }
+
+    // 叶子块有足够的空闲空间，只写这一块
+    ret = nfs_dirblk_add(leaf, dentry);
+    if (ret >= 0) {
+        ret = nfs_dx_write_blk(leaf_dno, leaf);
+        goto out;
+    }
+    if (ret != -NFS_ERROR_NOSPACE) {
+        goto out;
+    }
+
+    // 叶子块放不下：连同新目录项按哈希排序，在靠近半块的哈希边界处分裂
+    ents = (struct nfs_dentry *)nfs_scratch_alloc((NFS_BLK_SZ() / NFS_DENTRY_D_LEN(1) + 1) * sizeof(struct nfs_dentry));
+    for (ofs = 0; ofs < NFS_BLK_SZ(); ofs += rec->rec_len) {
+        rec = NFS_DENTRY_D_AT(leaf, ofs);
+        if (rec->name_len != 0) {
+            nfs_dx_fill(&ents[cnt++], rec);
+        }
+    }
+    ents[cnt++] = *dentry;
+    nfs_dx_sort(ents, cnt);
+    split = nfs_dx_chunk_end(ents, 0, cnt, NFS_BLK_SZ() / 2);
+    if (split < 0 || nfs_dx_chunk_end(ents, split, cnt, NFS_BLK_SZ()) != cnt) {
+        split = nfs_dx_chunk_end(ents, 0, cnt, NFS_BLK_SZ());
+    }
+    if (split < 0 || nfs_dx_chunk_end(ents, split, cnt, NFS_BLK_SZ()) != cnt) {
+        ret = -NFS_ERROR_NOSPACE;                       // 哈希相同的目录项超过一块，无法分裂
+        goto out;
+    }
+
+    new_dno = nfs_alloc_data_near(inode, leaf_dno);
+    if (new_dno < 0) {
+        ret = new_dno;
+        goto out;
+    }
+    ret = nfs_dx_insert(inode, frames, depth, nfs_dx_hash(ents[split].fname), new_dno);
+    if (ret != NFS_ERROR_NONE) {
+        nfs_free_data_blk(new_dno);
+    } else {
+        inode->size += NFS_BLK_SZ();
+        ret = nfs_dx_write_leaf(new_dno, &ents[split], cnt - split);
+        if (ret == NFS_ERROR_NONE) {
+            ret = nfs_dx_write_leaf(leaf_dno, ents, split);
+        }
+    }
+out:
+    nfs_scratch_release(mark);
+    return ret;
+}
+
+/**
+ * @brief 从索引目录中删除fname，只改写所在的叶子块
+ *
+ * 叶子块删空后仍保留在索引中，之后落入该哈希范围的目录项会复用它。
+ *
+ * @return int 0成功，未找到返回-NFS_ERROR_NOTFOUND
+ */
+int nfs_dx_del(struct nfs_inode* inode, const char* fname) {
+    struct nfs_dx_frame frames[NFS_DX_MAX_LEVELS];
+    struct nfs_scratch_mark mark = nfs_scratch_mark();
+    uint8_t* leaf;
+    int depth, leaf_dno, ofs, ret;
+
+    leaf_dno = nfs_dx_probe(inode, nfs_dx_hash(fname), frames, &depth);
+    if (leaf_dno < 0) {
+        nfs_scratch_release(mark);
+        return leaf_dno;
+    }
+
+    leaf = (uint8_t *)nfs_scratch_alloc(NFS_BLK_SZ());
+    ret  = nfs_dx_read_blk(leaf_dno, leaf);
+    if (ret == NFS_ERROR_NONE) {
+        ret = nfs_dirblk_check(leaf);
+    }
+    if (ret == NFS_ERROR_NONE) {
+        ofs = nfs_dirblk_find(leaf, fname);
+        if (ofs < 0) {
+            ret = -NFS_ERROR_NOTFOUND;
+        } else {
+            nfs_dirblk_del(leaf, ofs);
+            ret = nfs_dx_write_blk(leaf_dno, leaf);
+        }
+    }
+    nfs_scratch_release(mark);
+    return ret;
+}
+
+/**
+ * @brief 把线性目录转换为索引目录，同时插入dentry
+ *
+ * 线性目录的目录项全部在内存中。按哈希排序后依次写满叶子块，原第0块改作
+ * 索引根块，其余线性块释放。
+ *
+ * @return int 0成功，否则返回错误码
+ */
+int nfs_dx_convert(struct nfs_inode* inode, struct nfs_dentry* dentry) {
+    struct nfs_dentry*   ents;
+    struct nfs_dx_node*  root;
+    struct nfs_dentry*   cursor;
+    struct nfs_scratch_mark mark = nfs_scratch_mark();
+    int cnt      = inode->dir_cnt + 1;
+    int root_dno = inode->block_pointer[0];
+    int prev     = root_dno;
+    int start, end, dno, i = 0, ret = NFS_ERROR_NONE;
+
+    ents = (struct nfs_dentry *)nfs_scratch_alloc(cnt * sizeof(struct nfs_dentry));
+    for (cursor = inode->dentrys; cursor != NULL; cursor = cursor->brother) {
+        ents[i++] = *cursor;
+    }
+    ents[i] = *dentry;
+    nfs_dx_sort(ents, cnt);
+
+    root = (struct nfs_dx_node *)nfs_scratch_alloc(NFS_BLK_SZ());
+    memset(root, 0, NFS_BLK_SZ());
+    root->limit = NFS_DX_LIMIT();
+    for (start = 0; start < cnt && ret == NFS_ERROR_NONE; start = end) {
+        end = nfs_dx_chunk_end(ents, start, cnt, NFS_BLK_SZ());
+        dno = end < 0 || root->count == root->limit ? -NFS_ERROR_NOSPACE : nfs_alloc_data_near(inode, prev);
+        if (dno < 0) {
+            ret = dno;
+            break;
+        }
+        root->entries[root->count].hash = start == 0 ? 0 : nfs_dx_hash(ents[start].fname);
+        root->entries[root->count].dno  = dno;
+        root->count++;
+        ret  = nfs_dx_write_leaf(dno, &ents[start], end - start);
+        prev = dno;
+    }
+    if (ret == NFS_ERROR_NONE) {
+        ret = nfs_dx_write_blk(root_dno, root);
+    }
+
+    if (ret != NFS_ERROR_NONE) {                        // 回滚已分配的叶子块，目录保持线性
+        for (i = 0; i < root->count; i++) {
+            nfs_free_data_blk(root->entries[i].dno);
+        }
+    } else {
+        for (i = 1; i < NFS_DATA_PER_FILE && inode->block_pointer[i] != 0; i++) {
+            nfs_free_data_blk(inode->block_pointer[i]);
+            inode->block_pointer[i] = 0;
+        }
+        for (i = 0; i < NFS_DATA_PER_FILE; i++) {       // 线性目录块的缓存不再使用
+            nfs_slab_free(&nfs_super.blk_slab, inode->data[i]);
+            inode->data[i] = NULL;
+        }
+        inode->blk_dirty = 0;
+        inode->flags |= NFS_INODE_F_INDEX;
+        inode->size  = NFS_BLKS_SZ(1 + root->count);    // 索引根块与各叶子块
+    }
+    nfs_scratch_release(mark);
+    return ret;
+}
+
+/**
+ * @brief 在索引目录中查找fname，找到后加入目录的dentry缓存
+ *
+ * @return struct nfs_dentry* 找到的目录项，否则返回NULL
+ */
+struct nfs_dentry* nfs_dx_lookup(struct nfs_inode* inode, const char* fname) {
+    struct nfs_dx_frame  frames[NFS_DX_MAX_LEVELS];
+    struct nfs_dentry*   dentry = NULL;
+    struct nfs_scratch_mark mark = nfs_scratch_mark();
+    uint8_t* leaf;
+    int depth, leaf_dno, ofs;
+
+    leaf_dno = nfs_dx_probe(inode, nfs_dx_hash(fname), frames, &depth);
+    if (leaf_dno < 0) {
+        nfs_scratch_release(mark);
+        return NULL;
+    }
+
+    leaf = (uint8_t *)nfs_scratch_alloc(NFS_BLK_SZ());
+    if (nfs_dx_read_blk(leaf_dno, leaf) == NFS_ERROR_NONE && nfs_dirblk_check(leaf) == NFS_ERROR_NONE
+        && (ofs = nfs_dirblk_find(leaf, fname)) >= 0) {
+        dentry = nfs_dirblk_load(NFS_DENTRY_D_AT(leaf, ofs));
+    }
+    if (dentry != NULL) {                               // 分配失败按未找到处理
+        dentry->parent  = inode->dentry;
+        dentry->brother = inode->dentrys;
+        inode->dentrys  = dentry;
+        nfs_dtable_insert(inode, dentry);               // 失败时仅少一项缓存，下次仍可从索引找到
+    }
+    nfs_scratch_release(mark);
+    return dentry;
+}
+
+/**
+ * @brief 按索引顺序遍历叶子块，把offset之后的目录项交给filler，直到buf填满
+ *
+ * offset编码为 叶子序号 * 块大小 + 目录项在块内的字节偏移 + 1，只需读索引块
+ * 即可定位；在叶子块内插入只切分空闲空间，已有目录项的偏移不变。
+ */
+int nfs_dx_readdir(struct nfs_inode* inode, void* buf, fuse_fill_dir_t filler, off_t offset) {
+    struct nfs_scratch_mark mark = nfs_scratch_mark();
+    struct nfs_dx_node*  root   = (struct nfs_dx_node *)nfs_scratch_alloc(NFS_BLK_SZ());
+    struct nfs_dx_node*  node   = (struct nfs_dx_node *)nfs_scratch_alloc(NFS_BLK_SZ());
+    uint8_t*             leaf   = (uint8_t *)nfs_scratch_alloc(NFS_BLK_SZ());
+    struct nfs_dentry_d* rec;
+    char  fname[NFS_MAX_FILE_NAME];
+    off_t base;
+    int   ordinal = 0, full = FALSE, ret = NFS_ERROR_NONE;
+    int   i, j, ofs;
+
+    if (nfs_dx_read_blk(inode->block_pointer[0], root) != NFS_ERROR_NONE) {
+        ret = -NFS_ERROR_IO;
+        goto out;
+    }
+    for (i = 0; i < (root->levels == 0 ? 1 : root->count) && !full; i++) {
+        if (root->levels == 0) {
+            memcpy(node, root, NFS_BLK_SZ());           // 只有根块，当作唯一的底层索引块
+        } else if (nfs_dx_read_blk(root->entries[i].dno, node) != NFS_ERROR_NONE) {
+            ret = -NFS_ERROR_IO;
+            break;
+        }
+        for (j = 0; j < node->count && !full; j++, ordinal++) {
+            base = (off_t)ordinal * NFS_BLK_SZ();
+            if (base + NFS_BLK_SZ() <= offset) {
+                continue;
+            }
+            if (nfs_dx_read_blk(node->entries[j].dno, leaf) != NFS_ERROR_NONE || nfs_dirblk_check(leaf) != NFS_ERROR_NONE) {
+                ret = -NFS_ERROR_IO;
+                goto out;
+            }
+            for (ofs = 0; ofs < NFS_BLK_SZ() && !full; ofs += rec->rec_len) {
+                rec = NFS_DENTRY_D_AT(leaf, ofs);
+                if (rec->name_len == 0 || base + ofs + 1 <= offset) {
+                    continue;
+                }
+                memcpy(fname, rec->fname, rec->name_len);
+                fname[rec->name_len] = '\0';
+                full = filler(buf, fname, NULL, base + ofs + 1);
+            }
+        }
+    }
+out:
+    nfs_scratch_release(mark);
+    return ret;
+}
@@ -0,0 +1,641 @@
+#include "../include/newfs.h"
+#include <time.h>
+
+extern struct nfs_super      nfs_super;
+extern struct custom_options nfs_options;
+
+/******************************************************************************
+* SECTION: 元数据日志
+*******************************************************************************/
+/*
+ * inode、目录块、索引块、位图、块组描述符表与超级块都经nfs_journal_write
+ * 写入运行中的事务（内存中每块一份最新内容），不直接写回原位置。后台线程
+ * 每隔commit_ms把运行中事务作为一批顺序写入循环日志：
+ *
+ *     | 描述块 | 元数据块 ... | 提交块 |
+ *
+ * 提交块写完后事务即持久；这些块再在日志过半或卸载时统一写回原位置
+ * （checkpoint），然后推进日志超级块中的start。挂载时从start开始重放
+ * 校验和正确的事务，提交块缺失或损坏的事务整体丢弃。
+ *
+ * 读元数据时先查运行中事务，再查已提交未写回的块，最后才读磁盘。
+ * 释放的块从两者中移除，并在描述块中记录，重放时不会把旧内容写到已改作
+ * 他用的块上。释放的数据块另外记下，等释放它们的操作提交、崩溃后不会再
+ * 被引用时，才通知设备丢弃。
+ *
+ * 文件系统操作用nfs_journal_start/nfs_journal_stop包住，提交等待进行中的
+ * 操作结束，一个操作的修改总在同一个事务中；只有单个操作写满
+ * NFS_JNL_TXN_MAX块时才在操作中途提交。
+ */
+#define NFS_JNL()                   (&nfs_super.journal)
+#define NFS_JNL_BLK_OFS(j, pos)     ((j)->offset + NFS_BLKS_SZ(1 + (pos)))
+
+/**
+ * @brief 校验和（FNV-1a）
+ */
+static uint32_t nfs_jnl_csum(uint32_t csum, const uint8_t* buf, int size) {
+    while (size-- > 0) {
+        csum ^= *buf++;
+        csum *= 16777619u;
+    }
+    return csum;
+}
+
+/**
+ * @brief 循环日志中已使用的块数
+ */
+static int nfs_jnl_used(struct nfs_journal* j) {
+    return (j->head - j->start + j->blks) % j->blks;
+}
+
+static struct nfs_jblk* nfs_jnl_find(struct nfs_jblk* blks, int nr, int blk) {
+    int i;
+    for (i = 0; i < nr; i++) {
+        if (blks[i].blk == blk) {
+            return &blks[i];
+        }
+    }
+    return NULL;
+}
+
+/**
+ * @brief 从blks中删除一项，内容还给slab
+ */
+static void nfs_jnl_drop(struct nfs_journal* j, struct nfs_jblk* blks, int* nr, struct nfs_jblk* e) {
+    nfs_slab_free(&j->slab, e->data);
+    *e = blks[--(*nr)];
+}
+
+/**
+ * @brief 读写循环日志中从pos开始的cnt块，越过末尾时回到开头
+ */
+static int nfs_jnl_io(struct nfs_journal* j, int pos, uint8_t* buf, int cnt, boolean write) {
+    int first = cnt < j->blks - pos ? cnt : j->blks - pos;
+    int ret;
+
+    ret = write ? nfs_driver_write(NFS_JNL_BLK_OFS(j, pos), buf, NFS_BLKS_SZ(first))
+                : nfs_driver_read(NFS_JNL_BLK_OFS(j, pos), buf, NFS_BLKS_SZ(first));
+    if (ret == NFS_ERROR_NONE && cnt > first) {
+        ret = write ? nfs_driver_write(NFS_JNL_BLK_OFS(j, 0), buf + NFS_BLKS_SZ(first), NFS_BLKS_SZ(cnt - first))
+                    : nfs_driver_read(NFS_JNL_BLK_OFS(j, 0), buf + NFS_BLKS_SZ(first), NFS_BLKS_SZ(cnt - first));
+    }
+    return ret;
+}
+
+static int nfs_jnl_write_super(struct nfs_journal* j) {
+    struct nfs_jnl_super_d jsb;
+    jsb.magic = NFS_JNL_MAGIC;
+    jsb.seq   = j->start_seq;
+    jsb.start = j->start;
+    if (nfs_driver_write(j->offset, (uint8_t *)&jsb, sizeof(struct nfs_jnl_super_d)) != NFS_ERROR_NONE) {
+        return -NFS_ERROR_IO;
+    }
+    return nfs_driver_flush();
+}
+
+/**
+ * @brief 把已提交的块写回原位置，清空循环日志
+ */
+static int nfs_jnl_checkpoint(struct nfs_journal* j) {
+    // 按磁盘偏移排序并合并相邻块后写回，inode表、位图与目录块各自成段写入
+    if (nfs_driver_write_blks(j->committed, j->nr_committed) != NFS_ERROR_NONE) {
+        NFS_DBG("[%s] io error\n", __func__);
+        return -NFS_ERROR_IO;
+    }
+    if (nfs_driver_flush() != NFS_ERROR_NONE) {         // 写回落盘后才能推进start
+        return -NFS_ERROR_IO;
+    }
+    while (j->nr_committed > 0) {
+        nfs_jnl_drop(j, j->committed, &j->nr_committed, &j->committed[j->nr_committed - 1]);
+    }
+    j->start     = j->head;
+    j->start_seq = j->seq;
+    j->checkpoints++;
+    return nfs_jnl_write_super(j);
+}
+
+/**
+ * @brief 把运行中事务顺序写入日志，调用者持有lock
+ */
+static int nfs_jnl_commit(struct nfs_journal* j) {
+    struct nfs_scratch_mark  mark;
+    struct nfs_jnl_desc_d*   desc;
+    struct nfs_jnl_commit_d* commit;
+    struct nfs_jblk*         e;
+    uint8_t* buf;
+    int      need = j->nr_running + 2;
+    int      i, ret;
+
+    if (j->nr_running == 0 && j->nr_revoke == 0) {
+        return NFS_ERROR_NONE;
+    }
+    if (nfs_jnl_used(j) + need >= j->blks && (ret = nfs_jnl_checkpoint(j)) != NFS_ERROR_NONE) {
+        return ret;                                     // 日志放不下本事务，先写回腾出空间
+    }
+
+    mark = nfs_scratch_mark();
+    buf  = (uint8_t *)nfs_scratch_alloc(NFS_BLKS_SZ(need));
+    if (buf == NULL) {
+        nfs_scratch_release(mark);
+        return -NFS_ERROR_NOSPACE;
+    }
+    memset(buf, 0, NFS_BLK_SZ());
+    desc        = (struct nfs_jnl_desc_d *)buf;
+    desc->magic = NFS_JNL_DESC_MAGIC;
+    desc->seq   = j->seq;
+    desc->nr    = j->nr_running + j->nr_revoke;
+    for (i = 0; i < j->nr_running; i++) {
+        desc->entries[i] = j->running[i].blk;
+        memcpy(buf + NFS_BLKS_SZ(1 + i), j->running[i].data, NFS_BLK_SZ());
+    }
+    for (i = 0; i < j->nr_revoke; i++) {
+        desc->entries[j->nr_running + i] = -(j->revoke[i] + 1);
+    }
+    commit = (struct nfs_jnl_commit_d *)(buf + NFS_BLKS_SZ(need - 1));
+    memset(commit, 0, NFS_BLK_SZ());
+    commit->magic = NFS_JNL_COMMIT_MAGIC;
+    commit->seq   = j->seq;
+    commit->csum  = nfs_jnl_csum(2166136261u, buf, NFS_BLKS_SZ(need - 1));
+
+    ret = nfs_jnl_io(j, j->head, buf, need, TRUE);      // 整个事务一次顺序写入
+    if (ret == NFS_ERROR_NONE) {
+        ret = nfs_driver_flush();                       // 校验和保证提交块不会先于内容生效
+    }
+    nfs_scratch_release(mark);
+    if (ret != NFS_ERROR_NONE) {
+        NFS_DBG("[%s] io error\n", __func__);
+        return ret;
+    }
+
+    // 提交后的块转为待写回，同一块只保留最新的一份
+    for (i = 0; i < j->nr_running; i++) {
+        e = nfs_jnl_find(j->committed, j->nr_committed, j->running[i].blk);
+        if (e != NULL) {
+            nfs_slab_free(&j->slab, e->data);
+            e->data = j->running[i].data;
+        } else {
+            j->committed[j->nr_committed++] = j->running[i];
+        }
+    }
+    j->logged    += j->nr_running;
+    j->nr_running = 0;
+    j->nr_revoke  = 0;
+    j->head       = (j->head + need) % j->blks;
+    j->commit_seq = j->seq++;
+    j->commits++;
+    return NFS_ERROR_NONE;
+}
+
+/**
+ * @brief 等进行中的操作结束后提交，调用者持有lock
+ */
+static int nfs_jnl_commit_wait(struct nfs_journal* j) {
+    int ret;
+
+    j->committing = TRUE;
+    while (j->handles > 0) {
+        pthread_cond_wait(&j->done, &j->lock);
+    }
+    ret = nfs_jnl_commit(j);
+    // 没有进行中的操作，释放这些块的操作都已提交
+    if (ret == NFS_ERROR_NONE && j->nr_freed > 0) {
+        if (nfs_driver_discard_blks(j->freed, j->nr_freed) != NFS_ERROR_NONE) {
+            NFS_DBG("[%s] discard failed\n", __func__);  // 丢弃只是提示，不影响提交
+        }
+        j->nr_freed = 0;
+    }
+    j->committing = FALSE;
+    pthread_cond_broadcast(&j->done);
+    return ret;
+}
+
+/**
+ * @brief 记下后台线程的失败，由下一次nfs_journal_sync或卸载返回
+ *
+ * 失败的提交保留运行中事务、失败的写回保留已提交的块，下次都会重试。
+ */
+static void nfs_jnl_fail(struct nfs_journal* j, int ret, const char* what) {
+    NFS_DBG("[%s] background %s failed: %d\n", __func__, what, ret);
+    if (j->err == NFS_ERROR_NONE) {
+        j->err = ret;
+    }
+}
+
+/**
+ * @brief 后台线程：按commit_ms成组提交，日志过半时写回原位置
+ */
+static void* nfs_jnl_thread(void* arg) {
+    struct nfs_journal* j = (struct nfs_journal *)arg;
+    struct timespec ts;
+    int ret;
+
+    pthread_mutex_lock(&j->lock);
+    while (!j->stop) {
+        clock_gettime(CLOCK_REALTIME, &ts);
+        ts.tv_sec  += j->commit_ms / 1000;
+        ts.tv_nsec += (long)(j->commit_ms % 1000) * 1000000;
+        if (ts.tv_nsec >= 1000000000) {
+            ts.tv_sec++;
+            ts.tv_nsec -= 1000000000;
+        }
+        pthread_cond_timedwait(&j->wake, &j->lock, &ts);
+        if (j->stop) {
+            break;
+        }
+        if ((j->nr_running > 0 || j->nr_revoke > 0) && (ret = nfs_jnl_commit_wait(j)) != NFS_ERROR_NONE) {
+            nfs_jnl_fail(j, ret, "commit");
+        }
+        if (nfs_jnl_used(j) > j->blks / 2 && (ret = nfs_jnl_checkpoint(j)) != NFS_ERROR_NONE) {
+            nfs_jnl_fail(j, ret, "checkpoint");
+        }
+    }
+    pthread_mutex_unlock(&j->lock);
+    nfs_scratch_free();                                 // 提交与checkpoint用过的临时缓冲区
+    return NULL;
+}
+
+/**
+ * @brief 读出pos处序号为seq的完整事务到buf
+ *
+ * @return int 事务占用的日志块数，不完整或校验失败返回-1
+ */
+static int nfs_jnl_read_txn(struct nfs_journal* j, int pos, uint32_t seq, uint8_t* buf) {
+    struct nfs_jnl_desc_d*   desc = (struct nfs_jnl_desc_d *)buf;
+    struct nfs_jnl_commit_d* commit;
+    int i, cnt = 0;
+
+    if (nfs_jnl_io(j, pos, buf, 1, FALSE) != NFS_ERROR_NONE || desc->magic != NFS_JNL_DESC_MAGIC
+        || desc->seq != seq || desc->nr <= 0 || desc->nr > 2 * NFS_JNL_TXN_MAX) {
+        return -1;
+    }
+    for (i = 0; i < desc->nr; i++) {
+        cnt += desc->entries[i] >= 0;
+    }
+    if (cnt > NFS_JNL_TXN_MAX || cnt + 2 > j->blks
+        || nfs_jnl_io(j, (pos + 1) % j->blks, buf + NFS_BLK_SZ(), cnt + 1, FALSE) != NFS_ERROR_NONE) {
+        return -1;
+    }
+    commit = (struct nfs_jnl_commit_d *)(buf + NFS_BLKS_SZ(cnt + 1));
+    if (commit->magic != NFS_JNL_COMMIT_MAGIC || commit->seq != seq
+        || commit->csum != nfs_jnl_csum(2166136261u, buf, NFS_BLKS_SZ(cnt + 1))) {
+        return -1;
+    }
+    return cnt + 2;
+}
+
+/**
+ * @brief 重放日志：先收集各事务释放的块，再按顺序把元数据块写回原位置
+ *
+ * 块在某事务中被释放后，更早事务中它的内容不再写回。
+ */
+static int nfs_jnl_replay(struct nfs_journal* j) {
+    struct nfs_jnl_super_d jsb;
+    struct nfs_jnl_desc_d* desc;
+    uint8_t*  buf;
+    int*      revoked;                                  // 释放的块号与所在事务序号，成对存放
+    int       nr_revoked = 0, txns = 0, replayed = 0;
+    int       pos, len, n, pass, i, k, img, ret = NFS_ERROR_NONE;
+    uint32_t  seq;
+    boolean   skip;
+
+    if (nfs_driver_read(j->offset, (uint8_t *)&jsb, sizeof(struct nfs_jnl_super_d)) != NFS_ERROR_NONE
+        || jsb.magic != NFS_JNL_MAGIC || jsb.start < 0 || jsb.start >= j->blks) {
+        NFS_DBG("[%s] bad journal super block\n", __func__);
+        return -NFS_ERROR_IO;
+    }
+    buf     = (uint8_t *)malloc(NFS_BLKS_SZ(NFS_JNL_TXN_MAX + 2));
+    revoked = (int *)malloc(sizeof(int) * 2 * (j->blks / 2) * 2 * NFS_JNL_TXN_MAX);   // 每个事务至少2块
+    if (buf == NULL || revoked == NULL) {
+        free(revoked);
+        free(buf);
+        return -NFS_ERROR_NOSPACE;
+    }
+    desc    = (struct nfs_jnl_desc_d *)buf;
+
+    for (pass = 0; pass < 2; pass++) {
+        pos = jsb.start;
+        seq = jsb.seq;
+        for (len = 0; len < j->blks && (n = nfs_jnl_read_txn(j, pos, seq, buf)) > 0; len += n) {
+            for (i = 0, img = 0; i < desc->nr; i++) {
+                if (desc->entries[i] < 0 && pass == 0) {
+                    revoked[nr_revoked * 2]     = -desc->entries[i] - 1;
+                    revoked[nr_revoked * 2 + 1] = (int)seq;
+                    nr_revoked++;
+                }
+                if (desc->entries[i] < 0) {
+                    continue;
+                }
+                img++;
+                if (pass == 0) {
+                    continue;
+                }
+                for (skip = FALSE, k = 0; k < nr_revoked && !skip; k++) {
+                    skip = revoked[k * 2] == desc->entries[i] && (uint32_t)revoked[k * 2 + 1] > seq;
+                }
+                if (!skip && nfs_driver_write(NFS_BLKS_SZ(desc->entries[i]), buf + NFS_BLKS_SZ(img),
+                                              NFS_BLK_SZ()) != NFS_ERROR_NONE) {
+                    ret = -NFS_ERROR_IO;
+                }
+                replayed += !skip;
+            }
+            txns += pass;
+            pos = (pos + n) % j->blks;
+            seq++;
+        }
+    }
+    free(revoked);
+    free(buf);
+
+    j->start = j->head = pos;
+    j->start_seq = j->seq = seq;
+    if (txns > 0) {
+        NFS_DBG("[%s] replayed %d transactions, %d blocks\n", __func__, txns, replayed);
+    }
+    if (ret == NFS_ERROR_NONE) {
+        ret = nfs_driver_flush();                       // 重放的块落盘后才能清空日志
+    }
+    return ret != NFS_ERROR_NONE ? ret : nfs_jnl_write_super(j);
+}
+
+/**
+ * @brief 挂载日志：首次挂载时初始化日志区，否则重放日志，然后启动后台线程
+ *
+ * @param offset 日志区起始地址
+ * @param blks 日志区块数
+ * @param is_init 是否首次挂载
+ * @param commit_ms 成组提交间隔，0取NFS_JNL_COMMIT_MS
+ * @return int 0成功，否则返回错误码
+ */
+int nfs_journal_load(int offset, int blks, boolean is_init, int commit_ms) {
+    struct nfs_journal* j = NFS_JNL();
+    int ret;
+
+    memset(j, 0, sizeof(struct nfs_journal));
+    j->offset    = offset;
+    j->blks      = blks - 1;
+    j->commit_ms = commit_ms > 0 ? commit_ms : NFS_JNL_COMMIT_MS;
+    if (is_init) {
+        j->start_seq = j->seq = 1;
+        ret = nfs_jnl_write_super(j);
+    } else {
+        ret = nfs_jnl_replay(j);
+    }
+    if (ret != NFS_ERROR_NONE) {
+        return ret;
+    }
+    j->commit_seq = j->seq - 1;
+    j->committed  = (struct nfs_jblk *)malloc(j->blks * sizeof(struct nfs_jblk));
+    if (j->committed == NULL) {
+        return -NFS_ERROR_NOSPACE;
+    }
+    nfs_slab_init(&j->slab, NFS_BLK_SZ());
+    pthread_mutex_init(&j->lock, NULL);
+    pthread_cond_init(&j->wake, NULL);
+    pthread_cond_init(&j->done, NULL);
+    if (pthread_create(&j->thread, NULL, nfs_jnl_thread, j) != 0) {
+        pthread_cond_destroy(&j->done);
+        pthread_cond_destroy(&j->wake);
+        pthread_mutex_destroy(&j->lock);
+        nfs_slab_destroy(&j->slab);
+        free(j->committed);
+        j->committed = NULL;
+        return -NFS_ERROR_NOSPACE;
+    }
+    j->active = TRUE;
+    return NFS_ERROR_NONE;
+}
+
+/**
+ * @brief 卸载日志：停止后台线程，提交并写回全部元数据，日志清空
+ */
+int nfs_journal_shutdown() {
+    struct nfs_journal* j = NFS_JNL();
+    int ret;
+
+    if (!j->active) {
+        return NFS_ERROR_NONE;
+    }
+    pthread_mutex_lock(&j->lock);
+    j->stop = TRUE;
+    pthread_cond_signal(&j->wake);
+    pthread_mutex_unlock(&j->lock);
+    pthread_join(j->thread, NULL);
+
+    pthread_mutex_lock(&j->lock);
+    ret = nfs_jnl_commit_wait(j);
+    if (ret == NFS_ERROR_NONE) {
+        ret = nfs_jnl_checkpoint(j);
+    }
+    if (ret == NFS_ERROR_NONE) {                        // 最后的提交与写回成功，之前的失败都已重试过
+        j->err = NFS_ERROR_NONE;
+    }
+    j->active = FALSE;
+    pthread_mutex_unlock(&j->lock);
+
+    if (nfs_options.stats) {
+        NFS_DBG("[%s] commits %ld logged blocks %ld checkpoints %ld\n", __func__,
+                j->commits, j->logged, j->checkpoints);
+    }
+    nfs_slab_destroy(&j->slab);
+    free(j->committed);
+    pthread_cond_destroy(&j->done);
+    pthread_cond_destroy(&j->wake);
+    pthread_mutex_destroy(&j->lock);
+    return ret;
+}
+
+/**
+ * @brief 开始一个文件系统操作；运行中事务已较大时先等它提交
+ */
+void nfs_journal_start() {
+    struct nfs_journal* j = NFS_JNL();
+
+    if (!j->active) {
+        return;
+    }
+    pthread_mutex_lock(&j->lock);
+    while (j->committing || j->nr_running >= NFS_JNL_TXN_SOFT) {
+        if (!j->committing) {
+            pthread_cond_signal(&j->wake);
+        }
+        pthread_cond_wait(&j->done, &j->lock);
+    }
+    j->handles++;
+    pthread_mutex_unlock(&j->lock);
+}
+
+/**
+ * @brief 结束nfs_journal_start开始的操作
+ */
+void nfs_journal_stop() {
+    struct nfs_journal* j = NFS_JNL();
+
+    if (!j->active) {
+        return;
+    }
+    pthread_mutex_lock(&j->lock);
+    if (--j->handles == 0) {
+        pthread_cond_broadcast(&j->done);
+    }
+    pthread_mutex_unlock(&j->lock);
+}
+
+/**
+ * @brief 提交运行中事务并等待其写入日志；并发的调用者共用同一次提交
+ *
+ * @return int 0成功，否则返回错误码
+ */
+int nfs_journal_sync() {
+    struct nfs_journal* j = NFS_JNL();
+    uint32_t target;
+    int ret = NFS_ERROR_NONE;
+
+    if (!j->active) {
+        return NFS_ERROR_NONE;
+    }
+    pthread_mutex_lock(&j->lock);
+    target = j->nr_running > 0 || j->nr_revoke > 0 ? j->seq : j->commit_seq;
+    while (j->commit_seq < target && ret == NFS_ERROR_NONE) {
+        if (j->committing) {
+            pthread_cond_wait(&j->done, &j->lock);      // 别人正在提交，等它结束再看是否已包含target
+        } else {
+            ret = nfs_jnl_commit_wait(j);
+        }
+    }
+    if (ret == NFS_ERROR_NONE) {                        // 报告一次后台线程的失败
+        ret = j->err;
+    }
+    j->err = NFS_ERROR_NONE;
+    pthread_mutex_unlock(&j->lock);
+    return ret;
+}
+
+/**
+ * @brief 写元数据：offset按块对齐，内容按整块记入运行中事务，最后一块不足
+ *        一块的部分补0
+ *
+ * @return int 0成功，否则返回错误码
+ */
+int nfs_journal_write(int offset, uint8_t* content, int size) {
+    struct nfs_journal* j = NFS_JNL();
+    struct nfs_jblk*    e;
+    int blk, len, i, ret = NFS_ERROR_NONE;
+
+    if (!j->active || offset % NFS_BLK_SZ() != 0) {
+        return nfs_driver_write(offset, content, size);
+    }
+    pthread_mutex_lock(&j->lock);
+    for (blk = offset / NFS_BLK_SZ(); size > 0 && ret == NFS_ERROR_NONE; blk++, content += len, size -= len) {
+        len = size < NFS_BLK_SZ() ? size : NFS_BLK_SZ();
+        e   = nfs_jnl_find(j->running, j->nr_running, blk);
+        if (e == NULL) {
+            if (j->nr_running == NFS_JNL_TXN_MAX && (ret = nfs_jnl_commit(j)) != NFS_ERROR_NONE) {
+                break;                                  // 单个操作写满一个事务，只能中途提交
+            }
+            e = &j->running[j->nr_running];
+            e->data = (uint8_t *)nfs_slab_alloc(&j->slab);
+            if (e->data == NULL) {
+                ret = -NFS_ERROR_NOSPACE;
+                break;
+            }
+            e->blk = blk;
+            j->nr_running++;
+        }
+        memcpy(e->data, content, len);
+        memset(e->data + len, 0, NFS_BLK_SZ() - len);
+        for (i = 0; i < j->nr_revoke; i++) {            // 释放后又作为元数据使用
+            if (j->revoke[i] == blk) {
+                j->revoke[i] = j->revoke[--j->nr_revoke];
+                break;
+            }
+        }
+    }
+    pthread_mutex_unlock(&j->lock);
+    return ret;
+}
+
+/**
+ * @brief 读元数据：日志中尚未写回原位置的块取日志中的内容
+ *
+ * @return int 0成功，否则返回错误码
+ */
+int nfs_journal_read(int offset, uint8_t* out_content, int size) {
+    struct nfs_journal* j = NFS_JNL();
+    struct nfs_jblk*    e;
+    int blk, bias, len, ret;
+
+    if (!j->active) {
+        return nfs_driver_read(offset, out_content, size);
+    }
+    pthread_mutex_lock(&j->lock);                       // 防止读盘与写回交错
+    ret = nfs_driver_read(offset, out_content, size);
+    for (blk = offset / NFS_BLK_SZ(); ret == NFS_ERROR_NONE && NFS_BLKS_SZ(blk) < offset + size; blk++) {
+        e = nfs_jnl_find(j->running, j->nr_running, blk);
+        if (e == NULL) {
+            e = nfs_jnl_find(j->committed, j->nr_committed, blk);
+        }
+        if (e == NULL) {
+            continue;
+        }
+        bias = NFS_BLKS_SZ(blk) > offset ? 0 : offset - NFS_BLKS_SZ(blk);
+        len  = NFS_BLK_SZ() - bias;
+        if (NFS_BLKS_SZ(blk) + bias + len > offset + size) {
+            len = offset + size - NFS_BLKS_SZ(blk) - bias;
+        }
+        memcpy(out_content + NFS_BLKS_SZ(blk) + bias - offset, e->data + bias, len);
+    }
+    pthread_mutex_unlock(&j->lock);
+    return ret;
+}
+
+/**
+ * @brief 块被释放：丢弃日志中的内容，已写入日志的还要在描述块中记录
+ *
+ * @return int 0成功；释放记录已满且提交失败时返回错误码，块留在日志中，
+ *             调用者不能再把它当作空闲块
+ */
+int nfs_journal_revoke(int offset) {
+    struct nfs_journal* j = NFS_JNL();
+    struct nfs_jblk*    e;
+    int blk = offset / NFS_BLK_SZ();
+    int ret = NFS_ERROR_NONE;
+
+    if (!j->active) {
+        return NFS_ERROR_NONE;
+    }
+    pthread_mutex_lock(&j->lock);
+    e = nfs_jnl_find(j->running, j->nr_running, blk);
+    if (e != NULL) {
+        nfs_jnl_drop(j, j->running, &j->nr_running, e);
+    }
+    if (nfs_jnl_find(j->committed, j->nr_committed, blk) != NULL && j->nr_revoke == NFS_JNL_TXN_MAX) {
+        ret = nfs_jnl_commit(j);                        // 提交可能写回并清空committed，之后重新查找
+    }
+    e = nfs_jnl_find(j->committed, j->nr_committed, blk);
+    if (ret == NFS_ERROR_NONE && e != NULL) {
+        nfs_jnl_drop(j, j->committed, &j->nr_committed, e);
+        j->revoke[j->nr_revoke++] = blk;
+    }
+    pthread_mutex_unlock(&j->lock);
+    return ret;
+}
+
+/**
+ * @brief 记录释放的数据块，释放它的操作提交之后再通知设备丢弃
+ *
+ * 丢弃只是提示，记录已满时该块不再丢弃。
+ *
+ * @param dno 物理数据块号（0起）
+ */
+void nfs_journal_discard(int dno) {
+    struct nfs_journal* j = NFS_JNL();
+
+    if (!j->active) {
+        return;
+    }
+    pthread_mutex_lock(&j->lock);
+    if (j->nr_freed < NFS_JNL_FREED_MAX) {
+        j->freed[j->nr_freed++] = dno;
+    }
+    pthread_mutex_unlock(&j->lock);
+}
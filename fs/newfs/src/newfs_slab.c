@@ -0,0 +1,238 @@
+#include "../include/newfs.h"
+
+extern struct nfs_super      nfs_super;
+
+/******************************************************************************
+* SECTION: slab缓存
+*******************************************************************************/
+/*
+ * dentry、inode、逻辑块缓存与最小的子项表都是定长对象，各用一个slab：
+ * 每次向堆申请一页（NFS_SLAB_PAGE_SZ）切成若干对象，释放的对象挂回空闲
+ * 链表，下次分配直接取用。页只在卸载时整体释放，运行中反复创建、回收
+ * dentry与inode不再调用malloc/free。与newfs其余部分一样，slab不加锁。
+ */
+
+/**
+ * @brief 初始化obj_sz字节对象的slab
+ */
+void nfs_slab_init(struct nfs_slab* slab, int obj_sz) {
+    memset(slab, 0, sizeof(struct nfs_slab));
+    slab->obj_sz   = NFS_ROUND_UP(obj_sz, NFS_SLAB_ALIGN);
+    slab->per_page = (NFS_SLAB_PAGE_SZ - NFS_SLAB_ALIGN) / slab->obj_sz;
+    if (slab->per_page < 1) {
+        slab->per_page = 1;
+    }
+}
+
+/**
+ * @brief 从slab中取一个对象（内容未初始化）
+ *
+ * @return void* 对象，内存不足返回NULL
+ */
+void* nfs_slab_alloc(struct nfs_slab* slab) {
+    uint8_t* page;
+    void*    obj;
+    int      i;
+
+    if (slab->free_list == NULL) {
+        // 页首留出NFS_SLAB_ALIGN字节串起页链表，对象紧随其后
+        page = (uint8_t *)malloc(NFS_SLAB_ALIGN + (size_t)slab->per_page * slab->obj_sz);
+        if (page == NULL) {
+            return NULL;
+        }
+        *(void **)page = slab->pages;
+        slab->pages = page;
+        slab->pages_cnt++;
+        for (i = slab->per_page - 1; i >= 0; i--) {
+            obj = page + NFS_SLAB_ALIGN + (size_t)i * slab->obj_sz;
+            *(void **)obj = slab->free_list;
+            slab->free_list = obj;
+        }
+    }
+    obj = slab->free_list;
+    slab->free_list = *(void **)obj;
+    slab->allocs++;
+    return obj;
+}
+
+/**
+ * @brief 把对象还给slab，obj可以为NULL
+ */
+void nfs_slab_free(struct nfs_slab* slab, void* obj) {
+    if (obj == NULL) {
+        return;
+    }
+    *(void **)obj = slab->free_list;
+    slab->free_list = obj;
+    slab->frees++;
+}
+
+/**
+ * @brief 释放slab的所有页，其中的对象一并失效
+ */
+void nfs_slab_destroy(struct nfs_slab* slab) {
+    void* page;
+    while ((page = slab->pages) != NULL) {
+        slab->pages = *(void **)page;
+        free(page);
+    }
+    slab->free_list = NULL;
+}
+
+/**
+ * @brief 创建新的目录项
+ */
+struct nfs_dentry* new_dentry(char * fname, NFS_FILE_TYPE ftype) {
+    struct nfs_dentry * dentry = (struct nfs_dentry *)nfs_slab_alloc(&nfs_super.dentry_slab);
+    if (dentry == NULL) {
+        return NULL;
+    }
+    memset(dentry, 0, sizeof(struct nfs_dentry));
+    NFS_ASSIGN_FNAME(dentry, fname);
+    dentry->ftype   = ftype;
+    dentry->ino     = -1;
+    dentry->inode   = NULL;
+    dentry->parent  = NULL;
+    dentry->brother = NULL;
+    return dentry;
+}
+
+/**
+ * @brief 释放new_dentry创建的目录项
+ */
+void nfs_free_dentry(struct nfs_dentry* dentry) {
+    nfs_slab_free(&nfs_super.dentry_slab, dentry);
+}
+
+/******************************************************************************
+* SECTION: 临时缓冲区
+*******************************************************************************/
+/*
+ * 驱动读写的对齐缓冲区、htree操作中的索引块与叶子块只在一次调用内使用，
+ * 从每个线程自己的临时缓冲区栈上分配：
+ *
+ *     struct nfs_scratch_mark mark = nfs_scratch_mark();
+ *     buf = nfs_scratch_alloc(size);
+ *     ...
+ *     nfs_scratch_release(mark);
+ *
+ * 缓冲区栈由若干段（默认NFS_SCRATCH_CHUNK字节）组成，释放只移动栈顶，
+ * 段本身留给后续调用，线程稳定运行后不再向堆申请内存。mark/release
+ * 必须成对嵌套使用。线程退出前调用nfs_scratch_free归还自己的全部段。
+ */
+struct nfs_scratch_chunk {
+    struct nfs_scratch_chunk* next;
+    int                       cap;
+    int                       used;
+    uint8_t*                  buf;
+};
+
+static __thread struct nfs_scratch_chunk* scratch_head; // 第一段，释放时从这里遍历
+static __thread struct nfs_scratch_chunk* scratch_cur;  // 当前栈顶所在的段
+
+static struct nfs_scratch_chunk* nfs_scratch_chunk_new(int cap) {
+    struct nfs_scratch_chunk* chunk = (struct nfs_scratch_chunk *)malloc(sizeof(struct nfs_scratch_chunk));
+    if (chunk == NULL) {
+        return NULL;
+    }
+    chunk->buf = (uint8_t *)aligned_alloc(NFS_SCRATCH_ALIGN, cap);
+    if (chunk->buf == NULL) {
+        free(chunk);
+        return NULL;
+    }
+    chunk->next = NULL;
+    chunk->cap  = cap;
+    chunk->used = 0;
+    __atomic_add_fetch(&nfs_super.scratch_chunks, 1, __ATOMIC_RELAXED);
+    __atomic_add_fetch(&nfs_super.scratch_bytes, cap, __ATOMIC_RELAXED);
+    return chunk;
+}
+
+/**
+ * @brief 记录当前线程临时缓冲区的栈顶
+ */
+struct nfs_scratch_mark nfs_scratch_mark() {
+    struct nfs_scratch_mark mark;
+    if (scratch_cur == NULL) {
+        scratch_cur = scratch_head = nfs_scratch_chunk_new(NFS_SCRATCH_CHUNK);
+    }
+    mark.chunk = scratch_cur;
+    mark.used  = scratch_cur != NULL ? scratch_cur->used : 0;
+    return mark;
+}
+
+/**
+ * @brief 在当前线程的临时缓冲区上分配size字节，按NFS_SCRATCH_ALIGN对齐
+ *
+ * @return void* 缓冲区，在配对的nfs_scratch_release之前有效；内存不足返回NULL
+ */
+void* nfs_scratch_alloc(int size) {
+    struct nfs_scratch_chunk* chunk = scratch_cur;
+    struct nfs_scratch_chunk* grown;
+    void* buf;
+
+    size = NFS_ROUND_UP(size, NFS_SCRATCH_ALIGN);
+    if (chunk == NULL) {
+        return NULL;                                    // 未经nfs_scratch_mark或首段申请失败
+    }
+    if (chunk->cap - chunk->used < size) {
+        // 后面的段足够大就复用，否则在当前段之后插入新段，段的先后顺序即栈的顺序
+        if (chunk->next == NULL || chunk->next->cap < size) {
+            grown = nfs_scratch_chunk_new(size > NFS_SCRATCH_CHUNK ? size : NFS_SCRATCH_CHUNK);
+            if (grown == NULL) {
+                return NULL;
+            }
+            grown->next = chunk->next;
+            chunk->next = grown;
+        }
+        chunk = scratch_cur = chunk->next;
+        chunk->used = 0;
+    }
+    buf = chunk->buf + chunk->used;
+    chunk->used += size;
+    return buf;
+}
+
+/**
+ * @brief 释放mark之后分配的所有临时缓冲区
+ */
+void nfs_scratch_release(struct nfs_scratch_mark mark) {
+    if (mark.chunk != NULL) {
+        scratch_cur = (struct nfs_scratch_chunk *)mark.chunk;
+        scratch_cur->used = mark.used;
+    }
+}
+
+/**
+ * @brief 释放当前线程临时缓冲区的全部段，调用时不能有未释放的mark
+ */
+void nfs_scratch_free() {
+    struct nfs_scratch_chunk* chunk = scratch_head;
+    struct nfs_scratch_chunk* next;
+
+    for (; chunk != NULL; chunk = next) {
+        next = chunk->next;
+        __atomic_sub_fetch(&nfs_super.scratch_chunks, 1, __ATOMIC_RELAXED);
+        __atomic_sub_fetch(&nfs_super.scratch_bytes, chunk->cap, __ATOMIC_RELAXED);
+        free(chunk->buf);
+        free(chunk);
+    }
+    scratch_head = scratch_cur = NULL;
+}
+
+/**
+ * @brief 打印各slab与临时缓冲区的分配计数
+ */
+void nfs_alloc_stats() {
+    struct nfs_slab* slabs[] = { &nfs_super.dentry_slab, &nfs_super.inode_slab, &nfs_super.blk_slab,
+                                 &nfs_super.dtable_slab, &nfs_super.dtable_arr_slab };
+    const char*      names[] = { "dentry", "inode", "blk", "dtable", "dtarr" };
+    int i;
+
+    for (i = 0; i < (int)(sizeof(slabs) / sizeof(slabs[0])); i++) {
+        NFS_DBG("[%s] slab %-6s obj %5d allocs %ld frees %ld in use %ld pages %ld\n", __func__, names[i],
+                slabs[i]->obj_sz, slabs[i]->allocs, slabs[i]->frees,
+                slabs[i]->allocs - slabs[i]->frees, slabs[i]->pages_cnt);
+    }
+    NFS_DBG("[%s] scratch chunks %ld bytes %ld\n", __func__, nfs_super.scratch_chunks, nfs_super.scratch_bytes);
+}
@@ -3,6 +3,8 @@
 extern struct nfs_super      nfs_super; 
 extern struct custom_options nfs_options;
 
+static pthread_mutex_t nfs_io_lock = PTHREAD_MUTEX_INITIALIZER;   // 日志线程与操作共用设备，seek与读写须连在一起
+
 /**
  * @brief 获取文件名
  * 
@@ -42,9 +44,26 @@ int nfs_calc_lvl(const char * path) {
     return lvl;  // 返回路径的层级数
 }
 
+/**
+ * @brief 从对齐的偏移处一次读取size_aligned字节（两者都是逻辑块的整数倍），
+ *        调用者持有nfs_io_lock
+ *
+ * @return int 如果操作成功，返回NFS_ERROR_NONE；否则返回-NFS_ERROR_IO。
+ */
+static int nfs_driver_read_aligned(int offset_aligned, uint8_t *out_content, int size_aligned) {
+    // 将磁盘指针移动到对齐的偏移位置，整段交给驱动一次读出
+    if (ddriver_seek(NFS_DRIVER(), offset_aligned, SEEK_SET) < 0
+        || ddriver_read(NFS_DRIVER(), (char *)out_content, size_aligned) != size_aligned) {
+        return -NFS_ERROR_IO;
+    }
+    return NFS_ERROR_NONE;
+}
+
 /**
  * @brief 驱动读
  * 
+ * 整块对齐的读取直接读入out_content，否则经当前线程的临时缓冲区中转
+ *
  * @param offset       读取的起始偏移
  * @param out_content  读取内容的输出缓冲区
  * @param size         读取的字节大小
@@ -55,31 +74,42 @@ int nfs_driver_read(int offset, uint8_t *out_content, int size) {
     int      offset_aligned = NFS_ROUND_DOWN(offset, NFS_BLK_SZ());       // 向下对齐到逻辑块大小
     int      bias           = offset - offset_aligned;                   // 偏移量到逻辑块的偏差
     int      size_aligned   = NFS_ROUND_UP((size + bias), NFS_BLK_SZ()); // 向上对齐到逻辑块大小
-    uint8_t* temp_content   = (uint8_t*)malloc(size_aligned);            // 分配临时缓冲区
-    uint8_t* cur            = temp_content;                             // 临时缓冲区当前指针
-
-    // 将磁盘指针移动到对齐的偏移位置
-    ddriver_seek(NFS_DRIVER(), offset_aligned, SEEK_SET);
+    struct nfs_scratch_mark mark;
+    uint8_t* temp_content;
+    int      ret;
+
+    if (bias == 0 && size == size_aligned) {
+        pthread_mutex_lock(&nfs_io_lock);
+        ret = nfs_driver_read_aligned(offset_aligned, out_content, size_aligned);
+        pthread_mutex_unlock(&nfs_io_lock);
+        return ret;
+    }
 
-    // 按磁盘块大小(512B)循环读取数据
-    while (size_aligned != 0) {
-        ddriver_read(NFS_DRIVER(), cur, NFS_IO_SZ());                    // 每次读取一个磁盘块
-        cur          += NFS_IO_SZ();                                    // 更新临时缓冲区指针
-        size_aligned -= NFS_IO_SZ();                                    // 减少剩余读取大小
+    mark         = nfs_scratch_mark();
+    temp_content = (uint8_t *)nfs_scratch_alloc(size_aligned);          // 临时缓冲区
+    if (temp_content == NULL) {
+        nfs_scratch_release(mark);
+        return -NFS_ERROR_NOSPACE;
     }
+    pthread_mutex_lock(&nfs_io_lock);
+    ret = nfs_driver_read_aligned(offset_aligned, temp_content, size_aligned);
+    pthread_mutex_unlock(&nfs_io_lock);
 
     // 将读取的有效数据拷贝到输出缓冲区
-    memcpy(out_content, temp_content + bias, size);
+    if (ret == NFS_ERROR_NONE) {
+        memcpy(out_content, temp_content + bias, size);
+    }
 
-    // 释放临时缓冲区
-    free(temp_content);
-    
-    return NFS_ERROR_NONE;                                               // 返回成功状态码
+    nfs_scratch_release(mark);
+    return ret;                                                          // 返回状态码
 }
 
 /**
  * @brief 驱动写
  * 
+ * 整块对齐的写入直接写出in_content，否则在临时缓冲区中读出所在的块、
+ * 覆盖后整块写回
+ *
  * @param offset       写入的起始偏移
  * @param in_content   写入内容的输入缓冲区
  * @param size         写入的字节大小
@@ -90,41 +120,489 @@ int nfs_driver_write(int offset, uint8_t *in_content, int size) {
     int      offset_aligned = NFS_ROUND_DOWN(offset, NFS_BLK_SZ());       // 向下对齐到逻辑块大小
     int      bias           = offset - offset_aligned;                   // 偏移量到逻辑块的偏差
     int      size_aligned   = NFS_ROUND_UP((size + bias), NFS_BLK_SZ()); // 向上对齐到逻辑块大小
-    uint8_t* temp_content   = (uint8_t*)malloc(size_aligned);            // 分配临时缓冲区
-    uint8_t* cur            = temp_content;                             // 临时缓冲区当前指针
+    struct nfs_scratch_mark mark = nfs_scratch_mark();
+    uint8_t* temp_content   = in_content;
+    int      ret            = NFS_ERROR_NONE;
+
+    pthread_mutex_lock(&nfs_io_lock);
+    if (bias != 0 || size != size_aligned) {
+        temp_content = (uint8_t *)nfs_scratch_alloc(size_aligned);      // 临时缓冲区
+        if (temp_content == NULL) {
+            pthread_mutex_unlock(&nfs_io_lock);
+            nfs_scratch_release(mark);
+            return -NFS_ERROR_NOSPACE;
+        }
+        // 读出需要的磁盘块到内存，在内存中覆盖指定内容
+        ret = nfs_driver_read_aligned(offset_aligned, temp_content, size_aligned);
+        memcpy(temp_content + bias, in_content, size);
+    }
 
-    // 读出需要的磁盘块到内存
-    nfs_driver_read(offset_aligned, temp_content, size_aligned);
+    // 将磁盘指针移动到对齐的偏移位置，修改后的内容一次写回磁盘
+    if (ret == NFS_ERROR_NONE
+        && (ddriver_seek(NFS_DRIVER(), offset_aligned, SEEK_SET) < 0
+            || ddriver_write(NFS_DRIVER(), (char *)temp_content, size_aligned) != size_aligned)) {
+        ret = -NFS_ERROR_IO;
+    }
+    pthread_mutex_unlock(&nfs_io_lock);
 
-    // 在内存中覆盖指定内容
-    memcpy(temp_content + bias, in_content, size);
+    nfs_scratch_release(mark);
+    return ret;                                                          // 返回状态码
+}
 
-    // 将磁盘指针移动到对齐的偏移位置
-    ddriver_seek(NFS_DRIVER(), offset_aligned, SEEK_SET);
+/**
+ * @brief 刷写设备：驱动合并暂存的写全部下发，之前写入的内容在崩溃后可见
+ * 
+ * @return int 如果操作成功，返回NFS_ERROR_NONE；否则返回-NFS_ERROR_IO。
+ */
+int nfs_driver_flush() {
+    int ret;
+    pthread_mutex_lock(&nfs_io_lock);
+    ret = ddriver_ioctl(NFS_DRIVER(), IOC_REQ_DEVICE_FLUSH, NULL);
+    pthread_mutex_unlock(&nfs_io_lock);
+    return ret < 0 ? -NFS_ERROR_IO : NFS_ERROR_NONE;
+}
+
+static int nfs_jblk_cmp(const void* a, const void* b) {
+    int x = ((const struct nfs_jblk *)a)->blk;
+    int y = ((const struct nfs_jblk *)b)->blk;
+    return (x > y) - (x < y);
+}
 
-    // 将修改后的内容依次写回磁盘
-    while (size_aligned != 0) {
-        ddriver_write(NFS_DRIVER(), cur, NFS_IO_SZ());                   // 每次写入一个磁盘块
-        cur          += NFS_IO_SZ();                                    // 更新临时缓冲区指针
-        size_aligned -= NFS_IO_SZ();                                    // 减少剩余写入大小
+/**
+ * @brief 批量写回整块：先按块号（即磁盘偏移）排序，相邻的块合并为一次多块写入
+ * 
+ * 合并的块在临时缓冲区中拼接，一次至多NFS_WB_RUN_MAX块；blks会被重新排序。
+ * 
+ * @param blks 待写回的块，blk为逻辑块号
+ * @param cnt  块数
+ * @return int 如果操作成功，返回NFS_ERROR_NONE；否则返回错误码。
+ */
+int nfs_driver_write_blks(struct nfs_jblk* blks, int cnt) {
+    struct nfs_scratch_mark mark;
+    uint8_t* buf;
+    int i, k, run, ret = NFS_ERROR_NONE;
+
+    qsort(blks, cnt, sizeof(struct nfs_jblk), nfs_jblk_cmp);
+    for (i = 0; i < cnt && ret == NFS_ERROR_NONE; i += run) {
+        for (run = 1; i + run < cnt && run < NFS_WB_RUN_MAX && blks[i + run].blk == blks[i].blk + run; run++);
+        if (run == 1) {
+            ret = nfs_driver_write(NFS_BLKS_SZ(blks[i].blk), blks[i].data, NFS_BLK_SZ());
+            continue;
+        }
+        mark = nfs_scratch_mark();
+        buf  = (uint8_t *)nfs_scratch_alloc(NFS_BLKS_SZ(run));
+        if (buf == NULL) {
+            for (k = 0; k < run && ret == NFS_ERROR_NONE; k++) {     // 缓冲区不足时逐块写入
+                ret = nfs_driver_write(NFS_BLKS_SZ(blks[i + k].blk), blks[i + k].data, NFS_BLK_SZ());
+            }
+        } else {
+            for (k = 0; k < run; k++) {
+                memcpy(buf + NFS_BLKS_SZ(k), blks[i + k].data, NFS_BLK_SZ());
+            }
+            ret = nfs_driver_write(NFS_BLKS_SZ(blks[i].blk), buf, NFS_BLKS_SZ(run));
+        }
+        nfs_scratch_release(mark);
     }
+    return ret;
+}
 
-    // 释放临时缓冲区
-    free(temp_content);
-    
-    return NFS_ERROR_NONE;                                               // 返回成功状态码
+
+/**
+ * @brief 数据块位图操作，blk为物理数据块号（0起），位于块组blk / data_per_group
+ *        最后一个块组不完整时，超出部分视为已占用
+ */
+static inline boolean nfs_data_blk_used(int blk) {
+    struct nfs_group* group = &nfs_super.groups[NFS_DATA_GROUP(blk)];
+    int               bit   = blk % nfs_super.data_per_group;
+    if (bit >= group->nr_data) {
+        return TRUE;
+    }
+    return (group->map_data[bit / UINT8_BITS] & (0x1 << (bit % UINT8_BITS))) != 0;
+}
+
+static inline void nfs_data_blk_set(int blk) {
+    struct nfs_group* group = &nfs_super.groups[NFS_DATA_GROUP(blk)];
+    int               bit   = blk % nfs_super.data_per_group;
+    group->map_data[bit / UINT8_BITS] |= (0x1 << (bit % UINT8_BITS));
+    group->free_data--;
+    group->dirty = TRUE;
+}
+
+static inline void nfs_data_blk_clear(int blk) {
+    struct nfs_group* group = &nfs_super.groups[NFS_DATA_GROUP(blk)];
+    int               bit   = blk % nfs_super.data_per_group;
+    group->map_data[bit / UINT8_BITS] &= ~(0x1 << (bit % UINT8_BITS));
+    group->free_data++;
+    group->dirty = TRUE;
+}
+
+/**
+ * @brief 在块组内分配第一个空闲inode
+ * 
+ * @return int ino，块组已满返回-1
+ */
+static int nfs_group_alloc_ino(int g) {
+    struct nfs_group* group = &nfs_super.groups[g];
+    int bit;
+
+    for (bit = 0; group->free_inodes > 0 && bit < nfs_super.inodes_per_group; bit++) {
+        if ((group->map_inode[bit / UINT8_BITS] & (0x1 << (bit % UINT8_BITS))) == 0) {
+            group->map_inode[bit / UINT8_BITS] |= (0x1 << (bit % UINT8_BITS));
+            group->free_inodes--;
+            group->dirty = TRUE;
+            return g * nfs_super.inodes_per_group + bit;
+        }
+    }
+    return -1;
+}
+
+/**
+ * @brief 归还nfs_group_alloc_ino分配的inode，is_dir时同时减少块组的目录数
+ */
+static void nfs_group_free_ino(int ino, boolean is_dir) {
+    struct nfs_group* group = &nfs_super.groups[NFS_INO_GROUP(ino)];
+    int               bit   = ino % nfs_super.inodes_per_group;
+
+    group->map_inode[bit / UINT8_BITS] &= ~(0x1 << (bit % UINT8_BITS));
+    group->free_inodes++;
+    if (is_dir) {
+        group->used_dirs--;
+    }
+    group->dirty = TRUE;
+}
+
+/**
+ * @brief 为新目录选择块组（Orlov）
+ * 
+ * 1) 根目录下的顶层目录：在空闲inode与空闲数据块都不低于平均值的块组中，
+ *    选目录最少的一个，使互不相关的目录树分散到各个块组；
+ * 2) 其他目录：从父目录所在块组开始，找第一个目录数不过多、空闲资源不过少
+ *    的块组，让子目录尽量与父目录相邻；
+ * 3) 都不满足时，从父目录所在块组开始找任意有空闲inode的块组。
+ */
+static int nfs_find_group_dir(struct nfs_dentry* parent) {
+    int n = nfs_super.group_cnt;
+    int parent_group = NFS_INO_GROUP(parent->inode->ino);
+    int free_inodes = 0, free_data = 0, dirs = 0;
+    int avg_inodes, avg_data, max_dirs, min_inodes, min_data;
+    int g, i, best = -1;
+    struct nfs_group* group;
+
+    for (g = 0; g < n; g++) {
+        free_inodes += nfs_super.groups[g].free_inodes;
+        free_data   += nfs_super.groups[g].free_data;
+        dirs        += nfs_super.groups[g].used_dirs;
+    }
+    avg_inodes = free_inodes / n;
+    avg_data   = free_data / n;
+
+    if (parent == nfs_super.root_dentry) {
+        for (g = 0; g < n; g++) {
+            group = &nfs_super.groups[g];
+            if (group->free_inodes == 0 || group->free_inodes < avg_inodes || group->free_data < avg_data) {
+                continue;
+            }
+            if (best < 0 || group->used_dirs < nfs_super.groups[best].used_dirs
+                || (group->used_dirs == nfs_super.groups[best].used_dirs
+                    && group->free_data > nfs_super.groups[best].free_data)) {
+                best = g;
+            }
+        }
+        if (best >= 0) {
+            return best;
+        }
+    }
+    else {
+        max_dirs   = dirs / n + nfs_super.inodes_per_group / 16;
+        min_inodes = avg_inodes - nfs_super.inodes_per_group / 4;
+        min_data   = avg_data - nfs_super.data_per_group / 4;
+        for (i = 0; i < n; i++) {
+            group = &nfs_super.groups[(parent_group + i) % n];
+            if (group->free_inodes > 0 && group->used_dirs < max_dirs
+                && group->free_inodes >= min_inodes && group->free_data >= min_data) {
+                return (parent_group + i) % n;
+            }
+        }
+    }
+
+    for (i = 0; i < n; i++) {
+        if (nfs_super.groups[(parent_group + i) % n].free_inodes > 0) {
+            return (parent_group + i) % n;
+        }
+    }
+    return -1;
+}
+
+/**
+ * @brief 为普通文件选择块组：优先父目录所在块组，其次二次探测，最后线性查找
+ */
+static int nfs_find_group_other(struct nfs_dentry* parent) {
+    int n = nfs_super.group_cnt;
+    int parent_group = NFS_INO_GROUP(parent->inode->ino);
+    int g = parent_group, i;
+
+    if (nfs_super.groups[g].free_inodes > 0 && nfs_super.groups[g].free_data > 0) {
+        return g;
+    }
+    for (i = 1; i < n; i <<= 1) {
+        g = (g + i) % n;
+        if (nfs_super.groups[g].free_inodes > 0 && nfs_super.groups[g].free_data > 0) {
+            return g;
+        }
+    }
+    for (i = 1; i <= n; i++) {
+        g = (parent_group + i) % n;
+        if (nfs_super.groups[g].free_inodes > 0) {
+            return g;
+        }
+    }
+    return -1;
+}
+
+/**
+ * @brief 为inode分配空闲数据块（按磁道布局）
+ * 
+ * 设备的旋转模型按 |Δoffset| % 磁道大小 计时，同一磁道内相邻块之间几乎
+ * 没有定位开销。因此：
+ *   1) 有目标块时，优先在目标块所在磁道内、从其后方开始找空闲块；
+ *   2) 没有目标块时，优先选择剩余空闲块不少于want的第一条磁道；
+ *   3) 都找不到（或设备不提供几何信息）时，退化为从目标块之后的首次适配。
+ * 没有目标块时的查找限定在inode所在块组内，首次适配也从该块组开始，使文件的
+ * inode与数据处于同一块组。
+ * 
+ * @param inode 目标inode
+ * @param goal  目标物理数据块号，-1表示没有
+ * @param want  希望在同一磁道内连续分配的块数
+ * @return int  数据逻辑块号（含NFS_DNO_BASE偏移），失败返回-NFS_ERROR_NOSPACE
+ */
+static int nfs_alloc_data_goal(struct nfs_inode* inode, int goal, int want) {
+    int max_blks = nfs_super.max_data;
+    int blk      = -1;
+    int base     = NFS_INO_GROUP(inode->ino) * nfs_super.data_per_group;   // inode所在块组的首个数据块
+    int end      = base + nfs_super.groups[NFS_INO_GROUP(inode->ino)].nr_data;
+    int cursor, track, free_cnt;
+
+    if (nfs_super.sz_track > 0 && goal >= 0) {
+        track = NFS_DATA_TRACK(goal);
+        for (cursor = goal + 1; cursor < max_blks && NFS_DATA_TRACK(cursor) == track; cursor++) {
+            if (!nfs_data_blk_used(cursor)) {
+                blk = cursor;
+                break;
+            }
+        }
+        for (cursor = goal - 1; blk < 0 && cursor >= 0 && NFS_DATA_TRACK(cursor) == track; cursor--) {
+            if (!nfs_data_blk_used(cursor)) {
+                blk = cursor;
+            }
+        }
+    }
+    else if (nfs_super.sz_track > 0) {
+        for (cursor = base, free_cnt = 0, track = -1; cursor < end; cursor++) {
+            if (NFS_DATA_TRACK(cursor) != track) {  // 进入新磁道，重新计数
+                track    = NFS_DATA_TRACK(cursor);
+                free_cnt = 0;
+            }
+            if (!nfs_data_blk_used(cursor) && ++free_cnt == want) {
+                blk = cursor;
+                while (blk > base && NFS_DATA_TRACK(blk - 1) == track) {
+                    blk--;
+                }
+                while (nfs_data_blk_used(blk)) {    // 磁道内第一个空闲块
+                    blk++;
+                }
+                break;
+            }
+        }
+    }
+
+    if (goal < 0) {
+        goal = base - 1;
+    }
+    for (cursor = goal + 1; blk < 0 && cursor < goal + 1 + max_blks; cursor++) {
+        if (!nfs_data_blk_used(cursor % max_blks)) {
+            blk = cursor % max_blks;
+        }
+    }
+    if (blk < 0) {
+        return -NFS_ERROR_NOSPACE;
+    }
+
+    nfs_data_blk_set(blk);
+    return blk + NFS_DNO_BASE;
+}
+
+/**
+ * @brief 为inode的第idx个数据块分配空闲数据块，尽量紧跟第idx-1块
+ * 
+ * @param inode 目标inode
+ * @param idx   block_pointer下标
+ * @return int  数据逻辑块号（含NFS_DNO_BASE偏移），失败返回-NFS_ERROR_NOSPACE
+ */
+int nfs_alloc_data_blk(struct nfs_inode* inode, int idx) {
+    int goal = idx > 0 ? inode->block_pointer[idx - 1] - NFS_DNO_BASE : -1;
+    return nfs_alloc_data_goal(inode, goal, NFS_DATA_PER_FILE - idx);
+}
+
+/**
+ * @brief 分配一个靠近dno的空闲数据块，供不经过block_pointer的块（如目录索引块）使用
+ * 
+ * @param dno 目标数据逻辑块号（含NFS_DNO_BASE偏移）
+ * @return int 数据逻辑块号，失败返回-NFS_ERROR_NOSPACE
+ */
+int nfs_alloc_data_near(struct nfs_inode* inode, int dno) {
+    return nfs_alloc_data_goal(inode, dno - NFS_DNO_BASE, 1);
+}
+
+/**
+ * @brief 释放数据块
+ * 
+ * @param dno 数据逻辑块号（含NFS_DNO_BASE偏移）
+ */
+void nfs_free_data_blk(int dno) {
+    // 日志中该块的旧内容不再写回；记录不下时块仍在日志中，不能交给别人，只好留着不用
+    if (nfs_journal_revoke(NFS_DATA_OFS(dno - NFS_DNO_BASE)) != NFS_ERROR_NONE) {
+        NFS_DBG("[%s] can't revoke block %d, left allocated\n", __func__, dno);
+        return;
+    }
+    nfs_data_blk_clear(dno - NFS_DNO_BASE);
+    nfs_journal_discard(dno - NFS_DNO_BASE);    // 提交之后再让设备丢弃其内容
+}
+
+static int nfs_int_cmp(const void* a, const void* b) {
+    int x = *(const int *)a;
+    int y = *(const int *)b;
+    return (x > y) - (x < y);
+}
+
+/**
+ * @brief 通知设备丢弃已释放的数据块，驱动据此在镜像中打洞
+ * 
+ * 由日志在释放这些块的操作提交之后调用，此时没有进行中的操作；其间又被
+ * 分配出去的块跳过。按块号排序，同一块组内相邻的块合并为一次丢弃；
+ * blks会被重新排序。
+ * 
+ * @param blks 物理数据块号（0起）
+ * @param cnt  块数
+ * @return int 如果操作成功，返回NFS_ERROR_NONE；否则返回-NFS_ERROR_IO。
+ */
+int nfs_driver_discard_blks(int* blks, int cnt) {
+    struct ddriver_discard_range range;
+    int i, run, ret = NFS_ERROR_NONE;
+
+    qsort(blks, cnt, sizeof(int), nfs_int_cmp);
+    for (i = 0; i < cnt && ret == NFS_ERROR_NONE; i += run) {
+        run = 1;
+        if (nfs_data_blk_used(blks[i]) || (i > 0 && blks[i] == blks[i - 1])) {
+            continue;
+        }
+        for (; i + run < cnt && blks[i + run] == blks[i] + run && !nfs_data_blk_used(blks[i + run])
+               && NFS_DATA_GROUP(blks[i + run]) == NFS_DATA_GROUP(blks[i]); run++);
+        range.offset = NFS_DATA_OFS(blks[i]);
+        range.len    = NFS_BLKS_SZ(run);
+        pthread_mutex_lock(&nfs_io_lock);
+        if (ddriver_ioctl(NFS_DRIVER(), IOC_REQ_DEVICE_DISCARD, &range) < 0) {
+            ret = -NFS_ERROR_IO;
+        }
+        pthread_mutex_unlock(&nfs_io_lock);
+    }
+    return ret;
+}
+
+/**
+ * @brief 线性目录已分配的数据块数（block_pointer从0开始连续使用，未用的为0）
+ */
+static int nfs_dir_blks(struct nfs_inode* inode) {
+    int blks = 0;
+    while (blks < NFS_DATA_PER_FILE && inode->block_pointer[blks] != 0) {
+        blks++;
+    }
+    return blks;
 }
 
+/**
+ * @brief 为线性目录追加第blk个目录块，初始化为空块并标脏
+ */
+static int nfs_dir_grow(struct nfs_inode* inode, int blk) {
+    int dno = nfs_alloc_data_blk(inode, blk);
+
+    if (dno < 0) {
+        return dno;
+    }
+    inode->block_pointer[blk] = dno;
+    inode->data[blk] = (uint8_t *)nfs_slab_alloc(&nfs_super.blk_slab);
+    nfs_dirblk_init(inode->data[blk]);
+    inode->dir_free[blk] = nfs_dirblk_max_free(inode->data[blk]);
+    inode->blk_dirty |= 1 << blk;
+    inode->size += NFS_BLK_SZ();                        // 目录大小按占用的块计
+    return NFS_ERROR_NONE;
+}
 
 /**
- * @brief 为一个inode分配dentry，采用头插法，并根据情况分配新的数据块存储dentry
+ * @brief 把dentry放入线性目录第一块空闲空间足够的目录块，只修改并标脏这一块
+ *
+ * 每块最大的连续空闲空间记在dir_free中，查找不需要扫描目录块；删除留下的
+ * 空闲空间并入相邻记录后同样会被复用。所有块都放不下且grow为真时追加新块，
+ * 尽量与该目录已有的dentry块处于同一磁道。
+ *
+ * @return int 0成功，放不下且不能追加新块时返回-NFS_ERROR_NOSPACE
+ */
+static int nfs_dir_add(struct nfs_inode* inode, struct nfs_dentry* dentry, boolean grow) {
+    int need = NFS_DENTRY_D_LEN(strlen(dentry->fname));
+    int blks = nfs_dir_blks(inode);
+    int blk, ret;
+
+    for (blk = 0; blk < blks && inode->dir_free[blk] < need; blk++) {
+        ;
+    }
+    if (blk == blks) {
+        if (!grow || blks == NFS_DATA_PER_FILE) {
+            return -NFS_ERROR_NOSPACE;                  // 线性目录最多NFS_DATA_PER_FILE块
+        }
+        if ((ret = nfs_dir_grow(inode, blk)) != NFS_ERROR_NONE) {
+            return ret;
+        }
+    }
+    if ((ret = nfs_dirblk_add(inode->data[blk], dentry)) < 0) {
+        return ret;
+    }
+    inode->dir_free[blk] = nfs_dirblk_max_free(inode->data[blk]);
+    inode->blk_dirty |= 1 << blk;
+    return NFS_ERROR_NONE;
+}
+
+/**
+ * @brief 为一个inode分配dentry，采用头插法，并把目录项写入目录块
  * 
  * @param inode 目标inode
  * @param dentry 待分配的dentry
- * @param judge 判断是否需要分配新的数据块
+ * @param judge 为1时同时写入目录块；为0时目录项已在磁盘上（读入目录时）
  * @return int 返回inode的目录项数量（dir_cnt），失败时返回错误码
  */
 int nfs_alloc_dentry(struct nfs_inode* inode, struct nfs_dentry* dentry, int judge) {
+    int ret;
+
+    // 先登记子项表：写目录块失败时从表中撤下，dentrys链表与目录块都不留痕迹
+    ret = nfs_dtable_insert(inode, dentry);  // 同时登记到子项表，查找不再遍历链表
+    if (ret < 0) {
+        return ret;
+    }
+
+    // 索引目录直接把目录项写入哈希对应的叶子块；线性目录一块放不下时转换为索引目录
+    if (judge == 1 && (inode->flags & NFS_INODE_F_INDEX)) {
+        ret = nfs_dx_add(inode, dentry);
+    } else if (judge == 1) {
+        ret = nfs_dir_add(inode, dentry, nfs_options.no_dir_index || nfs_dir_blks(inode) == 0);
+        if (ret == -NFS_ERROR_NOSPACE && !nfs_options.no_dir_index && nfs_dir_blks(inode) > 0) {
+            ret = nfs_dx_convert(inode, dentry);
+        }
+    } else {
+        ret = NFS_ERROR_NONE;
+    }
+    if (ret < 0) {
+        nfs_dtable_remove(inode, dentry);
+        return ret;
+    }
+
     // 头插法，将dentry插入到inode的dentry链表头部
     if (inode->dentrys == NULL) {
         inode->dentrys = dentry;
@@ -134,39 +612,57 @@ int nfs_alloc_dentry(struct nfs_inode* inode, struct nfs_dentry* dentry, int jud
     }
 
     inode->dir_cnt++;  // 增加目录项计数
+    if (judge == 1) {
+        inode->dirty = TRUE;
+    }
+    return inode->dir_cnt;  // 返回更新后的目录项数量
+}
 
-    // 判断是否需要为inode分配新的数据块来存储dentry
-    int cur_blk = inode->dir_cnt / NFS_DENTRY_PER_DATABLK();  // 当前应分配的块号
-    if (judge == 1 && inode->dir_cnt % NFS_DENTRY_PER_DATABLK() == 1) {
-        // 查找空闲数据块
-        int byte_cursor = 0;
-        int bit_cursor  = 0;
-        int dno_cursor  = 500;  // 数据逻辑块号 -- 对应物理块号0
-        boolean is_find_free_data_blk = FALSE;
-
-        // 在数据块位图中查找空闲数据块
-        for (byte_cursor = 0; byte_cursor < NFS_BLKS_SZ(nfs_super.map_data_blks); byte_cursor++) {
-            for (bit_cursor = 0; bit_cursor < UINT8_BITS; bit_cursor++) {
-                if ((nfs_super.map_data[byte_cursor] & (0x1 << bit_cursor)) == 0) {
-                    nfs_super.map_data[byte_cursor] |= (0x1 << bit_cursor);  // 标记为已使用
-                    is_find_free_data_blk = TRUE;
-                    break;
-                }
-                dno_cursor++;
+/**
+ * @brief 从目录中删除dentry：线性目录只修改并标脏所在的一块，索引目录改写所在叶子块
+ * 
+ * 不释放dentry指向的inode与数据块，由调用者处理。
+ * 
+ * @param inode 目录inode
+ * @param dentry 待删除的目录项
+ * @return int 删除后的目录项数量，失败时返回错误码
+ */
+int nfs_drop_dentry(struct nfs_inode* inode, struct nfs_dentry* dentry) {
+    struct nfs_dentry** link;
+    int ret = -NFS_ERROR_NOTFOUND;
+    int blk, ofs;
+
+    if (inode->flags & NFS_INODE_F_INDEX) {
+        ret = nfs_dx_del(inode, dentry->fname);
+    } else {
+        for (blk = 0; blk < nfs_dir_blks(inode); blk++) {
+            ofs = nfs_dirblk_find(inode->data[blk], dentry->fname);
+            if (ofs >= 0) {
+                nfs_dirblk_del(inode->data[blk], ofs);
+                inode->dir_free[blk] = nfs_dirblk_max_free(inode->data[blk]);
+                inode->blk_dirty |= 1 << blk;
+                ret = NFS_ERROR_NONE;
+                break;
             }
-            if (is_find_free_data_blk) break;
         }
+    }
+    if (ret < 0) {
+        return ret;
+    }
 
-        // 如果未找到空闲数据块，返回错误
-        if (!is_find_free_data_blk || dno_cursor == nfs_super.max_data) {
-            return -NFS_ERROR_NOSPACE;
+    // 从dentry链表与子项表中摘除（索引目录的dentry可能不在缓存中）
+    for (link = &inode->dentrys; *link != NULL; link = &(*link)->brother) {
+        if (*link == dentry) {
+            *link = dentry->brother;
+            break;
         }
-
-        // 将空闲数据块号分配给当前块
-        inode->block_pointer[cur_blk] = dno_cursor;
     }
+    dentry->brother = NULL;
+    nfs_dtable_remove(inode, dentry);
 
-    return inode->dir_cnt;  // 返回更新后的目录项数量
+    inode->dir_cnt--;
+    inode->dirty = TRUE;
+    return inode->dir_cnt;
 }
 
 /**
@@ -177,34 +673,30 @@ int nfs_alloc_dentry(struct nfs_inode* inode, struct nfs_dentry* dentry, int jud
  */
 struct nfs_inode* nfs_alloc_inode(struct nfs_dentry * dentry) {
     struct nfs_inode* inode;
-    int byte_cursor = 0; 
-    int bit_cursor  = 0; 
-    int ino_cursor  = 0;
-    boolean is_find_free_entry = FALSE;
+    int group;
+    int ino_cursor;
 
-    // 查找空闲的inode，在inode位图中遍历
-    for (byte_cursor = 0; byte_cursor < NFS_BLKS_SZ(nfs_super.map_inode_blks); byte_cursor++)
-    {
-        for (bit_cursor = 0; bit_cursor < UINT8_BITS; bit_cursor++) {
-            if((nfs_super.map_inode[byte_cursor] & (0x1 << bit_cursor)) == 0) {    
-                // 找到空闲的inode位置
-                nfs_super.map_inode[byte_cursor] |= (0x1 << bit_cursor);  // 标记inode为已使用
-                is_find_free_entry = TRUE;           
-                break;
-            }
-            ino_cursor++;
-        }
-        if (is_find_free_entry) {
-            break;
-        }
+    // 选择块组：根目录在块组0，目录按Orlov分散，普通文件跟随父目录
+    if (dentry->parent == NULL) {
+        group = 0;
+    }
+    else if (dentry->ftype == NFS_DIR) {
+        group = nfs_find_group_dir(dentry->parent);
+    }
+    else {
+        group = nfs_find_group_other(dentry->parent);
     }
 
-    // 如果没有找到空闲inode或者inode数量达到上限，返回错误
-    if (!is_find_free_entry || ino_cursor == nfs_super.max_ino)
-        return -NFS_ERROR_NOSPACE;
+    // 在块组的inode位图中查找空闲inode，所有块组都满时返回错误
+    ino_cursor = group < 0 ? -1 : nfs_group_alloc_ino(group);
+    if (ino_cursor < 0)
+        return NULL;
+    if (dentry->ftype == NFS_DIR) {
+        nfs_super.groups[group].used_dirs++;
+    }
 
     // 分配新的inode内存
-    inode = (struct nfs_inode*)malloc(sizeof(struct nfs_inode));
+    inode = (struct nfs_inode*)nfs_slab_alloc(&nfs_super.inode_slab);
     inode->ino  = ino_cursor;  // 分配的inode号
     inode->size = 0;           // 初始化文件大小为0
     
@@ -216,93 +708,275 @@ struct nfs_inode* nfs_alloc_inode(struct nfs_dentry * dentry) {
     inode->dentry = dentry;
     
     inode->dir_cnt = 0;  // 初始化目录计数器为0
+    inode->flags   = 0;
+    inode->blk_dirty = 0;
+    memset(inode->block_pointer, 0, sizeof(inode->block_pointer));  // 目录按需分配数据块
+    memset(inode->data, 0, sizeof(inode->data));
     inode->dentrys = NULL;  // 初始化dentry链表为空
+    inode->dtable  = NULL;  // 子项表在插入第一个目录项时创建
     
-    // 如果是常规文件，则为文件分配数据块
+    // 如果是常规文件，则为文件分配数据块，按磁道集中放置
     if (NFS_IS_REG(inode)) {
         for(int i = 0; i < NFS_DATA_PER_FILE; i++) {
-            inode->data[i] = (uint8_t *)malloc(NFS_BLK_SZ());  // 分配文件数据块
+            inode->block_pointer[i] = nfs_alloc_data_blk(inode, i);
+            if (inode->block_pointer[i] < 0) {
+                // 数据块不足：归还已分配的数据块、inode与内存，dentry恢复为未分配
+                while (--i >= 0) {
+                    nfs_free_data_blk(inode->block_pointer[i]);
+                    nfs_slab_free(&nfs_super.blk_slab, inode->data[i]);
+                }
+                nfs_group_free_ino(ino_cursor, FALSE);
+                nfs_slab_free(&nfs_super.inode_slab, inode);
+                dentry->inode = NULL;
+                dentry->ino   = -1;
+                return NULL;
+            }
+            inode->data[i] = (uint8_t *)nfs_slab_alloc(&nfs_super.blk_slab);  // 分配文件数据块
+            memset(inode->data[i], 0, NFS_BLK_SZ());
+            inode->blk_dirty |= 1 << i;         // 新块需清零落盘
         }
     }
 
+    inode->dirty = TRUE;  // 新inode尚未写回
+    nfs_cache_add(inode);
     return inode;
 }
 
 /**
- * @brief 将内存 inode 及其下方结构全部刷回磁盘
+ * @brief 撤销nfs_alloc_inode：归还数据块与inode位图，释放内存inode
  * 
- * @param inode       指向需要刷回的内存 inode 的指针
- * @return int        操作状态码，NFS_ERROR_NONE 表示成功
+ * 只用于尚未加入父目录、也未写回的新inode，例如父目录写不下新目录项时。
+ * 
+ * @param inode nfs_alloc_inode返回的inode
  */
-int nfs_sync_inode(struct nfs_inode * inode) {
+void nfs_drop_inode(struct nfs_inode * inode) {
+    for (int i = 0; i < NFS_DATA_PER_FILE; i++) {
+        if (inode->block_pointer[i] > 0) {
+            nfs_free_data_blk(inode->block_pointer[i]);
+        }
+    }
+    nfs_group_free_ino(inode->ino, NFS_IS_DIR(inode));
+    nfs_free_inode(inode);
+}
+
+/**
+ * @brief 将内存 inode 本身写回，不递归：inode与线性目录的脏目录块写入元数据
+ *        日志，文件的脏数据块追加到wb，由调用者排序合并后直接写盘
+ * 
+ * inode未标脏时不写inode；索引目录的目录项在插入时已写入叶子块，blk_dirty为0。
+ * 文件数据块的blk_dirty位保留到wb写盘成功后由调用者清除，写盘失败时仍是脏块。
+ * 调用者持有日志句柄，wb写盘之前inode所在的事务不会提交。
+ * 
+ * @param inode 指向需要写回的内存 inode 的指针
+ * @param wb    输出：待写回的文件数据块
+ * @param nr_wb wb中已有的块数，返回时增加
+ * @return int  操作状态码，NFS_ERROR_NONE 表示成功
+ */
+static int nfs_write_inode_wb(struct nfs_inode * inode, struct nfs_jblk * wb, int * nr_wb) {
     struct nfs_inode_d  inode_d;               // 用于存储 inode 的磁盘结构
-    struct nfs_dentry*  dentry_cursor;         // 当前目录项指针
-    struct nfs_dentry_d dentry_d;              // 用于存储目录项的磁盘结构
-    int offset;                                // 当前写入磁盘的偏移量
     int ino = inode->ino;                      // inode 编号
+    int i, blk;
+
+    for (i = 0; i < NFS_DATA_PER_FILE; i++) {
+        if (!(inode->blk_dirty & (1 << i))) {
+            continue;
+        }
+        blk = NFS_DATA_OFS(inode->block_pointer[i] - NFS_DNO_BASE) / NFS_BLK_SZ();
+        if (NFS_IS_REG(inode)) {
+            wb[*nr_wb].blk  = blk;
+            wb[*nr_wb].data = inode->data[i];
+            (*nr_wb)++;
+            continue;
+        }
+        if (nfs_journal_write(NFS_BLKS_SZ(blk), inode->data[i], NFS_BLK_SZ()) != NFS_ERROR_NONE) {
+            NFS_DBG("[%s] io error\n", __func__);
+            return -NFS_ERROR_IO;              // 写入失败，返回错误码
+        }
+        inode->blk_dirty &= ~(1 << i);
+    }
+    if (!inode->dirty) {
+        return NFS_ERROR_NONE;
+    }
 
     /* 将内存中的 inode 刷回磁盘的 inode_d */
     inode_d.ino     = ino;                     // 设置 inode 编号
     inode_d.size    = inode->size;             // 设置 inode 文件大小
     inode_d.ftype   = inode->dentry->ftype;    // 设置文件类型
     inode_d.dir_cnt = inode->dir_cnt;          // 设置目录项计数
-    for (int i = 0; i < NFS_DATA_PER_FILE; i++) {
+    inode_d.flags   = inode->flags;            // 设置索引等标志
+    for (i = 0; i < NFS_DATA_PER_FILE; i++) {
         inode_d.block_pointer[i] = inode->block_pointer[i]; // 拷贝数据块指针
     }
     
-    // 写入 inode_d 到磁盘
-    if (nfs_driver_write(NFS_INO_OFS(ino), (uint8_t *)&inode_d, sizeof(struct nfs_inode_d)) != NFS_ERROR_NONE) {
+    // 写入 inode_d 到日志
+    if (nfs_journal_write(NFS_INO_OFS(ino), (uint8_t *)&inode_d, sizeof(struct nfs_inode_d)) != NFS_ERROR_NONE) {
         NFS_DBG("[%s] io error\n", __func__);
         return -NFS_ERROR_IO;                 // 写入失败，返回错误码
     }
+    inode->dirty = FALSE;
+    return NFS_ERROR_NONE;                    // 返回成功状态码
+}
 
-    /* 
-     * Cycle 1: 写入 INODE 
-     * Cycle 2: 写入数据
-     */
-
-    /* 如果是目录类型，则写回目录项，并递归刷写每个目录项对应的 inode 节点 */
-    if (NFS_IS_DIR(inode)) {    
-        int blk_number = 0;                   // 当前数据块编号
-        dentry_cursor = inode->dentrys;       // 获取目录项链表头指针
-
-        // 将目录项写入最多 6 个磁盘块
-        while (dentry_cursor != NULL && blk_number < NFS_DATA_PER_FILE) {
-            offset = NFS_DATA_OFS(inode->block_pointer[blk_number] - 500); // 当前数据块的起始偏移
-            while ((dentry_cursor != NULL) && 
-                   (offset + sizeof(struct nfs_dentry_d) < NFS_DATA_OFS(inode->block_pointer[blk_number] - 500) + NFS_BLK_SZ())) {
-                
-                // 将内存中 dentry_cursor 指向的目录项写入磁盘
-                memcpy(dentry_d.fname, dentry_cursor->fname, NFS_MAX_FILE_NAME); // 拷贝文件名
-                dentry_d.ftype = dentry_cursor->ftype;                          // 设置文件类型
-                dentry_d.ino   = dentry_cursor->ino;                            // 设置 inode 编号
-                if (nfs_driver_write(offset, (uint8_t *)&dentry_d, sizeof(struct nfs_dentry_d)) != NFS_ERROR_NONE) {
-                    NFS_DBG("[%s] io error\n", __func__);
-                    return -NFS_ERROR_IO;      // 写入失败，返回错误码
-                }
-                
-                // 递归同步目录项对应的 inode
-                if (dentry_cursor->inode != NULL) {
-                    nfs_sync_inode(dentry_cursor->inode);
-                }
+/**
+ * @brief 将内存 inode 本身写回，不递归；文件的脏数据块按偏移顺序直接写盘
+ * 
+ * @param inode       指向需要写回的内存 inode 的指针
+ * @return int        操作状态码，NFS_ERROR_NONE 表示成功
+ */
+int nfs_write_inode(struct nfs_inode * inode) {
+    struct nfs_jblk wb[NFS_DATA_PER_FILE];     // 文件的脏数据块
+    int nr_wb = 0;
+    int ret = nfs_write_inode_wb(inode, wb, &nr_wb);
+
+    if (ret == NFS_ERROR_NONE) {
+        ret = nfs_driver_write_blks(wb, nr_wb);
+    }
+    if (ret == NFS_ERROR_NONE && NFS_IS_REG(inode)) {
+        inode->blk_dirty = 0;                  // 数据块都已写盘
+    }
+    return ret;
+}
+
+/**
+ * @brief 写回一个inode及通往它的各级目录，不涉及其他文件
+ * 
+ * 先写inode自身的脏块，再沿父目录向上写回有修改的目录（新建文件的目录项
+ * 可能还在父目录的脏块中），最后写入块组位图。
+ * 
+ * @param inode 目标inode（文件或目录）
+ * @param wait  TRUE时提交日志并等待落盘（fsync）；FALSE时只写入运行中事务（flush）
+ * @return int  操作状态码，NFS_ERROR_NONE 表示成功
+ */
+int nfs_fsync_inode(struct nfs_inode * inode, boolean wait) {
+    struct nfs_inode* cursor;
+    int ret = NFS_ERROR_NONE;
+
+    nfs_journal_start();
+    for (cursor = inode; cursor != NULL && ret == NFS_ERROR_NONE;
+         cursor = cursor->dentry->parent != NULL ? cursor->dentry->parent->inode : NULL) {
+        if (cursor->dirty || cursor->blk_dirty) {
+            ret = nfs_write_inode(cursor);
+        }
+    }
+    if (ret == NFS_ERROR_NONE) {
+        ret = nfs_sync_groups();
+    }
+    nfs_journal_stop();
+    if (ret != NFS_ERROR_NONE || !wait) {
+        return ret;
+    }
+    // 日志为空时提交不会刷写设备，直接写盘的文件数据要单独刷写
+    ret = nfs_driver_flush();
+    return ret != NFS_ERROR_NONE ? ret : nfs_journal_sync();
+}
 
-                dentry_cursor = dentry_cursor->brother; // 移动到下一个兄弟目录项
-                offset += sizeof(struct nfs_dentry_d);  // 偏移量递增
+/**
+ * @brief 缓存中以inode为根的子树里文件脏数据块的总数
+ */
+static int nfs_count_wb(struct nfs_inode * inode) {
+    struct nfs_dentry* dentry_cursor;
+    int cnt = NFS_IS_REG(inode) ? __builtin_popcount(inode->blk_dirty) : 0;
+
+    if (NFS_IS_DIR(inode)) {
+        for (dentry_cursor = inode->dentrys; dentry_cursor != NULL; dentry_cursor = dentry_cursor->brother) {
+            if (dentry_cursor->inode != NULL) {
+                cnt += nfs_count_wb(dentry_cursor->inode);
             }
-            blk_number++;                      // 切换到下一个数据块
         }
     }
-    /* 如果是文件类型，则将 inode 指向的数据直接写入磁盘 */
-    else if (NFS_IS_REG(inode)) {
-        for (int i = 0; i < NFS_DATA_PER_FILE; i++) {
-            if (nfs_driver_write(NFS_DATA_OFS(inode->block_pointer[i] - 500), 
-                                 inode->data[i], NFS_BLK_SZ()) != NFS_ERROR_NONE) {
-                NFS_DBG("[%s] io error\n", __func__);
-                return -NFS_ERROR_IO;          // 写入失败，返回错误码
+    return cnt;
+}
+
+/**
+ * @brief 递归写回子树中的inode与目录块，文件数据块收集到wb
+ *
+ * 某个inode写入日志失败时仍继续遍历，保证子树中文件的脏数据块全部进入wb。
+ */
+static int nfs_sync_tree(struct nfs_inode * inode, struct nfs_jblk * wb, int * nr_wb) {
+    struct nfs_dentry*  dentry_cursor;         // 当前目录项指针
+    int ret = nfs_write_inode_wb(inode, wb, nr_wb);
+    int sub;
+
+    // 如果是目录类型，递归刷写缓存中的子inode
+    if (NFS_IS_DIR(inode)) {
+        for (dentry_cursor = inode->dentrys; dentry_cursor != NULL; dentry_cursor = dentry_cursor->brother) {
+            if (dentry_cursor->inode != NULL) {
+                sub = nfs_sync_tree(dentry_cursor->inode, wb, nr_wb);
+                ret = ret != NFS_ERROR_NONE ? ret : sub;
             }
         }
     }
-    return NFS_ERROR_NONE;                    // 返回成功状态码
+    return ret;
+}
+
+/**
+ * @brief wb写盘成功后清除子树中文件的blk_dirty
+ */
+static void nfs_sync_tree_done(struct nfs_inode * inode) {
+    struct nfs_dentry*  dentry_cursor;
+
+    if (NFS_IS_REG(inode)) {
+        inode->blk_dirty = 0;
+        return;
+    }
+    for (dentry_cursor = inode->dentrys; dentry_cursor != NULL; dentry_cursor = dentry_cursor->brother) {
+        if (dentry_cursor->inode != NULL) {
+            nfs_sync_tree_done(dentry_cursor->inode);
+        }
+    }
+}
+
+/**
+ * @brief 将内存 inode 及其下方结构全部刷回磁盘
+ * 
+ * 元数据按树的顺序写入日志（只是内存操作），文件数据块先全部收集起来，
+ * 按磁盘偏移排序、相邻块合并后再下发，避免按目录树顺序在inode表与数据区
+ * 之间来回寻道。元数据写回原位置时（checkpoint）同样排序合并。
+ * 
+ * @param inode       指向需要刷回的内存 inode 的指针
+ * @return int        操作状态码，NFS_ERROR_NONE 表示成功
+ */
+int nfs_sync_inode(struct nfs_inode * inode) {
+    struct nfs_scratch_mark mark;
+    struct nfs_jblk* wb;
+    int nr_wb = 0, ret;
+
+    nfs_journal_start();
+    mark = nfs_scratch_mark();
+    wb   = (struct nfs_jblk *)nfs_scratch_alloc(nfs_count_wb(inode) * sizeof(struct nfs_jblk) + 1);
+    if (wb == NULL) {
+        ret = -NFS_ERROR_NOSPACE;
+    } else {
+        ret = nfs_sync_tree(inode, wb, &nr_wb);
+        if (nfs_driver_write_blks(wb, nr_wb) != NFS_ERROR_NONE) {
+            ret = -NFS_ERROR_IO;
+        } else {
+            nfs_sync_tree_done(inode);                  // 数据块都已写盘，失败时仍留作脏块
+        }
+    }
+    nfs_scratch_release(mark);
+    nfs_journal_stop();
+    return ret;
+}
+
+/**
+ * @brief nfs_read_inode失败时释放已加载的目录项、子项表、数据块缓存与inode本身
+ *
+ * inode此时还没有计入缓存，父目录的ref也未增加。
+ */
+static void nfs_read_inode_undo(struct nfs_inode* inode) {
+    struct nfs_dentry* cursor;
+    struct nfs_dentry* next;
+
+    for (cursor = inode->dentrys; cursor != NULL; cursor = next) {
+        next = cursor->brother;
+        nfs_free_dentry(cursor);
+    }
+    nfs_dtable_free(inode);
+    for (int i = 0; i < NFS_DATA_PER_FILE; i++) {
+        nfs_slab_free(&nfs_super.blk_slab, inode->data[i]);
+    }
+    nfs_slab_free(&nfs_super.inode_slab, inode);
 }
 
 /**
@@ -313,15 +987,19 @@ int nfs_sync_inode(struct nfs_inode * inode) {
  * @return struct nfs_inode* 返回加载到内存的 inode 结构，失败返回 NULL
  */
 struct nfs_inode* nfs_read_inode(struct nfs_dentry * dentry, int ino) {
-    struct nfs_inode* inode = (struct nfs_inode*)malloc(sizeof(struct nfs_inode)); // 分配内存给 inode
+    struct nfs_inode* inode = (struct nfs_inode*)nfs_slab_alloc(&nfs_super.inode_slab); // 分配内存给 inode
     struct nfs_inode_d inode_d;             // 用于读取磁盘中的 inode 结构
     struct nfs_dentry* sub_dentry;          // 子目录项指针
-    struct nfs_dentry_d dentry_d;           // 用于读取磁盘中的目录项
-    int dir_cnt = 0;                        // 目录项计数
+    struct nfs_dentry_d* dentry_d;          // 目录块中的变长目录项
+
+    if (inode == NULL) {
+        return NULL;
+    }
 
     // 从磁盘读取 inode 数据
-    if (nfs_driver_read(NFS_INO_OFS(ino), (uint8_t *)&inode_d, sizeof(struct nfs_inode_d)) != NFS_ERROR_NONE) {
+    if (nfs_journal_read(NFS_INO_OFS(ino), (uint8_t *)&inode_d, sizeof(struct nfs_inode_d)) != NFS_ERROR_NONE) {
         NFS_DBG("[%s] io error\n", __func__);
+        nfs_slab_free(&nfs_super.inode_slab, inode);
         return NULL; // 读取失败，返回 NULL
     }
 
@@ -330,54 +1008,71 @@ struct nfs_inode* nfs_read_inode(struct nfs_dentry * dentry, int ino) {
     inode->size      = inode_d.size;        // 设置文件大小
     inode->dentry    = dentry;              // 设置对应的目录项
     inode->dentrys   = NULL;                // 初始化目录项链表为空
+    inode->dtable    = NULL;                // 子项表随目录项加载建立
     inode->dir_cnt   = 0;                   // 初始化目录项计数为 0
+    inode->flags     = inode_d.flags;       // 设置索引等标志
+    inode->blk_dirty = 0;                   // 刚读入的块都是干净的
+    inode->dirty     = FALSE;
+    memset(inode->data, 0, sizeof(inode->data));
     for (int i = 0; i < NFS_DATA_PER_FILE; i++) {
         inode->block_pointer[i] = inode_d.block_pointer[i]; // 复制数据块指针
     }
 
     /* 判断 inode 的文件类型 */
-    if (NFS_IS_DIR(inode)) { // 如果是目录类型
-        dir_cnt = inode_d.dir_cnt;          // 获取目录项计数
-        int blk_number = 0;                 // 当前处理的数据块编号
-        int offset;                         // 当前磁盘偏移量
-
-        /* 遍历目录项，将其加载到内存 */
-        while (dir_cnt > 0 && blk_number < NFS_DATA_PER_FILE) {
-            offset = NFS_DATA_OFS(inode->block_pointer[blk_number] - 500); // 计算当前块的起始偏移
-
-            // 遍历磁盘中当前数据块的目录项
-            while ((dir_cnt > 0) && 
-                   (offset + sizeof(struct nfs_dentry_d) < NFS_DATA_OFS(inode->block_pointer[blk_number] - 500) + NFS_BLK_SZ())) {
-                // 从磁盘读取一个目录项
-                if (nfs_driver_read(offset, (uint8_t *)&dentry_d, sizeof(struct nfs_dentry_d)) != NFS_ERROR_NONE) {
-                    NFS_DBG("[%s] io error\n", __func__);
-                    return NULL; // 读取失败，返回 NULL
-                }
+    if (NFS_IS_DIR(inode) && (inode->flags & NFS_INODE_F_INDEX)) {
+        inode->dir_cnt = inode_d.dir_cnt;   // 索引目录按需查找，不预先加载目录项
+    }
+    else if (NFS_IS_DIR(inode)) { // 如果是目录类型
+        uint8_t* blk;                       // 目录块缓冲区，保留在data[]中供插入、删除使用
+        int blk_number;                     // 当前处理的数据块编号
+        int offset;                         // 目录项在块内的偏移
+
+        /* 整块读入目录块，遍历其中的变长目录项，将其加载到内存 */
+        for (blk_number = 0; blk_number < NFS_DATA_PER_FILE && inode->block_pointer[blk_number] != 0; blk_number++) {
+            blk = inode->data[blk_number] = (uint8_t *)nfs_slab_alloc(&nfs_super.blk_slab);
+            if (blk == NULL || nfs_journal_read(NFS_DATA_OFS(inode->block_pointer[blk_number] - NFS_DNO_BASE), 
+                                 blk, NFS_BLK_SZ()) != NFS_ERROR_NONE || nfs_dirblk_check(blk) != NFS_ERROR_NONE) {
+                NFS_DBG("[%s] io error\n", __func__);
+                nfs_read_inode_undo(inode);
+                return NULL; // 读取失败，返回 NULL
+            }
+            inode->dir_free[blk_number] = nfs_dirblk_max_free(blk);
 
+            for (offset = 0; offset < NFS_BLK_SZ(); offset += dentry_d->rec_len) {
+                dentry_d = NFS_DENTRY_D_AT(blk, offset);
+                if (dentry_d->name_len == 0) {
+                    continue;                       // 空闲目录项
+                }
                 // 根据磁盘中的目录项创建一个内存中的子目录项
-                sub_dentry = new_dentry(dentry_d.fname, dentry_d.ftype); // 创建目录项
+                sub_dentry = nfs_dirblk_load(dentry_d);                  // 创建目录项
+                if (sub_dentry == NULL) {
+                    nfs_read_inode_undo(inode);
+                    return NULL;
+                }
                 sub_dentry->parent = inode->dentry;                     // 设置父目录项
-                sub_dentry->ino    = dentry_d.ino;                      // 设置 inode 编号
-                nfs_alloc_dentry(inode, sub_dentry, 0);                 // 将目录项添加到 inode 的目录链表中
-
-                offset += sizeof(struct nfs_dentry_d); // 偏移量移动到下一个目录项
-                dir_cnt--;                            // 剩余目录项计数减 1
+                if (nfs_alloc_dentry(inode, sub_dentry, 0) < 0) {       // 将目录项添加到 inode 的目录链表中
+                    nfs_free_dentry(sub_dentry);
+                    nfs_read_inode_undo(inode);
+                    return NULL;
+                }
             }
-            blk_number++; // 处理下一个数据块
         }
     } 
     else if (NFS_IS_REG(inode)) { // 如果是文件类型
         /* 直接读取文件数据到内存 */
         for (int i = 0; i < NFS_DATA_PER_FILE; i++) {
-            inode->data[i] = (uint8_t *)malloc(NFS_BLK_SZ()); // 分配内存用于存储数据块
-            if (nfs_driver_read(NFS_DATA_OFS(inode->block_pointer[i] - 500), 
+            inode->data[i] = (uint8_t *)nfs_slab_alloc(&nfs_super.blk_slab); // 分配内存用于存储数据块
+            if (inode->data[i] == NULL ||
+                nfs_driver_read(NFS_DATA_OFS(inode->block_pointer[i] - NFS_DNO_BASE), 
                                 (uint8_t *)inode->data[i], NFS_BLK_SZ()) != NFS_ERROR_NONE) {
                 NFS_DBG("[%s] io error\n", __func__);
+                nfs_read_inode_undo(inode);
                 return NULL; // 读取失败，返回 NULL
             }
         }
     }
 
+    nfs_cache_add(inode); // 计入inode缓存
     return inode; // 返回加载完成的 inode
 }
 
@@ -419,7 +1114,7 @@ struct nfs_dentry* nfs_get_dentry(struct nfs_inode * inode, int dir) {
  * @param path 路径字符串
  * @param is_find 指针，用于标识是否找到目标目录项
  * @param is_root 指针，用于标识路径是否为根目录
- * @return struct nfs_dentry* 返回找到的目录项，或其上一级目录项
+ * @return struct nfs_dentry* 返回找到的目录项，或其上一级目录项；读取inode失败返回NULL
  */
 struct nfs_dentry* nfs_lookup(const char * path, boolean* is_find, boolean* is_root) {
     struct nfs_dentry* dentry_cursor = nfs_super.root_dentry;// 当前处理的目录项，从根目录开始
@@ -429,10 +1124,14 @@ struct nfs_dentry* nfs_lookup(const char * path, boolean* is_find, boolean* is_r
     int lvl = 0;                                             // 当前处理的层级数
     boolean is_hit;                                          // 是否命中目录项
     char* fname = NULL;                                      // 当前层级的文件或文件夹名称
-    char* path_cpy = (char*)malloc(sizeof(path));            // 路径副本，避免修改原路径
+    struct nfs_scratch_mark mark = nfs_scratch_mark();
+    char* path_cpy = (char*)nfs_scratch_alloc(strlen(path) + 1); // 路径副本，避免修改原路径
     *is_root = FALSE;                                        // 初始化为非根目录
     strcpy(path_cpy, path);                                  // 复制路径字符串
 
+    // 每个操作都从这里开始，此时没有inode被使用，缓存超限时在这里回收
+    nfs_cache_shrink();
+
     // 如果路径层级为 0，表示路径为根目录，直接返回根目录项
     if (total_lvl == 0) {                            
         *is_find = TRUE;
@@ -447,10 +1146,16 @@ struct nfs_dentry* nfs_lookup(const char * path, boolean* is_find, boolean* is_r
 
         // 若当前目录项的 inode 为空，从磁盘读取 inode
         if (dentry_cursor->inode == NULL) {           
-            nfs_read_inode(dentry_cursor, dentry_cursor->ino);
+            dentry_cursor->inode = nfs_read_inode(dentry_cursor, dentry_cursor->ino);
         }
 
         inode = dentry_cursor->inode; // 获取当前目录项对应的 inode
+        if (inode == NULL) {          // 读盘或分配失败
+            *is_find = FALSE;
+            dentry_ret = NULL;
+            break;
+        }
+        nfs_cache_touch(inode);       // 经过的inode移到LRU表头
 
         // 如果 inode 是文件类型且未查找到目标层级，路径错误，返回上一级
         if (NFS_IS_REG(inode) && lvl < total_lvl) {
@@ -461,18 +1166,16 @@ struct nfs_dentry* nfs_lookup(const char * path, boolean* is_find, boolean* is_r
 
         // 如果 inode 是目录类型
         if (NFS_IS_DIR(inode)) {
-            dentry_cursor = inode->dentrys; // 进入该目录的子目录项链表
-            is_hit = FALSE;                // 初始化命中标志
-
-            // 遍历目录项链表，查找匹配的名称
-            while (dentry_cursor) {
-                if (memcmp(dentry_cursor->fname, fname, strlen(fname)) == 0) { // 名称匹配
-                    is_hit = TRUE;
-                    break;
-                }
-                dentry_cursor = dentry_cursor->brother; // 查找下一个目录项
-            }
+            // 在子项表中按名字查找，不再遍历目录项链表
+            dentry_cursor = nfs_dtable_find(inode, fname);
+            is_hit = dentry_cursor != NULL;
             
+            // 索引目录只缓存访问过的目录项，缓存未命中时查哈希索引
+            if (!is_hit && (inode->flags & NFS_INODE_F_INDEX)) {
+                dentry_cursor = nfs_dx_lookup(inode, fname);
+                is_hit = dentry_cursor != NULL;
+            }
+
             // 如果未命中，路径错误，返回上一级目录项
             if (!is_hit) {
                 *is_find = FALSE;
@@ -496,22 +1199,97 @@ struct nfs_dentry* nfs_lookup(const char * path, boolean* is_find, boolean* is_r
     // 若返回的目录项的 inode 未加载，则从磁盘读取
     if (dentry_ret && dentry_ret->inode == NULL) {
         dentry_ret->inode = nfs_read_inode(dentry_ret, dentry_ret->ino);
+        if (dentry_ret->inode == NULL) {
+            *is_find = FALSE;
+            dentry_ret = NULL;
+        }
+    }
+    if (dentry_ret) {
+        nfs_cache_touch(dentry_ret->inode);
     }
     
+    nfs_scratch_release(mark);
     return dentry_ret; // 返回查找到的目录项或上一级目录项
 }
 
+/**
+ * @brief 把内存中的超级块信息写入日志
+ * 
+ * @return int 如果操作成功，返回NFS_ERROR_NONE；否则返回错误码。
+ */
+int nfs_sync_super() {
+    struct nfs_super_d nfs_super_d;  // 用于存储即将写回磁盘的超级块
+
+    memset(&nfs_super_d, 0, sizeof(struct nfs_super_d));
+    nfs_super_d.magic_num          = NFS_MAGIC_NUM;                // 超级块的魔术数
+    nfs_super_d.sz_usage           = nfs_super.sz_usage;           // 文件系统使用情况
+    nfs_super_d.group_cnt          = nfs_super.group_cnt;          // 块组数
+    nfs_super_d.inodes_per_group   = nfs_super.inodes_per_group;   // 每个块组的inode数
+    nfs_super_d.data_per_group     = nfs_super.data_per_group;     // 每个完整块组的数据块数
+    nfs_super_d.last_group_data    = nfs_super.groups[nfs_super.group_cnt - 1].nr_data;
+    nfs_super_d.gdt_offset         = nfs_super.gdt_offset;         // 块组描述符表的偏移量
+    nfs_super_d.gdt_blks           = nfs_super.gdt_blks;           // 块组描述符表的块数
+    nfs_super_d.group_offset       = nfs_super.group_offset;       // 块组0的偏移量
+    nfs_super_d.journal_offset     = nfs_super.journal.offset;     // 日志区的偏移量
+    nfs_super_d.journal_blks       = nfs_super.journal.blks + 1;   // 日志区的块数
+
+    return nfs_journal_write(NFS_SUPER_OFS, (uint8_t *)&nfs_super_d, sizeof(struct nfs_super_d));
+}
+
+/**
+ * @brief 把修改过的块组位图与块组描述符表写入日志
+ * 
+ * @return int 如果操作成功，返回NFS_ERROR_NONE；否则返回错误码。
+ */
+int nfs_sync_groups() {
+    struct nfs_scratch_mark mark;
+    struct nfs_group_d* groups_d;    // 用于存储即将写回磁盘的块组描述符表
+    struct nfs_group* group;
+    boolean dirty = FALSE;
+    int g, ret = NFS_ERROR_NONE;
+
+    for (g = 0; g < nfs_super.group_cnt && ret == NFS_ERROR_NONE; g++) {
+        group = &nfs_super.groups[g];
+        if (!group->dirty) {
+            continue;
+        }
+        if (nfs_journal_write(NFS_GROUP_MAP_INODE_OFS(g), group->map_inode, NFS_BLK_SZ()) != NFS_ERROR_NONE
+            || nfs_journal_write(NFS_GROUP_MAP_DATA_OFS(g), group->map_data, NFS_BLK_SZ()) != NFS_ERROR_NONE) {
+            ret = -NFS_ERROR_IO;
+        }
+        group->dirty = FALSE;
+        dirty = TRUE;
+    }
+    if (!dirty || ret != NFS_ERROR_NONE) {
+        return ret;
+    }
+
+    mark     = nfs_scratch_mark();
+    groups_d = (struct nfs_group_d *)nfs_scratch_alloc(NFS_BLKS_SZ(nfs_super.gdt_blks));
+    memset(groups_d, 0, NFS_BLKS_SZ(nfs_super.gdt_blks));
+    for (g = 0; g < nfs_super.group_cnt; g++) {
+        group = &nfs_super.groups[g];
+        groups_d[g].free_inodes = group->free_inodes;
+        groups_d[g].free_data   = group->free_data;
+        groups_d[g].used_dirs   = group->used_dirs;
+    }
+    ret = nfs_journal_write(nfs_super.gdt_offset, (uint8_t *)groups_d, NFS_BLKS_SZ(nfs_super.gdt_blks));
+    nfs_scratch_release(mark);
+    return ret;
+}
+
 /**
  * @brief 挂载NFS文件系统并初始化必要的结构。
  * 
  * 该函数执行以下任务：
  * 1. 打开设备并获取必要的信息。
  * 2. 检查文件系统是否为首次挂载。
- * 3. 初始化超级块和位图（包括inode和数据块）。
+ * 3. 初始化超级块、块组描述符和各块组的位图（包括inode和数据块）。
  * 4. 创建根目录并分配根inode。
  * 5. 设置必要的结构并挂载文件系统。
  * 
- * 注意：16个Inode占用一个块（Blk）。
+ * 注意：每个inode占用一个块（Blk）；块组数由设备大小决定，最后一个块组
+ * 至少要容纳位图、inode表和1个数据块，否则舍去。
  * 
  * @param options 配置挂载操作的选项。
  * @return int 成功时返回0，失败时返回负错误代码。
@@ -522,18 +1300,25 @@ int nfs_mount(struct custom_options options) {
     struct nfs_super_d nfs_super_d;     // 内存中的超级块结构
     struct nfs_dentry* root_dentry;     // 根目录项指针
     struct nfs_inode* root_inode;       // 根inode指针
+    struct ddriver_geometry geometry;   // 设备磁道几何
 
-    int inode_num;                      // inode数量
-    int map_inode_blks;                 // inode位图块数量
+    struct nfs_group_d* groups_d;       // 磁盘上的块组描述符表
+    struct nfs_group* group;            // 当前块组
 
-    int data_num;                       // 数据块数量
-    int map_data_blks;                  // 数据块位图块数量
+    int group_cnt;                      // 块组数量
+    int gdt_blks;                       // 块组描述符表块数量
+    int tail_blks;                      // 最后一个块组的块数量
+    int g;
 
     int super_blks;                     // 超级块数量
     boolean is_init = FALSE;            // 是否为首次挂载标记
 
     // 标记文件系统未挂载
     nfs_super.is_mounted = FALSE;
+    nfs_super.lru_head    = NULL;
+    nfs_super.lru_tail    = NULL;
+    nfs_super.cache_bytes = 0;
+    nfs_super.cache_cap   = (long)options.mem_cap * 1024;
 
     // 打开设备驱动并获取驱动文件描述符
     driver_fd = ddriver_open(options.device);
@@ -546,9 +1331,26 @@ int nfs_mount(struct custom_options options) {
     ddriver_ioctl(NFS_DRIVER(), IOC_REQ_DEVICE_SIZE,  &nfs_super.sz_disk);
     ddriver_ioctl(NFS_DRIVER(), IOC_REQ_DEVICE_IO_SZ, &nfs_super.sz_io);
     nfs_super.sz_blks = 2 * nfs_super.sz_io;  // 计算块大小
+
+    // 查询磁道几何，用于数据块按磁道布局；设备不支持时退化为首次适配
+    memset(&geometry, 0, sizeof(struct ddriver_geometry));
+    if (ddriver_ioctl(NFS_DRIVER(), IOC_REQ_DEVICE_GEOMETRY, &geometry) < 0 || geometry.track_size <= 0) {
+        geometry.track_size = 0;
+    }
+    nfs_super.sz_track = geometry.track_size;
+
+    // dentry、inode、块缓存与子项表都从slab分配，块大小确定后才能建块缓存的slab
+    nfs_slab_init(&nfs_super.dentry_slab, sizeof(struct nfs_dentry));
+    nfs_slab_init(&nfs_super.inode_slab, sizeof(struct nfs_inode));
+    nfs_slab_init(&nfs_super.blk_slab, NFS_BLK_SZ());
+    nfs_slab_init(&nfs_super.dtable_slab, sizeof(struct nfs_dtable));
+    nfs_slab_init(&nfs_super.dtable_arr_slab, NFS_DTABLE_GROUP * (sizeof(struct nfs_dentry *) + 1));
     
     // 创建根目录项
     root_dentry = new_dentry("/", NFS_DIR);
+    if (root_dentry == NULL) {
+        return -NFS_ERROR_NOMEM;
+    }
 
     // 读取磁盘超级块nfs_super_d到内存中
     if (nfs_driver_read(NFS_SUPER_OFS, (uint8_t *)(&nfs_super_d), sizeof(struct nfs_super_d)) != NFS_ERROR_NONE) {
@@ -557,25 +1359,32 @@ int nfs_mount(struct custom_options options) {
 
     // 检查超级块中的幻数，判断是否为首次挂载
     if (nfs_super_d.magic_num != NFS_MAGIC_NUM) {  // 幻数不匹配，表示首次挂载
-        // 估算各部分大小
+        // 估算各部分大小：描述符表按可能的最大块组数预留
         super_blks = NFS_SUPER_BLKS;
-        inode_num  = NFS_INODE_BLKS;
-        data_num = NFS_DATA_BLKS;
-        map_inode_blks = NFS_MAP_INODE_BLKS;
-        map_data_blks = NFS_MAP_DATA_BLKS;
+        group_cnt  = NFS_ROUND_UP(NFS_DISK_SZ() / NFS_BLK_SZ() - super_blks - NFS_JOURNAL_BLKS, NFS_GROUP_BLKS) / NFS_GROUP_BLKS;
+        gdt_blks   = NFS_ROUND_UP(group_cnt * (int)sizeof(struct nfs_group_d), NFS_BLK_SZ()) / NFS_BLK_SZ();
+        tail_blks  = (NFS_DISK_SZ() / NFS_BLK_SZ() - super_blks - gdt_blks - NFS_JOURNAL_BLKS) % NFS_GROUP_BLKS;
+        group_cnt  = (NFS_DISK_SZ() / NFS_BLK_SZ() - super_blks - gdt_blks - NFS_JOURNAL_BLKS) / NFS_GROUP_BLKS;
+        if (tail_blks > NFS_GROUP_MAP_BLKS + NFS_GROUP_INODE_BLKS) {
+            group_cnt++;
+        } else {
+            tail_blks = NFS_GROUP_BLKS;
+        }
+        if (group_cnt == 0) {
+            return -NFS_ERROR_NOSPACE;  // 设备容纳不下一个块组
+        }
 
         // 设置超级块布局
-        nfs_super.max_ino = inode_num;
-        nfs_super.max_data = data_num;
-
-        nfs_super_d.map_inode_blks = map_inode_blks; 
-        nfs_super_d.map_data_blks = map_data_blks; 
+        nfs_super_d.group_cnt        = group_cnt;
+        nfs_super_d.inodes_per_group = NFS_GROUP_INODE_BLKS;
+        nfs_super_d.data_per_group   = NFS_GROUP_BLKS - NFS_GROUP_MAP_BLKS - NFS_GROUP_INODE_BLKS;
+        nfs_super_d.last_group_data  = tail_blks - NFS_GROUP_MAP_BLKS - NFS_GROUP_INODE_BLKS;
 
-        nfs_super_d.map_inode_offset = NFS_SUPER_OFS + NFS_BLKS_SZ(super_blks);
-        nfs_super_d.map_data_offset = nfs_super_d.map_inode_offset + NFS_BLKS_SZ(map_inode_blks);
-
-        nfs_super_d.inode_offset = nfs_super_d.map_data_offset + NFS_BLKS_SZ(map_data_blks);
-        nfs_super_d.data_offset = nfs_super_d.inode_offset + NFS_BLKS_SZ(inode_num);
+        nfs_super_d.gdt_offset     = NFS_SUPER_OFS + NFS_BLKS_SZ(super_blks);
+        nfs_super_d.gdt_blks       = gdt_blks;
+        nfs_super_d.journal_offset = nfs_super_d.gdt_offset + NFS_BLKS_SZ(gdt_blks);
+        nfs_super_d.journal_blks   = NFS_JOURNAL_BLKS;
+        nfs_super_d.group_offset   = nfs_super_d.journal_offset + NFS_BLKS_SZ(NFS_JOURNAL_BLKS);
 
         nfs_super_d.sz_usage = 0;
         nfs_super_d.magic_num = NFS_MAGIC_NUM;
@@ -585,41 +1394,86 @@ int nfs_mount(struct custom_options options) {
 
     /* 创建内存中的结构 */
     // 初始化超级块信息
-    nfs_super.sz_usage = nfs_super_d.sz_usage;
-
-    // 创建inode位图
-    nfs_super.map_inode = (uint8_t *)malloc(NFS_BLKS_SZ(nfs_super_d.map_inode_blks));
-    nfs_super.map_inode_blks = nfs_super_d.map_inode_blks;
-    nfs_super.map_inode_offset = nfs_super_d.map_inode_offset;
-    nfs_super.inode_offset = nfs_super_d.inode_offset;
-
-    // 创建数据块位图
-    nfs_super.map_data = (uint8_t *)malloc(NFS_BLKS_SZ(nfs_super_d.map_data_blks));
-    nfs_super.map_data_blks = nfs_super_d.map_data_blks;
-    nfs_super.map_data_offset = nfs_super_d.map_data_offset;
-    nfs_super.data_offset = nfs_super_d.data_offset;
+    nfs_super.sz_usage         = nfs_super_d.sz_usage;
+    nfs_super.group_cnt        = nfs_super_d.group_cnt;
+    nfs_super.inodes_per_group = nfs_super_d.inodes_per_group;
+    nfs_super.data_per_group   = nfs_super_d.data_per_group;
+    nfs_super.gdt_offset       = nfs_super_d.gdt_offset;
+    nfs_super.gdt_blks         = nfs_super_d.gdt_blks;
+    nfs_super.group_offset     = nfs_super_d.group_offset;
+    nfs_super.max_ino          = nfs_super.group_cnt * nfs_super.inodes_per_group;
+    nfs_super.max_data         = nfs_super.group_cnt * nfs_super.data_per_group;
+
+    // 挂载元数据日志：首次挂载时初始化日志区，否则先重放上次未写回的事务，
+    // 之后读到的超级块、描述符表、位图与inode都是最新的（布局字段创建后不再改变）
+    ret = nfs_journal_load(nfs_super_d.journal_offset, nfs_super_d.journal_blks, is_init, options.commit_ms);
+    if (ret != NFS_ERROR_NONE) {
+        return ret;
+    }
+    if (!is_init) {
+        if (nfs_driver_read(NFS_SUPER_OFS, (uint8_t *)(&nfs_super_d), sizeof(struct nfs_super_d)) != NFS_ERROR_NONE) {
+            return -NFS_ERROR_IO;
+        }
+        nfs_super.sz_usage = nfs_super_d.sz_usage;
+    }
 
-    // 读取inode位图到内存
-    if (nfs_driver_read(nfs_super_d.map_inode_offset, (uint8_t *)(nfs_super.map_inode), 
-                        NFS_BLKS_SZ(nfs_super_d.map_inode_blks)) != NFS_ERROR_NONE) {
-        return -NFS_ERROR_IO;  // 读取inode位图失败
+    // 读取块组描述符表，首次挂载时按空块组初始化
+    groups_d = (struct nfs_group_d *)calloc(1, NFS_BLKS_SZ(nfs_super.gdt_blks));
+    if (!is_init && nfs_driver_read(nfs_super.gdt_offset, (uint8_t *)groups_d,
+                                    NFS_BLKS_SZ(nfs_super.gdt_blks)) != NFS_ERROR_NONE) {
+        return -NFS_ERROR_IO;  // 读取块组描述符表失败
     }
 
-    // 读取数据块位图到内存
-    if (nfs_driver_read(nfs_super_d.map_data_offset, (uint8_t *)(nfs_super.map_data), 
-                        NFS_BLKS_SZ(nfs_super_d.map_data_blks)) != NFS_ERROR_NONE) {
-        return -NFS_ERROR_IO;  // 读取数据块位图失败
+    // 创建各块组的inode位图与数据块位图，并读取到内存
+    nfs_super.groups = (struct nfs_group *)calloc(nfs_super.group_cnt, sizeof(struct nfs_group));
+    for (g = 0; g < nfs_super.group_cnt; g++) {
+        group = &nfs_super.groups[g];
+        group->nr_data   = g == nfs_super.group_cnt - 1 ? nfs_super_d.last_group_data : nfs_super.data_per_group;
+        group->map_inode = (uint8_t *)malloc(NFS_BLK_SZ());
+        group->map_data  = (uint8_t *)malloc(NFS_BLK_SZ());
+        if (is_init) {
+            memset(group->map_inode, 0, NFS_BLK_SZ());
+            memset(group->map_data, 0, NFS_BLK_SZ());
+            group->free_inodes = nfs_super.inodes_per_group;
+            group->free_data   = group->nr_data;
+            group->used_dirs   = 0;
+            group->dirty       = TRUE;          // 首次挂载时全部写入
+            continue;
+        }
+        if (nfs_driver_read(NFS_GROUP_MAP_INODE_OFS(g), group->map_inode, NFS_BLK_SZ()) != NFS_ERROR_NONE
+            || nfs_driver_read(NFS_GROUP_MAP_DATA_OFS(g), group->map_data, NFS_BLK_SZ()) != NFS_ERROR_NONE) {
+            return -NFS_ERROR_IO;  // 读取位图失败
+        }
+        group->free_inodes = groups_d[g].free_inodes;
+        group->free_data   = groups_d[g].free_data;
+        group->used_dirs   = groups_d[g].used_dirs;
+        group->dirty       = FALSE;
     }
+    free(groups_d);
 
-    // 如果是首次挂载，则分配根节点
+    // 如果是首次挂载，则分配根节点，连同超级块与块组一起提交
     if (is_init) {
         root_inode = nfs_alloc_inode(root_dentry);  // 分配根inode
+        nfs_dir_grow(root_inode, 0);                // 根目录块放在块组0数据区的开头
         nfs_sync_inode(root_inode);  // 同步根inode
+        nfs_free_inode(root_inode);  // 下面统一从磁盘读入
+        if (nfs_sync_super() != NFS_ERROR_NONE || nfs_sync_groups() != NFS_ERROR_NONE
+            || nfs_journal_sync() != NFS_ERROR_NONE) {
+            return -NFS_ERROR_IO;
+        }
+        // 下次挂载靠原位置的超级块找到日志，提交之后再直接写入；在此之前崩溃则重新格式化
+        if (nfs_driver_write(NFS_SUPER_OFS, (uint8_t *)(&nfs_super_d), sizeof(struct nfs_super_d)) != NFS_ERROR_NONE) {
+            return -NFS_ERROR_IO;
+        }
     }
 
     // 读取根inode
     root_inode = nfs_read_inode(root_dentry, NFS_ROOT_INO);
+    if (root_inode == NULL) {
+        return -NFS_ERROR_IO;
+    }
     root_dentry->inode = root_inode;  // 将根inode与根目录项关联
+    root_inode->ref++;                // 根inode常驻缓存
     nfs_super.root_dentry = root_dentry;  // 将根目录项与超级块关联
     nfs_super.is_mounted = TRUE;  // 设置文件系统为已挂载
 
@@ -632,15 +1486,15 @@ int nfs_mount(struct custom_options options) {
  * 该函数执行以下任务：
  * 1. 确保文件系统已挂载，如果未挂载，则直接返回。
  * 2. 刷写根目录的inode信息。
- * 3. 将内存中的超级块nfs_super更新并写回磁盘。
- * 4. 刷写inode位图和数据位图到磁盘。
+ * 3. 将内存中的超级块、块组描述符表、inode位图和数据位图写入日志。
+ * 4. 提交日志并把其中的元数据写回原位置。
  * 5. 释放内存中的位图结构。
  * 6. 关闭设备驱动。
  * 
  * @return int 如果操作成功，返回NFS_ERROR_NONE；否则返回错误码。
  */
 int nfs_umount() {
-    struct nfs_super_d nfs_super_d;  // 用于存储即将写回磁盘的超级块
+    int g;
 
     // 如果文件系统未挂载，直接返回
     if (!nfs_super.is_mounted) {
@@ -650,34 +1504,30 @@ int nfs_umount() {
     // 刷写根目录inode，确保数据同步到磁盘
     nfs_sync_inode(nfs_super.root_dentry->inode);
 
-    // 用内存中的超级块信息更新nfs_super_d
-    nfs_super_d.magic_num          = NFS_MAGIC_NUM;                // 超级块的魔术数
-    nfs_super_d.sz_usage           = nfs_super.sz_usage;           // 文件系统使用情况
-    nfs_super_d.map_inode_blks     = nfs_super.map_inode_blks;     // inode位图的块数
-    nfs_super_d.map_inode_offset   = nfs_super.map_inode_offset;   // inode位图的偏移量
-    nfs_super_d.inode_offset       = nfs_super.inode_offset;       // inode表的偏移量
-    nfs_super_d.map_data_blks      = nfs_super.map_data_blks;      // 数据位图的块数
-    nfs_super_d.map_data_offset    = nfs_super.map_data_offset;    // 数据位图的偏移量
-    nfs_super_d.data_offset        = nfs_super.data_offset;        // 数据块的偏移量
-
-    // 将更新后的超级块写回磁盘
-    if (nfs_driver_write(NFS_SUPER_OFS, (uint8_t *)&nfs_super_d, sizeof(struct nfs_super_d)) != NFS_ERROR_NONE) {
+    // 超级块、块组描述符表与位图写入日志，随后全部提交并写回原位置
+    if (nfs_sync_super() != NFS_ERROR_NONE || nfs_sync_groups() != NFS_ERROR_NONE
+        || nfs_journal_shutdown() != NFS_ERROR_NONE) {
         return -NFS_ERROR_IO;  // 如果写入失败，返回IO错误
     }
 
-    // 将inode位图写回磁盘
-    if (nfs_driver_write(nfs_super_d.map_inode_offset, (uint8_t *)(nfs_super.map_inode), NFS_BLKS_SZ(nfs_super_d.map_inode_blks)) != NFS_ERROR_NONE) {
-        return -NFS_ERROR_IO;  // 如果写入失败，返回IO错误
+    // 释放内存中的块组描述符和位图
+    for (g = 0; g < nfs_super.group_cnt; g++) {
+        free(nfs_super.groups[g].map_inode);
+        free(nfs_super.groups[g].map_data);
     }
+    free(nfs_super.groups);
 
-    // 将数据位图写回磁盘
-    if (nfs_driver_write(nfs_super_d.map_data_offset, (uint8_t *)(nfs_super.map_data), NFS_BLKS_SZ(nfs_super_d.map_data_blks)) != NFS_ERROR_NONE) {
-        return -NFS_ERROR_IO;  // 如果写入失败，返回IO错误
+    // 内存中的dentry、inode与块缓存随slab一并释放
+    if (nfs_options.stats) {
+        nfs_alloc_stats();
     }
-
-    // 释放内存中的inode和数据位图
-    free(nfs_super.map_inode);
-    free(nfs_super.map_data);
+    nfs_slab_destroy(&nfs_super.dentry_slab);
+    nfs_slab_destroy(&nfs_super.inode_slab);
+    nfs_slab_destroy(&nfs_super.blk_slab);
+    nfs_slab_destroy(&nfs_super.dtable_slab);
+    nfs_slab_destroy(&nfs_super.dtable_arr_slab);
+    nfs_scratch_free();                     // 日志线程已在退出前释放自己的临时缓冲区
+    nfs_super.is_mounted = FALSE;
 
     // 关闭NFS驱动
     ddriver_close(NFS_DRIVER());
@@ -0,0 +1,88 @@
+/*
+ * 目录子项表微基准：在同一组内存目录项上比较nfs_dtable_find与原先沿
+ * brother链表逐个memcmp的查找。
+ *
+ * 构建：cmake -DCMAKE_BUILD_TYPE=Release .. && make dtable_bench
+ * 运行：./dtable_bench [查找次数]
+ */
+#include "../../include/newfs.h"
+#include <time.h>
+
+struct nfs_super      nfs_super;
+struct custom_options nfs_options;
+
+static double now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+/**
+ * @brief 原先nfs_lookup中的链表查找
+ */
+static struct nfs_dentry* brother_find(struct nfs_inode* inode, const char* fname) {
+    struct nfs_dentry* dentry_cursor = inode->dentrys;
+    while (dentry_cursor) {
+        if (memcmp(dentry_cursor->fname, fname, strlen(fname)) == 0) {
+            return dentry_cursor;
+        }
+        dentry_cursor = dentry_cursor->brother;
+    }
+    return NULL;
+}
+
+static void bench(int cnt, long rounds) {
+    struct nfs_inode   inode;
+    struct nfs_dentry* dentrys = (struct nfs_dentry *)calloc(cnt, sizeof(struct nfs_dentry));
+    int*               order   = (int *)malloc(rounds * sizeof(int));
+    char             (*fnames)[16] = malloc(cnt * 16);   // 预先格式化的查找名，计时只含查找本身
+    double             start, t_list, t_table;
+    long               i, hits = 0;
+
+    memset(&inode, 0, sizeof(inode));
+    for (i = 0; i < cnt; i++) {
+        snprintf(dentrys[i].fname, NFS_MAX_FILE_NAME, "file-%06ld", i);
+        snprintf(fnames[i], 16, "file-%06ld", i);
+        dentrys[i].brother = inode.dentrys;
+        inode.dentrys      = &dentrys[i];
+        nfs_dtable_insert(&inode, &dentrys[i]);
+    }
+    srand(cnt);
+    for (i = 0; i < rounds; i++) {
+        order[i] = rand() % cnt;
+    }
+
+    start = now_ns();
+    for (i = 0; i < rounds; i++) {
+        hits += brother_find(&inode, fnames[order[i]]) == &dentrys[order[i]];
+    }
+    t_list = now_ns() - start;
+
+    start = now_ns();
+    for (i = 0; i < rounds; i++) {
+        hits += nfs_dtable_find(&inode, fnames[order[i]]) == &dentrys[order[i]];
+    }
+    t_table = now_ns() - start;
+
+    printf("%8d entries: brother %10.1f ns/lookup, dtable %6.1f ns/lookup, %6.1fx%s\n",
+           cnt, t_list / rounds, t_table / rounds, t_list / t_table,
+           hits == 2 * rounds ? "" : "  MISMATCH");
+
+    nfs_dtable_free(&inode);
+    free(fnames);
+    free(order);
+    free(dentrys);
+}
+
+int main(int argc, char** argv) {
+    long rounds = argc > 1 ? atol(argv[1]) : 200000;
+    int  sizes[] = {4, 16, 64, 256, 1024, 4096, 16384};
+    int  i;
+
+    nfs_slab_init(&nfs_super.dtable_slab, sizeof(struct nfs_dtable));
+    nfs_slab_init(&nfs_super.dtable_arr_slab, NFS_DTABLE_GROUP * (sizeof(struct nfs_dentry *) + 1));
+    for (i = 0; i < (int)(sizeof(sizes) / sizeof(sizes[0])); i++) {
+        bench(sizes[i], sizes[i] >= 4096 ? rounds / 20 : rounds);   // 长链表的基线太慢，减少次数
+    }
+    return 0;
+}
@@ -0,0 +1,534 @@
+/*
+ * newfs功能测试：不经过FUSE挂载，在进程内直接调用newfs_mkdir、newfs_mknod、
+ * newfs_fsync等操作函数，覆盖元数据日志、htree与变长目录项、LRU回收、fsync、
+ * 释放块的丢弃、重新挂载与设备写满。
+ *
+ * 每个用例先删除~/ddriver重新格式化；用例的各阶段在fork出的子进程中挂载运行，
+ * 阶段以nfs_umount结束为正常卸载，直接返回（子进程_exit）即模拟崩溃，下一阶段
+ * 挂载时重放日志。需要默认的file后端，DDRIVER_MODEL未设置时取none。
+ *
+ * 构建：make newfs_func_test
+ * 运行：./newfs_func_test （会清空~/ddriver）
+ */
+#define _DEFAULT_SOURCE                             // newfs.c只定义了_XOPEN_SOURCE，MAP_ANONYMOUS需要
+#define main newfs_main
+#include "../../src/newfs.c"
+#undef main
+
+#include <sys/mman.h>
+#include <sys/wait.h>
+
+#define CHECK(cond, ...) do {                                           \
+    if (!(cond)) {                                                      \
+        fprintf(stderr, "    %s:%d: ", __func__, __LINE__);             \
+        fprintf(stderr, __VA_ARGS__);                                   \
+        fprintf(stderr, "\n");                                          \
+        return 1;                                                       \
+    }                                                                   \
+} while (0)
+
+struct func_shared      // 父子进程共享：前一阶段记录，后一阶段核对
+{
+    int                 free_inodes;
+    int                 free_data;
+    int                 nr_files;
+    int                 nr_dirs;
+    int                 dir_size;
+};
+
+static struct func_shared* shared;
+static char device[128];
+
+/******************************************************************************
+* SECTION: 辅助函数
+*******************************************************************************/
+static int func_mount(int mem_cap, int commit_ms, boolean no_dir_index) {
+    memset(&nfs_options, 0, sizeof(nfs_options));
+    nfs_options.device       = device;
+    nfs_options.mem_cap      = mem_cap;
+    nfs_options.commit_ms    = commit_ms;
+    nfs_options.no_dir_index = no_dir_index;
+    return nfs_mount(nfs_options);
+}
+
+static int func_free_inodes() {
+    int g, cnt = 0;
+    for (g = 0; g < nfs_super.group_cnt; g++) {
+        cnt += nfs_super.groups[g].free_inodes;
+    }
+    return cnt;
+}
+
+static int func_free_data() {
+    int g, cnt = 0;
+    for (g = 0; g < nfs_super.group_cnt; g++) {
+        cnt += nfs_super.groups[g].free_data;
+    }
+    return cnt;
+}
+
+static struct nfs_inode* func_inode(const char* path) {
+    boolean is_find, is_root;
+    struct nfs_dentry* dentry = nfs_lookup(path, &is_find, &is_root);
+    return is_find ? dentry->inode : NULL;
+}
+
+static boolean func_exists(const char* path, NFS_FILE_TYPE ftype) {
+    struct nfs_inode* inode = func_inode(path);
+    return inode != NULL && inode->dentry->ftype == ftype;
+}
+
+/**
+ * @brief 第i个目录项的名字，长度在3到92字节之间变化
+ */
+static void func_name(char* buf, const char* dir, int i) {
+    int len = sprintf(buf, "%s/%d-", dir, i);
+    int pad = (i * 37) % 90;
+    memset(buf + len, 'a' + i % 26, pad);
+    buf[len + pad] = '\0';
+}
+
+static int func_count_filler(void* buf, const char* name, const struct stat* st, off_t off) {
+    (void)name;
+    (void)st;
+    (void)off;
+    (*(int *)buf)++;
+    return 0;
+}
+
+/**
+ * @brief 逐项读取目录，返回目录项数
+ */
+static int func_readdir_count(const char* path) {
+    int cnt = 0, last = -1;
+    off_t offset = 0;
+
+    if (func_inode(path)->flags & NFS_INODE_F_INDEX) {
+        newfs_readdir(path, &cnt, func_count_filler, 0, NULL);      // 索引目录一次填完
+        return cnt;
+    }
+    while (cnt != last) {                                           // 线性目录每次填一项
+        last = cnt;
+        newfs_readdir(path, &cnt, func_count_filler, offset++, NULL);
+    }
+    return cnt;
+}
+
+/**
+ * @brief 在子进程中运行一个阶段，返回0表示通过
+ */
+static int func_run(int (*phase)(int), int arg) {
+    pid_t pid;
+    int status;
+
+    fflush(stdout);
+    pid = fork();
+    if (pid == 0) {
+        _exit(phase(arg));
+    }
+    if (pid < 0 || waitpid(pid, &status, 0) < 0) {
+        return 1;
+    }
+    return !WIFEXITED(status) || WEXITSTATUS(status) != 0;
+}
+
+/******************************************************************************
+* SECTION: 元数据日志：提交后崩溃，重放
+*******************************************************************************/
+static int journal_crash(int n) {
+    char path[64];
+    int i, k;
+
+    CHECK(func_mount(0, 60000, FALSE) == NFS_ERROR_NONE, "mount");
+    for (i = 0; i < n; i++) {
+        sprintf(path, "/d%d", i);
+        CHECK(newfs_mkdir(path, 0755) == 0, "mkdir %s", path);
+        for (k = 0; k < 5; k++) {
+            sprintf(path, "/d%d/f%d", i, k);
+            CHECK(newfs_mknod(path, S_IFREG | 0644, 0) == 0, "mknod %s", path);
+        }
+    }
+    CHECK(nfs_journal_sync() == NFS_ERROR_NONE, "journal sync");
+    shared->free_inodes = func_free_inodes();
+    shared->free_data   = func_free_data();
+
+    for (i = n; i < 2 * n; i++) {                   // 提交间隔内未提交，崩溃后丢失
+        sprintf(path, "/d%d", i);
+        CHECK(newfs_mkdir(path, 0755) == 0, "mkdir %s", path);
+    }
+    return 0;                                       // 不卸载
+}
+
+static int journal_replay(int n) {
+    char path[64];
+    int i, k;
+
+    CHECK(func_mount(0, 0, FALSE) == NFS_ERROR_NONE, "mount after crash");
+    for (i = 0; i < n; i++) {
+        sprintf(path, "/d%d", i);
+        CHECK(func_exists(path, NFS_DIR), "%s lost", path);
+        for (k = 0; k < 5; k++) {
+            sprintf(path, "/d%d/f%d", i, k);
+            CHECK(func_exists(path, NFS_REG_FILE), "%s lost", path);
+        }
+    }
+    for (i = n; i < 2 * n; i++) {
+        sprintf(path, "/d%d", i);
+        CHECK(!func_exists(path, NFS_DIR), "uncommitted %s survived", path);
+    }
+    CHECK(func_free_inodes() == shared->free_inodes && func_free_data() == shared->free_data,
+          "free inodes %d data %d, expected %d %d", func_free_inodes(), func_free_data(),
+          shared->free_inodes, shared->free_data);
+    return nfs_umount();
+}
+
+static int test_journal() {
+    return func_run(journal_crash, 20) || func_run(journal_replay, 20) || func_run(journal_replay, 20);
+}
+
+/******************************************************************************
+* SECTION: 变长目录项与htree：线性目录、转换为索引目录，重新挂载
+*******************************************************************************/
+static int dirents_create(int n) {
+    struct stat st;
+    char path[160];
+    boolean no_index = n < 0;                       // n为负时禁止转换为索引目录
+    const char* dir = no_index ? "/linear" : "/htree";
+    int i;
+
+    n = abs(n);
+    CHECK(func_mount(0, 0, no_index) == NFS_ERROR_NONE, "mount");
+    CHECK(newfs_mkdir(dir, 0755) == 0, "mkdir %s", dir);
+    for (i = 0; i < n; i++) {
+        func_name(path, dir, i);
+        if (no_index) {                             // 线性目录最多6块，用短名字
+            sprintf(path, "%s/%d", dir, i);
+        }
+        CHECK((i % 4 == 0 ? newfs_mknod(path, S_IFREG | 0644, 0) : newfs_mkdir(path, 0755)) == 0,
+              "create %s", path);
+    }
+    CHECK(func_readdir_count(dir) == n, "readdir %s: %d entries", dir, func_readdir_count(dir));
+    CHECK(newfs_getattr(dir, &st) == 0 && st.st_size > 0 && st.st_size % NFS_BLK_SZ() == 0,
+          "%s st_size %ld", dir, (long)st.st_size);
+    CHECK(((func_inode(dir)->flags & NFS_INODE_F_INDEX) == 0) == no_index, "%s index flag", dir);
+    shared->dir_size = st.st_size;
+    return nfs_umount();
+}
+
+static int dirents_check(int n) {
+    struct stat st;
+    char path[160];
+    boolean no_index = n < 0;
+    const char* dir = no_index ? "/linear" : "/htree";
+    int i;
+
+    n = abs(n);
+    CHECK(func_mount(0, 0, no_index) == NFS_ERROR_NONE, "remount");
+    for (i = 0; i < n; i++) {
+        func_name(path, dir, i);
+        if (no_index) {
+            sprintf(path, "%s/%d", dir, i);
+        }
+        CHECK(func_exists(path, i % 4 == 0 ? NFS_REG_FILE : NFS_DIR), "%s lost", path);
+    }
+    CHECK(func_readdir_count(dir) == n, "readdir %s: %d entries", dir, func_readdir_count(dir));
+    CHECK(newfs_getattr(dir, &st) == 0 && st.st_size == shared->dir_size,
+          "%s st_size %ld, expected %d", dir, (long)st.st_size, shared->dir_size);
+    return nfs_umount();
+}
+
+static int test_dirents() {
+    return func_run(dirents_create, -150) || func_run(dirents_check, -150)
+        || func_run(dirents_create, 400) || func_run(dirents_check, 400);
+}
+
+/******************************************************************************
+* SECTION: LRU回收：mem_cap为8/16 KiB时缓存不超过上限，回收的目录可重新读入
+*******************************************************************************/
+#define LRU_DIRS    30
+#define LRU_FILES   10
+
+/**
+ * @brief 下一个操作开始时的回收之后，缓存不超过上限，除非只剩常驻的根inode
+ */
+static boolean lru_within_cap(int mem_cap) {
+    nfs_cache_shrink();
+    return nfs_super.cache_bytes <= mem_cap * 1024 || nfs_super.lru_head == nfs_super.lru_tail;
+}
+
+static int lru_create(int mem_cap) {
+    struct nfs_dentry* dentry;
+    char path[64];
+    int i, k, ret;
+
+    unlink(device);                                 // 两种mem_cap各自从空盘开始
+    CHECK(func_mount(mem_cap, 0, FALSE) == NFS_ERROR_NONE, "mount");
+    for (i = 0; i < LRU_DIRS; i++) {
+        sprintf(path, "/dir%d", i);
+        ret = newfs_mkdir(path, 0755);
+        CHECK(ret == 0, "mkdir %s returned %d", path, ret);
+        for (k = 0; k < LRU_FILES; k++) {
+            sprintf(path, "/dir%d/file%d", i, k);
+            CHECK(newfs_mknod(path, S_IFREG | 0644, 0) == 0, "mknod %s", path);
+            CHECK(lru_within_cap(mem_cap),
+                  "cache %ld bytes over cap %d KiB", nfs_super.cache_bytes, mem_cap);
+        }
+    }
+    for (dentry = nfs_super.root_dentry->inode->dentrys; dentry->brother != NULL; dentry = dentry->brother);
+    CHECK(dentry->inode == NULL, "/%s never evicted", dentry->fname);   // 头插，表尾是最早的/dir0
+    return nfs_umount();
+}
+
+static int lru_check(int mem_cap) {
+    char path[64];
+    int round, i, k;
+
+    CHECK(func_mount(mem_cap, 0, FALSE) == NFS_ERROR_NONE, "remount");
+    for (round = 0; round < 2; round++) {
+        for (i = 0; i < LRU_DIRS; i++) {
+            for (k = 0; k < LRU_FILES; k++) {
+                sprintf(path, "/dir%d/file%d", i, k);
+                CHECK(func_exists(path, NFS_REG_FILE), "%s lost", path);
+                CHECK(lru_within_cap(mem_cap),
+                      "cache %ld bytes over cap %d KiB", nfs_super.cache_bytes, mem_cap);
+            }
+        }
+    }
+    return nfs_umount();
+}
+
+static int test_lru() {
+    return func_run(lru_create, 8) || func_run(lru_check, 8)
+        || func_run(lru_create, 16) || func_run(lru_check, 16);
+}
+
+/******************************************************************************
+* SECTION: fsync：fsync过的文件与数据在崩溃后仍在，之后的修改丢失
+*******************************************************************************/
+static int fsync_crash(int pattern) {
+    struct nfs_inode* inode;
+    char path[64];
+    int k;
+
+    CHECK(func_mount(0, 60000, FALSE) == NFS_ERROR_NONE, "mount");
+    CHECK(newfs_mkdir("/a", 0755) == 0, "mkdir /a");
+    for (k = 0; k < 5; k++) {
+        sprintf(path, "/a/f%d", k);
+        CHECK(newfs_mknod(path, S_IFREG | 0644, 0) == 0, "mknod %s", path);
+    }
+    inode = func_inode("/a/f2");                    // newfs_write未实现，直接改写第1块
+    memset(inode->data[1], pattern, NFS_BLK_SZ());
+    inode->size       = 2 * NFS_BLK_SZ();
+    inode->blk_dirty |= 1 << 1;
+    inode->dirty      = TRUE;
+    CHECK(newfs_fsync("/a/f2", 0, NULL) == 0, "fsync /a/f2");
+    CHECK(inode->blk_dirty == 0 && !inode->dirty, "/a/f2 still dirty after fsync");
+
+    CHECK(newfs_mknod("/a/late", S_IFREG | 0644, 0) == 0, "mknod /a/late");
+    return 0;                                       // 不卸载
+}
+
+static int fsync_check(int pattern) {
+    struct nfs_inode* inode;
+    int i;
+
+    CHECK(func_mount(0, 0, FALSE) == NFS_ERROR_NONE, "mount after crash");
+    inode = func_inode("/a/f2");
+    CHECK(inode != NULL, "/a/f2 lost");
+    CHECK(inode->size == 2 * NFS_BLK_SZ(), "/a/f2 size %d", inode->size);
+    for (i = 0; i < NFS_BLK_SZ(); i++) {
+        CHECK(inode->data[1][i] == pattern, "/a/f2 byte %d is %d", i, inode->data[1][i]);
+    }
+    CHECK(!func_exists("/a/late", NFS_REG_FILE), "/a/late survived without fsync");
+    return nfs_umount();
+}
+
+static int test_fsync() {
+    return func_run(fsync_crash, 0x5a) || func_run(fsync_check, 0x5a);
+}
+
+/******************************************************************************
+* SECTION: 丢弃：目录转换为索引目录后，释放的线性目录块提交后读回零
+*******************************************************************************/
+#define DISCARD_LINEAR  100
+
+static int discard_fill(int unused) {
+    char path[64];
+    int i;
+
+    (void)unused;
+    CHECK(func_mount(0, 0, TRUE) == NFS_ERROR_NONE, "mount");
+    CHECK(newfs_mkdir("/dc", 0755) == 0, "mkdir /dc");
+    for (i = 0; i < DISCARD_LINEAR; i++) {
+        sprintf(path, "/dc/%d", i);
+        CHECK(newfs_mkdir(path, 0755) == 0, "mkdir %s", path);
+    }
+    return nfs_umount();                            // 卸载时目录块写回原位置
+}
+
+static int discard_convert(int unused) {
+    struct nfs_inode* inode;
+    uint8_t blk[4096];
+    int dnos[NFS_DATA_PER_FILE];
+    char path[160];
+    int i, k, nr = 0;
+
+    (void)unused;
+    CHECK(func_mount(0, 60000, FALSE) == NFS_ERROR_NONE, "remount");
+    inode = func_inode("/dc");
+    CHECK(inode != NULL && NFS_BLK_SZ() <= (int)sizeof(blk), "/dc");
+    for (i = 1; i < NFS_DATA_PER_FILE && inode->block_pointer[i] != 0; i++) {
+        dnos[nr++] = inode->block_pointer[i];       // 转换后保留第0块作索引根，其余释放
+    }
+    CHECK(nr > 0, "/dc has a single block");
+    CHECK(nfs_driver_read(NFS_DATA_OFS(dnos[0] - NFS_DNO_BASE), blk, NFS_BLK_SZ()) == NFS_ERROR_NONE
+          && nfs_dirblk_check(blk) == NFS_ERROR_NONE && blk[0] != 0, "/dc block 1 not on disk");
+
+    for (i = DISCARD_LINEAR; !(inode->flags & NFS_INODE_F_INDEX); i++) {  // 只建目录，不分配数据块
+        func_name(path, "/dc", i);
+        CHECK(newfs_mkdir(path, 0755) == 0, "mkdir %s", path);
+        inode = func_inode("/dc");
+    }
+    shared->nr_dirs = i;
+    CHECK(nfs_journal_sync() == NFS_ERROR_NONE, "journal sync");
+    for (k = 0; k < nr; k++) {
+        CHECK(nfs_driver_read(NFS_DATA_OFS(dnos[k] - NFS_DNO_BASE), blk, NFS_BLK_SZ()) == NFS_ERROR_NONE,
+              "read block %d", dnos[k]);
+        for (i = 0; i < NFS_BLK_SZ(); i++) {
+            CHECK(blk[i] == 0, "freed block %d not discarded", dnos[k]);
+        }
+    }
+    return nfs_umount();
+}
+
+static int discard_check(int unused) {
+    char path[160];
+    int i;
+
+    (void)unused;
+    CHECK(func_mount(0, 0, FALSE) == NFS_ERROR_NONE, "remount");
+    for (i = 0; i < shared->nr_dirs; i++) {
+        if (i < DISCARD_LINEAR) {
+            sprintf(path, "/dc/%d", i);
+        } else {
+            func_name(path, "/dc", i);
+        }
+        CHECK(func_exists(path, NFS_DIR), "%s lost", path);
+    }
+    CHECK(func_readdir_count("/dc") == shared->nr_dirs, "readdir /dc: %d entries", func_readdir_count("/dc"));
+    return nfs_umount();
+}
+
+static int test_discard() {
+    return func_run(discard_fill, 0) || func_run(discard_convert, 0) || func_run(discard_check, 0);
+}
+
+/******************************************************************************
+* SECTION: 设备写满：失败的创建不占用inode与数据块，已创建的文件重新挂载后仍在
+*******************************************************************************/
+static int full_fill(int unused) {
+    char path[64];
+    int free_inodes, free_data, ret;
+
+    (void)unused;
+    CHECK(func_mount(0, 0, FALSE) == NFS_ERROR_NONE, "mount");
+    CHECK(newfs_mkdir("/full", 0755) == 0, "mkdir /full");
+    for (shared->nr_files = 0; ; shared->nr_files++) {
+        sprintf(path, "/full/f%d", shared->nr_files);
+        free_inodes = func_free_inodes();
+        free_data   = func_free_data();
+        if ((ret = newfs_mknod(path, S_IFREG | 0644, 0)) != 0) {
+            break;
+        }
+    }
+    CHECK(ret == -NFS_ERROR_NOSPACE, "mknod %s returned %d", path, ret);
+    CHECK(!func_exists(path, NFS_REG_FILE), "failed %s exists", path);
+    CHECK(func_free_inodes() == free_inodes && func_free_data() == free_data,
+          "failed mknod leaked: free inodes %d -> %d, data %d -> %d",
+          free_inodes, func_free_inodes(), free_data, func_free_data());
+
+    for (shared->nr_dirs = 0; ; shared->nr_dirs++) {  // 数据块先用完时目录仍可创建，直到inode用完
+        sprintf(path, "/full/d%d", shared->nr_dirs);
+        free_inodes = func_free_inodes();
+        free_data   = func_free_data();
+        if ((ret = newfs_mkdir(path, 0755)) != 0) {
+            break;
+        }
+    }
+    CHECK(ret == -NFS_ERROR_NOSPACE, "mkdir %s returned %d", path, ret);
+    CHECK(func_free_inodes() == free_inodes && func_free_data() == free_data,
+          "failed mkdir leaked: free inodes %d -> %d, data %d -> %d",
+          free_inodes, func_free_inodes(), free_data, func_free_data());
+    CHECK(shared->nr_files > 100, "only %d files fit", shared->nr_files);
+
+    shared->free_inodes = func_free_inodes();
+    shared->free_data   = func_free_data();
+    return nfs_umount();
+}
+
+static int full_check(int unused) {
+    char path[64];
+    int i;
+
+    (void)unused;
+    CHECK(func_mount(0, 0, FALSE) == NFS_ERROR_NONE, "remount");
+    for (i = 0; i < shared->nr_files; i++) {
+        sprintf(path, "/full/f%d", i);
+        CHECK(func_exists(path, NFS_REG_FILE), "%s lost", path);
+    }
+    for (i = 0; i < shared->nr_dirs; i++) {
+        sprintf(path, "/full/d%d", i);
+        CHECK(func_exists(path, NFS_DIR), "%s lost", path);
+    }
+    CHECK(func_free_inodes() == shared->free_inodes && func_free_data() == shared->free_data,
+          "free inodes %d data %d, expected %d %d", func_free_inodes(), func_free_data(),
+          shared->free_inodes, shared->free_data);
+    return nfs_umount();
+}
+
+static int test_full() {
+    return func_run(full_fill, 0) || func_run(full_check, 0);
+}
+
+/******************************************************************************
+* SECTION: 入口
+*******************************************************************************/
+static const struct {
+    const char* name;
+    int       (*run)();
+} tests[] = {
+    { "journal: crash after commit, replay",       test_journal },
+    { "dirents: linear, htree, remount",           test_dirents },
+    { "cache: LRU eviction with mem_cap 8/16 KiB", test_lru     },
+    { "fsync: survives crash",                     test_fsync   },
+    { "discard: freed directory blocks",           test_discard },
+    { "full device: ENOSPC without leaks",         test_full    },
+};
+
+int main(int argc, char** argv) {
+    int i, failed = 0;
+
+    (void)argc;
+    (void)argv;
+    snprintf(device, sizeof(device), "%s/ddriver", getenv("HOME"));
+    setenv("DDRIVER_MODEL", "none", 0);
+    shared = (struct func_shared *)mmap(NULL, sizeof(struct func_shared), PROT_READ | PROT_WRITE,
+                                        MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+    if (shared == MAP_FAILED) {
+        return 1;
+    }
+
+    for (i = 0; i < (int)(sizeof(tests) / sizeof(tests[0])); i++) {
+        unlink(device);                             // 下次挂载重新格式化
+        memset(shared, 0, sizeof(struct func_shared));
+        if (tests[i].run() != 0) {
+            printf("[FAIL] %s\n", tests[i].name);
+            failed++;
+        } else {
+            printf("[PASS] %s\n", tests[i].name);
+        }
+    }
+    printf("%d/%d passed\n", (int)(sizeof(tests) / sizeof(tests[0])) - failed,
+           (int)(sizeof(tests) / sizeof(tests[0])));
+    return failed != 0;
+}
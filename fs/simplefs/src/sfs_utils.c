@@ -94,6 +94,22 @@ int sfs_driver_write(int offset, uint8_t *in_content, int size) {
     free(temp_content);
     return SFS_ERROR_NONE;
 }
+/**
+ * @brief 通知驱动丢弃不再使用的区域，驱动据此在镜像中打洞
+ * 
+ * @param offset 
+ * @param size 
+ * @return int 
+ */
+int sfs_driver_discard(int offset, int size) {
+    struct ddriver_discard_range range;
+    range.offset = SFS_ROUND_DOWN(offset, SFS_IO_SZ());
+    range.len    = SFS_ROUND_UP(offset + size, SFS_IO_SZ()) - range.offset;
+    if (ddriver_ioctl(SFS_DRIVER(), IOC_REQ_DEVICE_DISCARD, &range) < 0) {
+        return -SFS_ERROR_IO;
+    }
+    return SFS_ERROR_NONE;
+}
 /**
  * @brief 将denry插入到inode中，采用头插法
  * 
@@ -322,6 +338,7 @@ int sfs_drop_inode(struct sfs_inode * inode) {
                 break;
             }
         }
+        sfs_driver_discard(SFS_DATA_OFS(inode->ino), SFS_BLKS_SZ(SFS_DATA_PER_FILE));
     }
     else if (SFS_IS_REG(inode) || SFS_IS_SYM_LINK(inode)) {
         for (byte_cursor = 0; byte_cursor < SFS_BLKS_SZ(sfs_super.map_inode_blks); 
@@ -339,6 +356,7 @@ int sfs_drop_inode(struct sfs_inode * inode) {
                 break;
             }
         }
+        sfs_driver_discard(SFS_DATA_OFS(inode->ino), SFS_BLKS_SZ(SFS_DATA_PER_FILE));
         if (inode->data)
             free(inode->data);
         free(inode);